@@ -1,7 +1,9 @@
 QT += qml \
       quick \
+      concurrent \
       serialport \
-      bluetooth
+      bluetooth \
+      network
 
 CONFIG += c++11
 CONFIG += qtquickcompiler
@@ -14,7 +16,26 @@ HEADERS += \
     src/cpp/routinecontroller.h \
     src/cpp/guihelper.h \
     src/cpp/bluetoothcommunicator.h \
-    src/cpp/serialcommunicator.h
+    src/cpp/serialcommunicator.h \
+    src/cpp/streamcommunicator.h \
+    src/cpp/logmodel.h \
+    src/cpp/logfilemodel.h \
+    src/cpp/eventjournal.h \
+    src/cpp/experimentrecorder.h \
+    src/cpp/telemetry.h \
+    src/cpp/interlocks.h \
+    src/cpp/shadowstate.h \
+    src/cpp/commandsink.h \
+    src/cpp/linkmonitor.h \
+    src/cpp/metrics.h \
+    src/cpp/controlserver.h \
+    src/cpp/sharedtelemetry.h \
+    src/cpp/triggerinput.h \
+    src/cpp/ufcs_shm.h \
+    src/cpp/tracing.h \
+    src/cpp/pressureseries.h \
+    src/cpp/pressurecontrolloop.h \
+    src/cpp/pressurechart.h
 
 SOURCES += \
     src/cpp/logger.cpp \
@@ -24,7 +45,25 @@ SOURCES += \
     src/cpp/routinecontroller.cpp \
     src/cpp/guihelper.cpp \
     src/cpp/bluetoothcommunicator.cpp \
-    src/cpp/serialcommunicator.cpp
+    src/cpp/serialcommunicator.cpp \
+    src/cpp/streamcommunicator.cpp \
+    src/cpp/logmodel.cpp \
+    src/cpp/logfilemodel.cpp \
+    src/cpp/eventjournal.cpp \
+    src/cpp/experimentrecorder.cpp \
+    src/cpp/telemetry.cpp \
+    src/cpp/interlocks.cpp \
+    src/cpp/shadowstate.cpp \
+    src/cpp/commandsink.cpp \
+    src/cpp/linkmonitor.cpp \
+    src/cpp/metrics.cpp \
+    src/cpp/controlserver.cpp \
+    src/cpp/sharedtelemetry.cpp \
+    src/cpp/triggerinput.cpp \
+    src/cpp/tracing.cpp \
+    src/cpp/pressureseries.cpp \
+    src/cpp/pressurecontrolloop.cpp \
+    src/cpp/pressurechart.cpp
 
 RESOURCES += qml.qrc
 
@@ -92,3 +131,6 @@ isEmpty(GIT_BIN) {
 }
 
 #DEFINES += LOG_TO_TERMINAL # Write logs to terminal as well as to a file and to the application
+
+# shm_open (see SharedTelemetry) is in librt with glibc older than 2.34
+linux:!android: LIBS += -lrt
@@ -0,0 +1,180 @@
+#include "clirunner.h"
+
+#include <cstdio>
+
+CliRunner::CliRunner(ApplicationController *controller, Mode mode, const QString &routinePath, QObject *parent)
+    : QObject(parent)
+    , mController(controller)
+    , mRoutineController(controller->routineController())
+    , mMode(mode)
+    , mRoutinePath(routinePath)
+    , mTimeScale(1.)
+    , mConnectionTimeout(10000)
+    , mRunning(false)
+    , mFinished(false)
+{
+    mConnectionTimer.setSingleShot(true);
+    connect(&mConnectionTimer, &QTimer::timeout, this, [this] {
+        fail("Could not connect to the microcontroller", 2);
+    });
+
+    mReconnectTimer.setSingleShot(true);
+    mReconnectTimer.setInterval(ReconnectInterval);
+    connect(&mReconnectTimer, &QTimer::timeout, mController, &ApplicationController::connect);
+}
+
+/**
+ * @brief Keep the microcontroller connected, for clients of the control socket, until the process is stopped
+ */
+void CliRunner::startDaemon()
+{
+    ControlServer* server = mController->controlServer();
+    if (!server) {
+        fail("The control socket is not available", 2);
+        return;
+    }
+    report("listening", {{"socket", server->fullServerName()}});
+
+    connect(mController->communicator(), &Communicator::connectionStatusChanged, this, [this](Communicator::ConnectionStatus status) {
+        if (status == Communicator::Connected)
+            report("connected");
+        else if (status == Communicator::Disconnected) {
+            report("disconnected");
+            mReconnectTimer.start();
+        }
+    });
+
+    mController->connect();
+    if (mController->communicator()->getConnectionStatus() == Communicator::Disconnected)
+        mReconnectTimer.start();
+}
+
+void CliRunner::start()
+{
+    mClock.start();
+
+    if (mMode == Daemon) {
+        startDaemon();
+        return;
+    }
+
+    QString url = QUrl::fromLocalFile(QFileInfo(mRoutinePath).absoluteFilePath()).toString();
+    if (!mRoutineController->loadFile(url)) {
+        fail("Could not load routine " + mRoutinePath, 2);
+        return;
+    }
+
+    // Direct while verifying; queued from the routine thread while running
+    connect(mRoutineController, &RoutineController::error, this, [this](QString message) {
+        report("error", {{"message", message}});
+    });
+
+    int errors = mRoutineController->verify();
+    report("verified", {{"steps", mRoutineController->numberOfSteps()},
+                        {"errors", errors},
+                        {"estimatedDuration", qlonglong(mRoutineController->totalRunTime())}});
+
+    if (mMode == Verify) {
+        mFinished = true;
+        emit finished(errors > 0 ? 1 : 0);
+        return;
+    }
+
+    if (errors > 0) {
+        fail("The routine has errors; it was not run", 1);
+        return;
+    }
+
+    connect(mRoutineController, &RoutineController::currentStepChanged, this, [this](int step) {
+        report("step", {{"step", step + 1},
+                        {"of", mRoutineController->numberOfSteps()},
+                        {"text", mRoutineController->steps().value(step)},
+                        {"elapsed", qlonglong(mRoutineController->elapsedTime())}});
+    });
+    connect(mRoutineController, &RoutineController::finished, this, &CliRunner::onRoutineFinished);
+    connect(mRoutineController, &RoutineController::triggerReceived, this, [this](QString name, qint64 latency) {
+        report("trigger", {{"name", name}, {"latency", latency / 1e6}});
+    });
+
+    if (mMode == Simulate) {
+        // The commands go nowhere; each pressure controller reaches its setpoint at once, for conditional waits
+        disconnect(mRoutineController, &RoutineController::setValve, mController, &ApplicationController::setValve);
+        disconnect(mRoutineController, &RoutineController::setPressure, mController, &ApplicationController::setPressure);
+
+        connect(mRoutineController, &RoutineController::setValve, this, [this](uint valveNumber, bool open) {
+            report("valve", {{"valve", valveNumber}, {"open", open}});
+        });
+        connect(mRoutineController, &RoutineController::setPressure, this, [this](uint controllerNumber, double value) {
+            report("pressure", {{"controller", controllerNumber}, {"setpoint", value}});
+            mRoutineController->onPressureChanged(controllerNumber, value);
+        });
+
+        mRoutineController->setTimeScale(mTimeScale);
+        begin();
+        return;
+    }
+
+    connect(mController->communicator(), &Communicator::connectionStatusChanged, this, &CliRunner::onConnectionStatusChanged);
+    mConnectionTimer.start(mConnectionTimeout);
+    mController->connect();
+}
+
+void CliRunner::onConnectionStatusChanged(Communicator::ConnectionStatus status)
+{
+    if (mFinished)
+        return;
+
+    if (status == Communicator::Connected) {
+        report("connected");
+        if (!mRunning)
+            begin();
+    }
+    else if (status == Communicator::Disconnected) {
+        report("disconnected");
+        if (!mRunning)
+            fail("Could not connect to the microcontroller", 2);
+    }
+}
+
+void CliRunner::begin()
+{
+    mConnectionTimer.stop();
+    mRunning = true;
+    mRoutineController->begin();
+}
+
+void CliRunner::onRoutineFinished()
+{
+    if (mFinished)
+        return;
+
+    int errors = mRoutineController->numberOfErrors();
+    report("finished", {{"errors", errors}, {"elapsed", qlonglong(mRoutineController->elapsedTime())}});
+
+    mFinished = true;
+    emit finished(errors > 0 ? 1 : 0);
+}
+
+void CliRunner::fail(const QString &message, int status)
+{
+    if (mFinished)
+        return;
+
+    report("error", {{"message", message}});
+    mFinished = true;
+    emit finished(status);
+}
+
+/**
+ * @brief Write an event as a line of JSON to standard output
+ */
+void CliRunner::report(const QString &event, QVariantMap fields)
+{
+    fields["event"] = event;
+    fields["time"] = qRound64(mClock.nsecsElapsed() / 1e6) / 1000.;
+
+    QByteArray line = QJsonDocument(QJsonObject::fromVariantMap(fields)).toJson(QJsonDocument::Compact);
+    line.append('\n');
+    fwrite(line.constData(), 1, size_t(line.size()), stdout);
+    fflush(stdout);
+}
@@ -0,0 +1,85 @@
+#ifndef CLIRUNNER_H
+#define CLIRUNNER_H
+
+#include <QtCore>
+
+#include "applicationcontroller.h"
+#include "routinecontroller.h"
+
+/**
+ * @brief Verifies, runs or simulates one routine for the command-line runner, reporting progress as JSON lines
+ *
+ * Each line written to standard output is a JSON object with an "event" member, and "time", the seconds elapsed
+ * since start() was called:
+ *
+ *     {"event":"verified","steps":70,"errors":0,"estimatedDuration":420,"time":0.004}
+ *     {"event":"connected","time":0.021}
+ *     {"event":"step","step":1,"of":70,"text":"pressure 1 5","elapsed":0,"time":0.022}
+ *     {"event":"valve","valve":3,"open":true,"time":0.5}              (simulation only)
+ *     {"event":"pressure","controller":1,"setpoint":0.17,"time":0.6}  (simulation only; setpoint from 0 to 1)
+ *     {"event":"trigger","name":"camera","latency":0.00004,"time":1.2}   (latency from firing to resuming, s)
+ *     {"event":"error","message":"Line 12: ...","time":1.3}
+ *     {"event":"disconnected","time":5.2}
+ *     {"event":"finished","errors":0,"elapsed":420,"time":420.1}
+ *
+ * "elapsed" is the routine time (the sum of the waits done), in seconds. When simulating, the routine is run
+ * without hardware, at the given time scale; pressure controllers report their setpoints as reached at once.
+ *
+ * finished() is emitted with the process exit status: 0 if the routine was verified or run without errors, 1 if
+ * it has errors, 2 if it could not be loaded or the microcontroller could not be reached.
+ *
+ * In daemon mode, there is no routine: the microcontroller is kept connected (and reconnected every few seconds
+ * when the link is lost) for other processes to drive it through the control socket (see ControlServer). A
+ * "listening" event gives the socket's path; finished() is only emitted if the socket could not be opened.
+ */
+class CliRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Mode {
+        Verify,
+        Run,
+        Simulate,
+        Daemon
+    };
+
+    /// Milliseconds between connection attempts in daemon mode
+    static const int ReconnectInterval = 2000;
+
+    CliRunner(ApplicationController* controller, Mode mode, const QString& routinePath, QObject* parent = nullptr);
+
+    void setTimeScale(double scale) { mTimeScale = scale; }
+    void setConnectionTimeout(int milliseconds) { mConnectionTimeout = milliseconds; }
+
+public slots:
+    void start();
+
+signals:
+    void finished(int status);
+
+private slots:
+    void onConnectionStatusChanged(Communicator::ConnectionStatus status);
+    void onRoutineFinished();
+
+private:
+    void begin();
+    void startDaemon();
+    void fail(const QString& message, int status);
+    void report(const QString& event, QVariantMap fields = QVariantMap());
+
+    ApplicationController* mController;
+    RoutineController* mRoutineController;
+    Mode mMode;
+    QString mRoutinePath;
+    double mTimeScale;
+    int mConnectionTimeout;
+
+    QElapsedTimer mClock;
+    QTimer mConnectionTimer;
+    QTimer mReconnectTimer;
+    bool mRunning;
+    bool mFinished;
+};
+
+#endif // CLIRUNNER_H
@@ -0,0 +1,79 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include "applicationcontroller.h"
+#include "logger.h"
+#include "clirunner.h"
+
+/*
+ * ufcs-cli: verify, run or simulate a routine without the graphical interface.
+ *
+ * Settings (serial port, baud rate, safety rules, recording, ...) are shared with the application. The hardware
+ * is described by a configuration file (see ApplicationController::loadHardwareConfiguration) rather than by QML.
+ * Progress is written to standard output as JSON lines (see CliRunner); log messages go to standard error.
+ *
+ * "ufcs-cli daemon" takes no routine: it keeps the microcontroller connected for clients of the control socket.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication::setApplicationName("ufcs-pc");
+    QCoreApplication::setOrganizationName("ufcs");
+
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Verify, run or simulate a microfluidics routine without the graphical interface.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("mode", "verify, run, simulate or daemon");
+    parser.addPositionalArgument("routine", "Routine file (except in daemon mode)");
+
+    QString defaultHardware = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/hardware.ini";
+    QCommandLineOption hardwareOption({"c", "hardware"}, "Hardware configuration file (default: " + defaultHardware + ").", "file");
+    QCommandLineOption portOption({"p", "port"}, "Serial port to use, instead of detecting the microcontroller.", "port");
+    QCommandLineOption timeScaleOption("time-scale", "When simulating, run this many times faster than real time (default: 1).", "factor", "1");
+    QCommandLineOption verboseOption({"v", "verbose"}, "Log debug and info messages too, as set in the application's settings.");
+    parser.addOption(hardwareOption);
+    parser.addOption(portOption);
+    parser.addOption(timeScaleOption);
+    parser.addOption(verboseOption);
+    parser.process(app);
+
+    QStringList arguments = parser.positionalArguments();
+    QMap<QString, CliRunner::Mode> modes {{"verify", CliRunner::Verify}, {"run", CliRunner::Run},
+                                          {"simulate", CliRunner::Simulate}, {"daemon", CliRunner::Daemon}};
+    CliRunner::Mode mode = modes.value(arguments.value(0), CliRunner::Daemon);
+    if (!modes.contains(arguments.value(0)) || arguments.size() != (mode == CliRunner::Daemon ? 1 : 2)) {
+        fputs(qPrintable(parser.helpText()), stderr);
+        return 2;
+    }
+
+    bool ok;
+    double timeScale = parser.value(timeScaleOption).toDouble(&ok);
+    if (!ok || timeScale <= 0) {
+        fputs("Invalid time scale\n", stderr);
+        return 2;
+    }
+
+    ApplicationController controller;
+
+    QString hardwareFile = parser.isSet(hardwareOption) ? parser.value(hardwareOption)
+                                                        : controller.settings()->value("hardware/file", defaultHardware).toString();
+    if (!controller.loadHardwareConfiguration(hardwareFile))
+        return 2;
+
+    if (parser.isSet(portOption))
+        controller.setSerialPortOverride(parser.value(portOption));
+
+    // Standard output is for progress; only warnings are logged, unless asked otherwise
+    if (!parser.isSet(verboseOption)) {
+        for (QString const& category : Logger::categoryNames())
+            Logger::setCategoryLevel(category, Logger::WarningLevel);
+    }
+
+    CliRunner runner(&controller, mode, arguments.value(1));
+    runner.setTimeScale(timeScale);
+    QObject::connect(&runner, &CliRunner::finished, &app, &QCoreApplication::exit, Qt::QueuedConnection);
+    QTimer::singleShot(0, &runner, &CliRunner::start);
+
+    return app.exec();
+}
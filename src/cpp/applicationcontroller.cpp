@@ -1,24 +1,39 @@
 #include "applicationcontroller.h"
 #include "guihelper.h"
+#include "logger.h"
 
-ApplicationController::ApplicationController(QObject *parent) : QObject(parent)
+ApplicationController::ApplicationController(QObject *parent)
+    : QObject(parent)
+    , mHardwareConfigured(false)
+    , mConfiguredValves(0)
+    , mConfiguredPumps(0)
 {
-    // Initialize mCommunicator. Can be either USB ("Serial") or Bluetooth. Windows
-    // doesn't support Bluetooth, and Android doesn't support serial over USB (at least,
-    // not without rooting your phone), so we can set defaults for those platforms.
-    // For other platforms, use whichever one you prefer.
-    // This has to be specified at compile time for now; run-time switching may be supported later.
+    mSettings = new QSettings();
+
+    // Initialize mCommunicator, for the transport in the "transport/type" setting: "serial" (USB), "bluetooth", "tcp"
+    // or "local" (a local socket). Windows doesn't support Bluetooth, and Android doesn't support serial over USB (at
+    // least, not without rooting your phone), so the default depends on the platform. The transport is only read at
+    // startup.
 
 #if defined(Q_OS_ANDROID)
-    mBluetoothEnabled = true;
+    mTransport = mSettings->value("transport/type", "bluetooth").toString();
 #else
-    mBluetoothEnabled = false;
+    mTransport = mSettings->value("transport/type", "serial").toString();
 #endif
+    mBluetoothEnabled = mTransport == "bluetooth";
 
     if (mBluetoothEnabled)
         mCommunicator = new BluetoothCommunicator(this);
-    else
+    else if (mTransport == "tcp")
+        mCommunicator = new TcpCommunicator(this);
+    else if (mTransport == "local")
+        mCommunicator = new LocalSocketCommunicator(this);
+    else {
+        if (mTransport != "serial")
+            qCWarning(lcCommunicator) << "Unknown transport" << mTransport << "; using the serial port instead";
+        mTransport = "serial";
         mCommunicator = new SerialCommunicator(this);
+    }
 
     QObject::connect(mCommunicator, &Communicator::valveStateChanged, this, &ApplicationController::onValveStateChanged);
     QObject::connect(mCommunicator, &Communicator::pressureChanged, this, &ApplicationController::onPressureChanged);
@@ -33,8 +48,139 @@ ApplicationController::ApplicationController(QObject *parent) : QObject(parent)
                      this, &ApplicationController::setValve);
     QObject::connect(mRoutineController, &RoutineController::setPressure,
                      this, &ApplicationController::setPressure);
+    QObject::connect(mCommunicator, &Communicator::pressureChanged,
+                     mRoutineController, &RoutineController::onPressureChanged);
+    QObject::connect(mCommunicator, &Communicator::congestionChanged,
+                     mRoutineController, &RoutineController::setOutputCongested);
+    QObject::connect(mCommunicator, &Communicator::interlockTriggered, this, [this](QString rule, bool stopRoutine) {
+        Q_UNUSED(rule);
+        if (stopRoutine && mRoutineController->status() == RoutineController::Running)
+            mRoutineController->stop();
+    });
+
+    mCommunicator->setMismatchTimeout(mSettings->value("shadow/mismatchTimeout", 2000).toInt());
+
+    mLogModel = new LogModel(mSettings->value("log/capacity", 100000).toInt(), this);
+    mLogFilterModel = new LogFilterModel(mLogModel, this);
+    mLogFileModel = new LogFileModel(this);
+
+    mTelemetryPublisher = new TelemetryPublisher(mCommunicator, this);
+    mTelemetryPublisher->setPublishRate(mSettings->value("telemetry/publishRate", 20).toInt());
+    QObject::connect(mTelemetryPublisher, &TelemetryPublisher::pressureChanged, this, &ApplicationController::onPressureChanged);
+    QObject::connect(mTelemetryPublisher, &TelemetryPublisher::pressureChanged, mRoutineController, &RoutineController::onPressureChanged);
+
+    for (int i(1); i <= N_PRS; ++i) {
+        PressureSeries* series = new PressureSeries(i, this);
+        QObject::connect(mCommunicator, &Communicator::pressureChanged, series, [series](uint controllerNumber, double pressure) {
+            if (int(controllerNumber) == series->controllerNumber())
+                series->appendMeasured(pressure);
+        });
+        QObject::connect(mCommunicator, &Communicator::pressureSetpointChanged, series, [series](uint controllerNumber, double pressure) {
+            if (int(controllerNumber) == series->controllerNumber())
+                series->setSetpoint(pressure);
+        });
+        QObject::connect(mTelemetryPublisher, &TelemetryPublisher::samplesReceived, series, [series](uint controllerNumber, QVector<TelemetrySample> samples) {
+            if (int(controllerNumber) == series->controllerNumber())
+                series->appendSamples(samples);
+        });
+        mPressureSeries.append(series);
+    }
 
-    mSettings = new QSettings();
+    mControlLoop = new PressureControlLoop(mCommunicator, mSettings->value("control/rate", 50).toInt(), this);
+    for (int i(1); i <= N_PRS; ++i) {
+        mControlLoop->setGains(i, mSettings->value("control/kp", 0.5).toDouble(), mSettings->value("control/ki", 1.0).toDouble());
+        mControlLoop->setSlewRate(i, mSettings->value("control/slewRate", 0.5).toDouble());
+    }
+    // Emitted from the loop thread; queued, so the command is still sent from this thread
+    QObject::connect(mControlLoop, &PressureControlLoop::setPressure, mCommunicator, &Communicator::setPressure);
+
+    mLinkMonitor = new LinkMonitor(mCommunicator, this);
+    mLinkMonitor->setHeartbeatInterval(mSettings->value("link/heartbeatInterval", 1000).toInt());
+    mLinkMonitor->setReportInterval(mSettings->value("link/reportInterval", 10000).toInt());
+    mLinkMonitor->setConfirmationTimeout(mSettings->value("link/confirmationTimeout", 2000).toInt());
+    mLinkMonitor->setThresholds(mSettings->value("link/latencyWarning", 250).toInt(),
+                                mSettings->value("link/lossWarning", 0.05).toDouble());
+
+    // Served on the loopback interface only; a port of 0 disables it
+    mMetricsServer = nullptr;
+    int metricsPort = mSettings->value("metrics/port", 9108).toInt();
+    if (metricsPort > 0 && metricsPort <= 0xFFFF) {
+        mMetricsServer = new MetricsServer(this);
+        mMetricsServer->listen(quint16(metricsPort));
+    }
+
+    // Lets other processes of the same user drive the hardware (see ControlServer)
+    mControlServer = nullptr;
+    if (mSettings->value("controlSocket/enabled", true).toBool()) {
+        mControlServer = new ControlServer(mCommunicator, this);
+        mControlServer->setRoutineController(mRoutineController);
+        if (!mControlServer->listen(mSettings->value("controlSocket/name", "ufcs-control").toString())) {
+            delete mControlServer;
+            mControlServer = nullptr;
+        }
+    }
+
+    // Triggers for "wait for trigger" routine steps, as lines of text
+    mTriggerInput = nullptr;
+    if (mSettings->value("triggers/enabled", true).toBool()) {
+        mTriggerInput = new TriggerInput(mRoutineController, this);
+        mTriggerInput->listen(mSettings->value("triggers/socket", "ufcs-triggers").toString());
+#if defined(Q_OS_UNIX)
+        QString fifo = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/triggers.fifo";
+        mTriggerInput->openFifo(mSettings->value("triggers/fifo", fifo).toString());
+#endif
+    }
+
+    // Read by other programs without going through the event loop (see ufcs_shm.h); Unix only
+    mSharedTelemetry = nullptr;
+    if (mSettings->value("sharedMemory/enabled", true).toBool()) {
+        mSharedTelemetry = new SharedTelemetry(mCommunicator, this);
+        if (!mSharedTelemetry->open(mSettings->value("sharedMemory/name", UFCS_SHM_DEFAULT_NAME).toString())) {
+            delete mSharedTelemetry;
+            mSharedTelemetry = nullptr;
+        }
+    }
+
+    mEventJournal = nullptr;
+    if (mSettings->value("journal/enabled", true).toBool()) {
+        mEventJournal = new EventJournal(this);
+        QString fileName = "journal_" + QDateTime::currentDateTime().toString("yyyy-MM-dd_hh-mm-ss") + ".ufj";
+        if (mEventJournal->open(EventJournal::journalDirectory() + "/" + fileName)) {
+            QObject::connect(mCommunicator, &Communicator::commandSent, mEventJournal, &EventJournal::recordCommandSent);
+            QObject::connect(mCommunicator, &Communicator::valveStateChanged, mEventJournal, &EventJournal::recordValveState);
+            QObject::connect(mCommunicator, &Communicator::pumpStateChanged, mEventJournal, &EventJournal::recordPumpState);
+            QObject::connect(mCommunicator, &Communicator::pressureChanged, mEventJournal, &EventJournal::recordPressureMeasured);
+            QObject::connect(mTelemetryPublisher, &TelemetryPublisher::pressureChanged, mEventJournal, &EventJournal::recordPressureMeasured);
+            QObject::connect(mCommunicator, &Communicator::pressureSetpointChanged, mEventJournal, &EventJournal::recordPressureSetpoint);
+            QObject::connect(mCommunicator, &Communicator::connectionStatusChanged, mEventJournal, [this](Communicator::ConnectionStatus status) {
+                mEventJournal->recordConnectionStatus(int(status));
+            });
+            QObject::connect(mRoutineController, &RoutineController::currentStepChanged, mEventJournal, [this](int stepNumber) {
+                mEventJournal->recordRoutineStep(stepNumber, mRoutineController->steps().value(stepNumber));
+            });
+        }
+    }
+
+    mExperimentRecorder = nullptr;
+    if (mSettings->value("recorder/enabled", true).toBool()) {
+        mExperimentRecorder = new ExperimentRecorder(this);
+        QObject::connect(mCommunicator, &Communicator::pressureChanged, mExperimentRecorder, &ExperimentRecorder::recordPressure);
+        QObject::connect(mTelemetryPublisher, &TelemetryPublisher::samplesReceived, mExperimentRecorder, &ExperimentRecorder::recordPressureSamples);
+        QObject::connect(mCommunicator, &Communicator::pressureSetpointChanged, mExperimentRecorder, &ExperimentRecorder::recordSetpoint);
+        QObject::connect(mCommunicator, &Communicator::valveStateChanged, mExperimentRecorder, &ExperimentRecorder::recordValveState);
+        QObject::connect(mRoutineController, &RoutineController::currentStepChanged, mExperimentRecorder, &ExperimentRecorder::recordStep);
+        QObject::connect(mRoutineController, &RoutineController::runStatusChanged, mExperimentRecorder, [this](RoutineController::RunStatus status) {
+            if (status == RoutineController::Running) {
+                QString fileName = "run_" + QDateTime::currentDateTime().toString("yyyy-MM-dd_hh-mm-ss") + ".ufx";
+                mExperimentRecorder->start(ExperimentRecorder::experimentDirectory() + "/" + fileName, mRoutineController->steps());
+            }
+            else if (status == RoutineController::Finished)
+                mExperimentRecorder->stop();
+        });
+    }
+
+    for (QString const& category : Logger::categoryNames())
+        Logger::setCategoryLevel(category, Logger::Level(logLevel(category)));
 
     if (isDenseThemeEnabled())
         qputenv("QT_QUICK_CONTROLS_MATERIAL_VARIANT", "Dense");
@@ -42,10 +188,97 @@ ApplicationController::ApplicationController(QObject *parent) : QObject(parent)
 
 ApplicationController::~ApplicationController()
 {
+    // The control loop thread reads from the communicator, so it must be stopped first
+    delete mControlLoop;
     delete mRoutineController;
+    // Detaches itself from the communicator when closed
+    delete mSharedTelemetry;
     delete mCommunicator;
 }
 
+void ApplicationController::setValve(uint valveNumber, bool open)
+{
+    TRACE_SPAN("gui", "setValve", valveNumber);
+    Tracer::flowEnd("routine", "command", Communicator::traceId(VALVE, valveNumber));
+
+    mCommunicator->setValve(valveNumber, open);
+}
+
+/**
+ * @brief Set the pressure of the given controller
+ *
+ * If the controller is under closed-loop control, this sets the target of the loop instead of the setpoint
+ * sent to the controller; the user interface and routines therefore work the same way in both modes.
+ */
+void ApplicationController::setPressure(uint controllerNumber, double pressure)
+{
+    TRACE_SPAN("gui", "setPressure", controllerNumber);
+    Tracer::flowEnd("routine", "command", Communicator::traceId(PRESSURE, controllerNumber));
+
+    if (mControlLoop->isEnabled(int(controllerNumber)))
+        mControlLoop->setTarget(int(controllerNumber), pressure);
+    else
+        mCommunicator->setPressure(controllerNumber, pressure);
+}
+
+/**
+ * @brief Stop the routine and closed-loop control, and set all pressures to zero and pumps off, ahead of any
+ * command already queued
+ */
+void ApplicationController::emergencyStop()
+{
+    if (mRoutineController->status() == RoutineController::Running || mRoutineController->status() == RoutineController::Paused)
+        mRoutineController->stop();
+
+    for (int i(1); i <= N_PRS; ++i)
+        mControlLoop->setEnabled(i, false);
+
+    mCommunicator->emergencyStop();
+}
+
+/**
+ * @brief Write the current value of all metrics to a new file in MetricsRegistry::dumpDirectory()
+ * @return The path of the file, or an empty string if it couldn't be written
+ */
+QString ApplicationController::dumpMetrics()
+{
+    QDir d;
+    d.mkpath(MetricsRegistry::dumpDirectory());
+
+    QString path = MetricsRegistry::dumpDirectory() + "/metrics_" + QDateTime::currentDateTime().toString("yyyy-MM-dd_hh-mm-ss") + ".prom";
+    if (!MetricsRegistry::registry()->dump(path))
+        return QString();
+
+    qCInfo(lcGui) << "Metrics saved to" << path;
+    return path;
+}
+
+/**
+ * @brief Start recording trace events, discarding those of the previous trace
+ */
+void ApplicationController::startTracing()
+{
+    Tracer::start();
+}
+
+/**
+ * @brief Stop recording trace events, and save them to a new file in Tracer::traceDirectory()
+ * @return The path of the file (Chrome trace JSON, which opens in Perfetto), or an empty string if it couldn't be
+ * written
+ */
+QString ApplicationController::stopTracing()
+{
+    Tracer::stop();
+
+    QDir d;
+    d.mkpath(Tracer::traceDirectory());
+
+    QString path = Tracer::traceDirectory() + "/trace_" + QDateTime::currentDateTime().toString("yyyy-MM-dd_hh-mm-ss") + ".json";
+    if (!Tracer::exportChromeTrace(path))
+        return QString();
+    return path;
+}
+
 QString ApplicationController::connectionStatus()
 {
     return mCommunicator->getConnectionStatusString();
@@ -59,30 +292,36 @@ void ApplicationController::connect()
 /**
  * @brief Return the number of valves defined in the GUI
  *
- * This reflects the ValveSwitches defined on the QML side
+ * This reflects the ValveSwitches defined on the QML side, or the hardware configuration file if one was loaded
  */
 int ApplicationController::nValves()
 {
+    if (mHardwareConfigured)
+        return mConfiguredValves;
     return mQmlValveSwitches.size();
 }
 
 /**
  * @brief Return the number of pumps defined in the GUI
  *
- * This reflects the PumpSwitches defined on the QML side
+ * This reflects the PumpSwitches defined on the QML side, or the hardware configuration file if one was loaded
  */
 int ApplicationController::nPumps()
 {
+    if (mHardwareConfigured)
+        return mConfiguredPumps;
     return mQmlPumpSwitches.size();
 }
 
 /**
  * @brief Return the number of pressure controllers defined in the GUI
  *
- * This reflects the PressureControllers defined on the QML side
+ * This reflects the PressureControllers defined on the QML side, or the hardware configuration file if one was loaded
  */
 int ApplicationController::nPressureControllers()
 {
+    if (mHardwareConfigured)
+        return mConfiguredPressureRanges.size();
     return mQmlPressureControllers.size();
 }
 
@@ -91,10 +330,13 @@ int ApplicationController::nPressureControllers()
  */
 double ApplicationController::minPressure(int controllerNumber)
 {
+    if (mHardwareConfigured && controllerNumber >= 1 && controllerNumber <= mConfiguredPressureRanges.size())
+        return mConfiguredPressureRanges[controllerNumber-1].first;
+
     QList<PCHelper*> pcs = mQmlPressureControllers[controllerNumber];
 
     if (pcs.isEmpty()) {
-        qCritical() << "Tried to access undefined pressure controller";
+        qCCritical(lcGui) << "Tried to access undefined pressure controller";
         return 0;
     }
 
@@ -106,16 +348,94 @@ double ApplicationController::minPressure(int controllerNumber)
  */
 double ApplicationController::maxPressure(int controllerNumber)
 {
+    if (mHardwareConfigured && controllerNumber >= 1 && controllerNumber <= mConfiguredPressureRanges.size())
+        return mConfiguredPressureRanges[controllerNumber-1].second;
+
     QList<PCHelper*> pcs = mQmlPressureControllers[controllerNumber];
 
     if (pcs.isEmpty()) {
-        qCritical() << "Tried to access undefined pressure controller";
+        qCCritical(lcGui) << "Tried to access undefined pressure controller";
         return 0;
     }
 
     return pcs.first()->maxPressure();
 }
 
+/**
+ * @brief Return the last pressure (0-1) measured by the given controller. Can be called from any thread.
+ * @return False if no measurement was received yet
+ */
+bool ApplicationController::latestMeasurement(int controllerNumber, double &value)
+{
+    quint32 sequence;
+    return mCommunicator->latestMeasurement(uint(controllerNumber), value, sequence);
+}
+
+
+/**
+ * @brief Describe the hardware with a configuration file, instead of the components registered from QML
+ * @return False if the file can't be read or is invalid, in which case nothing changes
+ *
+ * This is for front-ends without QML, such as the command-line runner. The file is in INI format:
+ *
+ *     [valves]
+ *     count=32
+ *
+ *     [pumps]
+ *     count=2
+ *
+ *     [pressureControllers]
+ *     count=2
+ *     1\minPressure=0
+ *     1\maxPressure=29.5
+ *     2\minPressure=0
+ *     2\maxPressure=4.8
+ */
+bool ApplicationController::loadHardwareConfiguration(const QString &path)
+{
+    if (!QFile::exists(path)) {
+        qCWarning(lcGui) << "Hardware configuration file not found:" << path;
+        return false;
+    }
+
+    QSettings file(path, QSettings::IniFormat);
+    if (file.status() != QSettings::NoError) {
+        qCWarning(lcGui) << "Could not read hardware configuration file" << path;
+        return false;
+    }
+
+    int valves = file.value("valves/count", 0).toInt();
+    int pumps = file.value("pumps/count", 0).toInt();
+    int controllers = file.value("pressureControllers/count", 0).toInt();
+
+    if (valves < 0 || valves > N_VALVES || pumps < 0 || pumps > N_PUMPS || controllers < 0 || controllers > N_PRS) {
+        qCWarning(lcGui) << "Invalid component count in" << path << "; at most" << N_VALVES << "valves,"
+                         << N_PUMPS << "pumps and" << N_PRS << "pressure controllers are supported";
+        return false;
+    }
+
+    QList<QPair<double, double>> ranges;
+    for (int i(1); i <= controllers; ++i) {
+        QString key = "pressureControllers/" + QString::number(i);
+        bool minOk, maxOk;
+        double min = file.value(key + "/minPressure").toDouble(&minOk);
+        double max = file.value(key + "/maxPressure").toDouble(&maxOk);
+        if (!minOk || !maxOk || max <= min) {
+            qCWarning(lcGui) << "Invalid or missing pressure range for controller" << i << "in" << path;
+            return false;
+        }
+        ranges << qMakePair(min, max);
+    }
+
+    mConfiguredValves = valves;
+    mConfiguredPumps = pumps;
+    mConfiguredPressureRanges = ranges;
+    mHardwareConfigured = true;
+
+    qCInfo(lcGui) << "Hardware configuration loaded from" << path << ":" << valves << "valves," << pumps << "pumps,"
+                  << controllers << "pressure controllers";
+    return true;
+}
 
 void ApplicationController::registerPCHelper(int controllerNumber, PCHelper* instance)
 {
@@ -138,19 +458,44 @@ void ApplicationController::registerPumpSwitchHelper(int pumpNumber, PumpSwitchH
     mQmlPumpSwitches[pumpNumber] = instance;
 }
 
+/**
+ * @brief Return the history of the given pressure controller, or nullptr if there is no such controller
+ */
+PressureSeries* ApplicationController::pressureSeries(int controllerNumber)
+{
+    if (controllerNumber < 1 || controllerNumber > mPressureSeries.size())
+        return nullptr;
+
+    PressureSeries* series = mPressureSeries[controllerNumber-1];
+    QQmlEngine::setObjectOwnership(series, QQmlEngine::CppOwnership);
+    return series;
+}
+
 /**
  * @brief Add a message to the (internal) log, for access within the application.
  * @param entry A QStringList (or compatible type) with 3 elements: time, message type and message text.
  *
  * This log is only for access within the application. It is separate from the messages logged to file.
- * See ApplicationController::messageHandler for the rest of the logging code.
+ * See Logger::messageHandler for the rest of the logging code.
+ *
+ * The log has a fixed capacity (the "log/capacity" setting); once it is reached, the oldest messages are dropped.
  */
 void ApplicationController::addToLog(QVariant entry)
 {
-    mLog.append(entry);
+    mLogModel->append(entry.toStringList());
     emit newLogMessage(entry);
 }
 
+/**
+ * @brief Return the log files of previous sessions (full paths), most recent first
+ *
+ * Any of these can be opened with logFileModel()->open().
+ */
+QStringList ApplicationController::pastLogFiles()
+{
+    return Logger::pastLogFiles();
+}
+
 bool ApplicationController::isDarkModeEnabled()
 {
     return mSettings->value("darkMode", false).toBool();
@@ -166,7 +511,7 @@ bool ApplicationController::isDarkModeEnabled()
 void ApplicationController::setDarkModeEnabled(bool enabled)
 {
     mSettings->setValue("darkMode", enabled);
-    qInfo() << "Setting theme to" << (enabled ? "dark" : "light") << "mode";
+    qCInfo(lcGui) << "Setting theme to" << (enabled ? "dark" : "light") << "mode";
     emit darkModeChanged(enabled);
 }
 
@@ -343,6 +688,120 @@ void ApplicationController::setCurrentGraphicalControlScreen(QString label)
 }
 
 
+/**
+ * @brief Return the names of the logging categories, for which the level can be set at run time
+ */
+QStringList ApplicationController::logCategories()
+{
+    return Logger::categoryNames();
+}
+
+/**
+ * @brief Load the minimum level of messages logged for a given category
+ * @return 0 for debug (the default), 1 for info, 2 for warnings and errors only
+ */
+int ApplicationController::logLevel(QString category)
+{
+    return mSettings->value("logging/" + category, Logger::DebugLevel).toInt();
+}
+
+/**
+ * @brief Set and persist the minimum level of messages logged for a given category
+ */
+void ApplicationController::setLogLevel(QString category, int level)
+{
+    mSettings->setValue("logging/" + category, level);
+    Logger::setCategoryLevel(category, Logger::Level(level));
+}
+
+/**
+ * @brief Return the numbers of the pressure controllers that support telemetry streaming
+ */
+QVariantList ApplicationController::telemetryControllers()
+{
+    QVariantList list;
+    for (int i(1); i <= N_PRS; ++i)
+        list << i;
+    return list;
+}
+
+/**
+ * @brief Return the telemetry rate (samples per second) requested for a controller; 0 if streaming is off
+ */
+int ApplicationController::telemetryRate(int controllerNumber)
+{
+    return mSettings->value("telemetry/rate" + QString::number(controllerNumber), 0).toInt();
+}
+
+/**
+ * @brief Set and persist the telemetry rate of a controller
+ *
+ * The rate is sent to the microcontroller immediately if it is connected, and again on every connection.
+ */
+void ApplicationController::setTelemetryRate(int controllerNumber, int rate)
+{
+    mSettings->setValue("telemetry/rate" + QString::number(controllerNumber), rate);
+
+    if (mCommunicator->getConnectionStatus() == Communicator::Connected)
+        mCommunicator->setTelemetryRate(uint(controllerNumber), uint(qMax(0, rate)));
+}
+
+/**
+ * @brief Load and compile the safety rules (see InterlockEngine)
+ * @return False if the rules file could not be read or contains errors. Valid rules are applied regardless.
+ *
+ * The file is set by "interlocks/file"; by default, interlocks.txt in the application's data directory. If it
+ * doesn't exist, no rules are applied.
+ */
+bool ApplicationController::loadInterlocks()
+{
+    QString defaultPath = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/interlocks.txt";
+    QFile file(mSettings->value("interlocks/file", defaultPath).toString());
+
+    if (!file.exists()) {
+        mCommunicator->interlocks().clear();
+        return true;
+    }
+
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qCWarning(lcCommunicator) << "Could not open safety rules file" << file.fileName() << ":" << file.errorString();
+        return false;
+    }
+
+    QList<QPair<double, double>> ranges;
+    for (int i(1); i <= nPressureControllers(); ++i)
+        ranges << qMakePair(minPressure(i), maxPressure(i));
+
+    InterlockEngine& interlocks = mCommunicator->interlocks();
+    bool ok = interlocks.compile(QString::fromUtf8(file.readAll()), ranges);
+
+    for (QString const& error : interlocks.errors())
+        qCWarning(lcCommunicator) << "Safety rules:" << error;
+    qCInfo(lcCommunicator) << "Loaded" << interlocks.ruleCount() << "safety rules from" << file.fileName();
+
+    return ok;
+}
+
+/**
+ * @brief Return the cost of evaluating the safety rules since the last call, and reset it
+ *
+ * Times are in nanoseconds.
+ */
+QVariantMap ApplicationController::interlockStatistics()
+{
+    InterlockEngine& interlocks = mCommunicator->interlocks();
+    InterlockEngine::Metrics metrics = interlocks.metrics();
+    interlocks.resetMetrics();
+
+    QVariantMap s;
+    s["rules"] = interlocks.ruleCount();
+    s["evaluations"] = metrics.evaluations;
+    s["meanTime"] = metrics.evaluations > 0 ? double(metrics.totalNanoseconds) / metrics.evaluations : 0.;
+    s["maxTime"] = metrics.maxNanoseconds;
+    s["triggers"] = metrics.triggers;
+    return s;
+}
+
 /**
  * @brief Load the baud rate for USB communication from settings
  * @return The baud rate; default value is 115200
@@ -361,9 +820,40 @@ void ApplicationController::setSerialBaudRate(int rate)
     mSettings->setValue("baudRate", rate);
 }
 
+/**
+ * @brief Load the number of setpoints per second sent by routine ramps from settings
+ * @return The rate, or 0 (the default) to choose it from the transport (see RoutineController::rampRate)
+ */
+int ApplicationController::rampRate()
+{
+    return mSettings->value("routine/rampRate", 0).toInt();
+}
+
+/**
+ * @brief Load the serial port to connect to from settings, unless it was overridden for this session
+ * @return The port name or path, or an empty string (the default) to detect the microcontroller automatically
+ */
+QString ApplicationController::serialPort()
+{
+    if (!mSerialPortOverride.isEmpty())
+        return mSerialPortOverride;
+    return mSettings->value("serialPort").toString();
+}
+
+/**
+ * @brief Load the address of the microcontroller for the TCP and local socket transports from settings
+ * @return "host:port" for TCP, the name or path of the socket for local sockets
+ */
+QString ApplicationController::transportAddress()
+{
+    return mSettings->value("transport/address").toString();
+}
+
 void ApplicationController::onValveStateChanged(int valveNumber, bool open)
 {
-    qInfo() << "Valve" << valveNumber << (open ? "opened" : "closed");
+    TRACE_SPAN("gui", "onValveStateChanged", valveNumber);
+
+    qCInfo(lcGui) << "Valve" << valveNumber << (open ? "opened" : "closed");
 
     if (mQmlValveSwitches.contains(valveNumber)) {
         for (auto v : mQmlValveSwitches[valveNumber])
@@ -373,7 +863,9 @@ void ApplicationController::onValveStateChanged(int valveNumber, bool open)
 
 void ApplicationController::onPumpStateChanged(int pumpNumber, bool on)
 {
-    qInfo() << "Pump" << pumpNumber << "switched" << (on ? "on" : "off");
+    TRACE_SPAN("gui", "onPumpStateChanged", pumpNumber);
+
+    qCInfo(lcGui) << "Pump" << pumpNumber << "switched" << (on ? "on" : "off");
 
     if (mQmlPumpSwitches.contains(pumpNumber))
         mQmlPumpSwitches[pumpNumber]->setState(on);
@@ -381,7 +873,9 @@ void ApplicationController::onPumpStateChanged(int pumpNumber, bool on)
 
 void ApplicationController::onPressureChanged(int controllerNumber, double pressure)
 {
-    //qInfo() << "Measured pressure (normalized) on controller" << controllerNumber << ":" << pressure;
+    TRACE_SPAN("gui", "onPressureChanged", controllerNumber);
+
+    //qCInfo(lcGui) << "Measured pressure (normalized) on controller" << controllerNumber << ":" << pressure;
 
     if (mQmlPressureControllers.contains(controllerNumber)) {
         for (auto p : mQmlPressureControllers[controllerNumber])
@@ -391,6 +885,8 @@ void ApplicationController::onPressureChanged(int controllerNumber, double press
 
 void ApplicationController::onPressureSetpointChanged(int controllerNumber, double pressure)
 {
+    TRACE_SPAN("gui", "onPressureSetpointChanged", controllerNumber);
+
     if (mQmlPressureControllers.contains(controllerNumber)) {
         for (auto p : mQmlPressureControllers[controllerNumber])
             p->setSetPoint(pressure);
@@ -402,15 +898,27 @@ void ApplicationController::onUptimeChanged(ulong seconds)
     int h = seconds/3600;
     int m = (seconds % 3600)/60;
     int s = seconds % 60;
-    qInfo() << "Current uptime:" << h << "h" << m << "min" << s << "s";
+    // Requested every second by the link monitor's heartbeat, so not worth showing to the user
+    qCDebug(lcGui) << "Current uptime:" << h << "h" << m << "min" << s << "s";
 }
 
 void ApplicationController::onCommunicatorStatusChanged(Communicator::ConnectionStatus newStatus)
 {
-    qDebug() << "App controller: communicator status changed to" << mCommunicator->getConnectionStatusString();
+    qCDebug(lcGui) << "App controller: communicator status changed to" << mCommunicator->getConnectionStatusString();
 
-    if (newStatus == Communicator::Connected)
+    if (newStatus == Communicator::Connected) {
+        // The pressure controllers are all registered by now, so their ranges are known
+        loadInterlocks();
+        // Undo whatever happened to the device while it was disconnected, then check the result
+        mCommunicator->resynchronize();
         mCommunicator->requestStatus();
 
+        for (QVariant const& n : telemetryControllers()) {
+            int rate = telemetryRate(n.toInt());
+            if (rate > 0)
+                mCommunicator->setTelemetryRate(n.toUInt(), uint(rate));
+        }
+    }
+
     emit connectionStatusChanged(mCommunicator->getConnectionStatusString());
 }
@@ -6,8 +6,22 @@
 
 #include "bluetoothcommunicator.h"
 #include "serialcommunicator.h"
+#include "streamcommunicator.h"
 
 #include "routinecontroller.h"
+#include "logmodel.h"
+#include "logfilemodel.h"
+#include "eventjournal.h"
+#include "experimentrecorder.h"
+#include "telemetry.h"
+#include "pressureseries.h"
+#include "pressurecontrolloop.h"
+#include "linkmonitor.h"
+#include "metrics.h"
+#include "controlserver.h"
+#include "sharedtelemetry.h"
+#include "triggerinput.h"
+#include "tracing.h"
 
 /*
  * ApplicationController is the backend of the application. Either the brains of the operation or middle management,
@@ -30,7 +44,8 @@ class ApplicationController : public QObject
     Q_OBJECT
 
     Q_PROPERTY(QString connectionStatus READ connectionStatus NOTIFY connectionStatusChanged)
-    Q_PROPERTY(QVariantList logMessageList READ log NOTIFY newLogMessage)
+    Q_PROPERTY(LogFilterModel* logModel READ logModel CONSTANT)
+    Q_PROPERTY(LogFileModel* logFileModel READ logFileModel CONSTANT)
     Q_PROPERTY(QString appVersion READ appVersion)
     Q_PROPERTY(bool darkMode READ isDarkModeEnabled WRITE setDarkModeEnabled NOTIFY darkModeChanged)
     Q_PROPERTY(int windowWidth READ windowWidth WRITE setWindowWidth NOTIFY windowWidthChanged)
@@ -38,7 +53,10 @@ class ApplicationController : public QObject
     Q_PROPERTY(bool graphicalControlEnabled READ isGraphicalControlEnabled WRITE setGraphicalControlEnabled)
     Q_PROPERTY(int baudRate READ serialBaudRate WRITE setSerialBaudRate)
     Q_PROPERTY(bool bluetoothEnabled READ isBluetoothEnabled CONSTANT)
+    Q_PROPERTY(QString transport READ transport CONSTANT)
     Q_PROPERTY(bool denseThemeEnabled READ isDenseThemeEnabled WRITE setDenseThemeEnabled NOTIFY denseThemeChanged)
+    Q_PROPERTY(PressureControlLoop* controlLoop READ controlLoop CONSTANT)
+    Q_PROPERTY(LinkMonitor* linkMonitor READ linkMonitor CONSTANT)
 
 
 public:
@@ -47,12 +65,20 @@ public:
 
     Q_INVOKABLE void connect();
     Q_INVOKABLE void requestRefresh() { mCommunicator->requestStatus(); }
+    Q_INVOKABLE void emergencyStop();
+    Q_INVOKABLE QVariantMap commandQueueStatistics() { return mCommunicator->queueStatistics(); }
+    Q_INVOKABLE QString dumpMetrics();
+    Q_INVOKABLE bool isTracing() { return Tracer::isEnabled(); }
+    Q_INVOKABLE void startTracing();
+    Q_INVOKABLE QString stopTracing();
 
     int nValves();
     int nPumps();
     int nPressureControllers();
     double minPressure(int controllerNumber);
     double maxPressure(int controllerNumber);
+    bool latestMeasurement(int controllerNumber, double& value);
+    bool loadHardwareConfiguration(const QString& path);
 
     QString appVersion() { return GIT_VERSION; }
     QString connectionStatus();
@@ -61,11 +87,20 @@ public:
     Q_INVOKABLE void registerValveSwitchHelper(int valveNumber, ValveSwitchHelper* instance);
     Q_INVOKABLE void registerPumpSwitchHelper(int pumpNumber, PumpSwitchHelper* instance);
 
+    Q_INVOKABLE PressureSeries* pressureSeries(int controllerNumber);
+
+    Communicator* communicator() { return mCommunicator; }
     RoutineController* routineController() { return mRoutineController; }
+    PressureControlLoop* controlLoop() { return mControlLoop; }
+    ControlServer* controlServer() { return mControlServer; }
+    LinkMonitor* linkMonitor() { return mLinkMonitor; }
 
-    QVariantList log() { return mLog; }
+    LogFilterModel* logModel() { return mLogFilterModel; }
+    LogFileModel* logFileModel() { return mLogFileModel; }
+    Q_INVOKABLE QStringList pastLogFiles();
 
     bool isBluetoothEnabled() { return mBluetoothEnabled; }
+    QString transport() { return mTransport; }
 
     // Settings
     bool isDarkModeEnabled();
@@ -95,15 +130,30 @@ public:
     Q_INVOKABLE void setCurrentGraphicalControlScreen(QString label);
     Q_INVOKABLE QUrl currentGraphicalControlScreenURL();
 
+    Q_INVOKABLE QStringList logCategories();
+    Q_INVOKABLE int logLevel(QString category);
+    Q_INVOKABLE void setLogLevel(QString category, int level);
+
+    Q_INVOKABLE QVariantList telemetryControllers();
+    Q_INVOKABLE int telemetryRate(int controllerNumber);
+    Q_INVOKABLE void setTelemetryRate(int controllerNumber, int rate);
+
+    Q_INVOKABLE bool loadInterlocks();
+    Q_INVOKABLE QVariantMap interlockStatistics();
+
     uint serialBaudRate();
     void setSerialBaudRate(int rate);
+    int rampRate();
+    QString serialPort();
+    void setSerialPortOverride(const QString& port) { mSerialPortOverride = port; }
+    QString transportAddress();
 
     QSettings* settings() { return mSettings; }
 
 public slots:
-    void setValve(uint valveNumber, bool open) { mCommunicator->setValve(valveNumber, open); }
+    void setValve(uint valveNumber, bool open);
     void setPump(uint pumpNumber, bool on) { mCommunicator->setPump(pumpNumber, on); }
-    void setPressure(uint controllerNumber, double pressure) { mCommunicator->setPressure(controllerNumber, pressure); }
+    void setPressure(uint controllerNumber, double pressure);
     void addToLog(QVariant entry);
 
 signals:
@@ -124,9 +174,12 @@ private slots:
     void onCommunicatorStatusChanged(BluetoothCommunicator::ConnectionStatus newStatus);
 
 private:
-    /// True if the communicator uses bluetooth; false if USB
+    /// True if the communicator uses bluetooth
     bool mBluetoothEnabled;
 
+    /// Type of connection to the microcontroller: "serial", "bluetooth", "tcp" or "local"
+    QString mTransport;
+
     Communicator * mCommunicator;
     RoutineController * mRoutineController;
 
@@ -134,9 +187,52 @@ private:
     QMap<int, QList<ValveSwitchHelper*> > mQmlValveSwitches;
     QMap<int, PumpSwitchHelper*> mQmlPumpSwitches;
 
-    QVariantList mLog;
+    /// Components described by a configuration file instead of QML (see loadHardwareConfiguration)
+    bool mHardwareConfigured;
+    int mConfiguredValves;
+    int mConfiguredPumps;
+    /// Minimum and maximum pressure of each configured controller; controller N is at index N-1
+    QList<QPair<double, double>> mConfiguredPressureRanges;
+
+    /// All messages shown on the log screen, in a ring of fixed capacity
+    LogModel* mLogModel;
+
+    /// Filtered view of mLogModel, displayed by the log screen
+    LogFilterModel* mLogFilterModel;
+
+    /// Log file of a previous session, opened from the log screen
+    LogFileModel* mLogFileModel;
+
+    /// History of each pressure controller, for the charts. Controller N is at index N-1.
+    QList<PressureSeries*> mPressureSeries;
+
+    /// Passes on the pressures streamed by the microcontroller to the GUI, at a limited rate
+    TelemetryPublisher* mTelemetryPublisher;
+
+    /// Adjusts the setpoints of the controllers under closed-loop control, on its own thread
+    PressureControlLoop* mControlLoop;
+    LinkMonitor* mLinkMonitor;
+    MetricsServer* mMetricsServer;
+
+    /// Local socket through which other processes send commands; null if disabled in the settings
+    ControlServer* mControlServer;
+
+    /// Receives routine triggers from other programs; null if disabled in the settings
+    TriggerInput* mTriggerInput;
+
+    /// State and changes published in shared memory; null if disabled in the settings or unsupported
+    SharedTelemetry* mSharedTelemetry;
+
+    /// Binary record of hardware events; null if disabled in the settings
+    EventJournal* mEventJournal;
+
+    /// Records pressures, valve states and steps while a routine runs; null if disabled in the settings
+    ExperimentRecorder* mExperimentRecorder;
 
     QSettings * mSettings;
+
+    /// Serial port to use in this session instead of the "serialPort" setting, if not empty
+    QString mSerialPortOverride;
 };
 
 #endif // APPLICATIONCONTROLLER_H
@@ -1,5 +1,6 @@
 #include "bluetoothcommunicator.h"
 #include "applicationcontroller.h"
+#include "logger.h"
 
 
 BluetoothCommunicator::BluetoothCommunicator(ApplicationController *applicationController)
@@ -14,7 +15,7 @@ BluetoothCommunicator::BluetoothCommunicator(ApplicationController *applicationC
 
 BluetoothCommunicator::~BluetoothCommunicator()
 {
-    qDebug() << "deleting bluetoothCommunicator";
+    qCDebug(lcCommunicator) << "deleting bluetoothCommunicator";
 
     // TODO: close and kill socket, if necessary
 }
@@ -36,8 +37,8 @@ void BluetoothCommunicator::connect()
         QBluetoothUuid uuid(settings->value("controllerUuid").toUuid());
         QBluetoothAddress address(settings->value("controllerAddress").toString());
 
-        qDebug() << "Attempting to connect to saved device at address " << address.toString()
-                 << "with UUID" << uuid.toString();
+        qCDebug(lcCommunicator) << "Attempting to connect to saved device at address " << address.toString()
+                                << "with UUID" << uuid.toString();
 
         mConnectingToSavedDevice = true;
 
@@ -45,7 +46,7 @@ void BluetoothCommunicator::connect()
     }
 
     else {
-        qDebug() << "Searching for ESP32...";
+        qCDebug(lcCommunicator) << "Searching for ESP32...";
 
         // There are two methods of discovering bluetooth devices. One discovers devices, and the other
         // discovers services. Both are useful to find the correct device; one then connects to it using
@@ -59,7 +60,7 @@ void BluetoothCommunicator::connect()
 
         initServiceDiscoveryAgent();
 
-        qDebug() << "Starting service discovery...";
+        qCDebug(lcCommunicator) << "Starting service discovery...";
         mServiceDiscoveryAgent->setUuidFilter(QBluetoothUuid::SerialPort);
         mServiceDiscoveryAgent->start(QBluetoothServiceDiscoveryAgent::FullDiscovery);
 
@@ -76,7 +77,7 @@ void BluetoothCommunicator::connect()
 void BluetoothCommunicator::connect(const QBluetoothAddress &address, const QBluetoothUuid& uuid)
 {
     setConnectionStatus(Connecting);
-    qDebug() << "Connecting to address" << address << "and UUID" << uuid;
+    qCDebug(lcCommunicator) << "Connecting to address" << address << "and UUID" << uuid;
 
     initSocket();
     mSocket->connectToService(address, uuid);
@@ -89,7 +90,7 @@ void BluetoothCommunicator::connect(const QBluetoothAddress &address, const QBlu
 void BluetoothCommunicator::connect(const QBluetoothServiceInfo &serviceInfo)
 {
     setConnectionStatus(Connecting);
-    qDebug() << "Connecting to service...";
+    qCDebug(lcCommunicator) << "Connecting to service...";
 
     initSocket();
     mSocket->connectToService(serviceInfo);
@@ -103,7 +104,7 @@ void BluetoothCommunicator::connect(const QBluetoothServiceInfo &serviceInfo)
 void BluetoothCommunicator::connect(const QBluetoothAddress &address, quint16 port)
 {
     setConnectionStatus(Connecting);
-    qDebug() << "Connecting to address" << address << ", port" << port;
+    qCDebug(lcCommunicator) << "Connecting to address" << address << ", port" << port;
     initSocket();
 
     mSocket->connectToService(address, port);
@@ -119,7 +120,7 @@ void BluetoothCommunicator::connect(const QBluetoothAddress &address, quint16 po
  */
 void BluetoothCommunicator::onSocketReady()
 {
-    //qDebug() << "Received" << mSocket->bytesAvailable() << "bytes on serial port";
+    //qCDebug(lcCommunicator) << "Received" << mSocket->bytesAvailable() << "bytes on serial port";
 
     mBuffer.append(mSocket->readAll());
 
@@ -136,15 +137,15 @@ void BluetoothCommunicator::onSocketError(QBluetoothSocket::SocketError error)
         return;
 
     if (error != QBluetoothSocket::NoSocketError) {
-        qWarning() << "Bluetooth socket error: " << mSocket->errorString();
+        qCWarning(lcCommunicator) << "Bluetooth socket error: " << mSocket->errorString();
 
         if (error == QBluetoothSocket::NetworkError) {
-            qWarning() << "Bluetooth adapter is unavailable. Make sure that it is powered on and try again.";
+            qCWarning(lcCommunicator) << "Bluetooth adapter is unavailable. Make sure that it is powered on and try again.";
             setConnectionStatus(Disconnected);
         }
 
         else if (mConnectingToSavedDevice) {
-            qInfo() << "Failed to connect to saved device. Will try searching for it instead.";
+            qCInfo(lcCommunicator) << "Failed to connect to saved device. Will try searching for it instead.";
             mFailedToConnectToSavedDevice = true;
             connect();
         }
@@ -157,15 +158,15 @@ void BluetoothCommunicator::onSocketError(QBluetoothSocket::SocketError error)
 void BluetoothCommunicator::onSocketConnected()
 {
     setConnectionStatus(Connected);
-    qDebug() << "Socket connected";
+    qCDebug(lcCommunicator) << "Socket connected";
 
     if (!mConnectingToSavedDevice || mFailedToConnectToSavedDevice) {
-        qDebug() << "Saving device information to speed up later connection attempts.";
+        qCDebug(lcCommunicator) << "Saving device information to speed up later connection attempts.";
 
         QBluetoothUuid uuid = mService.serviceClassUuids()[0];
         QBluetoothAddress address = mService.device().address();
 
-        qDebug() << "Device UUID and address:" << uuid.toString() << ";" << address.toString();
+        qCDebug(lcCommunicator) << "Device UUID and address:" << uuid.toString() << ";" << address.toString();
 
         appController->settings()->setValue("controllerUuid", uuid);
         appController->settings()->setValue("controllerAddress", address.toString());
@@ -178,26 +179,26 @@ void BluetoothCommunicator::onSocketConnected()
 void BluetoothCommunicator::onSocketDisconnected()
 {
     setConnectionStatus(Disconnected);
-    qDebug() << "Socket disconnected";
+    qCDebug(lcCommunicator) << "Socket disconnected";
 }
 
 void BluetoothCommunicator::onServiceDiscovered(QBluetoothServiceInfo serviceInfo)
 {
-    qDebug() << "==============================================";
-    qDebug() << "Discovered service on"
-             << serviceInfo.device().name() << serviceInfo.device().address().toString();
-    qDebug() << "\tService name:" << serviceInfo.serviceName();
-    qDebug() << "\tDescription:"
-             << serviceInfo.attribute(QBluetoothServiceInfo::ServiceDescription).toString();
-    qDebug() << "\tProvider:"
-             << serviceInfo.attribute(QBluetoothServiceInfo::ServiceProvider).toString();
-    qDebug() << "\tL2CAP protocol service multiplexer:"
-             << serviceInfo.protocolServiceMultiplexer();
-    qDebug() << "\tRFCOMM server channel:" << serviceInfo.serverChannel();
-    qDebug() << "==============================================";
+    qCDebug(lcCommunicator) << "==============================================";
+    qCDebug(lcCommunicator) << "Discovered service on"
+                            << serviceInfo.device().name() << serviceInfo.device().address().toString();
+    qCDebug(lcCommunicator) << "\tService name:" << serviceInfo.serviceName();
+    qCDebug(lcCommunicator) << "\tDescription:"
+                            << serviceInfo.attribute(QBluetoothServiceInfo::ServiceDescription).toString();
+    qCDebug(lcCommunicator) << "\tProvider:"
+                            << serviceInfo.attribute(QBluetoothServiceInfo::ServiceProvider).toString();
+    qCDebug(lcCommunicator) << "\tL2CAP protocol service multiplexer:"
+                            << serviceInfo.protocolServiceMultiplexer();
+    qCDebug(lcCommunicator) << "\tRFCOMM server channel:" << serviceInfo.serverChannel();
+    qCDebug(lcCommunicator) << "==============================================";
 
     if (serviceInfo.device().name() == "Microfluidics control system") {
-        qDebug () << "Found microcontroller.";
+        qCDebug(lcCommunicator) << "Found microcontroller.";
         mService = serviceInfo;
     }
 }
@@ -205,39 +206,39 @@ void BluetoothCommunicator::onServiceDiscovered(QBluetoothServiceInfo serviceInf
 void BluetoothCommunicator::onServiceDiscoveryError(QBluetoothServiceDiscoveryAgent::Error error)
 {
     Q_UNUSED(error)
-    qWarning() << "Bluetooth service discovery error:" << mServiceDiscoveryAgent->errorString();
+    qCWarning(lcCommunicator) << "Bluetooth service discovery error:" << mServiceDiscoveryAgent->errorString();
 }
 
 void BluetoothCommunicator::onServiceDiscoveryFinished()
 {
-    qDebug() << "Bluetooth service discovery finished";
+    qCDebug(lcCommunicator) << "Bluetooth service discovery finished";
     if (mService.isValid()) {
         connect(mService);
     }
     else {
-        qWarning() << "Microcontroller not found. Check that it is powered on and in range.";
+        qCWarning(lcCommunicator) << "Microcontroller not found. Check that it is powered on and in range.";
         setConnectionStatus(Disconnected);
     }
 }
 
 void BluetoothCommunicator::onDeviceDiscovered(QBluetoothDeviceInfo deviceInfo)
 {
-    qDebug() << "-------------------------------------------------------------------------------";
-    qDebug() << "Bluetooth device discovered:" << deviceInfo.name() << "(" << deviceInfo.address() << ")";
-    qDebug() << "Device UUID:" << deviceInfo.deviceUuid();
-    qDebug() << "Major device class:" << deviceInfo.majorDeviceClass();
-    qDebug() << "Minor device class:" << deviceInfo.minorDeviceClass();
-    qDebug() << "RSSI:" << deviceInfo.rssi();
-    qDebug() << "Service classes:" << deviceInfo.serviceClasses();
-
-    qDebug() << "Service UUIDs:";
+    qCDebug(lcCommunicator) << "-------------------------------------------------------------------------------";
+    qCDebug(lcCommunicator) << "Bluetooth device discovered:" << deviceInfo.name() << "(" << deviceInfo.address() << ")";
+    qCDebug(lcCommunicator) << "Device UUID:" << deviceInfo.deviceUuid();
+    qCDebug(lcCommunicator) << "Major device class:" << deviceInfo.majorDeviceClass();
+    qCDebug(lcCommunicator) << "Minor device class:" << deviceInfo.minorDeviceClass();
+    qCDebug(lcCommunicator) << "RSSI:" << deviceInfo.rssi();
+    qCDebug(lcCommunicator) << "Service classes:" << deviceInfo.serviceClasses();
+
+    qCDebug(lcCommunicator) << "Service UUIDs:";
     QList<QBluetoothUuid> uuids = deviceInfo.serviceUuids();
     foreach(QBluetoothUuid id, uuids) {
-        qDebug() << id;
+        qCDebug(lcCommunicator) << id;
     }
 
     if (deviceInfo.name() == "Microfluidics control system") {
-        qDebug() << "Found control system; stopping discovery";
+        qCDebug(lcCommunicator) << "Found control system; stopping discovery";
         mDeviceInfo = deviceInfo;
         mDeviceDiscoveryAgent->stop();
     }
@@ -247,12 +248,12 @@ void BluetoothCommunicator::onDeviceDiscovered(QBluetoothDeviceInfo deviceInfo)
 void BluetoothCommunicator::onDeviceDiscoveryError(QBluetoothDeviceDiscoveryAgent::Error error)
 {
     Q_UNUSED(error)
-    qDebug() << "Bluetooth device discovery error:" << mDeviceDiscoveryAgent->errorString();
+    qCDebug(lcCommunicator) << "Bluetooth device discovery error:" << mDeviceDiscoveryAgent->errorString();
 }
 
 void BluetoothCommunicator::onDeviceDiscoveryFinished()
 {
-    qDebug() << "Device discovery finished";
+    qCDebug(lcCommunicator) << "Device discovery finished";
     if (mDeviceInfo.isValid())
         connect(mDeviceInfo.address(), 2); // TODO: detect which channel the SPP is actually on (can't currently check for that)
     else
@@ -265,6 +266,11 @@ void BluetoothCommunicator::sendMessage(QByteArray message)
     mSocket->write(message);
 }
 
+qint64 BluetoothCommunicator::bytesToWrite() const
+{
+    return mSocket ? mSocket->bytesToWrite() : 0;
+}
+
 /**
  * @brief Initialize the bluetooth socket and connect signals & slots
  *
@@ -276,7 +282,7 @@ void BluetoothCommunicator::initSocket()
 {
     if (!mSocket) {
         mSocket = new QBluetoothSocket(QBluetoothServiceInfo::RfcommProtocol);
-        qDebug() << "Socket created";
+        qCDebug(lcCommunicator) << "Socket created";
 
         QObject::connect(mSocket, SIGNAL(connected()),
                          this, SLOT(onSocketConnected()));
@@ -286,6 +292,7 @@ void BluetoothCommunicator::initSocket()
                          this, SLOT(onSocketReady()));
         QObject::connect(mSocket, SIGNAL(error(QBluetoothSocket::SocketError)),
                          this, SLOT(onSocketError(QBluetoothSocket::SocketError)));
+        QObject::connect(mSocket, &QBluetoothSocket::bytesWritten, this, [this] { drainQueue(); });
 
     }
 }
@@ -303,7 +310,7 @@ void BluetoothCommunicator::initServiceDiscoveryAgent()
 {
     if (!mServiceDiscoveryAgent) {
         mServiceDiscoveryAgent = new QBluetoothServiceDiscoveryAgent();
-        qDebug() << "Discovery agent created";
+        qCDebug(lcCommunicator) << "Discovery agent created";
 
         QObject::connect(mServiceDiscoveryAgent, SIGNAL(serviceDiscovered(QBluetoothServiceInfo)),
                          this, SLOT(onServiceDiscovered(QBluetoothServiceInfo)));
@@ -326,7 +333,7 @@ void BluetoothCommunicator::initDeviceDiscoveryAgent()
 {
     if (!mDeviceDiscoveryAgent) {
         mDeviceDiscoveryAgent = new QBluetoothDeviceDiscoveryAgent();
-        qDebug() << "Device discovery agent created";
+        qCDebug(lcCommunicator) << "Device discovery agent created";
 
         QObject::connect(mDeviceDiscoveryAgent, SIGNAL(deviceDiscovered(QBluetoothDeviceInfo)),
                          this, SLOT(onDeviceDiscovered(QBluetoothDeviceInfo)));
@@ -53,6 +53,7 @@ private slots:
 protected:
     //void setComponentState(Component c, int val);
     void sendMessage(QByteArray message);
+    qint64 bytesToWrite() const;
 
 private:
     void initSocket();
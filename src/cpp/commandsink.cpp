@@ -0,0 +1,100 @@
+#include "commandsink.h"
+#include "communicator.h"
+
+CommandSink::CommandSink(Communicator *communicator)
+    : mCommunicator(communicator)
+    , mHead(nullptr)
+    , mSubmitted(0)
+    , mWakeups(0)
+{
+}
+
+CommandSink::~CommandSink()
+{
+    Command* c = takeAll();
+    while (c) {
+        Command* next = c->next;
+        c->confirmation.set_value(false);
+        delete c;
+        c = next;
+    }
+}
+
+/**
+ * @brief Open or close a valve. May be called from any thread.
+ */
+std::future<bool> CommandSink::setValve(uint valveNumber, bool open)
+{
+    return submit(ShadowState::Valve, valveNumber, open);
+}
+
+/**
+ * @brief Switch a pump on or off. May be called from any thread.
+ */
+std::future<bool> CommandSink::setPump(uint pumpNumber, bool on)
+{
+    return submit(ShadowState::Pump, pumpNumber, on);
+}
+
+/**
+ * @brief Set the setpoint of a pressure controller. May be called from any thread.
+ * @param pressure Between 0 and 1, as in Communicator::setPressure
+ */
+std::future<bool> CommandSink::setPressure(uint controllerNumber, double pressure)
+{
+    if (pressure < 0. || pressure > 1.)
+        return refused();
+    return submit(ShadowState::Pressure, controllerNumber, quint8(pressure*PR_MAX_VALUE));
+}
+
+/**
+ * @brief Queue a command for the Communicator, unless there is no such component
+ *
+ * Numbers are checked here, since they are truncated to 8 bits in the queue (and in the protocol).
+ */
+std::future<bool> CommandSink::submit(ShadowState::Component component, uint number, quint8 value)
+{
+    const uint counts[ShadowState::NumComponents] = { N_VALVES, N_PUMPS, N_PRS };
+    if (number < 1 || number > counts[component])
+        return refused();
+
+    Command* c = new Command { component, quint8(number), value, std::promise<bool>(), nullptr };
+    std::future<bool> confirmation = c->confirmation.get_future();
+
+    c->next = mHead.load(std::memory_order_relaxed);
+    while (!mHead.compare_exchange_weak(c->next, c, std::memory_order_release, std::memory_order_relaxed))
+        ;
+    mSubmitted.fetch_add(1, std::memory_order_relaxed);
+
+    // If the queue wasn't empty, the Communicator was already woken up and will see this command too
+    if (!c->next) {
+        mWakeups.fetch_add(1, std::memory_order_relaxed);
+        QMetaObject::invokeMethod(mCommunicator, "processSubmittedCommands", Qt::QueuedConnection);
+    }
+
+    return confirmation;
+}
+
+std::future<bool> CommandSink::refused()
+{
+    std::promise<bool> promise;
+    promise.set_value(false);
+    return promise.get_future();
+}
+
+/**
+ * @brief Remove all submitted commands from the queue, and return them oldest first
+ */
+CommandSink::Command* CommandSink::takeAll()
+{
+    Command* c = mHead.exchange(nullptr, std::memory_order_acquire);
+
+    Command* oldest = nullptr;
+    while (c) {
+        Command* next = c->next;
+        c->next = oldest;
+        oldest = c;
+        c = next;
+    }
+    return oldest;
+}
@@ -0,0 +1,69 @@
+#ifndef COMMANDSINK_H
+#define COMMANDSINK_H
+
+#include <atomic>
+#include <future>
+
+#include <QtCore>
+
+#include "shadowstate.h"
+
+class Communicator;
+
+/**
+ * @brief The CommandSink class lets any thread send commands to the microcontroller.
+ *
+ * Communicator, like the serial and Bluetooth backends, may only be used from the thread it lives in. Commands
+ * submitted to the sink are pushed to a lock-free queue instead, and handed to the Communicator from its own thread.
+ * Submitting a command takes one allocation and one atomic operation; the submitting thread never waits for the
+ * event loop. Only the first command of a batch (i.e. submitted while the queue was empty) posts an event to wake
+ * the Communicator; the whole batch is then sent in order.
+ *
+ * Each function returns a future that becomes true when the microcontroller reports the requested state (or right
+ * away, if it was already in that state), and false if the command was refused (safety rules, full queue, not
+ * connected), overridden by a later command for the same component, or not confirmed within the mismatch timeout.
+ *
+ * Valves, pumps and pressure controllers are 1-indexed, as in Communicator. Commands for components that don't exist
+ * are refused right away.
+ */
+class CommandSink
+{
+public:
+    explicit CommandSink(Communicator* communicator);
+    ~CommandSink();
+
+    std::future<bool> setValve(uint valveNumber, bool open);
+    std::future<bool> setPump(uint pumpNumber, bool on);
+    std::future<bool> setPressure(uint controllerNumber, double pressure);
+
+    /// Number of commands submitted so far
+    quint64 submitted() const { return mSubmitted.load(std::memory_order_relaxed); }
+
+    /// Number of times the Communicator was woken up to process submitted commands
+    quint64 wakeups() const { return mWakeups.load(std::memory_order_relaxed); }
+
+private:
+    struct Command {
+        ShadowState::Component component;
+        quint8 number;
+        quint8 value;
+        std::promise<bool> confirmation;
+        Command* next;
+    };
+
+    std::future<bool> submit(ShadowState::Component component, uint number, quint8 value);
+    static std::future<bool> refused();
+    Command* takeAll();
+
+    Communicator* mCommunicator;
+
+    /// Most recently submitted command; commands are linked from newest to oldest
+    std::atomic<Command*> mHead;
+
+    std::atomic<quint64> mSubmitted;
+    std::atomic<quint64> mWakeups;
+
+    friend class Communicator;
+};
+
+#endif // COMMANDSINK_H
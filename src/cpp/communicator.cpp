@@ -1,15 +1,48 @@
 #include "communicator.h"
 #include "applicationcontroller.h"
+#include "logger.h"
+#include "sharedtelemetry.h"
+
+#include <algorithm>
 
 
 Communicator::Communicator(ApplicationController* applicationController)
     : mConnectionStatus(Disconnected)
+    , mSharedTelemetry(nullptr)
     , appController(applicationController)
+    , mCongested(false)
+    , mMismatchTimeout(2000)
+    , mCommandSink(this)
 {
+    for (Lane& lane : mLanes)
+        lane = Lane { std::deque<QueuedCommand>(), 0, 0, 0, 0, 0, 0 };
+
+    MetricsRegistry* metrics = MetricsRegistry::registry();
+    mBytesReceivedMetric = &metrics->counter("ufcs_bytes_received_total", "Bytes received from the microcontroller");
+    mBytesSentMetric = &metrics->counter("ufcs_bytes_sent_total", "Bytes written to the microcontroller, framing included");
+    mFramesDecodedMetric = &metrics->counter("ufcs_frames_decoded_total", "Messages received from the microcontroller and handled");
+    mFramesRejectedMetrics[UnknownCommand] = &metrics->counter("ufcs_frames_rejected_total", "Messages received from the microcontroller and discarded", "reason=\"unknown_command\"");
+    mFramesRejectedMetrics[IncompleteParameter] = &metrics->counter("ufcs_frames_rejected_total", "Messages received from the microcontroller and discarded", "reason=\"incomplete_parameter\"");
+    mFramesRejectedMetrics[TooShort] = &metrics->counter("ufcs_frames_rejected_total", "Messages received from the microcontroller and discarded", "reason=\"too_short\"");
+    mQueueDepthMetrics[EmergencyPriority] = &metrics->gauge("ufcs_command_queue_depth", "Commands waiting to be written, per lane", "lane=\"emergency\"");
+    mQueueDepthMetrics[NormalPriority] = &metrics->gauge("ufcs_command_queue_depth", "Commands waiting to be written, per lane", "lane=\"normal\"");
+    mQueueDepthMetrics[LowPriority] = &metrics->gauge("ufcs_command_queue_depth", "Commands waiting to be written, per lane", "lane=\"low\"");
+
+    mShadowTimer.setInterval(500);
+    QObject::connect(&mShadowTimer, &QTimer::timeout, this, &Communicator::checkShadowState);
+    mShadowTimer.start();
+
+    // Enough for a few seconds of streaming at the highest rates the firmware supports
+    for (int i(0); i < N_PRS; ++i) {
+        mTelemetryRings.emplace_back(new SpscRing<TelemetrySample>(4096));
+        mLatestMeasurement[i] = 0;
+    }
 }
 
 Communicator::~Communicator()
 {
+    // Commands still in the sink are refused when it is destroyed
+    failAllConfirmations();
 }
 
 Communicator::ConnectionStatus Communicator::getConnectionStatus() const
@@ -41,16 +74,8 @@ QString Communicator::getConnectionStatusString() const
  */
 void Communicator::setValve(uint valveNumber, bool open)
 {
-    qDebug() << "Communicator: setting valve" << valveNumber << (open ? "open" : "closed");
-
-    QByteArray message;
-    message.push_back(VALVE);
-    message.push_back(1);
-    message.push_back((uint8_t)valveNumber);
-    message.push_back(1);
-    message.push_back((uint8_t)open);
-
-    sendMessage(frameMessage(message));
+    qCDebug(lcCommunicator) << "Communicator: setting valve" << valveNumber << (open ? "open" : "closed");
+    requestState(ShadowState::Valve, valveNumber, open);
 }
 
 /**
@@ -60,16 +85,8 @@ void Communicator::setValve(uint valveNumber, bool open)
  */
 void Communicator::setPump(uint pumpNumber, bool on)
 {
-    qDebug() << "Communicator: setting pump" << pumpNumber << (on ? "on" : "off");
-
-    QByteArray message;
-    message.push_back(PUMP);
-    message.push_back(1);
-    message.push_back((uint8_t)pumpNumber);
-    message.push_back(1);
-    message.push_back((uint8_t)on);
-
-    sendMessage(frameMessage(message));
+    qCDebug(lcCommunicator) << "Communicator: setting pump" << pumpNumber << (on ? "on" : "off");
+    requestState(ShadowState::Pump, pumpNumber, on);
 }
 
 /**
@@ -79,23 +96,176 @@ void Communicator::setPump(uint pumpNumber, bool on)
  */
 void Communicator::setPressure(uint controllerNumber, double pressure)
 {
-    qDebug() << "Communicator: setting pressure controller" << controllerNumber << " to " << pressure;
+    qCDebug(lcCommunicator) << "Communicator: setting pressure controller" << controllerNumber << " to " << pressure;
 
     if (pressure < 0. || pressure > 1.) {
-        qWarning() << "Pressure invalid. Must be between 0 and 1.";
+        qCWarning(lcCommunicator) << "Pressure invalid. Must be between 0 and 1.";
         return;
     }
 
     uint8_t sp = pressure*PR_MAX_VALUE;
+    requestState(ShadowState::Pressure, controllerNumber, sp);
+}
+
+/**
+ * @brief Send the command putting a component in the given state, unless it is redundant or forbidden
+ * @param value As stored in ShadowState: 0 or 1 for valves and pumps, raw setpoint for pressure controllers
+ */
+Communicator::RequestResult Communicator::requestState(ShadowState::Component component, uint number, int value)
+{
+    TRACE_SPAN("communicator", "requestState", number);
+
+    if (component == ShadowState::Valve) {
+        QString rule;
+        if (!mInterlocks.allowsValve(number, value, &rule)) {
+            qCWarning(lcCommunicator) << "Not opening valve" << number << "; prevented by safety rule:" << rule;
+            return RequestRefused;
+        }
+    }
+
+    if (mShadow.isRedundant(component, number, value)) {
+        qCDebug(lcCommunicator) << "The" << ShadowState::componentName(component) << number << "is already set to"
+                                << value << "; not sending command";
+        return RequestRedundant;
+    }
 
     QByteArray message;
-    message.push_back(PRESSURE);
-    message.push_back(1);
-    message.push_back((uint8_t)controllerNumber);
-    message.push_back(1);
-    message.push_back(sp);
+    switch (component) {
+        case ShadowState::Valve:
+            message = valveMessage(number, value);
+            break;
+        case ShadowState::Pump:
+            message = pumpMessage(number, value);
+            break;
+        default:
+            message = pressureMessage(number, uint8_t(value));
+            break;
+    }
 
-    sendMessage(frameMessage(message));
+    if (!sendCommand(message))
+        return RequestRefused;
+
+    setDesired(component, number, value);
+    if (component == ShadowState::Valve)
+        mInterlocks.setValveState(number, value);
+    return RequestSent;
+}
+
+/**
+ * @brief Send the commands submitted through commandSink()
+ *
+ * Called once per batch of submitted commands, from the thread the Communicator lives in.
+ */
+void Communicator::processSubmittedCommands()
+{
+    CommandSink::Command* c = mCommandSink.takeAll();
+    while (c) {
+        CommandSink::Command* next = c->next;
+
+        switch (requestState(c->component, c->number, c->value)) {
+            case RequestSent:
+                mPendingConfirmations.push_back(PendingConfirmation { c->component, c->number, c->value, std::move(c->confirmation) });
+                break;
+            case RequestRedundant:
+                c->confirmation.set_value(true);
+                break;
+            case RequestRefused:
+                c->confirmation.set_value(false);
+                break;
+        }
+
+        delete c;
+        c = next;
+    }
+}
+
+/**
+ * @brief Record the state requested for a component. Pending confirmations of a different state will never come.
+ */
+void Communicator::setDesired(ShadowState::Component component, uint number, int value)
+{
+    mShadow.setDesired(component, number, value, shadowClock());
+
+    for (size_t i(0); i < mPendingConfirmations.size();) {
+        PendingConfirmation& p = mPendingConfirmations[i];
+        if (p.component == component && p.number == number && p.value != value)
+            resolveConfirmation(i, false);
+        else
+            ++i;
+    }
+}
+
+/**
+ * @brief Record the state reported by the microcontroller for a component, and confirm the commands that requested it
+ */
+void Communicator::setReported(ShadowState::Component component, uint number, int value)
+{
+    if (Tracer::isEnabled()) {
+        static const uint8_t commands[ShadowState::NumComponents] = { VALVE, PUMP, PRESSURE };
+        const ShadowState::Entry* entry = mShadow.entry(component, number);
+        if (entry && entry->desired == value)
+            Tracer::asyncEnd("command", "awaiting report", traceId(commands[component], number));
+    }
+
+    mShadow.setReported(component, number, value, shadowClock());
+
+    for (size_t i(0); i < mPendingConfirmations.size();) {
+        PendingConfirmation& p = mPendingConfirmations[i];
+        if (p.component == component && p.number == number && p.value == value)
+            resolveConfirmation(i, true);
+        else
+            ++i;
+    }
+}
+
+void Communicator::failConfirmations(ShadowState::Component component, uint number)
+{
+    for (size_t i(0); i < mPendingConfirmations.size();) {
+        PendingConfirmation& p = mPendingConfirmations[i];
+        if (p.component == component && p.number == number)
+            resolveConfirmation(i, false);
+        else
+            ++i;
+    }
+}
+
+/**
+ * @brief Forget the request made by a queued command that will never be sent, unless a later one superseded it
+ *
+ * Its confirmations fail, and its component is no longer restored to it (by resynchronize()) nor checked against it.
+ */
+void Communicator::forgetQueuedCommand(const QByteArray &message)
+{
+    ShadowState::Component component;
+    uint number;
+    int value;
+    if (!parseStateMessage(message, component, number, value))
+        return;
+
+    const ShadowState::Entry* e = mShadow.entry(component, number);
+    if (!e || e->desired != value)
+        return;
+
+    mShadow.setDesired(component, number, -1, shadowClock());
+    failConfirmations(component, number);
+}
+
+/**
+ * @brief Resolve a pending confirmation and remove it; the last confirmation takes its index
+ */
+void Communicator::resolveConfirmation(size_t index, bool confirmed)
+{
+    mPendingConfirmations[index].promise.set_value(confirmed);
+    if (index + 1 < mPendingConfirmations.size())
+        mPendingConfirmations[index] = std::move(mPendingConfirmations.back());
+    mPendingConfirmations.pop_back();
+}
+
+void Communicator::failAllConfirmations()
+{
+    for (PendingConfirmation& p : mPendingConfirmations)
+        p.promise.set_value(false);
+    mPendingConfirmations.clear();
 }
 
 /**
@@ -103,10 +273,470 @@ void Communicator::setPressure(uint controllerNumber, double pressure)
  */
 void Communicator::requestStatus()
 {
-    qDebug() << "Communicator: requesting status of all components";
+    qCDebug(lcCommunicator) << "Communicator: requesting status of all components";
     QByteArray message;
     message.push_back(STATUS);
-    sendMessage(frameMessage(message));
+    sendCommand(message, LowPriority);
+}
+
+/**
+ * @brief Ask the microcontroller for its uptime; the answer is emitted with uptimeChanged
+ */
+void Communicator::requestUptime()
+{
+    QByteArray message;
+    message.push_back(UPTIME);
+    sendCommand(message, LowPriority);
+}
+
+/**
+ * @brief Ask the microcontroller to stream the measured pressure of a controller
+ * @param controllerNumber The controller number
+ * @param rate Number of samples per second. 0 stops streaming.
+ */
+void Communicator::setTelemetryRate(uint controllerNumber, uint rate)
+{
+    qCDebug(lcCommunicator) << "Communicator: setting telemetry rate of controller" << controllerNumber << "to" << rate << "Hz";
+
+    rate = qMin(rate, 0xFFFFu);
+
+    QByteArray message;
+    message.push_back(TELEMETRY);
+    message.push_back(1);
+    message.push_back((uint8_t)controllerNumber);
+    message.push_back(2);
+    message.push_back((uint8_t)(rate >> 8));
+    message.push_back((uint8_t)rate);
+
+    sendCommand(message, LowPriority);
+}
+
+/**
+ * @brief Return the ring to which telemetry samples of the given controller are pushed, or nullptr if there is no such controller
+ */
+SpscRing<TelemetrySample>* Communicator::telemetryRing(uint controllerNumber)
+{
+    if (controllerNumber < 1 || controllerNumber > mTelemetryRings.size())
+        return nullptr;
+    return mTelemetryRings[controllerNumber-1].get();
+}
+
+/**
+ * @brief Return the latest pressure measured by a controller. May be called from any thread.
+ * @param value Set to the measured pressure (0-1)
+ * @param sequence Set to a number that changes whenever a new measurement is received
+ * @return False if there is no such controller, or no measurement was received yet
+ */
+bool Communicator::latestMeasurement(uint controllerNumber, double &value, quint32 &sequence) const
+{
+    if (controllerNumber < 1 || controllerNumber > N_PRS)
+        return false;
+
+    quint32 latest = mLatestMeasurement[controllerNumber-1].load(std::memory_order_acquire);
+    sequence = latest >> 8;
+    value = double(latest & 0xFF) / PR_MAX_VALUE;
+    return sequence != 0;
+}
+
+void Communicator::storeLatestMeasurement(uint controllerNumber, uint8_t value)
+{
+    if (controllerNumber < 1 || controllerNumber > N_PRS)
+        return;
+
+    std::atomic<quint32>& latest = mLatestMeasurement[controllerNumber-1];
+    quint32 sequence = (latest.load(std::memory_order_relaxed) >> 8) + 1;
+    if (sequence >= (1u << 24))
+        sequence = 1;
+    latest.store(sequence << 8 | value, std::memory_order_release);
+}
+
+/**
+ * @brief Set all pressures to zero and switch off the pumps, ahead of any other queued command
+ *
+ * Commands still waiting in the other lanes are discarded, so that they can't undo this, and the requests they
+ * made are forgotten. Only commands closing a valve are kept.
+ */
+void Communicator::emergencyStop()
+{
+    qCWarning(lcCommunicator) << "Emergency stop";
+
+    QList<QByteArray> dropped;
+    for (int p(NormalPriority); p < NumPriorities; ++p) {
+        std::deque<QueuedCommand> kept;
+        for (QueuedCommand& c : mLanes[p].queue) {
+            ShadowState::Component component;
+            uint number;
+            int value;
+            if (parseStateMessage(c.message, component, number, value) && component == ShadowState::Valve && value == 0)
+                kept.push_back(std::move(c));
+            else
+                dropped << c.message;
+        }
+        mLanes[p].superseded += mLanes[p].queue.size() - kept.size();
+        mLanes[p].queue.swap(kept);
+    }
+
+    for (QByteArray const& message : dropped)
+        forgetQueuedCommand(message);
+
+    for (uint i(1); i <= N_PRS; ++i) {
+        sendCommand(pressureMessage(i, 0), EmergencyPriority);
+        setDesired(ShadowState::Pressure, i, 0);
+    }
+
+    for (uint i(1); i <= N_PUMPS; ++i) {
+        sendCommand(pumpMessage(i, false), EmergencyPriority);
+        setDesired(ShadowState::Pump, i, 0);
+    }
+
+    updateCongestion();
+}
+
+/**
+ * @brief Write the requested state of every component to the device, as a single batch
+ *
+ * This is meant to be called right after connecting, to undo any divergence between what was requested and what the
+ * device did while it was disconnected (e.g. after a reset). Components that were never set are left alone, and
+ * valves whose safety rules currently forbid opening them are not opened.
+ */
+void Communicator::resynchronize()
+{
+    if (mConnectionStatus != Connected)
+        return;
+
+    QList<QByteArray> messages;
+    for (uint i(1); i <= mShadow.count(ShadowState::Valve); ++i) {
+        int desired = mShadow.entry(ShadowState::Valve, i)->desired;
+        if (desired >= 0 && (desired == 0 || mInterlocks.allowsValve(i, true)))
+            messages << valveMessage(i, desired);
+    }
+    for (uint i(1); i <= mShadow.count(ShadowState::Pump); ++i) {
+        int desired = mShadow.entry(ShadowState::Pump, i)->desired;
+        if (desired >= 0)
+            messages << pumpMessage(i, desired);
+    }
+    for (uint i(1); i <= mShadow.count(ShadowState::Pressure); ++i) {
+        int desired = mShadow.entry(ShadowState::Pressure, i)->desired;
+        if (desired >= 0)
+            messages << pressureMessage(i, uint8_t(desired));
+    }
+
+    if (messages.isEmpty())
+        return;
+
+    qCInfo(lcCommunicator) << "Restoring the state of" << messages.size() << "components";
+
+    // The queue was emptied when the connection was lost, so nothing can be waiting ahead of these
+    QByteArray batch;
+    for (QByteArray const& message : messages)
+        batch.append(frameMessage(message));
+    mBytesSentMetric->increment(batch.size());
+    sendMessage(batch);
+
+    for (QByteArray const& message : messages)
+        emit commandSent(message);
+}
+
+/**
+ * @brief Set how long a component may differ from its requested state before stateMismatch is emitted
+ */
+void Communicator::setMismatchTimeout(int milliseconds)
+{
+    mMismatchTimeout = qMax(0, milliseconds);
+}
+
+/**
+ * @brief Report components that haven't reached their requested state within the mismatch timeout
+ */
+void Communicator::checkShadowState()
+{
+    if (mConnectionStatus != Connected)
+        return;
+
+    for (auto const& mismatch : mShadow.newMismatches(shadowClock(), mMismatchTimeout)) {
+        QString component = ShadowState::componentName(mismatch.first);
+        const ShadowState::Entry* e = mShadow.entry(mismatch.first, mismatch.second);
+        qCWarning(lcCommunicator) << "The" << component << mismatch.second << "was set to" << e->desired
+                                  << "but the microcontroller reports" << e->reported;
+        failConfirmations(mismatch.first, mismatch.second);
+        emit stateMismatch(component, mismatch.second);
+    }
+}
+
+/**
+ * @brief Queue a command for the microcontroller
+ * @param message The unframed message: command byte, followed by parameters
+ * @param priority The lane in which the command is queued
+ * @return False if the command was refused, because the device isn't connected or the lane is full
+ *
+ * All outgoing commands go through this function. A queued setpoint for the same controller is replaced by this one,
+ * and removed from lower-priority lanes, which would otherwise send it after this one.
+ */
+bool Communicator::sendCommand(const QByteArray &message, CommandPriority priority)
+{
+    if (mConnectionStatus == Disconnected) {
+        qCWarning(lcCommunicator) << "Can't send message: microcontroller is not connected";
+        return false;
+    }
+
+    Lane& lane = mLanes[priority];
+    int key = supersessionKey(message);
+
+    if (key >= 0) {
+        for (int p(priority + 1); p < NumPriorities; ++p) {
+            std::deque<QueuedCommand>& q = mLanes[p].queue;
+            size_t before = q.size();
+            q.erase(std::remove_if(q.begin(), q.end(), [key](const QueuedCommand& c) { return c.key == key; }), q.end());
+            mLanes[p].superseded += before - q.size();
+        }
+
+        for (QueuedCommand& c : lane.queue) {
+            if (c.key == key) {
+                // Keep its place in the queue (and its enqueue time, so wait times stay truthful)
+                c.message = message;
+                lane.superseded++;
+                drainQueue();
+                return true;
+            }
+        }
+    }
+
+    if (int(lane.queue.size()) >= MaxQueueDepth) {
+        lane.rejected++;
+        qCWarning(lcCommunicator) << "Command queue full; dropping command" << int((uint8_t)message[0]);
+        return false;
+    }
+
+    lane.queue.push_back(QueuedCommand { message, key, telemetryClock() });
+    lane.maxDepth = qMax(lane.maxDepth, lane.queue.size());
+
+    if (Tracer::isEnabled() && message.size() >= 3)
+        Tracer::asyncBegin("command", "queued", traceId((uint8_t)message[0], (uint8_t)message[2]), priority);
+
+    drainQueue();
+    return true;
+}
+
+/**
+ * @brief Write queued commands to the device, highest priority first, as long as the backend's buffer allows
+ *
+ * Emergency commands are written regardless of the buffer.
+ */
+void Communicator::drainQueue()
+{
+    for (int p(0); p < NumPriorities; ++p) {
+        Lane& lane = mLanes[p];
+        while (!lane.queue.empty() && (p == EmergencyPriority || bytesToWrite() < maxPendingBytes())) {
+            QueuedCommand command = lane.queue.front();
+            lane.queue.pop_front();
+
+            qint64 wait = telemetryClock() - command.enqueueTime;
+            lane.sent++;
+            lane.totalWait += wait;
+            lane.maxWait = qMax(lane.maxWait, wait);
+
+            quint64 id = command.message.size() >= 3 ? traceId((uint8_t)command.message[0], (uint8_t)command.message[2]) : 0;
+            Tracer::asyncEnd("command", "queued", id);
+
+            QByteArray frame = frameMessage(command.message);
+            mBytesSentMetric->increment(frame.size());
+            sendMessage(frame);
+            emit commandSent(command.message);
+
+            Tracer::asyncBegin("command", "awaiting report", id);
+        }
+        if (!lane.queue.empty())
+            break;
+    }
+
+    updateCongestion();
+}
+
+/**
+ * @brief Discard all queued commands, e.g. when the connection is lost
+ */
+void Communicator::clearQueue()
+{
+    for (Lane& lane : mLanes)
+        lane.queue.clear();
+    updateCongestion();
+}
+
+/**
+ * @brief Return the statistics of each lane since the last call, and reset them
+ *
+ * Wait times (between queueing and writing a command) are in microseconds.
+ */
+QVariantMap Communicator::queueStatistics()
+{
+    static const char* names[NumPriorities] = { "emergency", "normal", "low" };
+
+    QVariantMap statistics;
+    for (int p(0); p < NumPriorities; ++p) {
+        Lane& lane = mLanes[p];
+        QVariantMap s;
+        s["depth"] = int(lane.queue.size());
+        s["maxDepth"] = int(lane.maxDepth);
+        s["sent"] = lane.sent;
+        s["superseded"] = lane.superseded;
+        s["rejected"] = lane.rejected;
+        s["meanWait"] = lane.sent > 0 ? double(lane.totalWait) / lane.sent : 0.;
+        s["maxWait"] = lane.maxWait;
+        statistics[names[p]] = s;
+
+        lane.sent = lane.superseded = lane.rejected = 0;
+        lane.maxDepth = lane.queue.size();
+        lane.totalWait = lane.maxWait = 0;
+    }
+    return statistics;
+}
+
+/**
+ * @brief Return the key identifying commands that replace each other when queued, or -1 if the command can't be replaced
+ *
+ * Setpoints and telemetry rates are replaced per controller; status and uptime requests are merged.
+ */
+/**
+ * @brief Find the component set by a valve, pump or pressure command, and the value it is set to
+ * @return False if the message is not such a command
+ */
+bool Communicator::parseStateMessage(const QByteArray &message, ShadowState::Component &component, uint &number,
+                                     int &value)
+{
+    if (message.size() < 5)
+        return false;
+
+    switch ((uint8_t)message[0]) {
+        case VALVE:
+            component = ShadowState::Valve;
+            break;
+        case PUMP:
+            component = ShadowState::Pump;
+            break;
+        case PRESSURE:
+            component = ShadowState::Pressure;
+            break;
+        default:
+            return false;
+    }
+    number = (uint8_t)message[2];
+    value = (uint8_t)message[4];
+    return true;
+}
+
+int Communicator::supersessionKey(const QByteArray &message)
+{
+    uint8_t command = message[0];
+    switch (command) {
+        case PRESSURE:
+        case TELEMETRY:
+            return message.size() > 2 ? command << 8 | (uint8_t)message[2] : -1;
+        case STATUS:
+        case UPTIME:
+            return command << 8;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * @brief Emit congestionChanged when the normal lane crosses 3/4 of its capacity, or drains back below 1/4
+ *
+ * Called whenever the queues change; this also updates the queue depth metrics.
+ */
+void Communicator::updateCongestion()
+{
+    for (int p(0); p < NumPriorities; ++p)
+        mQueueDepthMetrics[p]->set(qint64(mLanes[p].queue.size()));
+
+    int depth = int(mLanes[NormalPriority].queue.size());
+    if (!mCongested && depth >= MaxQueueDepth * 3 / 4) {
+        mCongested = true;
+        emit congestionChanged(true);
+    }
+    else if (mCongested && depth <= MaxQueueDepth / 4) {
+        mCongested = false;
+        emit congestionChanged(false);
+    }
+}
+
+QByteArray Communicator::valveMessage(uint valveNumber, bool open)
+{
+    QByteArray message;
+    message.push_back(VALVE);
+    message.push_back(1);
+    message.push_back((uint8_t)valveNumber);
+    message.push_back(1);
+    message.push_back((uint8_t)open);
+    return message;
+}
+
+QByteArray Communicator::pumpMessage(uint pumpNumber, bool on)
+{
+    QByteArray message;
+    message.push_back(PUMP);
+    message.push_back(1);
+    message.push_back((uint8_t)pumpNumber);
+    message.push_back(1);
+    message.push_back((uint8_t)on);
+    return message;
+}
+
+QByteArray Communicator::pressureMessage(uint controllerNumber, uint8_t value)
+{
+    QByteArray message;
+    message.push_back(PRESSURE);
+    message.push_back(1);
+    message.push_back((uint8_t)controllerNumber);
+    message.push_back(1);
+    message.push_back(value);
+    return message;
+}
+
+/**
+ * @brief Send the commands required by the safety rules that were just violated, if any
+ *
+ * This is called from handleCommand, so the commands are sent before any other received message is handled. They go
+ * through the emergency lane, ahead of anything already queued.
+ */
+void Communicator::applyInterlockActions()
+{
+    if (mInterlockActions.empty())
+        return;
+
+    QString rule = mInterlocks.lastTriggeredRule();
+
+    // The requested state is only recorded once the command is on its way
+    auto send = [this, &rule](const QByteArray& message, ShadowState::Component component, uint number, int value) {
+        if (sendCommand(message, EmergencyPriority))
+            setDesired(component, number, value);
+        else
+            qCCritical(lcCommunicator) << "Could not set the" << ShadowState::componentName(component) << number
+                                       << "to" << value << "as required by safety rule:" << rule;
+    };
+
+    bool stopRoutine = false;
+    for (InterlockEngine::Action const& action : mInterlockActions) {
+        switch (action.type) {
+            case InterlockEngine::Action::CloseValve:
+                send(valveMessage(action.number, false), ShadowState::Valve, action.number, 0);
+                break;
+            case InterlockEngine::Action::OpenValve:
+                if (mInterlocks.allowsValve(action.number, true))
+                    send(valveMessage(action.number, true), ShadowState::Valve, action.number, 1);
+                break;
+            case InterlockEngine::Action::SetPressure:
+                send(pressureMessage(action.number, action.value), ShadowState::Pressure, action.number, action.value);
+                break;
+            case InterlockEngine::Action::StopRoutine:
+                stopRoutine = true;
+                break;
+        }
+    }
+    mInterlockActions.clear();
+
+    qCWarning(lcCommunicator) << "Safety rule triggered:" << rule;
+    emit interlockTriggered(rule, stopRoutine);
 }
 
 /**
@@ -116,6 +746,8 @@ void Communicator::requestStatus()
  */
 QByteArray Communicator::frameMessage(QByteArray message)
 {
+    TRACE_SPAN("communicator", "frameMessage");
+
     QByteArray framedMessage;
     framedMessage.push_back(START_BYTE);
 
@@ -141,19 +773,19 @@ void Communicator::logMicrocontrollerMessage(LogLevel level, const QByteArray &m
     switch (level) {
         case LOG_FATAL:
         case LOG_ERROR:
-            qCritical().noquote() << "Microcontroller: " << message;
+            qCCritical(lcCommunicator).noquote() << "Microcontroller: " << message;
             break;
         case LOG_WARNING:
-            qWarning().noquote() << "Microcontroller: " << message;
+            qCWarning(lcCommunicator).noquote() << "Microcontroller: " << message;
             break;
         case LOG_INFO:
-            qInfo().noquote() << "Microcontroller: " << message;
+            qCInfo(lcCommunicator).noquote() << "Microcontroller: " << message;
             break;
         case LOG_DEBUG:
-            qDebug().noquote() << "Microcontroller: " << message;
+            qCDebug(lcCommunicator).noquote() << "Microcontroller: " << message;
             break;
         default:
-            qDebug().noquote() << "Message from microcontroller with unknown level:" << message;
+            qCDebug(lcCommunicator).noquote() << "Message from microcontroller with unknown level:" << message;
             break;
     }
 }
@@ -182,6 +814,8 @@ QByteArray Communicator::decodeBuffer()
     // byte is discarded. When a valid message (i.e. any data framed by a start
     // and end byte) is found, it is returned.
 
+    TRACE_SPAN("communicator", "decodeBuffer");
+
     bool foundCompleteMessage(false);
     int decoderIndex(0);
 
@@ -200,6 +834,7 @@ QByteArray Communicator::decodeBuffer()
             }
             else if (mLastByteWasStart && c >= NUM_COMMANDS) {
                 // Invalid command, we stop right there
+                mFramesRejectedMetrics[UnknownCommand]->increment();
                 mDecoderRecording = false;
                 mLastByteWasStart = false;
                 break;
@@ -216,6 +851,7 @@ QByteArray Communicator::decodeBuffer()
     }
     // Everything that was parsed already should be removed from mBuffer
     mBuffer.remove(0, decoderIndex);
+    mBytesReceivedMetric->increment(decoderIndex);
 
     if (foundCompleteMessage) {
         QByteArray decodedBuffer = mDecodedBuffer;
@@ -236,8 +872,11 @@ void Communicator::parseDecodedBuffer(QByteArray buffer)
     //     command parameter_size param_data [param_size] [param_data] ....
     // With one or more parameters.
 
+    TRACE_SPAN("communicator", "parseDecodedBuffer");
+
     if (buffer.size() < 2) {
-        qWarning() << "parseDecodedBuffer called when the buffer is too short to contain a message";
+        mFramesRejectedMetrics[TooShort]->increment();
+        qCWarning(lcCommunicator) << "parseDecodedBuffer called when the buffer is too short to contain a message";
         return;
     }
 
@@ -257,15 +896,19 @@ void Communicator::parseDecodedBuffer(QByteArray buffer)
                 parameters.push_back(paramData);
             }
             else {
-                qWarning() << "Command parameter incomplete; ignoring command";
+                mFramesRejectedMetrics[IncompleteParameter]->increment();
+                qCWarning(lcCommunicator) << "Command parameter incomplete; ignoring command";
                 return;
             }
             i += paramSize;
         }
+        mFramesDecodedMetric->increment();
         handleCommand(command, parameters);
     }
-    else
-        qDebug() << "Unknown command received. Full buffer: " << buffer;
+    else {
+        mFramesRejectedMetrics[UnknownCommand]->increment();
+        qCDebug(lcCommunicator) << "Unknown command received. Full buffer: " << buffer;
+    }
 }
 
 /**
@@ -278,6 +921,8 @@ void Communicator::parseDecodedBuffer(QByteArray buffer)
  */
 void Communicator::handleCommand(uint8_t command, QList<QByteArray> parameters)
 {
+    TRACE_SPAN("communicator", "handleCommand", command);
+
     int nParameters = parameters.size();
 
     switch (command) {
@@ -285,38 +930,49 @@ void Communicator::handleCommand(uint8_t command, QList<QByteArray> parameters)
             // Should have 2 one-byte parameters: valve number and valve state.
             // State is 0 (closed) or 1 (open)
             if (nParameters != 2)
-                qWarning() << "Invalid number of parameters for VALVE command:" << nParameters;
+                qCWarning(lcCommunicator) << "Invalid number of parameters for VALVE command:" << nParameters;
             else if (parameters[0].length() != 1 || parameters[1].length() != 1)
-                qWarning() << "Invalid parameter sizes for VALVE command";
-            else
+                qCWarning(lcCommunicator) << "Invalid parameter sizes for VALVE command";
+            else {
+                setReported(ShadowState::Valve, (uint8_t)parameters[0][0], (bool)parameters[1][0]);
+                mInterlocks.onValveState((uint8_t)parameters[0][0], (bool)parameters[1][0], mInterlockActions);
+                applyInterlockActions();
                 emit valveStateChanged((uint8_t)parameters[0][0], (bool)parameters[1][0]);
+            }
             break;
 
         case PUMP:
             // Should have 2 one-byte parameters: number and state (0 (off) or 1 (on))
             if (nParameters != 2)
-                qWarning() << "Invalid number of parameters for PUMP command:" << nParameters;
+                qCWarning(lcCommunicator) << "Invalid number of parameters for PUMP command:" << nParameters;
             else if (parameters[0].length() != 1 || parameters[1].length() != 1)
-                qWarning() << "Invalid parameter sizes for PUMP command";
-            else
+                qCWarning(lcCommunicator) << "Invalid parameter sizes for PUMP command";
+            else {
+                setReported(ShadowState::Pump, (uint8_t)parameters[0][0], (bool)parameters[1][0]);
                 emit pumpStateChanged((uint8_t)parameters[0][0], (bool)parameters[1][0]);
+            }
             break;
 
         case PRESSURE:
             // Should have 3 one-byte parameters: number, setpoint and measured value
             if (nParameters != 3)
-                qWarning() << "Invalid number of parameters for PRESSURE command:" << nParameters;
+                qCWarning(lcCommunicator) << "Invalid number of parameters for PRESSURE command:" << nParameters;
             else if (parameters[0].length() != 1 || parameters[1].length() != 1 || parameters[2].length() != 1)
-                qWarning() << "Invalid parameter sizes for PRESSURE command";
+                qCWarning(lcCommunicator) << "Invalid parameter sizes for PRESSURE command";
             else {
                 uint8_t number = parameters[0][0];
                 uint8_t sp = parameters[1][0];
                 uint8_t pv = parameters[2][0];
 
                 if (number == 1){
-                    qDebug() << "Flow layer pressure setpoint vs measured"  << double(sp)/PR_MAX_VALUE << "\t" << double(pv)/PR_MAX_VALUE;
+                    qCDebug(lcCommunicator) << "Flow layer pressure setpoint vs measured"  << double(sp)/PR_MAX_VALUE << "\t" << double(pv)/PR_MAX_VALUE;
                 }
 
+                setReported(ShadowState::Pressure, number, sp);
+                storeLatestMeasurement(number, pv);
+                mInterlocks.onPressure(number, pv, mInterlockActions);
+                applyInterlockActions();
+
                 emit pressureSetpointChanged(number, double(sp)/PR_MAX_VALUE);
                 emit pressureChanged(number, double(pv)/PR_MAX_VALUE);
             }
@@ -325,9 +981,9 @@ void Communicator::handleCommand(uint8_t command, QList<QByteArray> parameters)
         case UPTIME:
             // Should have one 4-byte parameter
             if (nParameters != 1)
-                qWarning() << "Invalid number of parameters for UPTIME command:" << nParameters;
+                qCWarning(lcCommunicator) << "Invalid number of parameters for UPTIME command:" << nParameters;
             else if (parameters[0].length() != 4)
-                qWarning() << "Invalid parameter size for UPTIME command";
+                qCWarning(lcCommunicator) << "Invalid parameter size for UPTIME command";
             else {
                 uint8_t value0 = parameters[0][0];
                 uint8_t value1 = parameters[0][1];
@@ -340,17 +996,22 @@ void Communicator::handleCommand(uint8_t command, QList<QByteArray> parameters)
             break;
 
         case ERROR:
-            qDebug() << "Error received";
+            qCDebug(lcCommunicator) << "Error received";
             break;
 
         case LOG:
             if (nParameters != 2)
-                qWarning() << "Invalid number of parameters for LOG command" << nParameters;
+                qCWarning(lcCommunicator) << "Invalid number of parameters for LOG command" << nParameters;
             else
                 logMicrocontrollerMessage(LogLevel((uint8_t)parameters[0][0]), parameters[1]);
             break;
+
+        case TELEMETRY:
+            handleTelemetry(parameters);
+            break;
+
         default:
-            qWarning() << "Unknown command received:" << int(command);
+            qCWarning(lcCommunicator) << "Unknown command received:" << int(command);
             break;
     }
 
@@ -358,10 +1019,60 @@ void Communicator::handleCommand(uint8_t command, QList<QByteArray> parameters)
 
 
 
+/**
+ * @brief Push the samples of a TELEMETRY command to the ring of their controller
+ *
+ * The last sample is timestamped with the time of reception; earlier samples are back-dated by the
+ * sample interval.
+ */
+void Communicator::handleTelemetry(const QList<QByteArray> &parameters)
+{
+    // Should have 3 parameters: number (1 byte), interval (4 bytes), samples (1 byte each)
+    if (parameters.size() != 3 || parameters[0].length() != 1 || parameters[1].length() != 4 || parameters[2].isEmpty()) {
+        qCWarning(lcCommunicator) << "Invalid parameters for TELEMETRY command";
+        return;
+    }
+
+    uint controllerNumber = (uint8_t)parameters[0][0];
+    SpscRing<TelemetrySample>* ring = telemetryRing(controllerNumber);
+    if (!ring) {
+        qCWarning(lcCommunicator) << "TELEMETRY command received for unknown controller" << controllerNumber;
+        return;
+    }
+
+    const QByteArray& p = parameters[1];
+    qint64 interval = qint64((uint8_t)p[0]) << 24 | (uint8_t)p[1] << 16 | (uint8_t)p[2] << 8 | (uint8_t)p[3];
+
+    const QByteArray& samples = parameters[2];
+    int n = samples.size();
+    qint64 now = telemetryClock();
+
+    for (int i(0); i < n; ++i) {
+        TelemetrySample sample;
+        sample.timestamp = now - (n - 1 - i) * interval;
+        sample.value = float((uint8_t)samples[i]) / PR_MAX_VALUE;
+        ring->push(sample);
+
+        if (mSharedTelemetry)
+            mSharedTelemetry->record(UFCS_SHM_TELEMETRY, controllerNumber, (uint8_t)samples[i], sample.timestamp);
+
+        mInterlocks.onPressure(controllerNumber, (uint8_t)samples[i], mInterlockActions);
+    }
+    applyInterlockActions();
+
+    storeLatestMeasurement(controllerNumber, (uint8_t)samples[n-1]);
+}
+
 void Communicator::setConnectionStatus(ConnectionStatus status)
 {
     if (status != mConnectionStatus) {
         mConnectionStatus = status;
+        if (status == Disconnected) {
+            clearQueue();
+            failAllConfirmations();
+        }
+        else if (status == Connected)
+            mShadow.forgetReported(shadowClock());
         emit connectionStatusChanged(status);
     }
 }
@@ -1,20 +1,30 @@
 #ifndef COMMUNICATOR_H
 #define COMMUNICATOR_H
 
+#include <deque>
+
 #include <QtCore>
 
 #include "constants.h"
+#include "telemetry.h"
+#include "interlocks.h"
+#include "shadowstate.h"
+#include "commandsink.h"
+#include "metrics.h"
+#include "tracing.h"
 
 class ApplicationController;
+class SharedTelemetry;
 
 
 /**
  * @brief The Communicator class provides an interface to the microcontroller
  *
  * Communicator is an abstract class, with SerialCommunicator and BluetoothCommunicator handling
- * the specifics related to USB and Bluetooth communication.
+ * the specifics related to USB and Bluetooth communication, and the subclasses of StreamCommunicator those of
+ * sockets (e.g. to a serial-to-Ethernet bridge).
  *
- * In both cases, the microcontroller is automatically detected; a call to `connect()` is all that
+ * With USB and Bluetooth, the microcontroller is automatically detected; a call to `connect()` is all that
  * is necessary to connect to it.
  * Connection status can be checked using the getConnectionStatus() and getConnectionStatusString()
  * functions, or better, by connecting to the connectionStatusChanged signal.
@@ -28,6 +38,36 @@ class ApplicationController;
  *  are emitted whenever the microcontroller communicates the current status of a component.
  * Connect to these to know the current status of the hardware.
  *
+ * Pressure controllers can also stream their measured pressure at a fixed rate (see setTelemetryRate). These
+ * samples don't go through pressureChanged; they are pushed to a lock-free ring per controller (telemetryRing),
+ * which is drained by a TelemetryPublisher, and, if set, recorded into shared memory (setSharedTelemetry).
+ *
+ * Every valve state and pressure measurement received is checked against the safety rules of interlocks() as soon as
+ * it is decoded, in handleCommand. The commands required by a violated rule are sent right away, before the next
+ * received message is handled, and commands to open a valve are refused while its requirements aren't met.
+ *
+ * Outgoing commands are not written to the device straight away: they go through one of several queues ("lanes"),
+ * and are written when the backend's write buffer is nearly empty (see bytesToWrite). The emergency lane, used by
+ * safety rules and emergencyStop(), always goes first; then the normal lane (valves, pumps and setpoints); then the
+ * low-priority lane (status requests and telemetry settings). This way, a safety command waits behind at most a
+ * few bytes, whatever was queued before it. Each lane is bounded: when it is full, new commands are refused, and
+ * congestionChanged() tells senders to slow down. A setpoint that is still queued when a newer one is sent for
+ * the same controller is replaced rather than sent twice; valve commands are never merged, as sequences of
+ * valve actuations (e.g. peristaltic pumping) must be played in full.
+ *
+ * The state requested for each valve, pump and pressure controller is kept alongside the state last reported by
+ * the microcontroller (see shadowState()). Commands that would not change anything (the component was requested and
+ * reported to be in that state already) are dropped; components that don't reach the requested state within
+ * the mismatch timeout are reported by stateMismatch(). After reconnecting, resynchronize() writes the requested
+ * state back to the device in a single batch.
+ *
+ * When tracing is on (see Tracer), each command is traced from sendCommand() to the microcontroller's report of the
+ * requested state: the time spent in the queue and the time waiting for the report are asynchronous spans,
+ * identified by traceId().
+ *
+ * All of the above must be called from the thread the Communicator lives in. Other threads can send commands
+ * through commandSink(), which also tells them when the microcontroller has confirmed the requested state.
+ *
  * In order to know how many components are available, and what pressures are supported by the pressure controllers,
  * use the nValves, nPumps, nPressureControllers, minPressure and maxPressure functions.
  *
@@ -44,6 +84,11 @@ class ApplicationController;
  * (Serial/BluetoothCommunicator) uses; they are added to mBuffer, then the following methods
  * are called: decodeBuffer -> parseDecodedBuffer -> handleCommand.
  *
+ * TELEMETRY commands have the following parameters:
+ *   - host to microcontroller: controller number [1B], rate in Hz [2B, big-endian]. A rate of 0 stops streaming.
+ *   - microcontroller to host: controller number [1B], sample interval in microseconds [4B, big-endian],
+ *     then one or more samples [1B each, 0-PR_MAX_VALUE], oldest first.
+ *
  */
 class Communicator : public QObject
 {
@@ -56,12 +101,48 @@ public:
         Connected
     };
 
+    enum CommandPriority {
+        EmergencyPriority,
+        NormalPriority,
+        LowPriority,
+        NumPriorities
+    };
+
+    /// Outcome of requestState()
+    enum RequestResult {
+        RequestSent,
+        RequestRedundant,
+        RequestRefused
+    };
+
+    /// Maximum number of commands waiting in each lane
+    static const int MaxQueueDepth = 128;
+
+    /// Commands are only written when fewer than this many bytes are waiting in the backend's write buffer
+    static const int MaxPendingBytes = 32;
+
     Communicator(ApplicationController* applicationController);
     virtual ~Communicator ();
 
     ConnectionStatus getConnectionStatus() const;
     QString getConnectionStatusString() const;
 
+    SpscRing<TelemetrySample>* telemetryRing(uint controllerNumber);
+    bool latestMeasurement(uint controllerNumber, double& value, quint32& sequence) const;
+
+    InterlockEngine& interlocks() { return mInterlocks; }
+
+    bool isCongested() const { return mCongested; }
+    QVariantMap queueStatistics();
+
+    const ShadowState& shadowState() const { return mShadow; }
+    CommandSink& commandSink() { return mCommandSink; }
+    RequestResult requestState(ShadowState::Component component, uint number, int value);
+    void setMismatchTimeout(int milliseconds);
+    void setSharedTelemetry(SharedTelemetry* shared) { mSharedTelemetry = shared; }
+
+    /// Identifies the commands sent to a component, and its reports, in traces
+    static quint64 traceId(uint8_t command, uint number) { return quint64(command) << 8 | number; }
 
 public slots:
     virtual void connect() = 0;
@@ -69,6 +150,10 @@ public slots:
     void setPressure(uint controllerNumber, double pressure);
     void setPump(uint pumpNumber, bool on);
     void requestStatus();
+    void requestUptime();
+    void setTelemetryRate(uint controllerNumber, uint rate);
+    void emergencyStop();
+    void resynchronize();
 
 signals:
     void valveStateChanged(uint valveNumber, bool open);
@@ -79,9 +164,32 @@ signals:
 
     void connectionStatusChanged(ConnectionStatus newStatus);
 
+    /// Emitted whenever a command is sent to the microcontroller. The message is not framed.
+    void commandSent(QByteArray message);
+
+    /// Emitted when a safety rule was violated, after the commands it requires were sent
+    void interlockTriggered(QString rule, bool stopRoutine);
+
+    /// Emitted when the normal lane becomes nearly full (congested is true), and when it has mostly drained again
+    void congestionChanged(bool congested);
+
+    /// Emitted when a component has not been reported in the requested state for longer than the mismatch timeout
+    void stateMismatch(QString component, uint number);
+
 protected:
     void setConnectionStatus(ConnectionStatus status);
     QByteArray frameMessage(QByteArray message);
+    bool sendCommand(const QByteArray& message, CommandPriority priority = NormalPriority);
+    void drainQueue();
+    void clearQueue();
+
+    /// Number of bytes written but not yet sent by the backend. Subclasses must call drainQueue() when it decreases.
+    virtual qint64 bytesToWrite() const { return 0; }
+    /// Commands are only written while bytesToWrite() is below this; MaxPendingBytes unless the backend batches writes
+    virtual qint64 maxPendingBytes() const { return MaxPendingBytes; }
+    static QByteArray valveMessage(uint valveNumber, bool open);
+    static QByteArray pressureMessage(uint controllerNumber, uint8_t value);
+    static QByteArray pumpMessage(uint pumpNumber, bool on);
     virtual void sendMessage(QByteArray message) = 0;
     void logMicrocontrollerMessage(LogLevel level, QByteArray const& message);
 
@@ -95,6 +203,25 @@ protected:
     void parseDecodedBuffer(QByteArray buffer);
     void handleCommand(uint8_t command, QList<QByteArray> parameters);
 
+    void handleTelemetry(const QList<QByteArray>& parameters);
+    void applyInterlockActions();
+
+    InterlockEngine mInterlocks;
+
+    /// Actions required by the safety rules, reused to avoid allocating for each message
+    std::vector<InterlockEngine::Action> mInterlockActions;
+
+    /// Samples received in telemetry mode, one ring per pressure controller
+    std::vector<std::unique_ptr<SpscRing<TelemetrySample>>> mTelemetryRings;
+
+    /// Where streamed samples are published for other processes as they are decoded; may be null
+    SharedTelemetry* mSharedTelemetry;
+
+    /// Latest measured pressure of each controller, from PRESSURE or TELEMETRY commands, readable from any thread.
+    /// The low byte is the raw value (0-PR_MAX_VALUE); the upper bytes count the measurements received.
+    std::atomic<quint32> mLatestMeasurement[N_PRS];
+    void storeLatestMeasurement(uint controllerNumber, uint8_t value);
+
     QByteArray mDecodedBuffer;
     bool mDecoderRecording;
     bool mDecoderEscaped;
@@ -102,8 +229,74 @@ protected:
 
     ApplicationController* appController;
 
+private slots:
+    void processSubmittedCommands();
+
+private:
+    struct PendingConfirmation {
+        ShadowState::Component component;
+        uint number;
+        int value;
+        std::promise<bool> promise;
+    };
+
+    struct QueuedCommand {
+        QByteArray message;
+        int key;                // See supersessionKey()
+        qint64 enqueueTime;     // telemetryClock()
+    };
+
+    struct Lane {
+        std::deque<QueuedCommand> queue;
+        quint64 sent;
+        quint64 superseded;
+        quint64 rejected;
+        size_t maxDepth;
+        qint64 totalWait;
+        qint64 maxWait;
+    };
+
+    static bool parseStateMessage(const QByteArray& message, ShadowState::Component& component, uint& number,
+                                  int& value);
+    static int supersessionKey(const QByteArray& message);
+    void updateCongestion();
+    void checkShadowState();
+    static qint64 shadowClock() { return telemetryClock() / 1000; }
+
+    void setDesired(ShadowState::Component component, uint number, int value);
+    void setReported(ShadowState::Component component, uint number, int value);
+    void failConfirmations(ShadowState::Component component, uint number);
+    void forgetQueuedCommand(const QByteArray& message);
+    void failAllConfirmations();
+    void resolveConfirmation(size_t index, bool confirmed);
+
+    Lane mLanes[NumPriorities];
+    bool mCongested;
+
+    enum RejectionReason {
+        UnknownCommand,
+        IncompleteParameter,
+        TooShort,
+        NumRejectionReasons
+    };
+
+    MetricsRegistry::Metric* mBytesReceivedMetric;
+    MetricsRegistry::Metric* mBytesSentMetric;
+    MetricsRegistry::Metric* mFramesDecodedMetric;
+    MetricsRegistry::Metric* mFramesRejectedMetrics[NumRejectionReasons];
+    MetricsRegistry::Metric* mQueueDepthMetrics[NumPriorities];
+
+    ShadowState mShadow;
+    QTimer mShadowTimer;
+    int mMismatchTimeout;
+
+    CommandSink mCommandSink;
+    std::vector<PendingConfirmation> mPendingConfirmations;
+
 #ifdef TESTING
     friend class TestCommunicator;
+    friend class TestMetrics;
+    friend class TestTracing;
 #endif
 
 };
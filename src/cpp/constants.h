@@ -29,6 +29,7 @@ enum Command : uint8_t {
     UPTIME,
     ERROR,
     LOG,
+    TELEMETRY,
     NUM_COMMANDS
 };
 
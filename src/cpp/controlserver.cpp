@@ -0,0 +1,284 @@
+#include "controlserver.h"
+#include "routinecontroller.h"
+#include "logger.h"
+
+ControlServer::ControlServer(Communicator *communicator, QObject *parent)
+    : QObject(parent)
+    , mCommunicator(communicator)
+    , mRoutineController(nullptr)
+    , mFlushScheduled(false)
+{
+    MetricsRegistry* metrics = MetricsRegistry::registry();
+    mClientsMetric = &metrics->gauge("ufcs_control_clients", "Clients connected to the control socket");
+    mRequestsMetric = &metrics->counter("ufcs_control_requests_total", "Requests received on the control socket");
+    mEventsDroppedMetric = &metrics->counter("ufcs_control_events_dropped_total",
+                                             "Events not sent to control clients that were too slow to read them");
+
+    connect(&mServer, &QLocalServer::newConnection, this, &ControlServer::onNewConnection);
+
+    connect(mCommunicator, &Communicator::valveStateChanged, this, [this](uint number, bool open) {
+        publish(ValveEvent, number, open);
+    });
+    connect(mCommunicator, &Communicator::pumpStateChanged, this, [this](uint number, bool on) {
+        publish(PumpEvent, number, on);
+    });
+    connect(mCommunicator, &Communicator::pressureSetpointChanged, this, [this](uint number, double pressure) {
+        publish(SetpointEvent, number, qRound(pressure * PR_MAX_VALUE));
+    });
+    connect(mCommunicator, &Communicator::pressureChanged, this, [this](uint number, double pressure) {
+        publish(PressureEvent, number, qRound(pressure * PR_MAX_VALUE));
+    });
+    connect(mCommunicator, &Communicator::connectionStatusChanged, this, [this](Communicator::ConnectionStatus status) {
+        publish(ConnectionEvent, 0, status);
+    });
+}
+
+/**
+ * @brief Start serving on the local socket with the given name (or full path), accessible to the current user only
+ *
+ * A socket file left behind by a process that didn't exit cleanly is removed; one in use by another process is not.
+ */
+bool ControlServer::listen(const QString &name)
+{
+    mServer.setSocketOptions(QLocalServer::UserAccessOption);
+
+    if (!mServer.listen(name) && mServer.serverError() == QAbstractSocket::AddressInUseError) {
+        QLocalSocket probe;
+        probe.connectToServer(name);
+        if (!probe.waitForConnected(100)) {
+            QLocalServer::removeServer(name);
+            mServer.listen(name);
+        }
+    }
+
+    if (!mServer.isListening()) {
+        qCWarning(lcGui) << "Could not open the control socket" << name << ":" << mServer.errorString();
+        return false;
+    }
+
+    qCInfo(lcGui) << "Control socket listening on" << mServer.fullServerName();
+    return true;
+}
+
+/**
+ * @brief Return a message of the given type, framed with its length
+ */
+QByteArray ControlServer::message(quint8 type, quint32 id, const QByteArray &payload)
+{
+    QByteArray m;
+    m.reserve(HeaderSize + payload.size());
+
+    QDataStream stream(&m, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << quint32(HeaderSize - 4 + payload.size()) << type << id;
+    m += payload;
+    return m;
+}
+
+void ControlServer::onNewConnection()
+{
+    while (QLocalSocket* socket = mServer.nextPendingConnection()) {
+        mClients.insert(socket, Client { QByteArray(), 0 });
+        mClientsMetric->increment();
+
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket] { onReadyRead(socket); });
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket] {
+            if (mClients.remove(socket))
+                mClientsMetric->decrement();
+            mPendingFlush.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void ControlServer::onReadyRead(QLocalSocket *socket)
+{
+    auto client = mClients.find(socket);
+    if (client == mClients.end())
+        return;
+
+    QByteArray& buffer = client->buffer;
+    buffer += socket->readAll();
+
+    QByteArray replies;
+    int offset = 0;
+    while (buffer.size() - offset >= 4) {
+        quint32 length = qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(buffer.constData() + offset));
+        if (length < HeaderSize - 4 || length > MaxMessageSize) {
+            qCWarning(lcGui) << "Invalid message on the control socket; disconnecting client";
+            socket->abort();
+            return;
+        }
+        if (buffer.size() - offset < int(4 + length))
+            break;
+
+        const uchar* header = reinterpret_cast<const uchar*>(buffer.constData() + offset + 4);
+        quint8 type = header[0];
+        quint32 id = qFromLittleEndian<quint32>(header + 1);
+        QByteArray payload = buffer.mid(offset + HeaderSize, int(length) - (HeaderSize - 4));
+
+        mRequestsMetric->increment();
+        replies += handleRequest(type, id, payload, *client);
+        offset += 4 + int(length);
+    }
+    buffer.remove(0, offset);
+
+    // All the replies to what was received together go out in one write
+    if (!replies.isEmpty()) {
+        socket->write(replies);
+        socket->flush();
+    }
+}
+
+QByteArray ControlServer::handleRequest(quint8 type, quint32 id, const QByteArray &payload, Client &client)
+{
+    switch (type) {
+        case Ping: {
+            QByteArray reply(8, 0);
+            qToLittleEndian<qint64>(telemetryClock(), reinterpret_cast<uchar*>(reply.data()));
+            return message(Ping | ReplyFlag, id, reply);
+        }
+        case Commands: {
+            QByteArray results = runCommands(payload);
+            if (results.isEmpty())
+                break;
+            return message(Commands | ReplyFlag, id, results);
+        }
+        case GetState:
+            return message(GetState | ReplyFlag, id, state());
+        case Subscribe:
+            if (payload.size() != 4)
+                break;
+            client.subscriptions = qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(payload.constData()));
+            return message(Subscribe | ReplyFlag, id);
+        case Trigger:
+            if (!mRoutineController || payload.isEmpty())
+                break;
+            mRoutineController->fireTrigger(QString::fromUtf8(payload));
+            return message(Trigger | ReplyFlag, id);
+        default:
+            break;
+    }
+
+    qCDebug(lcGui) << "Invalid request of type" << type << "on the control socket";
+    return message(ErrorReply, id);
+}
+
+/**
+ * @brief Request the state given by each command of a Commands request, in order
+ * @return The payload of the reply, or an empty array if the request is malformed
+ */
+QByteArray ControlServer::runCommands(const QByteArray &payload)
+{
+    if (payload.size() < 2)
+        return QByteArray();
+
+    const uchar* data = reinterpret_cast<const uchar*>(payload.constData());
+    quint16 count = qFromLittleEndian<quint16>(data);
+    if (payload.size() != 2 + 3 * count)
+        return QByteArray();
+
+    QByteArray results(2 + count, 0);
+    qToLittleEndian<quint16>(count, reinterpret_cast<uchar*>(results.data()));
+
+    const ShadowState& shadow = mCommunicator->shadowState();
+    for (int i(0); i < count; ++i) {
+        const uchar* command = data + 2 + 3 * i;
+        uint number = command[1];
+        int value = command[2];
+
+        CommandResult result = CommandInvalid;
+        if (command[0] < ShadowState::NumComponents) {
+            ShadowState::Component component = ShadowState::Component(command[0]);
+            bool valid = number >= 1 && number <= shadow.count(component)
+                         && (component == ShadowState::Pressure || value <= 1);
+
+            if (valid) {
+                switch (mCommunicator->requestState(component, number, value)) {
+                    case Communicator::RequestSent:
+                        result = CommandSent;
+                        break;
+                    case Communicator::RequestRedundant:
+                        result = CommandRedundant;
+                        break;
+                    case Communicator::RequestRefused:
+                        result = CommandRefused;
+                        break;
+                }
+            }
+        }
+        results[2 + i] = char(result);
+    }
+
+    return results;
+}
+
+/**
+ * @brief Return the payload of a GetState reply: the connection status, then the shadow state of each component
+ */
+QByteArray ControlServer::state() const
+{
+    const ShadowState& shadow = mCommunicator->shadowState();
+
+    QByteArray s;
+    QDataStream stream(&s, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    stream << quint8(mCommunicator->getConnectionStatus());
+    for (int c(0); c < ShadowState::NumComponents; ++c) {
+        ShadowState::Component component = ShadowState::Component(c);
+        stream << quint8(shadow.count(component));
+        for (uint n(1); n <= shadow.count(component); ++n) {
+            const ShadowState::Entry* e = shadow.entry(component, n);
+            stream << qint16(e->desired) << qint16(e->reported);
+        }
+    }
+    return s;
+}
+
+/**
+ * @brief Queue an event for the clients subscribed to its kind; they are written at the end of the event loop pass
+ */
+void ControlServer::publish(EventKind kind, uint number, int value)
+{
+    if (mClients.isEmpty())
+        return;
+
+    QByteArray event;
+    for (auto it = mClients.begin(); it != mClients.end(); ++it) {
+        if (!(it->subscriptions & (1u << kind)))
+            continue;
+
+        QLocalSocket* socket = it.key();
+        if (socket->bytesToWrite() > MaxPendingBytes) {
+            mEventsDroppedMetric->increment();
+            continue;
+        }
+
+        if (event.isEmpty()) {
+            QByteArray payload(12, 0);
+            uchar* p = reinterpret_cast<uchar*>(payload.data());
+            p[0] = kind;
+            p[1] = uchar(number);
+            qToLittleEndian<qint16>(qint16(value), p + 2);
+            qToLittleEndian<qint64>(telemetryClock(), p + 4);
+            event = message(Event, 0, payload);
+        }
+
+        socket->write(event);
+        mPendingFlush.insert(socket);
+    }
+
+    if (!mPendingFlush.isEmpty() && !mFlushScheduled) {
+        mFlushScheduled = true;
+        QTimer::singleShot(0, this, &ControlServer::flushEvents);
+    }
+}
+
+void ControlServer::flushEvents()
+{
+    mFlushScheduled = false;
+    for (QLocalSocket* socket : mPendingFlush)
+        socket->flush();
+    mPendingFlush.clear();
+}
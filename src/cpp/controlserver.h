@@ -0,0 +1,121 @@
+#ifndef CONTROLSERVER_H
+#define CONTROLSERVER_H
+
+#include <QtCore>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+#include "communicator.h"
+#include "metrics.h"
+
+class RoutineController;
+
+/**
+ * @brief The ControlServer class lets other local processes send commands to the microcontroller and follow its
+ * state, over a local socket (a Unix domain socket, or a named pipe on Windows).
+ *
+ * The protocol is binary; integers are little-endian. Each message, in either direction, is:
+ *
+ *   Length [4B, bytes after this field] | Type [1B] | Request ID [4B] | Payload
+ *
+ * Requests, and the payload of their replies (whose type is the request's, plus 0x80, with the same ID):
+ *
+ *   - Ping (1): empty. Reply: the server's clock (telemetryClock) [8B], to measure round trips and align clocks.
+ *   - Commands (2): count [2B], then for each command: component [1B: 0 valve, 1 pump, 2 pressure], number [1B],
+ *     value [1B: 0 or 1 for valves and pumps, raw setpoint 0-255 for pressure controllers]. The commands are
+ *     queued in order, in one go. Reply: count [2B], then one result per command [1B: 0 sent, 1 already in that
+ *     state, 2 refused (not connected, full queue or safety rule), 3 invalid].
+ *   - Get state (3): empty. Reply: connection status [1B: 0 disconnected, 1 connecting, 2 connected], then for
+ *     valves, pumps and pressure controllers: count [1B], then for each: requested and reported value [2B each,
+ *     signed, -1 if unknown].
+ *   - Subscribe (4): event mask [4B: bit 0 valves, 1 pumps, 2 setpoints, 3 measured pressures, 4 connection
+ *     status]; 0 unsubscribes. Reply: empty.
+ *   - Trigger (5): trigger name [UTF-8, the rest of the payload], passed to RoutineController::fireTrigger.
+ *     Reply: empty, once the routine thread has been woken up.
+ *
+ * Unknown or malformed requests are answered with type 0xFF and an empty payload.
+ *
+ * Subscribers receive events (type 0x40, ID 0): kind [1B, as the bits of the mask], number [1B], value [2B,
+ * signed, raw as above; the connection status for kind 4], timestamp [8B, telemetryClock]. Events reach a
+ * client only while it reads them: once a megabyte is waiting to be written to it, further events are dropped.
+ *
+ * Replies are written as soon as all the requests received together have been handled; events produced during
+ * one pass of the event loop are written together at its end.
+ */
+class ControlServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum MessageType : quint8 {
+        Ping = 1,
+        Commands = 2,
+        GetState = 3,
+        Subscribe = 4,
+        Trigger = 5,
+        Event = 0x40,
+        ReplyFlag = 0x80,
+        ErrorReply = 0xFF
+    };
+
+    enum EventKind : quint8 {
+        ValveEvent,
+        PumpEvent,
+        SetpointEvent,
+        PressureEvent,
+        ConnectionEvent
+    };
+
+    enum CommandResult : quint8 {
+        CommandSent,
+        CommandRedundant,
+        CommandRefused,
+        CommandInvalid
+    };
+
+    static const int HeaderSize = 9;
+    static const int MaxMessageSize = 65536;
+    static const qint64 MaxPendingBytes = 1 << 20;
+
+    explicit ControlServer(Communicator* communicator, QObject* parent = nullptr);
+
+    bool listen(const QString& name);
+    void setRoutineController(RoutineController* routineController) { mRoutineController = routineController; }
+    QString fullServerName() const { return mServer.fullServerName(); }
+    int clientCount() const { return mClients.size(); }
+
+    static QByteArray message(quint8 type, quint32 id, const QByteArray& payload = QByteArray());
+
+private slots:
+    void onNewConnection();
+    void flushEvents();
+
+private:
+    struct Client {
+        QByteArray buffer;
+        quint32 subscriptions;
+    };
+
+    void onReadyRead(QLocalSocket* socket);
+    QByteArray handleRequest(quint8 type, quint32 id, const QByteArray& payload, Client& client);
+    QByteArray runCommands(const QByteArray& payload);
+    QByteArray state() const;
+    void publish(EventKind kind, uint number, int value);
+
+    Communicator* mCommunicator;
+    RoutineController* mRoutineController;
+    QHash<QLocalSocket*, Client> mClients;
+
+    /// Clients written to since the last flush
+    QSet<QLocalSocket*> mPendingFlush;
+    bool mFlushScheduled;
+
+    /// Declared after the client lists, so that the sockets (its children) are disconnected while those still exist
+    QLocalServer mServer;
+
+    MetricsRegistry::Metric* mClientsMetric;
+    MetricsRegistry::Metric* mRequestsMetric;
+    MetricsRegistry::Metric* mEventsDroppedMetric;
+};
+
+#endif // CONTROLSERVER_H
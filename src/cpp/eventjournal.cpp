@@ -0,0 +1,411 @@
+#include "eventjournal.h"
+#include "logger.h"
+
+#include <cstring>
+
+namespace {
+
+const char JournalMagic[4] = {'U', 'F', 'E', 'J'};
+const quint32 JournalVersion = 1;
+const quint32 RecordAlignment = 8;
+
+qint64 padded(qint64 size)
+{
+    return (size + RecordAlignment - 1) / RecordAlignment * RecordAlignment;
+}
+
+}
+
+JournalState::JournalState()
+    : connectionStatus(0)
+    , routineStep(-1)
+{
+    memset(valves, Unknown, sizeof(valves));
+    memset(pumps, Unknown, sizeof(pumps));
+    for (int i(0); i < N_PRS; ++i) {
+        setpoints[i] = -1;
+        measured[i] = -1;
+    }
+}
+
+
+EventJournal::EventJournal(QObject *parent)
+    : QObject(parent)
+    , mChunkSize(16*1024*1024)
+    , mChunkOffset(0)
+    , mMappedChunk(nullptr)
+    , mWritePosition(0)
+    , mSequence(0)
+    , mLastSnapshot(0)
+    , mSnapshotInterval(10LL*1000*1000*1000)
+{
+}
+
+EventJournal::~EventJournal()
+{
+    close();
+}
+
+/**
+ * @brief Return the directory in which journal files are saved by default
+ */
+QString EventJournal::journalDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/journal";
+}
+
+/**
+ * @brief Create a new journal file. If the file exists, it is overwritten.
+ */
+bool EventJournal::open(const QString &filePath)
+{
+    close();
+
+    QFileInfo info(filePath);
+    QDir().mkpath(info.absolutePath());
+
+    mFile.setFileName(filePath);
+    if (!mFile.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        qCWarning(lcCommunicator) << "Could not open journal file" << filePath << ":" << mFile.errorString();
+        return false;
+    }
+
+    mSequence = 0;
+    mState = JournalState();
+    mWritePosition = 0;
+    if (!mapChunk(0))
+        return false;
+
+    JournalFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, JournalMagic, 4);
+    header.version = JournalVersion;
+    header.startTime = QDateTime::currentMSecsSinceEpoch();
+    header.recordAlignment = RecordAlignment;
+    mClock.start();
+
+    memcpy(mMappedChunk, &header, sizeof(header));
+    mWritePosition = sizeof(header);
+
+    writeSnapshot();
+
+    qCInfo(lcCommunicator) << "Recording events to" << filePath;
+    return true;
+}
+
+/**
+ * @brief Close the journal, truncating the file to the size that was actually written
+ */
+void EventJournal::close()
+{
+    if (!mMappedChunk)
+        return;
+
+    mFile.unmap(mMappedChunk);
+    mMappedChunk = nullptr;
+    mFile.resize(mWritePosition);
+    mFile.close();
+}
+
+/**
+ * @brief Grow the file if necessary, and map the chunk starting at the given offset
+ */
+bool EventJournal::mapChunk(qint64 offset)
+{
+    if (mMappedChunk) {
+        mFile.unmap(mMappedChunk);
+        mMappedChunk = nullptr;
+    }
+
+    if (mFile.size() < offset + mChunkSize && !mFile.resize(offset + mChunkSize)) {
+        qCWarning(lcCommunicator) << "Could not grow journal file:" << mFile.errorString();
+        mFile.close();
+        return false;
+    }
+
+    mMappedChunk = mFile.map(offset, mChunkSize);
+    if (!mMappedChunk) {
+        qCWarning(lcCommunicator) << "Could not map journal file:" << mFile.errorString();
+        mFile.close();
+        return false;
+    }
+    mChunkOffset = offset;
+    return true;
+}
+
+void EventJournal::append(JournalRecordType type, const void *payload, quint16 size)
+{
+    if (!mMappedChunk)
+        return;
+
+    qint64 timestamp = mClock.nsecsElapsed();
+
+    // Snapshots are written before the event that triggers them, so that they only contain past events
+    if (type != JournalSnapshot && timestamp - mLastSnapshot >= mSnapshotInterval)
+        writeSnapshot();
+
+    qint64 recordSize = padded(sizeof(JournalRecordHeader) + size);
+
+    // The end marker (an all-zero header) following each record must fit in the same chunk
+    if (mWritePosition + recordSize + qint64(sizeof(JournalRecordHeader)) > mChunkOffset + mChunkSize) {
+        // Map the next chunk starting at the current write position, rounded down to the alignment
+        if (!mapChunk(mWritePosition / 4096 * 4096))
+            return;
+    }
+
+    JournalRecordHeader header;
+    header.timestamp = quint64(timestamp);
+    header.type = type;
+    header.size = size;
+    header.sequence = mSequence++;
+
+    uchar* p = mMappedChunk + (mWritePosition - mChunkOffset);
+    memcpy(p + sizeof(header), payload, size);
+    memcpy(p, &header, sizeof(header));
+
+    mWritePosition += recordSize;
+}
+
+void EventJournal::writeSnapshot()
+{
+    mLastSnapshot = mClock.nsecsElapsed();
+    append(JournalSnapshot, &mState, sizeof(mState));
+}
+
+void EventJournal::recordCommandSent(QByteArray message)
+{
+    append(JournalCommandSent, message.constData(), quint16(qMin(message.size(), 0xFFFF)));
+}
+
+void EventJournal::recordValveState(uint valveNumber, bool open)
+{
+    if (valveNumber >= 1 && valveNumber <= N_VALVES)
+        mState.valves[valveNumber-1] = open;
+
+    quint8 payload[2] = { quint8(valveNumber), quint8(open) };
+    append(JournalValveState, payload, sizeof(payload));
+}
+
+void EventJournal::recordPumpState(uint pumpNumber, bool on)
+{
+    if (pumpNumber >= 1 && pumpNumber <= N_PUMPS)
+        mState.pumps[pumpNumber-1] = on;
+
+    quint8 payload[2] = { quint8(pumpNumber), quint8(on) };
+    append(JournalPumpState, payload, sizeof(payload));
+}
+
+void EventJournal::recordPressureSetpoint(uint controllerNumber, double value)
+{
+    float v = float(value);
+    if (controllerNumber >= 1 && controllerNumber <= N_PRS) {
+        if (mState.setpoints[controllerNumber-1] == v)
+            return;
+        mState.setpoints[controllerNumber-1] = v;
+    }
+
+    uchar payload[5];
+    payload[0] = quint8(controllerNumber);
+    memcpy(payload + 1, &v, sizeof(v));
+    append(JournalPressureSetpoint, payload, sizeof(payload));
+}
+
+void EventJournal::recordPressureMeasured(uint controllerNumber, double value)
+{
+    float v = float(value);
+    if (controllerNumber >= 1 && controllerNumber <= N_PRS) {
+        if (mState.measured[controllerNumber-1] == v)
+            return;
+        mState.measured[controllerNumber-1] = v;
+    }
+
+    uchar payload[5];
+    payload[0] = quint8(controllerNumber);
+    memcpy(payload + 1, &v, sizeof(v));
+    append(JournalPressureMeasured, payload, sizeof(payload));
+}
+
+void EventJournal::recordRoutineStep(int stepNumber, QString stepText)
+{
+    mState.routineStep = stepNumber;
+
+    QByteArray payload(reinterpret_cast<const char*>(&stepNumber), sizeof(qint32));
+    payload.append(stepText.toUtf8().left(0xFFFF - sizeof(qint32)));
+    append(JournalRoutineStep, payload.constData(), quint16(payload.size()));
+}
+
+void EventJournal::recordConnectionStatus(int status)
+{
+    mState.connectionStatus = quint8(status);
+
+    quint8 payload = quint8(status);
+    append(JournalConnectionStatus, &payload, sizeof(payload));
+}
+
+
+JournalReader::JournalReader()
+    : mData(nullptr)
+    , mSize(0)
+    , mEndTimestamp(0)
+{
+}
+
+JournalReader::~JournalReader()
+{
+    close();
+}
+
+bool JournalReader::open(const QString &filePath)
+{
+    close();
+
+    mFile.setFileName(filePath);
+    if (!mFile.open(QIODevice::ReadOnly))
+        return false;
+
+    mSize = mFile.size();
+    if (mSize < qint64(sizeof(JournalFileHeader))) {
+        mFile.close();
+        return false;
+    }
+
+    mData = mFile.map(0, mSize);
+    if (!mData) {
+        mFile.close();
+        return false;
+    }
+
+    memcpy(&mHeader, mData, sizeof(mHeader));
+    if (memcmp(mHeader.magic, JournalMagic, 4) != 0 || mHeader.version != JournalVersion) {
+        close();
+        return false;
+    }
+
+    // Locate the snapshots
+    Record r;
+    qint64 offset = sizeof(JournalFileHeader);
+    qint64 next;
+    while (readRecord(offset, r, next)) {
+        if (r.type == JournalSnapshot)
+            mSnapshots.push_back(std::make_pair(r.timestamp, offset));
+        mEndTimestamp = r.timestamp;
+        offset = next;
+    }
+
+    return true;
+}
+
+void JournalReader::close()
+{
+    if (mData) {
+        mFile.unmap(const_cast<uchar*>(mData));
+        mData = nullptr;
+    }
+    mFile.close();
+    mSnapshots.clear();
+    mSize = 0;
+    mEndTimestamp = 0;
+}
+
+/**
+ * @brief Return the wall-clock time at which the journal was started (i.e. timestamp 0)
+ */
+QDateTime JournalReader::startTime() const
+{
+    return QDateTime::fromMSecsSinceEpoch(mHeader.startTime);
+}
+
+/**
+ * @brief Read the record at the given offset
+ * @param next Set to the offset of the following record
+ * @return False if there is no valid record at that offset (i.e. the end of the journal was reached)
+ */
+bool JournalReader::readRecord(qint64 offset, Record &record, qint64 &next) const
+{
+    if (!mData || offset + qint64(sizeof(JournalRecordHeader)) > mSize)
+        return false;
+
+    JournalRecordHeader header;
+    memcpy(&header, mData + offset, sizeof(header));
+
+    qint64 recordSize = padded(sizeof(header) + header.size);
+    if (header.type == JournalEnd || offset + recordSize > mSize)
+        return false;
+
+    record.timestamp = header.timestamp;
+    record.type = JournalRecordType(header.type);
+    record.sequence = header.sequence;
+    record.payload = mData + offset + sizeof(header);
+    record.size = header.size;
+
+    next = offset + recordSize;
+    return true;
+}
+
+/**
+ * @brief Rebuild the state of the hardware at the given time
+ * @param timestamp Nanoseconds since startTime()
+ */
+JournalState JournalReader::stateAt(quint64 timestamp) const
+{
+    JournalState state;
+
+    qint64 offset = sizeof(JournalFileHeader);
+    for (auto const& s : mSnapshots) {
+        if (s.first > timestamp)
+            break;
+        offset = s.second;
+    }
+
+    Record r;
+    qint64 next;
+    while (readRecord(offset, r, next) && r.timestamp <= timestamp) {
+        apply(state, r);
+        offset = next;
+    }
+
+    return state;
+}
+
+void JournalReader::apply(JournalState &state, const Record &r)
+{
+    switch (r.type) {
+        case JournalSnapshot:
+            if (r.size == sizeof(JournalState))
+                memcpy(&state, r.payload, sizeof(JournalState));
+            break;
+
+        case JournalValveState:
+            if (r.size == 2 && r.payload[0] >= 1 && r.payload[0] <= N_VALVES)
+                state.valves[r.payload[0]-1] = r.payload[1];
+            break;
+
+        case JournalPumpState:
+            if (r.size == 2 && r.payload[0] >= 1 && r.payload[0] <= N_PUMPS)
+                state.pumps[r.payload[0]-1] = r.payload[1];
+            break;
+
+        case JournalPressureSetpoint:
+            if (r.size == 5 && r.payload[0] >= 1 && r.payload[0] <= N_PRS)
+                memcpy(&state.setpoints[r.payload[0]-1], r.payload + 1, sizeof(float));
+            break;
+
+        case JournalPressureMeasured:
+            if (r.size == 5 && r.payload[0] >= 1 && r.payload[0] <= N_PRS)
+                memcpy(&state.measured[r.payload[0]-1], r.payload + 1, sizeof(float));
+            break;
+
+        case JournalRoutineStep:
+            if (r.size >= sizeof(qint32))
+                memcpy(&state.routineStep, r.payload, sizeof(qint32));
+            break;
+
+        case JournalConnectionStatus:
+            if (r.size == 1)
+                state.connectionStatus = r.payload[0];
+            break;
+
+        default:
+            break;
+    }
+}
@@ -0,0 +1,216 @@
+#ifndef EVENTJOURNAL_H
+#define EVENTJOURNAL_H
+
+#include <vector>
+
+#include <QtCore>
+
+#include "constants.h"
+
+/**
+ * Binary event journal
+ * --------------------
+ *
+ * The journal is a record of every event concerning the hardware: commands sent, states reported by the
+ * microcontroller, routine steps and connection status changes. Unlike the text log, it is meant to be
+ * read by programs, to reconstruct the state of the system at any point in time.
+ *
+ * File layout (all values little-endian, as written by x86 and ARM hosts):
+ *
+ *     JournalFileHeader
+ *     JournalRecordHeader, payload, padding to a multiple of 8 bytes
+ *     JournalRecordHeader, payload, padding
+ *     ...
+ *
+ * A record header with type JournalEnd (0) marks the end of the journal; the file is pre-allocated
+ * with zeros, so this is also what follows the last record if the application exits unexpectedly.
+ *
+ * Timestamps are nanoseconds on a monotonic clock, counted from the moment the journal was opened; the
+ * wall-clock time of that moment is saved in the file header.
+ *
+ * A JournalSnapshot record with the full state of the system is written every few seconds, so that a
+ * reader can rebuild the state at a given time by starting from the preceding snapshot.
+ */
+
+enum JournalRecordType : quint16 {
+    JournalEnd,
+    JournalCommandSent,        // payload: the unframed message (command byte and parameters)
+    JournalValveState,         // payload: quint8 valve number, quint8 state (0: closed, 1: open)
+    JournalPumpState,          // payload: quint8 pump number, quint8 state (0: off, 1: on)
+    JournalPressureSetpoint,   // payload: quint8 controller number, float value (0-1)
+    JournalPressureMeasured,   // payload: quint8 controller number, float value (0-1)
+    JournalRoutineStep,        // payload: qint32 step index, UTF-8 text of the step
+    JournalConnectionStatus,   // payload: quint8 Communicator::ConnectionStatus
+    JournalSnapshot            // payload: JournalState
+};
+
+#pragma pack(push, 1)
+
+struct JournalFileHeader {
+    char magic[4];              // "UFEJ"
+    quint32 version;
+    qint64 startTime;           // Wall-clock time at timestamp 0, in milliseconds since the epoch (UTC)
+    quint32 recordAlignment;
+    quint32 reserved[11];
+};
+
+struct JournalRecordHeader {
+    quint64 timestamp;          // Nanoseconds since startTime (monotonic)
+    quint16 type;               // JournalRecordType
+    quint16 size;               // Payload size, excluding padding
+    quint32 sequence;           // Record number, starting at 0
+};
+
+/// Complete state of the hardware, as reported by the microcontroller. Component N is at index N-1.
+struct JournalState {
+    static const quint8 Unknown = 0xFF;
+
+    quint8 valves[N_VALVES];    // 0: closed, 1: open, Unknown
+    quint8 pumps[N_PUMPS];      // 0: off, 1: on, Unknown
+    float setpoints[N_PRS];     // 0-1, or negative if unknown
+    float measured[N_PRS];      // 0-1, or negative if unknown
+    quint8 connectionStatus;
+    qint32 routineStep;         // -1 if no routine is running
+
+    JournalState();
+};
+
+#pragma pack(pop)
+
+
+/**
+ * @brief The EventJournal class appends events to a journal file, through a memory-mapped buffer.
+ *
+ * The file is grown and mapped in chunks; appending a record is a copy into the mapped memory. When the
+ * journal is closed, the file is truncated to the size actually used.
+ *
+ * Measured pressures and setpoints are only recorded when they change, since the microcontroller
+ * reports them continuously.
+ */
+class EventJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    EventJournal(QObject* parent = nullptr);
+    virtual ~EventJournal();
+
+    bool open(const QString& filePath);
+    void close();
+    bool isOpen() const { return mMappedChunk != nullptr; }
+    QString filePath() const { return mFile.fileName(); }
+
+    /// Set the minimum time between two snapshots (10 seconds by default)
+    void setSnapshotInterval(int milliseconds) { mSnapshotInterval = qint64(milliseconds) * 1000000; }
+
+    static QString journalDirectory();
+
+public slots:
+    void recordCommandSent(QByteArray message);
+    void recordValveState(uint valveNumber, bool open);
+    void recordPumpState(uint pumpNumber, bool on);
+    void recordPressureSetpoint(uint controllerNumber, double value);
+    void recordPressureMeasured(uint controllerNumber, double value);
+    void recordRoutineStep(int stepNumber, QString stepText);
+    void recordConnectionStatus(int status);
+
+private:
+    void append(JournalRecordType type, const void* payload, quint16 size);
+    bool mapChunk(qint64 offset);
+    void writeSnapshot();
+
+    QFile mFile;
+    QElapsedTimer mClock;
+
+    /// Size of each mapped region of the file
+    qint64 mChunkSize;
+
+    /// Start of the currently mapped region, relative to the start of the file
+    qint64 mChunkOffset;
+    uchar* mMappedChunk;
+
+    /// Write position, relative to the start of the file
+    qint64 mWritePosition;
+
+    quint32 mSequence;
+
+    /// State of the hardware, kept up to date for the periodic snapshots
+    JournalState mState;
+    qint64 mLastSnapshot;
+    qint64 mSnapshotInterval;
+};
+
+
+/**
+ * @brief The JournalReader class reads journal files written by EventJournal.
+ *
+ * The file is memory-mapped. When it is opened, the record headers are scanned once to locate the snapshots;
+ * stateAt() then starts from the last snapshot before the requested time and applies the records that follow it.
+ */
+class JournalReader
+{
+public:
+    struct Record {
+        quint64 timestamp;
+        JournalRecordType type;
+        quint32 sequence;
+        const uchar* payload;
+        quint16 size;
+    };
+
+    JournalReader();
+    ~JournalReader();
+
+    bool open(const QString& filePath);
+    void close();
+
+    QDateTime startTime() const;
+    quint64 endTimestamp() const { return mEndTimestamp; }
+    int snapshotCount() const { return int(mSnapshots.size()); }
+
+    JournalState stateAt(quint64 timestamp) const;
+
+    /// Call f(record) for each record with a timestamp between from and to (inclusive)
+    template <typename F>
+    void forEachRecord(quint64 from, quint64 to, F f) const;
+
+private:
+    bool readRecord(qint64 offset, Record& record, qint64& next) const;
+    static void apply(JournalState& state, const Record& record);
+
+    QFile mFile;
+    const uchar* mData;
+    qint64 mSize;
+
+    JournalFileHeader mHeader;
+
+    /// Offset and timestamp of each snapshot record, in file order
+    std::vector<std::pair<quint64, qint64>> mSnapshots;
+
+    quint64 mEndTimestamp;
+};
+
+template <typename F>
+void JournalReader::forEachRecord(quint64 from, quint64 to, F f) const
+{
+    Record r;
+    qint64 next;
+    qint64 offset = sizeof(JournalFileHeader);
+
+    // Skip ahead to the last snapshot strictly before `from`
+    for (auto const& s : mSnapshots) {
+        if (s.first >= from)
+            break;
+        offset = s.second;
+    }
+
+    while (readRecord(offset, r, next)) {
+        if (r.timestamp > to)
+            break;
+        if (r.timestamp >= from)
+            f(r);
+        offset = next;
+    }
+}
+
+#endif // EVENTJOURNAL_H
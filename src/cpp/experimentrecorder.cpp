@@ -0,0 +1,427 @@
+#include "experimentrecorder.h"
+#include "logger.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const char ExperimentMagic[4] = {'U', 'F', 'X', 'R'};
+const quint32 ExperimentVersion = 1;
+
+/// Interval at which partially filled chunks are written, in milliseconds
+const int FlushInterval = 5000;
+
+void writeVarint(QByteArray& out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(char(value | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+quint64 readVarint(const uchar*& p, const uchar* end)
+{
+    quint64 value = 0;
+    int shift = 0;
+    while (p < end) {
+        uchar b = *p++;
+        value |= quint64(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            break;
+        shift += 7;
+    }
+    return value;
+}
+
+quint64 zigzag(qint64 value)
+{
+    return (quint64(value) << 1) ^ quint64(value >> 63);
+}
+
+qint64 unzigzag(quint64 value)
+{
+    return qint64(value >> 1) ^ -qint64(value & 1);
+}
+
+}
+
+ExperimentRecorder::ExperimentRecorder(QObject *parent)
+    : QObject(parent)
+    , mRecording(false)
+    , mTelemetryClockStart(0)
+    , mStopWriter(false)
+    , mDroppedSamples(0)
+{
+    for (int i(1); i <= N_PRS; ++i)
+        mChannels.push_back(Chunk{ExperimentPressure, quint8(i), {}, {}});
+    for (int i(1); i <= N_PRS; ++i)
+        mChannels.push_back(Chunk{ExperimentSetpoint, quint8(i), {}, {}});
+    for (int i(1); i <= N_VALVES; ++i)
+        mChannels.push_back(Chunk{ExperimentValve, quint8(i), {}, {}});
+    mChannels.push_back(Chunk{ExperimentStep, 0, {}, {}});
+    for (int i(1); i <= N_PRS; ++i)
+        mChannels.push_back(Chunk{ExperimentTelemetry, quint8(i), {}, {}});
+
+    mFlushTimer.setInterval(FlushInterval);
+    connect(&mFlushTimer, &QTimer::timeout, this, &ExperimentRecorder::flushAll);
+}
+
+ExperimentRecorder::~ExperimentRecorder()
+{
+    stop();
+}
+
+/**
+ * @brief Return the directory in which experiment files are saved by default
+ */
+QString ExperimentRecorder::experimentDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/experiments";
+}
+
+/**
+ * @brief Start recording to a new file
+ * @param filePath Path of the file. If it exists, it is overwritten.
+ * @param steps Steps of the routine being run, saved in the file header
+ */
+bool ExperimentRecorder::start(const QString &filePath, const QStringList &steps)
+{
+    stop();
+
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+
+    mFile.setFileName(filePath);
+    if (!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(lcRoutine) << "Could not open experiment file" << filePath << ":" << mFile.errorString();
+        return false;
+    }
+
+    QByteArray stepsData = steps.join('\n').toUtf8();
+
+    ExperimentFileHeader header;
+    memcpy(header.magic, ExperimentMagic, 4);
+    header.version = ExperimentVersion;
+    header.startTime = QDateTime::currentMSecsSinceEpoch();
+    header.pressureScale = PR_MAX_VALUE;
+    header.stepsSize = quint32(stepsData.size());
+    mClock.start();
+    mTelemetryClockStart = telemetryClock();
+
+    mFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    mFile.write(stepsData);
+
+    mDroppedSamples = 0;
+    mStopWriter = false;
+    mWriter = std::thread([this] { writerLoop(); });
+    mFlushTimer.start();
+    mRecording = true;
+
+    qCInfo(lcRoutine) << "Recording experiment to" << filePath;
+    return true;
+}
+
+/**
+ * @brief Write any remaining samples and close the file
+ */
+void ExperimentRecorder::stop()
+{
+    if (!mRecording)
+        return;
+
+    mFlushTimer.stop();
+    flushAll();
+    mRecording = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mQueueMutex);
+        mStopWriter = true;
+    }
+    mQueueConditionVariable.notify_one();
+    mWriter.join();
+
+    mFile.close();
+
+    if (mDroppedSamples > 0)
+        qCWarning(lcRoutine) << "Experiment recorder dropped" << mDroppedSamples << "samples";
+}
+
+void ExperimentRecorder::recordPressure(uint controllerNumber, double value)
+{
+    if (controllerNumber >= 1 && controllerNumber <= N_PRS)
+        append(ExperimentPressure, controllerNumber, qint64(std::lround(value * PR_MAX_VALUE)), mClock.nsecsElapsed() / 1000);
+}
+
+void ExperimentRecorder::recordSetpoint(uint controllerNumber, double value)
+{
+    if (controllerNumber >= 1 && controllerNumber <= N_PRS)
+        append(ExperimentSetpoint, controllerNumber, qint64(std::lround(value * PR_MAX_VALUE)), mClock.nsecsElapsed() / 1000);
+}
+
+void ExperimentRecorder::recordValveState(uint valveNumber, bool open)
+{
+    if (valveNumber >= 1 && valveNumber <= N_VALVES)
+        append(ExperimentValve, valveNumber, open, mClock.nsecsElapsed() / 1000);
+}
+
+void ExperimentRecorder::recordStep(int stepNumber)
+{
+    append(ExperimentStep, 0, stepNumber, mClock.nsecsElapsed() / 1000);
+}
+
+void ExperimentRecorder::recordPressureSamples(uint controllerNumber, QVector<TelemetrySample> samples)
+{
+    if (controllerNumber < 1 || controllerNumber > N_PRS)
+        return;
+
+    for (TelemetrySample const& sample : samples)
+        append(ExperimentTelemetry, controllerNumber, qint64(std::lround(sample.value * PR_MAX_VALUE)),
+               sample.timestamp - mTelemetryClockStart);
+}
+
+/**
+ * @brief Add a sample to the buffer of a channel
+ * @param timestamp Microseconds since the start of the recording
+ */
+void ExperimentRecorder::append(ExperimentChannelKind kind, uint number, qint64 value, qint64 timestamp)
+{
+    if (!mRecording)
+        return;
+
+    size_t index;
+    switch (kind) {
+        case ExperimentPressure: index = number - 1; break;
+        case ExperimentSetpoint: index = N_PRS + number - 1; break;
+        case ExperimentValve: index = 2*N_PRS + number - 1; break;
+        case ExperimentStep: index = 2*N_PRS + N_VALVES; break;
+        default: index = 2*N_PRS + N_VALVES + number; break;
+    }
+
+    Chunk& channel = mChannels[index];
+    if (channel.timestamps.empty()) {
+        channel.timestamps.reserve(ChunkSamples);
+        channel.values.reserve(ChunkSamples);
+    }
+
+    // Timestamps are stored as unsigned deltas. Back-dated samples (see Communicator::handleTelemetry) can
+    // arrive slightly out of order, in which case they take the timestamp of the previous sample.
+    if (!channel.timestamps.empty())
+        timestamp = qMax(timestamp, channel.timestamps.back());
+
+    channel.timestamps.push_back(timestamp);
+    channel.values.push_back(value);
+
+    if (channel.timestamps.size() >= size_t(ChunkSamples))
+        flush(channel);
+}
+
+/**
+ * @brief Hand the samples buffered for a channel over to the writer thread
+ */
+void ExperimentRecorder::flush(Chunk &channel)
+{
+    if (channel.timestamps.empty())
+        return;
+
+    Chunk chunk{channel.kind, channel.number, {}, {}};
+    chunk.timestamps.swap(channel.timestamps);
+    chunk.values.swap(channel.values);
+
+    {
+        std::lock_guard<std::mutex> lock(mQueueMutex);
+        if (mQueue.size() >= size_t(MaxQueuedChunks)) {
+            mDroppedSamples += chunk.timestamps.size();
+            return;
+        }
+        mQueue.push_back(std::move(chunk));
+    }
+    mQueueConditionVariable.notify_one();
+}
+
+void ExperimentRecorder::flushAll()
+{
+    for (auto& channel : mChannels)
+        flush(channel);
+}
+
+void ExperimentRecorder::writerLoop()
+{
+    while (true) {
+        Chunk chunk;
+        {
+            std::unique_lock<std::mutex> lock(mQueueMutex);
+            mQueueConditionVariable.wait(lock, [this]{ return !mQueue.empty() || mStopWriter; });
+            if (mQueue.empty())
+                break;
+            chunk = std::move(mQueue.front());
+            mQueue.pop_front();
+        }
+
+        QByteArray data = encode(chunk);
+        if (mFile.write(data) != data.size())
+            qCWarning(lcRoutine) << "Could not write to experiment file:" << mFile.errorString();
+    }
+
+    mFile.flush();
+}
+
+/**
+ * @brief Encode a chunk into its header and delta-encoded payload
+ */
+QByteArray ExperimentRecorder::encode(const Chunk &chunk)
+{
+    size_t n = chunk.timestamps.size();
+
+    QByteArray payload;
+    payload.reserve(int(n * 4));
+
+    for (size_t i(1); i < n; ++i)
+        writeVarint(payload, quint64(chunk.timestamps[i] - chunk.timestamps[i-1]));
+    for (size_t i(1); i < n; ++i)
+        writeVarint(payload, zigzag(chunk.values[i] - chunk.values[i-1]));
+
+    ExperimentChunkHeader header;
+    header.kind = chunk.kind;
+    header.number = chunk.number;
+    header.reserved = 0;
+    header.count = quint32(n);
+    header.size = quint32(payload.size());
+    header.firstTimestamp = chunk.timestamps[0];
+    header.firstValue = chunk.values[0];
+
+    QByteArray data(reinterpret_cast<const char*>(&header), sizeof(header));
+    data.append(payload);
+    return data;
+}
+
+
+ExperimentReader::ExperimentReader()
+    : mData(nullptr)
+    , mSize(0)
+{
+    memset(&mHeader, 0, sizeof(mHeader));
+}
+
+ExperimentReader::~ExperimentReader()
+{
+    close();
+}
+
+bool ExperimentReader::open(const QString &filePath)
+{
+    close();
+
+    mFile.setFileName(filePath);
+    if (!mFile.open(QIODevice::ReadOnly))
+        return false;
+
+    mSize = mFile.size();
+    if (mSize < qint64(sizeof(ExperimentFileHeader))) {
+        mFile.close();
+        return false;
+    }
+
+    mData = mFile.map(0, mSize);
+    if (!mData) {
+        mFile.close();
+        return false;
+    }
+
+    memcpy(&mHeader, mData, sizeof(mHeader));
+    qint64 offset = qint64(sizeof(mHeader)) + mHeader.stepsSize;
+    if (memcmp(mHeader.magic, ExperimentMagic, 4) != 0 || mHeader.version != ExperimentVersion || offset > mSize) {
+        close();
+        return false;
+    }
+
+    QString steps = QString::fromUtf8(reinterpret_cast<const char*>(mData + sizeof(mHeader)), int(mHeader.stepsSize));
+    if (!steps.isEmpty())
+        mSteps = steps.split('\n');
+
+    // A truncated last chunk (if the application exited while writing) is ignored
+    ExperimentChunkHeader chunk;
+    while (offset + qint64(sizeof(chunk)) <= mSize) {
+        memcpy(&chunk, mData + offset, sizeof(chunk));
+        if (offset + qint64(sizeof(chunk)) + chunk.size > mSize || chunk.count == 0)
+            break;
+        mChunks[channelKey(chunk.kind, chunk.number)].push_back(offset);
+        offset += qint64(sizeof(chunk)) + chunk.size;
+    }
+
+    return true;
+}
+
+void ExperimentReader::close()
+{
+    if (mData) {
+        mFile.unmap(const_cast<uchar*>(mData));
+        mData = nullptr;
+    }
+    mFile.close();
+    mSize = 0;
+    mSteps.clear();
+    mChunks.clear();
+}
+
+QDateTime ExperimentReader::startTime() const
+{
+    return QDateTime::fromMSecsSinceEpoch(mHeader.startTime);
+}
+
+std::vector<std::pair<ExperimentChannelKind, int>> ExperimentReader::channels() const
+{
+    std::vector<std::pair<ExperimentChannelKind, int>> result;
+    for (auto const& c : mChunks)
+        result.push_back(std::make_pair(ExperimentChannelKind(c.first >> 8), int(c.first & 0xFF)));
+    return result;
+}
+
+/**
+ * @brief Decode all the samples of a channel
+ * @return The timestamps and values, or empty vectors if the channel is not in the file
+ */
+ExperimentReader::Series ExperimentReader::series(ExperimentChannelKind kind, int number) const
+{
+    Series s;
+
+    auto it = mChunks.find(channelKey(kind, number));
+    if (it == mChunks.end())
+        return s;
+
+    size_t total(0);
+    for (qint64 offset : it->second) {
+        ExperimentChunkHeader header;
+        memcpy(&header, mData + offset, sizeof(header));
+        total += header.count;
+    }
+    s.timestamps.resize(total);
+    s.values.resize(total);
+
+    size_t i(0);
+    for (qint64 offset : it->second) {
+        ExperimentChunkHeader header;
+        memcpy(&header, mData + offset, sizeof(header));
+
+        const uchar* p = mData + offset + sizeof(header);
+        const uchar* end = p + header.size;
+
+        qint64 t = header.firstTimestamp;
+        s.timestamps[i] = t;
+        for (quint32 k(1); k < header.count; ++k) {
+            t += qint64(readVarint(p, end));
+            s.timestamps[i+k] = t;
+        }
+
+        qint64 v = header.firstValue;
+        s.values[i] = v;
+        for (quint32 k(1); k < header.count; ++k) {
+            v += unzigzag(readVarint(p, end));
+            s.values[i+k] = v;
+        }
+
+        i += header.count;
+    }
+
+    return s;
+}
@@ -0,0 +1,196 @@
+#ifndef EXPERIMENTRECORDER_H
+#define EXPERIMENTRECORDER_H
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <QtCore>
+
+#include "constants.h"
+#include "telemetry.h"
+
+/**
+ * Experiment files
+ * ----------------
+ *
+ * An experiment file holds the time series recorded during one run of a routine: measured pressure and
+ * setpoint of each controller, the state of each valve, and the current step of the routine.
+ *
+ * Each series (or "channel") is stored column-wise, in chunks of up to a few thousand samples:
+ *
+ *     ExperimentFileHeader
+ *     Steps of the routine (UTF-8, one per line; stepsSize bytes)
+ *     ExperimentChunkHeader, payload
+ *     ExperimentChunkHeader, payload
+ *     ...
+ *
+ * Chunks of different channels are interleaved, in the order they were filled. The first sample of a chunk
+ * is stored in its header; the payload holds the following (count - 1) timestamp deltas as unsigned LEB128
+ * varints, then the (count - 1) value deltas as zigzag-encoded varints.
+ *
+ * Timestamps are microseconds since the start of the run. Values are integers: pressures and setpoints are in
+ * units of 1/pressureScale (i.e. the raw 0-PR_MAX_VALUE values exchanged with the microcontroller), valve
+ * states are 0 or 1, and steps are the index of the step in the routine. Telemetry channels hold the pressures
+ * streamed by the microcontroller (see telemetry.h), in the same units as the pressure channels.
+ *
+ * tools/experiment_reader.py loads these files into numpy arrays.
+ */
+
+enum ExperimentChannelKind : quint8 {
+    ExperimentPressure,
+    ExperimentSetpoint,
+    ExperimentValve,
+    ExperimentStep,
+    ExperimentTelemetry
+};
+
+#pragma pack(push, 1)
+
+struct ExperimentFileHeader {
+    char magic[4];              // "UFXR"
+    quint32 version;
+    qint64 startTime;           // Wall-clock time at timestamp 0, in milliseconds since the epoch (UTC)
+    quint32 pressureScale;
+    quint32 stepsSize;
+};
+
+struct ExperimentChunkHeader {
+    quint8 kind;                // ExperimentChannelKind
+    quint8 number;              // Controller or valve number (1-indexed); 0 for the step channel
+    quint16 reserved;
+    quint32 count;              // Number of samples
+    quint32 size;               // Payload size in bytes
+    qint64 firstTimestamp;
+    qint64 firstValue;
+};
+
+#pragma pack(pop)
+
+
+/**
+ * @brief The ExperimentRecorder class records pressures, valve states and routine steps to an experiment file.
+ *
+ * Samples are appended to per-channel buffers on the calling thread. Full buffers are handed over to a writer
+ * thread, which encodes and writes them; buffers that are not full are flushed every few seconds, and when
+ * recording stops.
+ *
+ * Memory use is bounded: if the writer falls behind by more than a fixed number of chunks, the newest chunks
+ * are dropped (and counted) rather than queued.
+ */
+class ExperimentRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    ExperimentRecorder(QObject* parent = nullptr);
+    virtual ~ExperimentRecorder();
+
+    bool start(const QString& filePath, const QStringList& steps);
+    void stop();
+    bool isRecording() const { return mRecording; }
+    QString filePath() const { return mFile.fileName(); }
+
+    /// Number of samples lost because the writer thread could not keep up
+    quint64 droppedSamples() const { return mDroppedSamples; }
+
+    static QString experimentDirectory();
+
+    /// Maximum number of samples per chunk
+    static const int ChunkSamples = 4096;
+
+    /// Maximum number of chunks waiting to be written
+    static const int MaxQueuedChunks = 64;
+
+public slots:
+    void recordPressure(uint controllerNumber, double value);
+    void recordSetpoint(uint controllerNumber, double value);
+    void recordValveState(uint valveNumber, bool open);
+    void recordStep(int stepNumber);
+    void recordPressureSamples(uint controllerNumber, QVector<TelemetrySample> samples);
+
+private slots:
+    void flushAll();
+
+private:
+    struct Chunk {
+        quint8 kind;
+        quint8 number;
+        std::vector<qint64> timestamps;
+        std::vector<qint64> values;
+    };
+
+    void append(ExperimentChannelKind kind, uint number, qint64 value, qint64 timestamp);
+    void flush(Chunk& channel);
+    void writerLoop();
+    static QByteArray encode(const Chunk& chunk);
+
+    bool mRecording;
+    QFile mFile;
+    QElapsedTimer mClock;
+    QTimer mFlushTimer;
+
+    /// telemetryClock() at the start of the recording
+    qint64 mTelemetryClockStart;
+
+    /// Buffer of each channel: pressures, then setpoints, then valves, then steps, then telemetry
+    std::vector<Chunk> mChannels;
+
+    /// Chunks waiting to be written, shared with the writer thread
+    std::deque<Chunk> mQueue;
+    std::mutex mQueueMutex;
+    std::condition_variable mQueueConditionVariable;
+    bool mStopWriter;
+    std::thread mWriter;
+
+    quint64 mDroppedSamples;
+};
+
+
+/**
+ * @brief The ExperimentReader class loads the series saved by ExperimentRecorder.
+ *
+ * The file is memory-mapped, and the chunk headers are scanned once when it is opened; a series is only
+ * decoded when it is requested.
+ */
+class ExperimentReader
+{
+public:
+    struct Series {
+        std::vector<qint64> timestamps;
+        std::vector<qint64> values;
+    };
+
+    ExperimentReader();
+    ~ExperimentReader();
+
+    bool open(const QString& filePath);
+    void close();
+
+    QDateTime startTime() const;
+    QStringList steps() const { return mSteps; }
+    quint32 pressureScale() const { return mHeader.pressureScale; }
+
+    /// Channels present in the file, as (kind, number) pairs
+    std::vector<std::pair<ExperimentChannelKind, int>> channels() const;
+
+    Series series(ExperimentChannelKind kind, int number) const;
+
+private:
+    static quint16 channelKey(int kind, int number) { return quint16(kind << 8 | number); }
+
+    QFile mFile;
+    const uchar* mData;
+    qint64 mSize;
+
+    ExperimentFileHeader mHeader;
+    QStringList mSteps;
+
+    /// Offsets of the chunks of each channel, in file order
+    std::map<quint16, std::vector<qint64>> mChunks;
+};
+
+#endif // EXPERIMENTRECORDER_H
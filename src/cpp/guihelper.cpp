@@ -1,5 +1,6 @@
 #include "guihelper.h"
 #include "applicationcontroller.h"
+#include "logger.h"
 
 PCHelper::PCHelper()
     : mSetPoint(0)
@@ -47,7 +48,7 @@ double PCHelper::measuredValueInPsi() const
  */
 void PCHelper::setSetPoint(double val)
 {
-    //qDebug() << "PCHelper: Setting pressure to " << val;
+    //qCDebug(lcGui) << "PCHelper: Setting pressure to " << val;
     mSetPoint = val;
     emit setPointChanged(val);
 }
@@ -59,7 +60,7 @@ void PCHelper::setSetPoint(double val)
 void PCHelper::setSetPointInPsi(double val)
 {
     if (val > mMaxPressure || val < mMinPressure) {
-        qDebug() << "PCHelper::setSetPointInPsi: value out of bounds";
+        qCDebug(lcGui) << "PCHelper::setSetPointInPsi: value out of bounds";
         return;
     }
 
@@ -88,7 +89,7 @@ void PCHelper::setMeasuredValue(double val)
 void PCHelper::setMeasuredValueInPsi(double val)
 {
     if (val > mMaxPressure || val < mMinPressure) {
-        qDebug() << "PCHelper::setMeasuredValueInPsi: value out of bounds";
+        qCDebug(lcGui) << "PCHelper::setMeasuredValueInPsi: value out of bounds";
         return;
     }
 
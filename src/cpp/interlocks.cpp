@@ -0,0 +1,405 @@
+#include "interlocks.h"
+
+#include <chrono>
+#include <cmath>
+
+InterlockEngine::InterlockEngine()
+{
+    clear();
+
+    for (int i(0); i < N_PRS; ++i) {
+        mPressure[i] = 0;
+        mHasPressure[i] = false;
+    }
+    for (int i(0); i < N_VALVES; ++i)
+        mValveOpen[i] = false;
+
+    resetMetrics();
+}
+
+/**
+ * @brief Remove all rules. The known state of the hardware is kept.
+ */
+void InterlockEngine::clear()
+{
+    mRules.clear();
+    mActions.clear();
+    mPressureRules.clear();
+    mValveRules.clear();
+    mSourceLines.clear();
+    mErrors.clear();
+
+    for (int i(0); i <= N_PRS; ++i)
+        mPressureOffsets[i] = 0;
+    for (int i(0); i <= N_VALVES; ++i)
+        mValveOffsets[i] = 0;
+}
+
+/**
+ * @brief Compile a set of rules, replacing the current ones
+ * @param source The rules, one per line (see the class description for the syntax)
+ * @param pressureRanges The minimum and maximum pressure (in PSI) of each pressure controller, starting with controller 1
+ * @return False if any rule is invalid. Invalid rules are skipped, and described by errors(); valid rules are kept.
+ */
+bool InterlockEngine::compile(const QString &source, const QList<QPair<double, double>> &pressureRanges)
+{
+    clear();
+    mSourceLines = source.split('\n');
+
+    for (int i(0); i < mSourceLines.size(); ++i) {
+        QString line = mSourceLines[i];
+        line.remove(QRegExp("#.*"));
+        line = line.simplified();
+        if (line.isEmpty())
+            continue;
+
+        QStringList tokens = line.split(' ');
+        QString error;
+
+        Rule rule;
+        rule.requiredBy = 0;
+        rule.active = false;
+        rule.line = i;
+        rule.firstAction = quint16(mActions.size());
+
+        bool ok = false;
+        if (tokens[0] == "if") {
+            // if pressure X <op> P then <actions>
+            if (tokens.size() < 7 || tokens[5] != "then")
+                error = "rules starting with \"if\" should have the form \"if pressure 2 > 4 then close valves 1-8\"";
+            else if (parseCondition(tokens, 1, pressureRanges, rule.condition, error))
+                ok = parseActions(tokens, 6, pressureRanges, error);
+        }
+        else if (tokens[0] == "valve") {
+            // valve V requires pressure X <op> P
+            bool numberOk;
+            uint valve = tokens.value(1).toUInt(&numberOk);
+            if (tokens.size() != 7 || tokens[2] != "requires")
+                error = "rules starting with \"valve\" should have the form \"valve 5 requires pressure 1 >= 10\"";
+            else if (!numberOk || valve < 1 || valve > N_VALVES)
+                error = "invalid valve number: " + tokens[1];
+            else if (parseCondition(tokens, 3, pressureRanges, rule.condition, error)) {
+                rule.requiredBy = quint8(valve);
+                ok = true;
+            }
+        }
+        else
+            error = "rules should start with \"if\" or \"valve\"";
+
+        if (!ok) {
+            mActions.resize(rule.firstAction);
+            mErrors << "Line " + QString::number(i+1) + ": " + error;
+            continue;
+        }
+
+        rule.actionCount = quint16(mActions.size() - rule.firstAction);
+        mRules.push_back(rule);
+    }
+
+    // Index the rules by the pressure controller and the valve they depend on
+    for (int c(1); c <= N_PRS; ++c) {
+        for (size_t r(0); r < mRules.size(); ++r) {
+            if (mRules[r].condition.controller == c)
+                mPressureRules.push_back(quint16(r));
+        }
+        mPressureOffsets[c] = quint16(mPressureRules.size());
+    }
+    for (int v(1); v <= N_VALVES; ++v) {
+        for (size_t r(0); r < mRules.size(); ++r) {
+            if (mRules[r].requiredBy == v)
+                mValveRules.push_back(quint16(r));
+        }
+        mValveOffsets[v] = quint16(mValveRules.size());
+    }
+
+    return mErrors.isEmpty();
+}
+
+/**
+ * @brief Parse "pressure X <op> P", starting at tokens[start]
+ */
+bool InterlockEngine::parseCondition(const QStringList &tokens, int start, const QList<QPair<double, double>> &pressureRanges,
+                                     Condition &condition, QString &error)
+{
+    if (tokens.value(start) != "pressure") {
+        error = "expected a condition such as \"pressure 1 >= 10\"";
+        return false;
+    }
+
+    bool ok;
+    int controller = tokens.value(start+1).toInt(&ok);
+    if (!ok || controller < 1 || controller > qMin(N_PRS, pressureRanges.size())) {
+        error = "invalid pressure controller: " + tokens.value(start+1);
+        return false;
+    }
+
+    double raw;
+    if (!parsePressure(tokens.value(start+3), controller, pressureRanges, raw, error))
+        return false;
+
+    // The measured values are integers, so strict comparisons are turned into non-strict ones. The small margin
+    // keeps thresholds that fall exactly on a raw value from being rounded the wrong way.
+    QString op = tokens.value(start+2);
+    double threshold;
+    if (op == ">=") {
+        condition.atLeast = true;
+        threshold = std::ceil(raw - 1e-9);
+    }
+    else if (op == ">") {
+        condition.atLeast = true;
+        threshold = std::floor(raw + 1e-9) + 1;
+    }
+    else if (op == "<=") {
+        condition.atLeast = false;
+        threshold = std::floor(raw + 1e-9);
+    }
+    else if (op == "<") {
+        condition.atLeast = false;
+        threshold = std::ceil(raw - 1e-9) - 1;
+    }
+    else {
+        error = "unknown comparison: " + op + ". Must be <, <=, > or >=";
+        return false;
+    }
+
+    condition.controller = quint8(controller);
+    condition.threshold = qint16(qBound(-1., threshold, PR_MAX_VALUE + 1.));
+    return true;
+}
+
+/**
+ * @brief Convert a pressure in PSI to the raw units of the given controller (not rounded)
+ */
+bool InterlockEngine::parsePressure(const QString &token, int controller, const QList<QPair<double, double>> &pressureRanges,
+                                    double &raw, QString &error)
+{
+    bool ok;
+    double pressure = token.toDouble(&ok);
+    if (!ok) {
+        error = "invalid pressure: " + token;
+        return false;
+    }
+
+    double minPressure = pressureRanges[controller-1].first;
+    double maxPressure = pressureRanges[controller-1].second;
+    if (maxPressure <= minPressure) {
+        error = "the range of pressure controller " + QString::number(controller) + " is unknown";
+        return false;
+    }
+
+    raw = (pressure - minPressure) / (maxPressure - minPressure) * PR_MAX_VALUE;
+    return true;
+}
+
+/**
+ * @brief Parse the actions of a rule, starting at tokens[start], and append them to mActions
+ */
+bool InterlockEngine::parseActions(const QStringList &tokens, int start, const QList<QPair<double, double>> &pressureRanges,
+                                   QString &error)
+{
+    int i = start;
+    while (i < tokens.size()) {
+        QString verb = tokens[i];
+
+        if (verb == "close" || verb == "open") {
+            if (tokens.value(i+1) != "valve" && tokens.value(i+1) != "valves") {
+                error = "expected \"valves\" after \"" + verb + "\"";
+                return false;
+            }
+            i += 2;
+            std::vector<quint8> valves;
+            if (!parseValveList(tokens, i, valves)) {
+                error = "invalid valve list: " + tokens.mid(start).join(' ');
+                return false;
+            }
+            for (quint8 v : valves)
+                mActions.push_back(Action { verb == "close" ? Action::CloseValve : Action::OpenValve, v, 0 });
+        }
+
+        else if (verb == "set") {
+            bool ok;
+            int controller = tokens.value(i+2).toInt(&ok);
+            if (tokens.value(i+1) != "pressure" || !ok || controller < 1 || controller > qMin(N_PRS, pressureRanges.size())) {
+                error = "expected \"set pressure <controller> <pressure>\"";
+                return false;
+            }
+            double raw;
+            if (!parsePressure(tokens.value(i+3), controller, pressureRanges, raw, error))
+                return false;
+            if (raw < 0 || raw > PR_MAX_VALUE) {
+                error = "pressure out of bounds for this controller: " + tokens.value(i+3);
+                return false;
+            }
+            mActions.push_back(Action { Action::SetPressure, quint8(controller), quint8(std::lround(raw)) });
+            i += 4;
+        }
+
+        else if (verb == "stop") {
+            mActions.push_back(Action { Action::StopRoutine, 0, 0 });
+            i++;
+        }
+
+        else {
+            error = "unknown action: " + verb;
+            return false;
+        }
+
+        if (i < tokens.size()) {
+            if (tokens[i] != "and" || i + 1 == tokens.size()) {
+                error = "actions should be separated by \"and\"";
+                return false;
+            }
+            i++;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Parse valve numbers, ranges ("1-8") or "all", from tokens[i] up to the next "and"
+ */
+bool InterlockEngine::parseValveList(const QStringList &tokens, int &i, std::vector<quint8> &valves)
+{
+    for (; i < tokens.size() && tokens[i] != "and"; ++i) {
+        if (tokens[i] == "all") {
+            for (int v(1); v <= N_VALVES; ++v)
+                valves.push_back(quint8(v));
+            continue;
+        }
+
+        QStringList bounds = tokens[i].split('-');
+        bool firstOk;
+        int first = bounds[0].toInt(&firstOk);
+        bool lastOk = firstOk;
+        int last = first;
+        if (bounds.size() == 2)
+            last = bounds[1].toInt(&lastOk);
+
+        if (bounds.size() > 2 || !firstOk || !lastOk || first < 1 || last > N_VALVES || first > last)
+            return false;
+        for (int v(first); v <= last; ++v)
+            valves.push_back(quint8(v));
+    }
+    return !valves.empty();
+}
+
+/**
+ * @brief Evaluate the rules that depend on a new pressure measurement
+ * @param actions The actions to take are appended to this vector
+ */
+void InterlockEngine::onPressure(uint controllerNumber, quint8 value, std::vector<Action> &actions)
+{
+    if (controllerNumber < 1 || controllerNumber > N_PRS)
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+
+    mPressure[controllerNumber-1] = value;
+    mHasPressure[controllerNumber-1] = true;
+
+    for (int i(mPressureOffsets[controllerNumber-1]); i < mPressureOffsets[controllerNumber]; ++i) {
+        Rule& rule = mRules[mPressureRules[i]];
+        bool met = rule.condition.test(value);
+
+        if (rule.requiredBy == 0) {
+            if (met && !rule.active)
+                trigger(rule, actions);
+            rule.active = met;
+        }
+        else if (!met && mValveOpen[rule.requiredBy-1]) {
+            // Assume the valve closes, so that it isn't closed again on every measurement
+            mValveOpen[rule.requiredBy-1] = false;
+            actions.push_back(Action { Action::CloseValve, rule.requiredBy, 0 });
+            mLastTriggeredRule = mSourceLines[rule.line].trimmed();
+            mMetrics.triggers++;
+        }
+    }
+
+    quint64 elapsed = quint64(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    mMetrics.evaluations++;
+    mMetrics.totalNanoseconds += elapsed;
+    mMetrics.maxNanoseconds = qMax(mMetrics.maxNanoseconds, elapsed);
+}
+
+/**
+ * @brief Evaluate the requirements of a valve whose state was reported by the microcontroller
+ * @param actions The actions to take are appended to this vector
+ */
+void InterlockEngine::onValveState(uint valveNumber, bool open, std::vector<Action> &actions)
+{
+    if (valveNumber < 1 || valveNumber > N_VALVES)
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+
+    mValveOpen[valveNumber-1] = open;
+
+    // Until a pressure is known, the valve is left as it is; it is checked again when the pressure arrives
+    for (int i(mValveOffsets[valveNumber-1]); open && i < mValveOffsets[valveNumber]; ++i) {
+        const Rule& rule = mRules[mValveRules[i]];
+        int c = rule.condition.controller - 1;
+        if (mHasPressure[c] && !rule.condition.test(mPressure[c])) {
+            mValveOpen[valveNumber-1] = false;
+            actions.push_back(Action { Action::CloseValve, quint8(valveNumber), 0 });
+            mLastTriggeredRule = mSourceLines[rule.line].trimmed();
+            mMetrics.triggers++;
+            break;
+        }
+    }
+
+    quint64 elapsed = quint64(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    mMetrics.evaluations++;
+    mMetrics.totalNanoseconds += elapsed;
+    mMetrics.maxNanoseconds = qMax(mMetrics.maxNanoseconds, elapsed);
+}
+
+/**
+ * @brief Return whether a valve may be set to the given state
+ * @param rule If the valve may not be opened, set to the rule preventing it
+ *
+ * Closing a valve is always allowed. Opening it is refused if one of its requirements is not met, or if the
+ * pressure it depends on was not measured yet.
+ */
+bool InterlockEngine::allowsValve(uint valveNumber, bool open, QString *rule) const
+{
+    if (!open || valveNumber < 1 || valveNumber > N_VALVES)
+        return true;
+
+    for (int i(mValveOffsets[valveNumber-1]); i < mValveOffsets[valveNumber]; ++i) {
+        const Rule& r = mRules[mValveRules[i]];
+        int c = r.condition.controller - 1;
+        if (!mHasPressure[c] || !r.condition.test(mPressure[c])) {
+            if (rule)
+                *rule = mSourceLines[r.line].trimmed();
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Update the known state of a valve, without evaluating its requirements (e.g. when a command is sent)
+ */
+void InterlockEngine::setValveState(uint valveNumber, bool open)
+{
+    if (valveNumber >= 1 && valveNumber <= N_VALVES)
+        mValveOpen[valveNumber-1] = open;
+}
+
+void InterlockEngine::resetMetrics()
+{
+    mMetrics = Metrics { 0, 0, 0, 0 };
+}
+
+void InterlockEngine::trigger(const Rule &rule, std::vector<Action> &actions)
+{
+    for (int i(rule.firstAction); i < rule.firstAction + rule.actionCount; ++i) {
+        const Action& action = mActions[i];
+        if (action.type == Action::CloseValve || action.type == Action::OpenValve)
+            mValveOpen[action.number-1] = (action.type == Action::OpenValve);
+        actions.push_back(action);
+    }
+    mLastTriggeredRule = mSourceLines[rule.line].trimmed();
+    mMetrics.triggers++;
+}
@@ -0,0 +1,128 @@
+#ifndef INTERLOCKS_H
+#define INTERLOCKS_H
+
+#include <vector>
+
+#include <QtCore>
+
+#include "constants.h"
+
+/**
+ * @brief The InterlockEngine class enforces safety rules on the valves and pressures reported by the microcontroller.
+ *
+ * Rules are written in a text file, one per line ('#' starts a comment). Pressures are in PSI.
+ *
+ * if pressure X <op> P then <action> [and <action> ...]
+ *      When the pressure measured by controller X starts meeting the condition (<op> is <, <=, > or >=), take the
+ *      actions. The rule fires again only after the condition has stopped being met. Actions are:
+ *        - close valves A B C (or a range such as 1-8, or "all"); "valve" also works
+ *        - open valves A B C
+ *        - set pressure Y P
+ *        - stop (stops the running routine)
+ *
+ *      Example: if pressure 2 > 4 then set pressure 2 0 and close valves 1-8 and stop
+ *
+ * valve V requires pressure X <op> P
+ *      Valve V may only be open while the condition is met. Commands to open it are refused otherwise, and if the
+ *      condition stops being met (or the valve is reported open anyway), the valve is closed.
+ *
+ *      Example: valve 5 requires pressure 1 >= 10
+ *
+ * compile() turns the rules into flat arrays: conditions are stored as raw thresholds (0-PR_MAX_VALUE, the units
+ * of the microcontroller), and the rules depending on each pressure controller and each valve are listed
+ * contiguously. Evaluating a measurement therefore only touches the few rules that depend on it, with no parsing,
+ * allocation or unit conversion, whatever the total number of rules.
+ */
+class InterlockEngine
+{
+public:
+    struct Action {
+        enum Type : quint8 {
+            CloseValve,
+            OpenValve,
+            SetPressure,
+            StopRoutine
+        };
+
+        Type type;
+        quint8 number;      // Valve or controller number
+        quint8 value;       // Raw setpoint, for SetPressure
+    };
+
+    /// Evaluation cost since the last call to resetMetrics()
+    struct Metrics {
+        quint64 evaluations;
+        quint64 totalNanoseconds;
+        quint64 maxNanoseconds;
+        quint64 triggers;
+    };
+
+    InterlockEngine();
+
+    bool compile(const QString& source, const QList<QPair<double, double>>& pressureRanges);
+    void clear();
+    QStringList errors() const { return mErrors; }
+    int ruleCount() const { return int(mRules.size()); }
+
+    void onPressure(uint controllerNumber, quint8 value, std::vector<Action>& actions);
+    void onValveState(uint valveNumber, bool open, std::vector<Action>& actions);
+    bool allowsValve(uint valveNumber, bool open, QString* rule = nullptr) const;
+    void setValveState(uint valveNumber, bool open);
+
+    /// Source line of the rule that produced the most recent actions
+    QString lastTriggeredRule() const { return mLastTriggeredRule; }
+
+    Metrics metrics() const { return mMetrics; }
+    void resetMetrics();
+
+private:
+    /// "value >= threshold" or "value <= threshold", in raw units. Strict comparisons are turned into these
+    /// when compiling; the threshold may be out of the 0-PR_MAX_VALUE range, if the condition can never be met.
+    struct Condition {
+        quint8 controller;
+        bool atLeast;
+        qint16 threshold;
+
+        bool test(quint8 value) const { return atLeast ? value >= threshold : value <= threshold; }
+    };
+
+    struct Rule {
+        Condition condition;
+        quint8 requiredBy;      // Valve number for "requires" rules; 0 for "if ... then" rules
+        quint16 firstAction;
+        quint16 actionCount;
+        bool active;            // Whether the condition was met at the last evaluation ("if ... then" rules)
+        int line;
+    };
+
+    static bool parseCondition(const QStringList& tokens, int start, const QList<QPair<double, double>>& pressureRanges,
+                               Condition& condition, QString& error);
+    static bool parsePressure(const QString& token, int controller, const QList<QPair<double, double>>& pressureRanges,
+                              double& raw, QString& error);
+    bool parseActions(const QStringList& tokens, int start, const QList<QPair<double, double>>& pressureRanges,
+                      QString& error);
+    static bool parseValveList(const QStringList& tokens, int& i, std::vector<quint8>& valves);
+    void trigger(const Rule& rule, std::vector<Action>& actions);
+
+    std::vector<Rule> mRules;
+    std::vector<Action> mActions;
+
+    /// Rules depending on each controller / valve: the indices from mPressureOffsets[n-1] to mPressureOffsets[n]
+    /// in mPressureRules. Requirements of valve v are in mValveRules, likewise.
+    std::vector<quint16> mPressureRules;
+    quint16 mPressureOffsets[N_PRS + 1];
+    std::vector<quint16> mValveRules;
+    quint16 mValveOffsets[N_VALVES + 1];
+
+    /// Last known state of the hardware
+    quint8 mPressure[N_PRS];
+    bool mHasPressure[N_PRS];
+    bool mValveOpen[N_VALVES];
+
+    QStringList mSourceLines;
+    QStringList mErrors;
+    QString mLastTriggeredRule;
+    Metrics mMetrics;
+};
+
+#endif // INTERLOCKS_H
@@ -0,0 +1,308 @@
+#include "linkmonitor.h"
+#include "communicator.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cmath>
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::record(qint64 microseconds)
+{
+    mCounts[bucketIndex(microseconds)]++;
+    mCount++;
+    mMax = qMax(mMax, microseconds);
+}
+
+void LatencyHistogram::reset()
+{
+    std::fill(mCounts, mCounts + NumBuckets, 0);
+    mCount = 0;
+    mMax = 0;
+}
+
+/**
+ * @brief Return the value below which the given percentage of the recorded values fall (e.g. 99 for p99)
+ *
+ * The result is the upper bound of the bucket containing that value, so it may exceed the true value by up to
+ * 1/SubBuckets; it never exceeds max().
+ */
+qint64 LatencyHistogram::percentile(double percent) const
+{
+    if (mCount == 0)
+        return 0;
+
+    quint64 rank = quint64(std::ceil(qBound(0., percent, 100.) / 100. * mCount));
+    rank = qMax(rank, quint64(1));
+
+    quint64 cumulated = 0;
+    for (int i(0); i < NumBuckets; ++i) {
+        cumulated += mCounts[i];
+        if (cumulated >= rank)
+            return qMin(bucketUpperBound(i), mMax);
+    }
+    return mMax;
+}
+
+int LatencyHistogram::bucketIndex(qint64 value)
+{
+    if (value < 2 * SubBuckets)
+        return int(qMax(value, qint64(0)));
+
+    // Shift the value until it has as many significant bits as there are sub-buckets, plus the leading one
+    int shift = 0;
+    while ((value >> shift) >= 2 * SubBuckets)
+        ++shift;
+
+    return qMin(SubBuckets * shift + int(value >> shift), NumBuckets - 1);
+}
+
+qint64 LatencyHistogram::bucketUpperBound(int index)
+{
+    if (index < 2 * SubBuckets)
+        return index;
+
+    int shift = index / SubBuckets - 1;
+    qint64 base = index % SubBuckets + SubBuckets;
+    return ((base + 1) << shift) - 1;
+}
+
+
+LinkMonitor::LinkMonitor(Communicator *communicator, QObject *parent)
+    : QObject(parent)
+    , mCommunicator(communicator)
+    , mConfirmationTimeout(2000000)
+    , mLatencyThreshold(250000)
+    , mLossThreshold(0.05)
+    , mHealthy(true)
+{
+    for (Counters& c : mCounters)
+        c = Counters { 0, 0, 0 };
+
+    connect(communicator, &Communicator::commandSent, this, &LinkMonitor::onCommandSent);
+    connect(communicator, &Communicator::valveStateChanged, this, [this](uint valveNumber, bool open) {
+        onConfirmation(ValveCommand, valveNumber, open);
+    });
+    connect(communicator, &Communicator::pumpStateChanged, this, [this](uint pumpNumber, bool on) {
+        onConfirmation(PumpCommand, pumpNumber, on);
+    });
+    connect(communicator, &Communicator::pressureSetpointChanged, this, [this](uint controllerNumber, double pressure) {
+        onConfirmation(PressureCommand, controllerNumber, qRound(pressure*PR_MAX_VALUE));
+    });
+    connect(communicator, &Communicator::uptimeChanged, this, [this](ulong) {
+        onConfirmation(HeartbeatCommand, 0, 0);
+    });
+    connect(communicator, &Communicator::connectionStatusChanged, this, [this](Communicator::ConnectionStatus status) {
+        onConnectionStatusChanged(int(status));
+    });
+
+    mHeartbeatTimer.setInterval(1000);
+    connect(&mHeartbeatTimer, &QTimer::timeout, this, &LinkMonitor::sendHeartbeat);
+
+    mReportTimer.setInterval(10000);
+    connect(&mReportTimer, &QTimer::timeout, this, &LinkMonitor::report);
+    mReportTimer.start();
+}
+
+void LinkMonitor::setHeartbeatInterval(int milliseconds)
+{
+    mHeartbeatTimer.setInterval(qMax(100, milliseconds));
+}
+
+void LinkMonitor::setReportInterval(int milliseconds)
+{
+    mReportTimer.setInterval(qMax(1000, milliseconds));
+}
+
+/**
+ * @brief Set how long to wait for the microcontroller to confirm a command before considering it lost
+ */
+void LinkMonitor::setConfirmationTimeout(int milliseconds)
+{
+    mConfirmationTimeout = qint64(qMax(0, milliseconds)) * 1000;
+}
+
+/**
+ * @brief Set the 99th percentile round-trip time and the proportion of lost commands above which a warning is raised
+ */
+void LinkMonitor::setThresholds(int latencyMilliseconds, double lossRatio)
+{
+    mLatencyThreshold = qint64(latencyMilliseconds) * 1000;
+    mLossThreshold = lossRatio;
+}
+
+QString LinkMonitor::typeName(CommandType type)
+{
+    switch (type) {
+        case ValveCommand:
+            return "valve";
+        case PumpCommand:
+            return "pump";
+        case PressureCommand:
+            return "pressure";
+        case HeartbeatCommand:
+            return "heartbeat";
+        default:
+            return QString();
+    }
+}
+
+/**
+ * @brief Compute the statistics of the current interval, log them, check them against the thresholds, and start a
+ * new interval
+ *
+ * Round-trip times are in milliseconds.
+ */
+void LinkMonitor::report()
+{
+    expirePending();
+
+    QVariantMap statistics;
+    QStringList problems;
+
+    for (int t(0); t < NumCommandTypes; ++t) {
+        LatencyHistogram& h = mHistograms[t];
+        Counters& c = mCounters[t];
+        QString name = typeName(CommandType(t));
+
+        QVariantMap s;
+        s["sent"] = c.sent;
+        s["confirmed"] = c.confirmed;
+        s["lost"] = c.lost;
+        s["p50"] = h.percentile(50) / 1000.;
+        s["p99"] = h.percentile(99) / 1000.;
+        s["max"] = h.max() / 1000.;
+        statistics[name] = s;
+
+        if (c.sent > 0 || c.confirmed > 0 || c.lost > 0) {
+            qCInfo(lcCommunicator) << "Round-trip time of" << name << "commands (ms): p50" << s["p50"].toDouble()
+                                   << "p99" << s["p99"].toDouble() << "max" << s["max"].toDouble()
+                                   << "; sent" << c.sent << "confirmed" << c.confirmed << "lost" << c.lost;
+        }
+
+        if (h.count() > 0 && h.percentile(99) > mLatencyThreshold)
+            problems << QString("%1 commands take %2 ms to be confirmed (99th percentile)").arg(name).arg(s["p99"].toDouble());
+
+        quint64 answered = c.confirmed + c.lost;
+        if (answered > 0 && double(c.lost) / answered > mLossThreshold)
+            problems << QString("%1 of %2 %3 commands were not confirmed").arg(c.lost).arg(answered).arg(name);
+
+        h.reset();
+        c = Counters { 0, 0, 0 };
+    }
+
+    mStatistics = statistics;
+    emit statisticsChanged();
+
+    for (QString const& problem : problems)
+        warn(problem);
+
+    bool healthy = problems.isEmpty();
+    if (healthy != mHealthy) {
+        mHealthy = healthy;
+        emit healthChanged(healthy);
+    }
+}
+
+void LinkMonitor::onCommandSent(QByteArray message)
+{
+    if (message.isEmpty())
+        return;
+
+    Pending p { NumCommandTypes, 0, 0, telemetryClock() };
+    switch ((uint8_t)message[0]) {
+        case VALVE:
+            p.type = ValveCommand;
+            break;
+        case PUMP:
+            p.type = PumpCommand;
+            break;
+        case PRESSURE:
+            p.type = PressureCommand;
+            break;
+        case UPTIME:
+            p.type = HeartbeatCommand;
+            break;
+        default:
+            return;
+    }
+
+    if (p.type != HeartbeatCommand) {
+        // command, size, number, size, value
+        if (message.size() < 5)
+            return;
+        p.number = (uint8_t)message[2];
+        p.value = (uint8_t)message[4];
+    }
+
+    mPending.push_back(p);
+    mCounters[p.type].sent++;
+}
+
+void LinkMonitor::onConfirmation(CommandType type, uint number, int value)
+{
+    qint64 now = telemetryClock();
+
+    for (auto it = mPending.begin(); it != mPending.end(); ++it) {
+        if (it->type == type && it->number == number && it->value == value) {
+            mHistograms[type].record(now - it->sentAt);
+            mCounters[type].confirmed++;
+
+            // Commands sent to the same component before this one were overtaken
+            auto overtaken = std::remove_if(mPending.begin(), it + 1, [type, number](const Pending& p) {
+                return p.type == type && p.number == number;
+            });
+            mPending.erase(overtaken, it + 1);
+            return;
+        }
+    }
+}
+
+void LinkMonitor::onConnectionStatusChanged(int status)
+{
+    if (status == Communicator::Connected)
+        mHeartbeatTimer.start();
+    else {
+        mHeartbeatTimer.stop();
+        mPending.clear();
+    }
+}
+
+/**
+ * @brief Count the commands that haven't been confirmed within the confirmation timeout as lost
+ */
+void LinkMonitor::expirePending()
+{
+    qint64 now = telemetryClock();
+    bool heartbeatLost = false;
+
+    while (!mPending.empty() && now - mPending.front().sentAt >= mConfirmationTimeout) {
+        CommandType type = mPending.front().type;
+        mCounters[type].lost++;
+        heartbeatLost |= (type == HeartbeatCommand);
+        mPending.pop_front();
+    }
+
+    if (heartbeatLost) {
+        warn(QString("The microcontroller did not answer within %1 ms").arg(mConfirmationTimeout / 1000));
+        if (mHealthy) {
+            mHealthy = false;
+            emit healthChanged(false);
+        }
+    }
+}
+
+void LinkMonitor::sendHeartbeat()
+{
+    expirePending();
+    mCommunicator->requestUptime();
+}
+
+void LinkMonitor::warn(const QString &message)
+{
+    qCWarning(lcCommunicator).noquote() << "Link:" << message;
+    emit linkWarning(message);
+}
@@ -0,0 +1,139 @@
+#ifndef LINKMONITOR_H
+#define LINKMONITOR_H
+
+#include <deque>
+
+#include <QtCore>
+
+#include "constants.h"
+
+class Communicator;
+
+/**
+ * @brief Histogram of latencies, in microseconds, with a bounded relative error
+ *
+ * Buckets are laid out as in HdrHistogram: each power of two is split into SubBuckets linear buckets, so that
+ * any value is counted within 1/SubBuckets (about 6%) of its true value, from 1 microsecond to over an hour,
+ * in a fixed array. Recording is a few shifts and an increment.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(qint64 microseconds);
+    void reset();
+
+    quint64 count() const { return mCount; }
+    qint64 max() const { return mMax; }
+    qint64 percentile(double percent) const;
+
+private:
+    static const int SubBuckets = 16;
+    static const int MaxShift = 32;
+    static const int NumBuckets = SubBuckets * (MaxShift + 2);
+
+    static int bucketIndex(qint64 value);
+    static qint64 bucketUpperBound(int index);
+
+    quint64 mCounts[NumBuckets];
+    quint64 mCount;
+    qint64 mMax;
+};
+
+
+/**
+ * @brief The LinkMonitor class measures the round-trip time of commands sent to the microcontroller, and how many
+ * go unanswered.
+ *
+ * The microcontroller reports the state of a valve, pump or pressure controller after each command changing it.
+ * Each command written (Communicator::commandSent) is matched with the first report of the requested state for the
+ * same component; the time in between is recorded in a LatencyHistogram per command type. Earlier commands for
+ * that component that are still unconfirmed are dropped without being counted, as the device may only report the
+ * latest state. Commands that are not confirmed within the confirmation timeout count as lost.
+ *
+ * While connected, an UPTIME request is sent every heartbeat interval, so that the link is measured even when the
+ * user is not doing anything.
+ *
+ * Every report interval, statistics (p50, p99, max, loss) are computed over the interval, logged, and published
+ * for the user interface. If the 99th percentile of the round-trip time or the proportion of lost commands
+ * exceeds its threshold, or a heartbeat goes unanswered, a warning is logged and linkWarning() is emitted.
+ */
+class LinkMonitor : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(QVariantMap statistics READ statistics NOTIFY statisticsChanged)
+    Q_PROPERTY(bool healthy READ isHealthy NOTIFY healthChanged)
+
+public:
+    enum CommandType {
+        ValveCommand,
+        PumpCommand,
+        PressureCommand,
+        HeartbeatCommand,
+        NumCommandTypes
+    };
+
+    LinkMonitor(Communicator* communicator, QObject* parent = nullptr);
+
+    void setHeartbeatInterval(int milliseconds);
+    void setReportInterval(int milliseconds);
+    void setConfirmationTimeout(int milliseconds);
+    void setThresholds(int latencyMilliseconds, double lossRatio);
+
+    QVariantMap statistics() const { return mStatistics; }
+    bool isHealthy() const { return mHealthy; }
+
+    static QString typeName(CommandType type);
+
+public slots:
+    void report();
+
+signals:
+    void statisticsChanged();
+    void healthChanged(bool healthy);
+    void linkWarning(QString message);
+
+private:
+    struct Pending {
+        CommandType type;
+        uint number;
+        int value;          // Requested state, as sent; 0 for heartbeats
+        qint64 sentAt;      // telemetryClock()
+    };
+
+    struct Counters {
+        quint64 sent;
+        quint64 confirmed;
+        quint64 lost;
+    };
+
+    void onCommandSent(QByteArray message);
+    void onConfirmation(CommandType type, uint number, int value);
+    void onConnectionStatusChanged(int status);
+    void expirePending();
+    void sendHeartbeat();
+    void warn(const QString& message);
+
+    Communicator* mCommunicator;
+
+    std::deque<Pending> mPending;
+    LatencyHistogram mHistograms[NumCommandTypes];
+    Counters mCounters[NumCommandTypes];
+
+    QTimer mHeartbeatTimer;
+    QTimer mReportTimer;
+    qint64 mConfirmationTimeout;    // Microseconds
+    qint64 mLatencyThreshold;       // Microseconds
+    double mLossThreshold;
+
+    QVariantMap mStatistics;
+    bool mHealthy;
+
+#ifdef TESTING
+    friend class TestLinkMonitor;
+#endif
+};
+
+#endif // LINKMONITOR_H
@@ -0,0 +1,401 @@
+#include "logfilemodel.h"
+#include "logmodel.h"
+#include "logger.h"
+
+#include <cstring>
+
+#include <QtConcurrent>
+
+namespace {
+
+/// Header of the ".idx" file saved alongside a log file. Values are in native byte order, since
+/// the index is only a cache: it is rebuilt if it can't be used.
+struct IndexFileHeader {
+    char magic[4];
+    quint32 version;
+    qint64 sourceSize;
+    qint64 sourceModified;
+    quint64 lineCount;
+};
+
+const char IndexMagic[4] = {'U', 'L', 'I', 'X'};
+const quint32 IndexVersion = 1;
+
+/// Length of the "yyyy-MM-dd hh:mm:ss.zzz" timestamp at the start of each line
+const int TimestampLength = 23;
+
+}
+
+LogFileModel::LogFileModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , mData(nullptr)
+    , mSourceSize(0)
+    , mSourceModified(0)
+    , mIndexData(nullptr)
+    , mLineCount(0)
+    , mOffsets(nullptr)
+    , mLevels(nullptr)
+    , mIndexing(false)
+{
+    for (int i(0); i < 4; ++i)
+        mLevelEnabled[i] = true;
+
+    connect(&mIndexWatcher, &QFutureWatcherBase::finished, this, &LogFileModel::onIndexBuilt);
+}
+
+LogFileModel::~LogFileModel()
+{
+    close();
+}
+
+int LogFileModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return int(mRows.size());
+}
+
+QVariant LogFileModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= int(mRows.size()))
+        return QVariant();
+
+    quint32 line = mRows[index.row()];
+    quint8 level = mLevels[line];
+
+    if (role == LogModel::LevelRole)
+        return int(level & ~ContinuationFlag);
+
+    const char* start = reinterpret_cast<const char*>(mData + mOffsets[line]);
+    qint64 length = mOffsets[line+1] - mOffsets[line];
+    while (length > 0 && (start[length-1] == '\n' || start[length-1] == '\r'))
+        length--;
+
+    if (level & ContinuationFlag) {
+        if (role == LogModel::MessageRole || role == Qt::DisplayRole)
+            return QString::fromUtf8(start, int(length));
+        return QString();
+    }
+
+    // Line format: "yyyy-MM-dd hh:mm:ss.zzz Type: message"
+    const char* typeStart = start + TimestampLength + 1;
+    const char* end = start + length;
+    const char* typeEnd = static_cast<const char*>(memchr(typeStart, ':', size_t(end - typeStart)));
+    if (!typeEnd)
+        typeEnd = end;
+
+    switch (role) {
+        case LogModel::TimeRole:
+            return QString::fromLatin1(start, TimestampLength);
+        case LogModel::TypeRole:
+            return QString::fromLatin1(typeStart, int(typeEnd - typeStart));
+        case Qt::DisplayRole:
+        case LogModel::MessageRole: {
+            const char* messageStart = qMin(typeEnd + 2, end);
+            return QString::fromUtf8(messageStart, int(end - messageStart));
+        }
+        default:
+            return QVariant();
+    }
+}
+
+QHash<int, QByteArray> LogFileModel::roleNames() const
+{
+    QHash<int, QByteArray> roles;
+    roles[LogModel::TimeRole] = "time";
+    roles[LogModel::TypeRole] = "type";
+    roles[LogModel::MessageRole] = "message";
+    roles[LogModel::LevelRole] = "level";
+    return roles;
+}
+
+/**
+ * @brief Open a log file
+ * @param filePath Path to the log file
+ * @return True if the file could be opened and mapped
+ *
+ * If an up-to-date index file exists, the rows are available as soon as this function returns.
+ * Otherwise, the index is built in a separate thread; the `indexing` property is true until it is done.
+ */
+bool LogFileModel::open(const QString &filePath)
+{
+    close();
+
+    mFile.setFileName(filePath);
+    if (!mFile.open(QIODevice::ReadOnly)) {
+        qCWarning(lcGui) << "Could not open log file" << filePath << ":" << mFile.errorString();
+        return false;
+    }
+
+    mSourceSize = mFile.size();
+    mSourceModified = QFileInfo(mFile).lastModified().toMSecsSinceEpoch();
+
+    if (mSourceSize > 0) {
+        mData = mFile.map(0, mSourceSize);
+        if (!mData) {
+            qCWarning(lcGui) << "Could not map log file" << filePath << ":" << mFile.errorString();
+            mFile.close();
+            return false;
+        }
+    }
+
+    emit fileChanged(fileName());
+
+    if (mData && !loadIndexFile()) {
+        mIndexing = true;
+        mIndexWatcher.setFuture(QtConcurrent::run(&LogFileModel::buildIndex, mData, mSourceSize));
+        emit indexingChanged(true);
+        return true;
+    }
+
+    rebuildRows();
+    return true;
+}
+
+/**
+ * @brief Close the current file, if any
+ */
+void LogFileModel::close()
+{
+    // The indexing thread reads from the mapped file, so it must be done before unmapping it. Its finished()
+    // signal may already be queued; dropping the future makes sure its result isn't applied to the next file.
+    mIndexWatcher.waitForFinished();
+    mIndexWatcher.setFuture(QFuture<Index>());
+    bool wasIndexing = mIndexing;
+    mIndexing = false;
+
+    beginResetModel();
+    mRows.clear();
+    mLineCount = 0;
+    mOffsets = nullptr;
+    mLevels = nullptr;
+    mIndex = Index();
+
+    if (mIndexData) {
+        mIndexFile.unmap(const_cast<uchar*>(mIndexData));
+        mIndexData = nullptr;
+    }
+    mIndexFile.close();
+
+    if (mData) {
+        mFile.unmap(const_cast<uchar*>(mData));
+        mData = nullptr;
+    }
+    mFile.close();
+    mSourceSize = 0;
+    mSourceModified = 0;
+    endResetModel();
+
+    emit countChanged(0);
+    if (wasIndexing)
+        emit indexingChanged(false);
+}
+
+QString LogFileModel::fileName() const
+{
+    return QFileInfo(mFile.fileName()).fileName();
+}
+
+void LogFileModel::onIndexBuilt()
+{
+    // Also called for the empty future set by close(), and possibly after the current file was indexed already
+    if (!mIndexing || !mIndexWatcher.isFinished())
+        return;
+
+    mIndexing = false;
+
+    mIndex = mIndexWatcher.result();
+    mLineCount = quint32(mIndex.levels.size());
+    mOffsets = mIndex.offsets.data();
+    mLevels = mIndex.levels.data();
+
+    saveIndexFile(mIndex);
+    rebuildRows();
+    emit indexingChanged(false);
+}
+
+/**
+ * @brief Scan the log file once, to find the start and level of each line
+ */
+LogFileModel::Index LogFileModel::buildIndex(const uchar *data, qint64 size)
+{
+    Index index;
+    const char* begin = reinterpret_cast<const char*>(data);
+    const char* end = begin + size;
+    const char* line = begin;
+
+    // Rough estimate, based on the typical length of a log line
+    index.offsets.reserve(size_t(size / 80));
+    index.levels.reserve(size_t(size / 80));
+
+    quint8 previousLevel = LogModel::InfoLevel;
+
+    while (line < end) {
+        const char* newline = static_cast<const char*>(memchr(line, '\n', size_t(end - line)));
+        const char* next = newline ? newline + 1 : end;
+
+        int level = parseLevel(line, next - line);
+        if (level < 0)
+            index.levels.push_back(previousLevel | ContinuationFlag);
+        else {
+            previousLevel = quint8(level);
+            index.levels.push_back(previousLevel);
+        }
+        index.offsets.push_back(quint64(line - begin));
+
+        line = next;
+    }
+    index.offsets.push_back(quint64(size));
+
+    return index;
+}
+
+/**
+ * @brief Return the level of a line written by Logger::messageHandler, or -1 if it is not the first line of a message
+ */
+int LogFileModel::parseLevel(const char *line, qint64 length)
+{
+    if (length < TimestampLength + 2 || line[4] != '-' || line[10] != ' ' || line[13] != ':'
+            || line[19] != '.' || line[TimestampLength] != ' ')
+        return -1;
+
+    const char* type = line + TimestampLength + 1;
+    qint64 remaining = length - TimestampLength - 1;
+
+    auto startsWith = [type, remaining](const char* prefix) {
+        size_t n = strlen(prefix);
+        return qint64(n) <= remaining && memcmp(type, prefix, n) == 0;
+    };
+
+    if (startsWith("Debug:"))
+        return LogModel::DebugLevel;
+    if (startsWith("Info:"))
+        return LogModel::InfoLevel;
+    if (startsWith("Warning:"))
+        return LogModel::WarningLevel;
+    if (startsWith("Critical error:") || startsWith("Fatal error:"))
+        return LogModel::ErrorLevel;
+    return -1;
+}
+
+QString LogFileModel::indexFilePath() const
+{
+    return mFile.fileName() + ".idx";
+}
+
+/**
+ * @brief Map the index file saved alongside the log file, if there is one and it matches the log file
+ * @return True if the index was loaded
+ */
+bool LogFileModel::loadIndexFile()
+{
+    mIndexFile.setFileName(indexFilePath());
+    if (!mIndexFile.open(QIODevice::ReadOnly))
+        return false;
+
+    IndexFileHeader header;
+    qint64 fileSize = mIndexFile.size();
+    if (fileSize < qint64(sizeof(header))) {
+        mIndexFile.close();
+        return false;
+    }
+
+    mIndexData = mIndexFile.map(0, fileSize);
+    if (!mIndexData) {
+        mIndexFile.close();
+        return false;
+    }
+    memcpy(&header, mIndexData, sizeof(header));
+
+    qint64 expectedSize = qint64(sizeof(header) + (header.lineCount + 1) * sizeof(quint64) + header.lineCount);
+
+    if (memcmp(header.magic, IndexMagic, 4) != 0 || header.version != IndexVersion
+            || header.sourceSize != mSourceSize || header.sourceModified != mSourceModified
+            || header.lineCount > quint64(mSourceSize) || fileSize != expectedSize
+            || !isIndexValid(header.lineCount)) {
+        mIndexFile.unmap(const_cast<uchar*>(mIndexData));
+        mIndexData = nullptr;
+        mIndexFile.close();
+        return false;
+    }
+
+    mLineCount = quint32(header.lineCount);
+    mOffsets = reinterpret_cast<const quint64*>(mIndexData + sizeof(header));
+    mLevels = mIndexData + sizeof(header) + (header.lineCount + 1) * sizeof(quint64);
+    return true;
+}
+
+/**
+ * @brief Check that the mapped index file only points inside the log file, so that a stale or damaged index
+ * can't cause reads past its end
+ */
+bool LogFileModel::isIndexValid(quint64 lineCount) const
+{
+    const quint64* offsets = reinterpret_cast<const quint64*>(mIndexData + sizeof(IndexFileHeader));
+    const quint8* levels = mIndexData + sizeof(IndexFileHeader) + (lineCount + 1) * sizeof(quint64);
+
+    if (offsets[0] != 0 || offsets[lineCount] != quint64(mSourceSize))
+        return false;
+
+    for (quint64 i(0); i < lineCount; ++i) {
+        if (offsets[i] >= offsets[i+1] || (levels[i] & ~ContinuationFlag) >= LogModel::NumLevels)
+            return false;
+    }
+    return true;
+}
+
+void LogFileModel::saveIndexFile(const Index &index)
+{
+    IndexFileHeader header;
+    memcpy(header.magic, IndexMagic, 4);
+    header.version = IndexVersion;
+    header.sourceSize = mSourceSize;
+    header.sourceModified = mSourceModified;
+    header.lineCount = index.levels.size();
+
+    QSaveFile file(indexFilePath());
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcGui) << "Could not save log index file" << indexFilePath();
+        return;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(index.offsets.data()), qint64(index.offsets.size() * sizeof(quint64)));
+    file.write(reinterpret_cast<const char*>(index.levels.data()), qint64(index.levels.size()));
+    file.commit();
+}
+
+void LogFileModel::setLevelEnabled(int level, bool enabled)
+{
+    if (mLevelEnabled[level] == enabled)
+        return;
+
+    mLevelEnabled[level] = enabled;
+    rebuildRows();
+    emit filterChanged();
+}
+
+/**
+ * @brief Recompute the visible rows from the level of each line
+ */
+void LogFileModel::rebuildRows()
+{
+    std::vector<quint32> rows;
+
+    bool allEnabled = mLevelEnabled[0] && mLevelEnabled[1] && mLevelEnabled[2] && mLevelEnabled[3];
+    if (allEnabled) {
+        rows.resize(mLineCount);
+        for (quint32 i(0); i < mLineCount; ++i)
+            rows[i] = i;
+    }
+    else {
+        for (quint32 i(0); i < mLineCount; ++i) {
+            if (mLevelEnabled[mLevels[i] & ~ContinuationFlag])
+                rows.push_back(i);
+        }
+    }
+
+    beginResetModel();
+    mRows.swap(rows);
+    endResetModel();
+    emit countChanged(rowCount());
+}
@@ -0,0 +1,119 @@
+#ifndef LOGFILEMODEL_H
+#define LOGFILEMODEL_H
+
+#include <vector>
+
+#include <QtCore>
+#include <QAbstractListModel>
+
+/**
+ * @brief The LogFileModel class displays a log file written by a previous session of the application.
+ *
+ * The file is memory-mapped rather than read. When a file is first opened, it is scanned once to build
+ * a line index (the offset of each line, and its message level); this index is saved next to the log
+ * file (with an ".idx" suffix), so that opening the same file again only requires mapping both files.
+ * Lines are only parsed into time, type and message when the view requests them.
+ *
+ * Lines follow the format written by Logger::messageHandler:
+ *
+ *     yyyy-MM-dd hh:mm:ss.zzz Type: message
+ *
+ * Lines that don't match it (e.g. the second line of a multi-line message) take the level of the
+ * preceding line, and are displayed with an empty time and type.
+ *
+ * The roles are the same as LogModel's, so the log screen can display either model with the same delegate.
+ */
+class LogFileModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+    Q_PROPERTY(QString fileName READ fileName NOTIFY fileChanged)
+    Q_PROPERTY(bool indexing READ isIndexing NOTIFY indexingChanged)
+    Q_PROPERTY(bool showDebug READ showDebug WRITE setShowDebug NOTIFY filterChanged)
+    Q_PROPERTY(bool showInfo READ showInfo WRITE setShowInfo NOTIFY filterChanged)
+    Q_PROPERTY(bool showWarnings READ showWarnings WRITE setShowWarnings NOTIFY filterChanged)
+    Q_PROPERTY(bool showErrors READ showErrors WRITE setShowErrors NOTIFY filterChanged)
+    Q_PROPERTY(int count READ rowCount NOTIFY countChanged)
+
+public:
+    LogFileModel(QObject* parent = nullptr);
+    virtual ~LogFileModel();
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    Q_INVOKABLE bool open(const QString& filePath);
+    Q_INVOKABLE void close();
+
+    QString fileName() const;
+    bool isIndexing() const { return mIndexing; }
+
+    bool showDebug() const { return mLevelEnabled[0]; }
+    bool showInfo() const { return mLevelEnabled[1]; }
+    bool showWarnings() const { return mLevelEnabled[2]; }
+    bool showErrors() const { return mLevelEnabled[3]; }
+
+    void setShowDebug(bool show) { setLevelEnabled(0, show); }
+    void setShowInfo(bool show) { setLevelEnabled(1, show); }
+    void setShowWarnings(bool show) { setLevelEnabled(2, show); }
+    void setShowErrors(bool show) { setLevelEnabled(3, show); }
+
+signals:
+    void fileChanged(QString fileName);
+    void indexingChanged(bool indexing);
+    void filterChanged();
+    void countChanged(int count);
+
+private slots:
+    void onIndexBuilt();
+
+private:
+    /// Line index, as built from the log file or as loaded from the index file
+    struct Index {
+        std::vector<quint64> offsets; // offsets[i] is the start of line i; the last element is the file size
+        std::vector<quint8> levels; // LogModel::Level of each line, with ContinuationFlag set if applicable
+    };
+
+    static const quint8 ContinuationFlag = 0x80;
+
+    static Index buildIndex(const uchar* data, qint64 size);
+    static int parseLevel(const char* line, qint64 length);
+
+    bool loadIndexFile();
+    bool isIndexValid(quint64 lineCount) const;
+    void saveIndexFile(const Index& index);
+    QString indexFilePath() const;
+
+    void setLevelEnabled(int level, bool enabled);
+    void rebuildRows();
+
+    QFile mFile;
+    const uchar* mData;
+
+    /// Size and modification time of the log file when it was opened, which the index must match
+    qint64 mSourceSize;
+    qint64 mSourceModified;
+
+    /// The index file, mapped when an up-to-date one exists
+    QFile mIndexFile;
+    const uchar* mIndexData;
+
+    /// The index, when it had to be built (i.e. no valid index file was found)
+    Index mIndex;
+
+    /// Number of lines in the file, and pointers to the index (either mIndex's or the mapped index file's)
+    quint32 mLineCount;
+    const quint64* mOffsets;
+    const quint8* mLevels;
+
+    bool mLevelEnabled[4];
+
+    /// Line numbers of the visible rows
+    std::vector<quint32> mRows;
+
+    QFutureWatcher<Index> mIndexWatcher;
+    bool mIndexing;
+};
+
+#endif // LOGFILEMODEL_H
@@ -1,5 +1,11 @@
 #include "logger.h"
 
+#include <QStringBuilder>
+
+Q_LOGGING_CATEGORY(lcCommunicator, "ufcs.communicator")
+Q_LOGGING_CATEGORY(lcRoutine, "ufcs.routine")
+Q_LOGGING_CATEGORY(lcGui, "ufcs.gui")
+
 static Logger* singleton = nullptr;
 
 Logger* Logger::logger()
@@ -12,7 +18,7 @@ Logger* Logger::logger()
 Logger::Logger()
 {
     // Initialize log file path
-    QString dataLocation = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/logs";
+    QString dataLocation = logDirectory();
     QDir d;
     if (!d.mkpath(dataLocation))
         fprintf(stderr, "Could not create directory for log file storage\n");
@@ -23,72 +29,202 @@ Logger::Logger()
     QByteArray path = mLogFilePath.toLocal8Bit();
     fprintf(stdout, "Log file location: %s\n", path.constData());
 
+    // The file is kept open for the whole session, rather than re-opened for each message
+    mLogFile.setFileName(mLogFilePath);
+    if (!mLogFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        fprintf(stderr, "Could not open log file for writing at %s\n", path.constData());
+        fflush(stderr);
+    }
+
+    mPendingMessagesMetric = &MetricsRegistry::registry()->gauge("ufcs_logger_pending_messages", "Log messages waiting to be written to the log file");
+    mMessagesMetric = &MetricsRegistry::registry()->counter("ufcs_log_messages_total", "Log messages handled, all levels included");
+
     connect(this , &Logger::newLogForFile, this, &Logger::logToFile);
     connect(this, &Logger::newLogForFile, this, &Logger::logToTerminal);
 }
 
+/**
+ * @brief Return the directory in which log files are saved
+ */
+QString Logger::logDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/logs";
+}
+
+/**
+ * @brief Return the paths of the log files written by previous sessions, most recent first
+ *
+ * The log file of the current session is not included, since it is still being written to.
+ */
+QStringList Logger::pastLogFiles()
+{
+    QDir d(logDirectory());
+    QStringList files;
+
+    for (const QFileInfo& info : d.entryInfoList(QStringList() << "log_*.txt", QDir::Files, QDir::Name | QDir::Reversed)) {
+        if (singleton == nullptr || info.absoluteFilePath() != QFileInfo(singleton->mLogFilePath).absoluteFilePath())
+            files << info.absoluteFilePath();
+    }
+    return files;
+}
+
+/**
+ * @brief Return the names of the logging categories whose level can be set with setCategoryLevel
+ */
+QStringList Logger::categoryNames()
+{
+    return QStringList() << "communicator" << "routine" << "gui";
+}
+
+QLoggingCategory* Logger::category(const QString &name)
+{
+    if (name == "communicator")
+        return &lcCommunicator();
+    if (name == "routine")
+        return &lcRoutine();
+    if (name == "gui")
+        return &lcGui();
+    return nullptr;
+}
+
+Logger::Level Logger::categoryLevel(const QString &name)
+{
+    QLoggingCategory* c = category(name);
+    if (!c || c->isDebugEnabled())
+        return DebugLevel;
+    if (c->isInfoEnabled())
+        return InfoLevel;
+    return WarningLevel;
+}
+
+/**
+ * @brief Set the minimum level of messages that are logged for a given category
+ * @param name One of the names returned by categoryNames()
+ * @param level The minimum level. Warnings and errors are always logged.
+ */
+void Logger::setCategoryLevel(const QString &name, Level level)
+{
+    QLoggingCategory* c = category(name);
+    if (!c) {
+        qWarning() << "Unknown logging category:" << name;
+        return;
+    }
+
+    c->setEnabled(QtDebugMsg, level <= DebugLevel);
+    c->setEnabled(QtInfoMsg, level <= InfoLevel);
+}
+
+/**
+ * @brief Format the current date and time
+ *
+ * Rather than querying the system's wall clock and time zone for every message, the local time is read once a
+ * minute (by each logging thread) and advanced with a monotonic timer in between. Changes to the system clock,
+ * including daylight saving time, are thus reflected within a minute. The date string is only re-formatted when the
+ * day changes.
+ */
+void Logger::currentTimestamp(QString &date, QString &time)
+{
+    const qint64 ResyncInterval = 60000;
+
+    // Local time as of the last reading of the wall clock, in milliseconds since the epoch
+    static thread_local qint64 baseMSecs = 0;
+    static thread_local QElapsedTimer timer;
+
+    if (!timer.isValid() || timer.elapsed() >= ResyncInterval) {
+        QDateTime wallClock = QDateTime::currentDateTime();
+        baseMSecs = wallClock.toMSecsSinceEpoch() + 1000*qint64(wallClock.offsetFromUtc());
+        timer.start();
+    }
+
+    const qint64 msPerDay = 86400000;
+    qint64 now = baseMSecs + timer.elapsed();
+    qint64 day = now / msPerDay;
+
+    static thread_local qint64 cachedDay = -1;
+    static thread_local QString cachedDate;
+    if (day != cachedDay) {
+        cachedDay = day;
+        cachedDate = QDateTime::fromMSecsSinceEpoch(day * msPerDay, Qt::UTC).toString("yyyy-MM-dd");
+    }
+    date = cachedDate;
+
+    // hh:mm:ss.zzz
+    int ms = int(now % msPerDay);
+    int fields[4] = { ms / 3600000, (ms / 60000) % 60, (ms / 1000) % 60, ms % 1000 };
+
+    time = QString(12, Qt::Uninitialized);
+    QChar* c = time.data();
+    for (int i(0); i < 3; ++i) {
+        *c++ = QLatin1Char(char('0' + fields[i] / 10));
+        *c++ = QLatin1Char(char('0' + fields[i] % 10));
+        *c++ = QLatin1Char(i < 2 ? ':' : '.');
+    }
+    *c++ = QLatin1Char(char('0' + fields[3] / 100));
+    *c++ = QLatin1Char(char('0' + (fields[3] / 10) % 10));
+    *c = QLatin1Char(char('0' + fields[3] % 10));
+}
+
 void Logger::messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
 {
-    QString date = QDateTime::currentDateTime().toString("yyyy-MM-dd");
-    QString time = QDateTime::currentDateTime().toString("hh:mm:ss.zzz");
+    QString date, time;
+    currentTimestamp(date, time);
 
-    QString messageType;
+    QLatin1String messageType("");
     QString message;
 
     switch (type) {
     case QtDebugMsg:
-        messageType  = "Debug";
+        messageType  = QLatin1String("Debug");
         message = msg;
         break;
     case QtInfoMsg:
-        messageType  = "Info";
+        messageType  = QLatin1String("Info");
         message = msg;
         break;
     case QtWarningMsg:
-        messageType  = "Warning";
+        messageType  = QLatin1String("Warning");
         message = msg;
         break;
     case QtCriticalMsg:
-        messageType  = "Critical error";
+        messageType  = QLatin1String("Critical error");
         message = QString("%1 (%2:%3, %4)").arg(msg).arg(context.file).arg(context.line).arg(context.function);
         break;
     case QtFatalMsg:
-        messageType  = "Fatal error";
+        messageType  = QLatin1String("Fatal error");
         message = QString("%1 (%2:%3, %4)").arg(msg).arg(context.file).arg(context.line).arg(context.function);
         break;
     }
 
-    QString text = date + " " + time + " " + messageType + ": " + message + "\n";
+    QString text = date % QLatin1Char(' ') % time % QLatin1Char(' ') % messageType % QLatin1String(": ") % message % QLatin1Char('\n');
 
-    emit logger()->newLogForFile(text);
+    Logger* l = logger();
+    l->mMessagesMetric->increment();
+    l->mPendingMessagesMetric->increment();
+    emit l->newLogForFile(text);
 
     // Logs are stored in a fragmented way to make rich markup easier in QML.
-    // Date is omitted since not particularly useful within the app
-    QStringList toAdd;
-    if(type == QtCriticalMsg || type == QtFatalMsg || type == QtWarningMsg || type == QtInfoMsg){
+    // Date is omitted since not particularly useful within the app.
+    // Debug messages only go to the log file.
+    if (type != QtDebugMsg) {
+        QStringList toAdd;
         toAdd << time << messageType << message;
         emit logger()->newLogForGUI(toAdd);
     }
-
 }
 
 void Logger::logToFile(QString message)
 {
-    QFile logFile(logger()->mLogFilePath);
-    if (logFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
-        QTextStream ts(&logFile);
-        ts << message;
-    }
-    else {
-        QByteArray path = logger()->mLogFilePath.toLocal8Bit();
-        fprintf(stderr, "Could not open log file for writing at %s", path.constData());
-        fflush(stderr);
+    mPendingMessagesMetric->decrement();
+
+    if (mLogFile.isOpen()) {
+        mLogFile.write(message.toUtf8());
+        mLogFile.flush();
     }
 }
 
 void Logger::logToTerminal(QString message)
 {
     QByteArray b = message.toLocal8Bit();
-    fprintf(stdout, b.constData());
+    fputs(b.constData(), stdout);
     fflush(stdout); // Force output to be printed right away
 }
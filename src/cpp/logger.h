@@ -3,14 +3,36 @@
 #include <QObject>
 #include <QtCore>
 
+#include "metrics.h"
+
+/// Logging categories. Use qCDebug(lcCommunicator) etc. instead of qDebug(), so that debug output can be
+/// switched off at run time; a disabled category costs a single branch, and the message isn't formatted.
+Q_DECLARE_LOGGING_CATEGORY(lcCommunicator)
+Q_DECLARE_LOGGING_CATEGORY(lcRoutine)
+Q_DECLARE_LOGGING_CATEGORY(lcGui)
+
 class Logger : public QObject
 {
     Q_OBJECT
 
 public:
+    /// Minimum level of the messages logged for a category (see setCategoryLevel)
+    enum Level {
+        DebugLevel,
+        InfoLevel,
+        WarningLevel
+    };
+
     static Logger* logger();
     static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg);
 
+    static QString logDirectory();
+    static QStringList pastLogFiles();
+
+    static QStringList categoryNames();
+    static Level categoryLevel(const QString& name);
+    static void setCategoryLevel(const QString& name, Level level);
+
 signals:
     void newLogForGUI(QStringList message);
     void newLogForFile(QString message);
@@ -21,7 +43,15 @@ private slots:
 
 private:
     Logger();
+    static QLoggingCategory* category(const QString& name);
+    static void currentTimestamp(QString& date, QString& time);
+
     QString mLogFilePath;
+    QFile mLogFile;
+
+    /// Messages handled but not yet written to the file; grows when other threads log faster than it is written
+    MetricsRegistry::Metric* mPendingMessagesMetric;
+    MetricsRegistry::Metric* mMessagesMetric;
 };
 
 #endif // LOGGER_H
@@ -0,0 +1,337 @@
+#include "logmodel.h"
+
+#include <QtConcurrent>
+
+LogModel::LogModel(int capacity, QObject *parent)
+    : QAbstractListModel(parent)
+    , mCapacity(qMax(1, capacity))
+    , mHead(0)
+    , mSize(0)
+    , mFirstSequence(0)
+{
+}
+
+int LogModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return mSize;
+}
+
+QVariant LogModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= mSize)
+        return QVariant();
+
+    const Entry& e = entry(mFirstSequence + index.row());
+
+    switch (role) {
+        case TimeRole:
+            return e.time;
+        case TypeRole:
+            return e.type;
+        case Qt::DisplayRole:
+        case MessageRole:
+            return e.message;
+        case LevelRole:
+            return e.level;
+        default:
+            return QVariant();
+    }
+}
+
+QHash<int, QByteArray> LogModel::roleNames() const
+{
+    QHash<int, QByteArray> roles;
+    roles[TimeRole] = "time";
+    roles[TypeRole] = "type";
+    roles[MessageRole] = "message";
+    roles[LevelRole] = "level";
+    return roles;
+}
+
+/**
+ * @brief Return the message with the given sequence number
+ *
+ * The sequence number must be between firstSequence() and endSequence().
+ */
+const LogModel::Entry& LogModel::entry(quint64 sequence) const
+{
+    int offset = int(sequence - mFirstSequence);
+    return mEntries[(mHead + offset) % mCapacity];
+}
+
+/**
+ * @brief Return the level corresponding to a message type, as written by Logger::messageHandler
+ */
+int LogModel::levelFromType(const QString &type)
+{
+    if (type == QLatin1String("Debug"))
+        return DebugLevel;
+    if (type == QLatin1String("Info"))
+        return InfoLevel;
+    if (type == QLatin1String("Warning"))
+        return WarningLevel;
+    return ErrorLevel;
+}
+
+/**
+ * @brief Append a message to the log. If the log is full, the oldest message is dropped.
+ * @param message A list with 3 elements: time, message type and message text.
+ */
+void LogModel::append(const QStringList &message)
+{
+    if (message.size() < 3)
+        return;
+
+    if (mSize == mCapacity) {
+        beginRemoveRows(QModelIndex(), 0, 0);
+        mHead = (mHead + 1) % mCapacity;
+        mSize--;
+        mFirstSequence++;
+        endRemoveRows();
+        emit entriesEvicted(mFirstSequence);
+    }
+
+    Entry e;
+    e.time = message[0];
+    e.type = message[1];
+    e.message = message[2];
+    e.level = levelFromType(e.type);
+
+    beginInsertRows(QModelIndex(), mSize, mSize);
+    int position = (mHead + mSize) % mCapacity;
+    if (position == int(mEntries.size()))
+        mEntries.push_back(e);
+    else
+        mEntries[position] = e;
+    mSize++;
+    endInsertRows();
+
+    emit entryAppended(endSequence() - 1, e.level);
+}
+
+/**
+ * @brief Remove all messages. Sequence numbers are not reused.
+ */
+void LogModel::clear()
+{
+    beginResetModel();
+    mEntries.clear();
+    mFirstSequence += mSize;
+    mHead = 0;
+    mSize = 0;
+    endResetModel();
+    emit cleared();
+}
+
+
+LogFilterModel::LogFilterModel(LogModel *source, QObject *parent)
+    : QAbstractListModel(parent)
+    , mSource(source)
+    , mSearchSnapshotEnd(0)
+{
+    for (int i(0); i < LogModel::NumLevels; ++i)
+        mLevelEnabled[i] = true;
+
+    for (quint64 s = mSource->firstSequence(); s < mSource->endSequence(); ++s)
+        mLevelIndex[mSource->entry(s).level].push_back(s);
+    rebuild();
+
+    connect(mSource, &LogModel::entryAppended, this, &LogFilterModel::onEntryAppended);
+    connect(mSource, &LogModel::entriesEvicted, this, &LogFilterModel::onEntriesEvicted);
+    connect(mSource, &LogModel::cleared, this, &LogFilterModel::onSourceCleared);
+    connect(&mSearchWatcher, &QFutureWatcherBase::finished, this, &LogFilterModel::onSearchFinished);
+}
+
+int LogFilterModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return int(mRows.size());
+}
+
+QVariant LogFilterModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= int(mRows.size()))
+        return QVariant();
+
+    quint64 sequence = mRows[index.row()];
+    return mSource->data(mSource->index(int(sequence - mSource->firstSequence())), role);
+}
+
+QHash<int, QByteArray> LogFilterModel::roleNames() const
+{
+    return mSource->roleNames();
+}
+
+/**
+ * @brief Only show messages containing the given text (case insensitive). An empty string disables text filtering.
+ *
+ * The search runs in a worker thread; the `searching` property is true until it is done.
+ */
+void LogFilterModel::setSearchText(const QString &text)
+{
+    if (text == mSearchText)
+        return;
+
+    mSearchText = text;
+    emit searchTextChanged(text);
+    mSearchMatches.clear();
+
+    if (text.isEmpty()) {
+        mSearchWatcher.setFuture(QFuture<std::vector<quint64>>());
+        rebuild();
+        emit searchingChanged(false);
+        return;
+    }
+
+    // QStrings are implicitly shared, so this snapshot only costs a reference count per message
+    quint64 first = mSource->firstSequence();
+    QVector<QString> snapshot;
+    snapshot.reserve(int(mSource->endSequence() - first));
+    for (quint64 s = first; s < mSource->endSequence(); ++s)
+        snapshot.push_back(mSource->entry(s).message);
+    mSearchSnapshotEnd = mSource->endSequence();
+
+    mSearchWatcher.setFuture(QtConcurrent::run([snapshot, first, text]() {
+        std::vector<quint64> matches;
+        for (int i(0); i < snapshot.size(); ++i) {
+            if (snapshot[i].contains(text, Qt::CaseInsensitive))
+                matches.push_back(first + i);
+        }
+        return matches;
+    }));
+    emit searchingChanged(true);
+}
+
+void LogFilterModel::onSearchFinished()
+{
+    if (mSearchText.isEmpty())
+        return;
+
+    // Matches found by the worker come before those found on arrival while it was running
+    std::vector<quint64> result = mSearchWatcher.result();
+    std::deque<quint64> matches;
+    for (quint64 s : result) {
+        if (s >= mSource->firstSequence())
+            matches.push_back(s);
+    }
+    for (quint64 s : mSearchMatches) {
+        if (s >= mSearchSnapshotEnd)
+            matches.push_back(s);
+    }
+    mSearchMatches.swap(matches);
+
+    rebuild();
+    emit searchingChanged(false);
+}
+
+void LogFilterModel::onEntryAppended(quint64 sequence, int level)
+{
+    mLevelIndex[level].push_back(sequence);
+
+    if (!mSearchText.isEmpty()) {
+        if (!matchesSearch(mSource->entry(sequence)))
+            return;
+        mSearchMatches.push_back(sequence);
+    }
+
+    if (mLevelEnabled[level]) {
+        int row = int(mRows.size());
+        beginInsertRows(QModelIndex(), row, row);
+        mRows.push_back(sequence);
+        endInsertRows();
+        emit countChanged(rowCount());
+    }
+}
+
+void LogFilterModel::onEntriesEvicted(quint64 firstSequence)
+{
+    for (auto& list : mLevelIndex) {
+        while (!list.empty() && list.front() < firstSequence)
+            list.pop_front();
+    }
+
+    while (!mSearchMatches.empty() && mSearchMatches.front() < firstSequence)
+        mSearchMatches.pop_front();
+
+    int n(0);
+    while (n < int(mRows.size()) && mRows[n] < firstSequence)
+        n++;
+
+    if (n > 0) {
+        beginRemoveRows(QModelIndex(), 0, n-1);
+        mRows.erase(mRows.begin(), mRows.begin() + n);
+        endRemoveRows();
+        emit countChanged(rowCount());
+    }
+}
+
+void LogFilterModel::onSourceCleared()
+{
+    for (auto& list : mLevelIndex)
+        list.clear();
+    mSearchMatches.clear();
+    rebuild();
+}
+
+void LogFilterModel::setLevelEnabled(int level, bool enabled)
+{
+    if (mLevelEnabled[level] == enabled)
+        return;
+
+    mLevelEnabled[level] = enabled;
+    rebuild();
+    emit filterChanged();
+}
+
+/**
+ * @brief Recompute the visible rows by merging the per-level lists of every enabled level
+ *
+ * If a text filter is active, only messages that also appear in mSearchMatches are kept.
+ */
+void LogFilterModel::rebuild()
+{
+    std::deque<quint64>::const_iterator it[LogModel::NumLevels];
+    for (int l(0); l < LogModel::NumLevels; ++l)
+        it[l] = mLevelEnabled[l] ? mLevelIndex[l].cbegin() : mLevelIndex[l].cend();
+
+    bool filterText = !mSearchText.isEmpty();
+    auto match = mSearchMatches.cbegin();
+
+    std::deque<quint64> rows;
+
+    while (true) {
+        int next(-1);
+        for (int l(0); l < LogModel::NumLevels; ++l) {
+            if (it[l] != mLevelIndex[l].cend() && (next == -1 || *it[l] < *it[next]))
+                next = l;
+        }
+        if (next == -1)
+            break;
+
+        quint64 sequence = *it[next];
+        ++it[next];
+
+        if (filterText) {
+            while (match != mSearchMatches.cend() && *match < sequence)
+                ++match;
+            if (match == mSearchMatches.cend())
+                break;
+            if (*match != sequence)
+                continue;
+        }
+        rows.push_back(sequence);
+    }
+
+    beginResetModel();
+    mRows.swap(rows);
+    endResetModel();
+    emit countChanged(rowCount());
+}
+
+bool LogFilterModel::matchesSearch(const LogModel::Entry &entry) const
+{
+    return entry.message.contains(mSearchText, Qt::CaseInsensitive);
+}
@@ -0,0 +1,174 @@
+#ifndef LOGMODEL_H
+#define LOGMODEL_H
+
+#include <deque>
+#include <vector>
+
+#include <QtCore>
+#include <QAbstractListModel>
+
+/**
+ * @brief The LogModel class holds the messages displayed on the log screen.
+ *
+ * Messages are stored in a fixed-capacity ring: once it is full, the oldest message is dropped each
+ * time a new one is appended. Each message is given a sequence number, which keeps increasing for the
+ * lifetime of the model; this is what LogFilterModel uses to refer to messages, since row numbers
+ * shift whenever the oldest message is evicted.
+ *
+ * Each row exposes three roles to QML: time, type (e.g. "Warning") and message.
+ */
+class LogModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Roles {
+        TimeRole = Qt::UserRole + 1,
+        TypeRole,
+        MessageRole,
+        LevelRole
+    };
+
+    /// Message levels, from least to most severe. Used as indices by LogFilterModel.
+    enum Level {
+        DebugLevel,
+        InfoLevel,
+        WarningLevel,
+        ErrorLevel,
+        NumLevels
+    };
+
+    struct Entry {
+        QString time;
+        QString type;
+        QString message;
+        int level;
+    };
+
+    LogModel(int capacity, QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    int capacity() const { return mCapacity; }
+
+    quint64 firstSequence() const { return mFirstSequence; }
+    quint64 endSequence() const { return mFirstSequence + mSize; }
+    const Entry& entry(quint64 sequence) const;
+
+    static int levelFromType(const QString& type);
+
+public slots:
+    void append(const QStringList& message);
+    void clear();
+
+signals:
+    /// Emitted after a message has been appended (and after any eviction it caused)
+    void entryAppended(quint64 sequence, int level);
+
+    /// Emitted after the oldest message(s) were dropped; all sequences below firstSequence are gone
+    void entriesEvicted(quint64 firstSequence);
+
+    /// Emitted when the model was cleared
+    void cleared();
+
+private:
+    std::vector<Entry> mEntries;
+    int mCapacity;
+
+    /// Index in mEntries of the oldest message
+    int mHead;
+
+    /// Number of messages currently stored
+    int mSize;
+
+    /// Sequence number of the oldest message
+    quint64 mFirstSequence;
+};
+
+
+/**
+ * @brief The LogFilterModel class is a filtering proxy over LogModel, by message level and text.
+ *
+ * One sorted list of sequence numbers is kept per message level, and updated as messages are appended
+ * or evicted from the source model. Changing the level filter is then a merge of the enabled lists,
+ * rather than a scan of every message.
+ *
+ * Text filtering (case-insensitive substring search) runs on a worker thread over a snapshot of the
+ * messages. Messages appended while a search is in progress are matched on arrival; when the worker
+ * is done, its result replaces the visible rows in one go.
+ */
+class LogFilterModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+    Q_PROPERTY(bool showDebug READ showDebug WRITE setShowDebug NOTIFY filterChanged)
+    Q_PROPERTY(bool showInfo READ showInfo WRITE setShowInfo NOTIFY filterChanged)
+    Q_PROPERTY(bool showWarnings READ showWarnings WRITE setShowWarnings NOTIFY filterChanged)
+    Q_PROPERTY(bool showErrors READ showErrors WRITE setShowErrors NOTIFY filterChanged)
+    Q_PROPERTY(QString searchText READ searchText WRITE setSearchText NOTIFY searchTextChanged)
+    Q_PROPERTY(bool searching READ isSearching NOTIFY searchingChanged)
+    Q_PROPERTY(int count READ rowCount NOTIFY countChanged)
+
+public:
+    LogFilterModel(LogModel* source, QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    bool showDebug() const { return mLevelEnabled[LogModel::DebugLevel]; }
+    bool showInfo() const { return mLevelEnabled[LogModel::InfoLevel]; }
+    bool showWarnings() const { return mLevelEnabled[LogModel::WarningLevel]; }
+    bool showErrors() const { return mLevelEnabled[LogModel::ErrorLevel]; }
+
+    void setShowDebug(bool show) { setLevelEnabled(LogModel::DebugLevel, show); }
+    void setShowInfo(bool show) { setLevelEnabled(LogModel::InfoLevel, show); }
+    void setShowWarnings(bool show) { setLevelEnabled(LogModel::WarningLevel, show); }
+    void setShowErrors(bool show) { setLevelEnabled(LogModel::ErrorLevel, show); }
+
+    QString searchText() const { return mSearchText; }
+    void setSearchText(const QString& text);
+
+    bool isSearching() const { return mSearchWatcher.isRunning(); }
+
+signals:
+    void filterChanged();
+    void searchTextChanged(QString text);
+    void searchingChanged(bool searching);
+    void countChanged(int count);
+
+private slots:
+    void onEntryAppended(quint64 sequence, int level);
+    void onEntriesEvicted(quint64 firstSequence);
+    void onSourceCleared();
+    void onSearchFinished();
+
+private:
+    void setLevelEnabled(int level, bool enabled);
+    void rebuild();
+    bool matchesSearch(const LogModel::Entry& entry) const;
+
+    LogModel* mSource;
+
+    bool mLevelEnabled[LogModel::NumLevels];
+
+    /// Sequence numbers of the source's messages, split by level. Each list is sorted.
+    std::deque<quint64> mLevelIndex[LogModel::NumLevels];
+
+    /// Sequence numbers of the visible rows
+    std::deque<quint64> mRows;
+
+    QString mSearchText;
+
+    /// Sorted sequence numbers matching mSearchText; only meaningful when mSearchText is not empty
+    std::deque<quint64> mSearchMatches;
+
+    /// End of the snapshot handed to the current search; later messages are matched as they arrive
+    quint64 mSearchSnapshotEnd;
+
+    QFutureWatcher<std::vector<quint64>> mSearchWatcher;
+};
+
+#endif // LOGMODEL_H
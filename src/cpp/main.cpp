@@ -7,6 +7,8 @@
 #include "src/cpp/applicationcontroller.h"
 #include "src/cpp/guihelper.h"
 #include "src/cpp/logger.h"
+#include "src/cpp/pressurechart.h"
+#include "src/cpp/tracing.h"
 
 
 int main(int argc, char *argv[])
@@ -14,6 +16,8 @@ int main(int argc, char *argv[])
     QCoreApplication::setApplicationName("ufcs-pc");
     QCoreApplication::setOrganizationName("ufcs");
 
+    Tracer::setThreadName("GUI");
+
     Logger* logger = Logger::logger();
     qInstallMessageHandler(Logger::messageHandler);
 
@@ -26,6 +30,8 @@ int main(int argc, char *argv[])
     qmlRegisterType<PCHelper>("org.example.ufcs", 1, 0, "PCHelper");
     qmlRegisterType<ValveSwitchHelper>("org.example.ufcs", 1, 0, "ValveSwitchHelper");
     qmlRegisterType<PumpSwitchHelper>("org.example.ufcs", 1, 0, "PumpSwitchHelper");
+    qmlRegisterType<PressureChart>("org.example.ufcs", 1, 0, "PressureChart");
+    qmlRegisterUncreatableType<PressureSeries>("org.example.ufcs", 1, 0, "PressureSeries", "Use Backend.pressureSeries()");
     qmlRegisterSingletonType(QUrl("qrc:/src/qml/Style.qml"), "org.example.ufcs", 1, 0, "Style"); // an alternative to this not-very-clean solution is to use a qmldir file. This way the QML-only stuff would stay separate from C++.
 
     QQmlApplicationEngine engine;
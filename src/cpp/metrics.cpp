@@ -0,0 +1,181 @@
+#include "metrics.h"
+#include "logger.h"
+
+MetricsRegistry::Metric::Metric(Type type, const QByteArray &name, const QByteArray &help, const QByteArray &labels)
+    : mType(type)
+    , mName(name)
+    , mHelp(help)
+    , mLabels(labels)
+    , mValue(0)
+{
+}
+
+/**
+ * @brief Set the value of the metric to the given value, if it is greater
+ */
+void MetricsRegistry::Metric::setMax(qint64 value)
+{
+    qint64 current = mValue.load(std::memory_order_relaxed);
+    while (value > current && !mValue.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        ;
+}
+
+MetricsRegistry* MetricsRegistry::registry()
+{
+    static MetricsRegistry instance;
+    return &instance;
+}
+
+/**
+ * @brief Return the counter with the given name and labels, registering it if needed
+ * @param name Metric name, e.g. "ufcs_bytes_sent_total"
+ * @param help One-line description
+ * @param labels Label pairs, e.g. "lane=\"normal\"", or an empty string
+ */
+MetricsRegistry::Metric& MetricsRegistry::counter(const char* name, const char* help, const char* labels)
+{
+    return add(Counter, name, help, labels);
+}
+
+/**
+ * @brief Return the gauge with the given name and labels, registering it if needed
+ */
+MetricsRegistry::Metric& MetricsRegistry::gauge(const char* name, const char* help, const char* labels)
+{
+    return add(Gauge, name, help, labels);
+}
+
+MetricsRegistry::Metric& MetricsRegistry::add(Type type, const char* name, const char* help, const char* labels)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    for (std::unique_ptr<Metric> const& m : mMetrics) {
+        if (m->mName == name && m->mLabels == labels)
+            return *m;
+    }
+
+    mMetrics.emplace_back(new Metric(type, name, help, labels));
+    return *mMetrics.back();
+}
+
+/**
+ * @brief Format all metrics in the Prometheus text exposition format
+ *
+ * Metrics sharing a name (with different labels) are grouped under a single HELP and TYPE line.
+ */
+QByteArray MetricsRegistry::prometheusText() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    QList<QByteArray> names;
+    for (std::unique_ptr<Metric> const& m : mMetrics) {
+        if (!names.contains(m->mName))
+            names << m->mName;
+    }
+
+    QByteArray text;
+    for (QByteArray const& name : names) {
+        bool first = true;
+        for (std::unique_ptr<Metric> const& m : mMetrics) {
+            if (m->mName != name)
+                continue;
+
+            if (first) {
+                text += "# HELP " + name + " " + m->mHelp + "\n";
+                text += "# TYPE " + name + (m->mType == Counter ? " counter\n" : " gauge\n");
+                first = false;
+            }
+
+            text += name;
+            if (!m->mLabels.isEmpty())
+                text += "{" + m->mLabels + "}";
+            text += " " + QByteArray::number(m->value()) + "\n";
+        }
+    }
+    return text;
+}
+
+/**
+ * @brief Write the current value of all metrics to a file, in the Prometheus text format
+ */
+bool MetricsRegistry::dump(const QString &path) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(lcGui) << "Could not write metrics to" << path;
+        return false;
+    }
+
+    file.write(prometheusText());
+    return true;
+}
+
+/**
+ * @brief Return the directory in which metrics are dumped
+ */
+QString MetricsRegistry::dumpDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/metrics";
+}
+
+
+MetricsServer::MetricsServer(QObject *parent)
+    : QObject(parent)
+{
+    connect(&mServer, &QTcpServer::newConnection, this, &MetricsServer::onNewConnection);
+}
+
+/**
+ * @brief Start serving on the given port of the loopback interface. A port of 0 picks any free port.
+ */
+bool MetricsServer::listen(quint16 port)
+{
+    if (!mServer.listen(QHostAddress::LocalHost, port)) {
+        qCWarning(lcGui) << "Could not serve metrics on port" << port << ":" << mServer.errorString();
+        return false;
+    }
+
+    qCInfo(lcGui) << "Serving metrics on http://localhost:" + QString::number(mServer.serverPort()) + "/metrics";
+    return true;
+}
+
+void MetricsServer::onNewConnection()
+{
+    while (QTcpSocket* socket = mServer.nextPendingConnection()) {
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket] { onReadyRead(socket); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket] {
+            mRequests.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void MetricsServer::onReadyRead(QTcpSocket *socket)
+{
+    // Only the request line matters, but the headers are read too, so that the client isn't cut off mid-request
+    QByteArray& request = mRequests[socket];
+    request += socket->readAll();
+
+    if (request.size() > MaxRequestSize) {
+        socket->abort();
+        return;
+    }
+    if (!request.contains("\r\n\r\n"))
+        return;
+
+    QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+    QByteArray path = requestLine.value(1);
+
+    QByteArray response;
+    if (requestLine.value(0) == "GET" && (path == "/metrics" || path == "/")) {
+        QByteArray body = MetricsRegistry::registry()->prometheusText();
+        response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                   + QByteArray::number(body.size()) + "\r\n\r\n" + body;
+    }
+    else
+        response = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+
+    mRequests.remove(socket);
+    socket->write(response);
+    socket->disconnectFromHost();
+}
@@ -0,0 +1,100 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include <QtCore>
+#include <QtNetwork>
+
+/**
+ * @brief The MetricsRegistry class holds the application's counters and gauges, for monitoring.
+ *
+ * Metrics are registered once (typically in a constructor), and the returned Metric is kept and updated on the
+ * hot paths. Updating a metric is a single relaxed atomic operation: it never locks, allocates or formats
+ * anything, and may be done from any thread. Registering the same name and labels twice returns the same Metric.
+ *
+ * prometheusText() formats all metrics in the Prometheus text exposition format; MetricsServer serves it over HTTP,
+ * and dump() writes it to a file.
+ */
+class MetricsRegistry
+{
+public:
+    enum Type {
+        Counter,
+        Gauge
+    };
+
+    class Metric {
+    public:
+        void increment(qint64 n = 1) { mValue.fetch_add(n, std::memory_order_relaxed); }
+        void decrement(qint64 n = 1) { mValue.fetch_sub(n, std::memory_order_relaxed); }
+        void set(qint64 value) { mValue.store(value, std::memory_order_relaxed); }
+        void setMax(qint64 value);
+        qint64 value() const { return mValue.load(std::memory_order_relaxed); }
+
+    private:
+        Metric(Type type, const QByteArray& name, const QByteArray& help, const QByteArray& labels);
+
+        Type mType;
+        QByteArray mName;
+        QByteArray mHelp;
+        QByteArray mLabels;
+        std::atomic<qint64> mValue;
+
+        friend class MetricsRegistry;
+    };
+
+    static MetricsRegistry* registry();
+
+    Metric& counter(const char* name, const char* help, const char* labels = "");
+    Metric& gauge(const char* name, const char* help, const char* labels = "");
+
+    QByteArray prometheusText() const;
+    bool dump(const QString& path) const;
+
+    static QString dumpDirectory();
+
+private:
+    MetricsRegistry() {}
+    Metric& add(Type type, const char* name, const char* help, const char* labels);
+
+    mutable std::mutex mMutex;
+
+    /// Never shrinks, so references to metrics stay valid
+    std::deque<std::unique_ptr<Metric>> mMetrics;
+};
+
+
+/**
+ * @brief The MetricsServer class serves the metrics registry in Prometheus format over HTTP, on the loopback
+ * interface only.
+ *
+ * Any GET request for /metrics (or /) is answered with MetricsRegistry::prometheusText(), and the connection is
+ * closed.
+ */
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsServer(QObject* parent = nullptr);
+
+    bool listen(quint16 port);
+    quint16 serverPort() const { return mServer.serverPort(); }
+
+private:
+    void onNewConnection();
+    void onReadyRead(QTcpSocket* socket);
+
+    static const int MaxRequestSize = 8192;
+
+    QTcpServer mServer;
+
+    /// Data received so far on each connection, until the end of the request headers
+    QHash<QTcpSocket*, QByteArray> mRequests;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,113 @@
+#include "pressurechart.h"
+
+#include <QSGGeometryNode>
+#include <QSGFlatColorMaterial>
+
+namespace {
+
+QSGGeometryNode* createLineNode()
+{
+    QSGGeometry* geometry = new QSGGeometry(QSGGeometry::defaultAttributes_Point2D(), 0);
+    geometry->setDrawingMode(QSGGeometry::DrawLineStrip);
+    geometry->setLineWidth(2);
+
+    QSGGeometryNode* node = new QSGGeometryNode;
+    node->setGeometry(geometry);
+    node->setFlag(QSGNode::OwnsGeometry);
+    node->setMaterial(new QSGFlatColorMaterial);
+    node->setFlag(QSGNode::OwnsMaterial);
+    return node;
+}
+
+}
+
+PressureChart::PressureChart(QQuickItem *parent)
+    : QQuickItem(parent)
+    , mSeries(nullptr)
+    , mTimeWindow(600)
+    , mMeasuredColor(Qt::blue)
+    , mSetpointColor(Qt::gray)
+    , mPointCount(0)
+{
+    setFlag(ItemHasContents, true);
+    connect(this, &PressureChart::colorsChanged, this, &QQuickItem::update);
+}
+
+void PressureChart::setSeries(PressureSeries *series)
+{
+    if (series == mSeries)
+        return;
+
+    if (mSeries)
+        disconnect(mSeries, nullptr, this, nullptr);
+
+    mSeries = series;
+
+    // update() only schedules a repaint for the next frame, so this can't redraw faster than the display
+    if (mSeries)
+        connect(mSeries, &PressureSeries::updated, this, &QQuickItem::update);
+
+    emit seriesChanged();
+    update();
+}
+
+void PressureChart::setTimeWindow(int seconds)
+{
+    if (seconds == mTimeWindow || seconds <= 0)
+        return;
+
+    mTimeWindow = seconds;
+    emit timeWindowChanged(seconds);
+    update();
+}
+
+QSGNode* PressureChart::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *)
+{
+    QSGNode* root = oldNode;
+    if (!root) {
+        root = new QSGNode;
+        root->appendChildNode(createLineNode()); // setpoint, drawn below
+        root->appendChildNode(createLineNode()); // measured
+    }
+
+    QSGGeometryNode* setpointNode = static_cast<QSGGeometryNode*>(root->firstChild());
+    QSGGeometryNode* measuredNode = static_cast<QSGGeometryNode*>(root->lastChild());
+
+    static_cast<QSGFlatColorMaterial*>(setpointNode->material())->setColor(mSetpointColor);
+    static_cast<QSGFlatColorMaterial*>(measuredNode->material())->setColor(mMeasuredColor);
+
+    std::vector<PressurePoint> points;
+    qint64 to(0), from(0);
+    if (mSeries && width() > 0 && height() > 0) {
+        to = mSeries->now();
+        from = to - qint64(mTimeWindow) * 1000;
+        points = mSeries->window(from, to, int(width()));
+    }
+
+    QSGGeometry* measured = measuredNode->geometry();
+    QSGGeometry* setpoint = setpointNode->geometry();
+    measured->allocate(int(points.size()));
+    setpoint->allocate(int(points.size()));
+
+    QSGGeometry::Point2D* m = measured->vertexDataAsPoint2D();
+    QSGGeometry::Point2D* s = setpoint->vertexDataAsPoint2D();
+
+    double xScale = width() / double(qMax(qint64(1), to - from));
+    float h = float(height());
+
+    for (size_t i(0); i < points.size(); ++i) {
+        float x = float((points[i].time - from) * xScale);
+        m[i].set(x, h * (1.f - qBound(0.f, points[i].measured, 1.f)));
+        s[i].set(x, h * (1.f - qBound(0.f, points[i].setpoint, 1.f)));
+    }
+
+    measuredNode->markDirty(QSGNode::DirtyGeometry | QSGNode::DirtyMaterial);
+    setpointNode->markDirty(QSGNode::DirtyGeometry | QSGNode::DirtyMaterial);
+
+    if (int(points.size()) != mPointCount) {
+        mPointCount = int(points.size());
+        QMetaObject::invokeMethod(this, "pointCountChanged", Qt::QueuedConnection, Q_ARG(int, mPointCount));
+    }
+
+    return root;
+}
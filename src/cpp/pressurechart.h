@@ -0,0 +1,57 @@
+#ifndef PRESSURECHART_H
+#define PRESSURECHART_H
+
+#include <QQuickItem>
+#include <QColor>
+
+#include "pressureseries.h"
+
+/**
+ * @brief The PressureChart class draws the recent history of a PressureSeries as two lines: measured
+ * pressure and setpoint.
+ *
+ * Only the last `timeWindow` seconds are shown. The points are requested from the series for each frame,
+ * downsampled to the width of the item, and drawn directly by the scene graph as line strips.
+ *
+ * Values are normalized (0-1), like PCHelper's setPoint and measuredValue.
+ */
+class PressureChart : public QQuickItem
+{
+    Q_OBJECT
+
+    Q_PROPERTY(PressureSeries* series READ series WRITE setSeries NOTIFY seriesChanged)
+    Q_PROPERTY(int timeWindow READ timeWindow WRITE setTimeWindow NOTIFY timeWindowChanged)
+    Q_PROPERTY(QColor measuredColor MEMBER mMeasuredColor NOTIFY colorsChanged)
+    Q_PROPERTY(QColor setpointColor MEMBER mSetpointColor NOTIFY colorsChanged)
+    Q_PROPERTY(int pointCount READ pointCount NOTIFY pointCountChanged)
+
+public:
+    PressureChart(QQuickItem* parent = nullptr);
+
+    PressureSeries* series() const { return mSeries; }
+    void setSeries(PressureSeries* series);
+
+    int timeWindow() const { return mTimeWindow; }
+    void setTimeWindow(int seconds);
+
+    /// Number of points drawn in the last frame
+    int pointCount() const { return mPointCount; }
+
+signals:
+    void seriesChanged();
+    void timeWindowChanged(int seconds);
+    void colorsChanged();
+    void pointCountChanged(int count);
+
+protected:
+    QSGNode* updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData*) override;
+
+private:
+    PressureSeries* mSeries;
+    int mTimeWindow;
+    QColor mMeasuredColor;
+    QColor mSetpointColor;
+    int mPointCount;
+};
+
+#endif // PRESSURECHART_H
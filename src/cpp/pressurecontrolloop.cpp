@@ -0,0 +1,353 @@
+#include "pressurecontrolloop.h"
+#include "communicator.h"
+#include "logger.h"
+#include "tracing.h"
+
+#include <chrono>
+#include <cmath>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#elif defined(Q_OS_UNIX)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+PiController::PiController()
+    : kp(0.5)
+    , ki(1.0)
+    , slewRate(0.5)
+    , integral(0)
+    , output(0)
+{
+}
+
+/**
+ * @brief Reset the controller so that its output starts at the given value (bumpless transfer)
+ */
+void PiController::reset(double currentOutput)
+{
+    integral = currentOutput;
+    output = currentOutput;
+}
+
+/**
+ * @brief Compute the new output
+ * @param dt Time since the previous update, in seconds
+ */
+double PiController::update(double target, double measured, double dt)
+{
+    double error = target - measured;
+    integral += ki * error * dt;
+
+    double u = qBound(0., kp * error + integral, 1.);
+
+    if (slewRate > 0) {
+        double maxStep = slewRate * dt;
+        u = qBound(output - maxStep, u, output + maxStep);
+    }
+
+    // Anti-windup: when the output is limited (by saturation or slew rate), the integral is set to the
+    // value that produces exactly that output, rather than growing while it has no effect
+    if (std::abs(u - (kp * error + integral)) > 1e-9)
+        integral = u - kp * error;
+
+    output = u;
+    return u;
+}
+
+
+PressureControlLoop::PressureControlLoop(Communicator *communicator, int rate, QObject *parent)
+    : QObject(parent)
+    , mCommunicator(communicator)
+    , mRate(qBound(1, rate, 1000))
+    , mJitterCount(0)
+    , mJitterMean(0)
+    , mJitterM2(0)
+    , mJitterMax(0)
+    , mOverruns(0)
+    , mStopRequested(false)
+{
+    for (Channel& c : mChannels) {
+        c.enabled = false;
+        c.target = 0;
+        c.resetRequested = false;
+        c.resetOutput = 0;
+        c.lastSentValue = -1;
+        c.lastSequence = 0;
+        c.elapsed = 0;
+        c.errorSquaredSum = 0;
+        c.errorMax = 0;
+        c.errorCount = 0;
+    }
+
+    mStatisticsTimer.setInterval(1000);
+    connect(&mStatisticsTimer, &QTimer::timeout, this, [this] {
+        QVariantMap s = statistics();
+        qCDebug(lcCommunicator) << "Control loop jitter (us): mean" << s["jitterMean"].toDouble()
+                                << "std dev" << s["jitterStdDev"].toDouble() << "max" << s["jitterMax"].toLongLong()
+                                << "overruns" << s["overruns"].toULongLong();
+        emit statisticsUpdated(s);
+    });
+}
+
+PressureControlLoop::~PressureControlLoop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopRequested = true;
+    }
+    mWakeCondition.notify_all();
+
+    if (mThread.joinable())
+        mThread.join();
+}
+
+bool PressureControlLoop::isEnabled(int controllerNumber) const
+{
+    if (controllerNumber < 1 || controllerNumber > N_PRS)
+        return false;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mChannels[controllerNumber-1].enabled;
+}
+
+/**
+ * @brief Enable or disable closed-loop control of a controller
+ * @param currentSetpoint The setpoint currently applied (0-1), from which the loop starts adjusting
+ *
+ * The loop thread is started the first time a controller is enabled, and sleeps while none is.
+ */
+void PressureControlLoop::setEnabled(int controllerNumber, bool enabled, double currentSetpoint)
+{
+    if (controllerNumber < 1 || controllerNumber > N_PRS)
+        return;
+
+    bool anyEnabled;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        Channel& c = mChannels[controllerNumber-1];
+        c.enabled = enabled;
+        if (enabled) {
+            c.resetRequested = true;
+            c.resetOutput = qBound(0., currentSetpoint, 1.);
+            c.errorSquaredSum = 0;
+            c.errorMax = 0;
+            c.errorCount = 0;
+        }
+        anyEnabled = isAnyEnabled();
+    }
+    mWakeCondition.notify_all();
+
+    qCInfo(lcCommunicator) << "Closed-loop control of pressure controller" << controllerNumber << (enabled ? "enabled" : "disabled");
+
+    if (enabled && !mThread.joinable())
+        mThread = std::thread([this] { run(); });
+
+    if (anyEnabled)
+        mStatisticsTimer.start();
+    else
+        mStatisticsTimer.stop();
+}
+
+/**
+ * @brief Return true if closed-loop control is enabled for any controller. mMutex must be held.
+ */
+bool PressureControlLoop::isAnyEnabled() const
+{
+    for (Channel const& c : mChannels) {
+        if (c.enabled)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Set the pressure (0-1) that the loop should reach on the given controller
+ */
+void PressureControlLoop::setTarget(int controllerNumber, double target)
+{
+    if (controllerNumber < 1 || controllerNumber > N_PRS)
+        return;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mChannels[controllerNumber-1].target = qBound(0., target, 1.);
+}
+
+void PressureControlLoop::setGains(int controllerNumber, double kp, double ki)
+{
+    if (controllerNumber < 1 || controllerNumber > N_PRS)
+        return;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mChannels[controllerNumber-1].controller.kp = kp;
+    mChannels[controllerNumber-1].controller.ki = ki;
+}
+
+/**
+ * @brief Set the maximum change of the setpoint per second (as a fraction of the full range). 0 disables the limit.
+ */
+void PressureControlLoop::setSlewRate(int controllerNumber, double perSecond)
+{
+    if (controllerNumber < 1 || controllerNumber > N_PRS)
+        return;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mChannels[controllerNumber-1].controller.slewRate = qMax(0., perSecond);
+}
+
+/**
+ * @brief Return the loop statistics gathered since the previous call, and reset them
+ *
+ * Jitter values are in microseconds; tracking errors are normalized (0-1), like the pressures.
+ */
+QVariantMap PressureControlLoop::statistics()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    QVariantMap s;
+    s["iterations"] = mJitterCount;
+    s["jitterMean"] = mJitterMean;
+    s["jitterStdDev"] = mJitterCount > 1 ? std::sqrt(mJitterM2 / (mJitterCount - 1)) : 0.;
+    s["jitterMax"] = mJitterMax;
+    s["overruns"] = mOverruns;
+
+    for (int i(0); i < N_PRS; ++i) {
+        Channel& c = mChannels[i];
+        if (!c.enabled)
+            continue;
+        QString n = QString::number(i+1);
+        s["trackingErrorRms" + n] = c.errorCount > 0 ? std::sqrt(c.errorSquaredSum / c.errorCount) : 0.;
+        s["trackingErrorMax" + n] = c.errorMax;
+        c.errorSquaredSum = 0;
+        c.errorMax = 0;
+        c.errorCount = 0;
+    }
+
+    mJitterCount = 0;
+    mJitterMean = 0;
+    mJitterM2 = 0;
+    mJitterMax = 0;
+    mOverruns = 0;
+
+    return s;
+}
+
+void PressureControlLoop::run()
+{
+    using namespace std::chrono;
+
+    raiseThreadPriority();
+    Tracer::setThreadName("Control loop");
+
+    const microseconds period(1000000 / mRate);
+    const double dt = period.count() / 1e6;
+    steady_clock::time_point deadline = steady_clock::now() + period;
+
+    while (!mStopRequested) {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (!isAnyEnabled()) {
+                mWakeCondition.wait(lock, [this] { return mStopRequested || isAnyEnabled(); });
+                // Time spent parked is neither jitter nor an overrun
+                deadline = steady_clock::now() + period;
+                continue;
+            }
+        }
+
+        std::this_thread::sleep_until(deadline);
+        steady_clock::time_point now = steady_clock::now();
+        qint64 jitter = duration_cast<microseconds>(now - deadline).count();
+
+        {
+            TRACE_SPAN("control loop", "iterate", jitter);
+            iterate(dt);
+        }
+
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        // Welford's algorithm, for a numerically stable running mean and variance
+        mJitterCount++;
+        double delta = jitter - mJitterMean;
+        mJitterMean += delta / mJitterCount;
+        mJitterM2 += delta * (jitter - mJitterMean);
+        mJitterMax = qMax(mJitterMax, jitter);
+
+        // Deadlines are absolute, so a late iteration doesn't delay the next ones. If a whole period
+        // was missed, skip ahead rather than running the missed iterations back to back.
+        deadline += period;
+        if (now > deadline) {
+            mOverruns++;
+            deadline = now + period;
+        }
+    }
+}
+
+void PressureControlLoop::iterate(double dt)
+{
+    std::vector<std::pair<uint, double>> commands;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        for (int i(0); i < N_PRS; ++i) {
+            Channel& c = mChannels[i];
+            if (!c.enabled)
+                continue;
+
+            if (c.resetRequested) {
+                c.controller.reset(c.resetOutput);
+                c.lastSentValue = int(std::lround(c.resetOutput * PR_MAX_VALUE));
+                c.lastSequence = 0;
+                c.elapsed = 0;
+                c.resetRequested = false;
+            }
+
+            // Only a new measurement says anything new about the error
+            c.elapsed += dt;
+            double measured;
+            quint32 sequence;
+            if (!mCommunicator->latestMeasurement(uint(i+1), measured, sequence) || sequence == c.lastSequence)
+                continue;
+
+            double elapsed = c.elapsed;
+            c.lastSequence = sequence;
+            c.elapsed = 0;
+
+            double error = c.target - measured;
+            c.errorSquaredSum += error * error;
+            c.errorMax = qMax(c.errorMax, std::abs(error));
+            c.errorCount++;
+
+            double output = c.controller.update(c.target, measured, elapsed);
+
+            // The microcontroller's resolution is 1/PR_MAX_VALUE; smaller changes aren't worth sending
+            int value = int(std::lround(output * PR_MAX_VALUE));
+            if (value != c.lastSentValue) {
+                c.lastSentValue = value;
+                commands.push_back(std::make_pair(uint(i+1), double(value) / PR_MAX_VALUE));
+            }
+        }
+    }
+
+    for (auto const& command : commands)
+        emit setPressure(command.first, command.second);
+}
+
+/**
+ * @brief Give the calling thread real-time (or the highest available) scheduling priority
+ *
+ * This usually requires elevated privileges; if it fails, the loop runs with normal priority.
+ */
+void PressureControlLoop::raiseThreadPriority()
+{
+#if defined(Q_OS_WIN)
+    if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+        qCInfo(lcCommunicator) << "Could not raise the priority of the pressure control thread";
+#elif defined(Q_OS_UNIX)
+    sched_param param;
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 10;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+        qCInfo(lcCommunicator) << "Could not give the pressure control thread real-time priority; running with normal priority";
+#endif
+}
@@ -0,0 +1,128 @@
+#ifndef PRESSURECONTROLLOOP_H
+#define PRESSURECONTROLLOOP_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <QtCore>
+
+#include "constants.h"
+
+class Communicator;
+
+/**
+ * @brief Proportional-integral controller with anti-windup and slew rate limiting
+ *
+ * All values are normalized (0-1), like the setpoints sent to the microcontroller.
+ */
+struct PiController {
+    double kp;
+    double ki;
+
+    /// Maximum change of the output per second
+    double slewRate;
+
+    double integral;
+    double output;
+
+    PiController();
+
+    void reset(double currentOutput);
+    double update(double target, double measured, double dt);
+};
+
+
+/**
+ * @brief The PressureControlLoop class regulates the measured pressure of the pressure controllers to a target,
+ * by adjusting their setpoint.
+ *
+ * The regulators themselves are driven open-loop: the setpoint sent to them doesn't guarantee the pressure
+ * actually reached under load. When closed-loop control is enabled for a controller, this class adjusts its
+ * setpoint with a PiController until the measured pressure matches the target.
+ *
+ * The loop runs on its own thread, at a fixed rate, with the highest scheduling priority the system allows.
+ * Each iteration is scheduled on an absolute deadline (start time + n * period), so that delays don't
+ * accumulate; the thread sleeps without a deadline while no controller is enabled. Measurements are read from
+ * Communicator::latestMeasurement, which doesn't involve the GUI thread. Measurements usually arrive more slowly
+ * than the loop runs, so a controller is only updated when a new one has arrived, with the time elapsed since
+ * the previous one; otherwise the same error would be integrated several times.
+ * New setpoints are emitted with setPressure; they are only emitted when they change by at least one step
+ * of the microcontroller's resolution.
+ *
+ * The loop period jitter (actual wake-up time minus deadline) and the tracking error (target minus measured
+ * pressure) of each controller are measured continuously; statistics() returns and resets them.
+ */
+class PressureControlLoop : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(int rate READ rate CONSTANT)
+
+public:
+    PressureControlLoop(Communicator* communicator, int rate, QObject* parent = nullptr);
+    virtual ~PressureControlLoop();
+
+    int rate() const { return mRate; }
+
+    Q_INVOKABLE bool isEnabled(int controllerNumber) const;
+    Q_INVOKABLE void setEnabled(int controllerNumber, bool enabled, double currentSetpoint = 0);
+    Q_INVOKABLE void setTarget(int controllerNumber, double target);
+    Q_INVOKABLE void setGains(int controllerNumber, double kp, double ki);
+    Q_INVOKABLE void setSlewRate(int controllerNumber, double perSecond);
+
+    Q_INVOKABLE QVariantMap statistics();
+
+signals:
+    void setPressure(uint controllerNumber, double pressure);
+    void statisticsUpdated(QVariantMap statistics);
+
+private:
+    struct Channel {
+        bool enabled;
+        double target;
+        PiController controller;
+        bool resetRequested;
+        double resetOutput;
+
+        /// Last setpoint sent, in units of 1/PR_MAX_VALUE
+        int lastSentValue;
+
+        /// Sequence number of the last measurement used (0: none yet), and time since then, in seconds
+        quint32 lastSequence;
+        double elapsed;
+
+        // Tracking error statistics, since the last call to statistics()
+        double errorSquaredSum;
+        double errorMax;
+        quint64 errorCount;
+    };
+
+    void run();
+    void iterate(double dt);
+    bool isAnyEnabled() const;
+    static void raiseThreadPriority();
+
+    Communicator* mCommunicator;
+    int mRate;
+
+    /// Protects mChannels and the statistics
+    mutable std::mutex mMutex;
+    /// Wakes the loop thread up when a controller is enabled, or when it must stop
+    std::condition_variable mWakeCondition;
+    Channel mChannels[N_PRS];
+
+    // Jitter statistics, in microseconds, since the last call to statistics()
+    quint64 mJitterCount;
+    double mJitterMean;
+    double mJitterM2;
+    qint64 mJitterMax;
+    quint64 mOverruns;
+
+    std::atomic<bool> mStopRequested;
+    std::thread mThread;
+    QTimer mStatisticsTimer;
+};
+
+#endif // PRESSURECONTROLLOOP_H
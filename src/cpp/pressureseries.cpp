@@ -0,0 +1,215 @@
+#include "pressureseries.h"
+
+#include <cmath>
+
+namespace {
+
+/// Capacity of each tier
+const size_t TierCapacity[PressureSeries::NumTiers] = { 30000, 24*3600, 7*24*60 };
+
+/// Time covered by each point of a tier, in milliseconds
+const qint64 TierResolution[PressureSeries::NumTiers] = { 0, 1000, 60*1000 };
+
+}
+
+void PressureSeries::Ring::push(const PressurePoint &p)
+{
+    if (mSize < mPoints.size()) {
+        mPoints[(mHead + mSize) % mPoints.size()] = p;
+        mSize++;
+    }
+    else {
+        mPoints[mHead] = p;
+        mHead = (mHead + 1) % mPoints.size();
+    }
+}
+
+/**
+ * @brief Return the index of the first point at or after the given time (or size() if there is none)
+ */
+size_t PressureSeries::Ring::lowerBound(qint64 time) const
+{
+    size_t low = 0, high = mSize;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (at(mid).time < time)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+
+PressureSeries::PressureSeries(int controllerNumber, QObject *parent)
+    : QObject(parent)
+    , mControllerNumber(controllerNumber)
+    , mSetpoint(0)
+    , mFirstTime(-1)
+{
+    for (int t(0); t < NumTiers; ++t) {
+        mTiers.emplace_back(TierCapacity[t]);
+        mBuckets[t] = Bucket{0, 0, 0, 0};
+    }
+}
+
+void PressureSeries::appendMeasured(double measured)
+{
+    append(now(), measured);
+}
+
+void PressureSeries::appendSamples(QVector<TelemetrySample> samples)
+{
+    for (TelemetrySample const& s : samples)
+        append(s.timestamp / 1000, double(s.value));
+}
+
+void PressureSeries::setSetpoint(double setpoint)
+{
+    mSetpoint = float(setpoint);
+}
+
+/**
+ * @brief Add a measurement to the series
+ * @param time Time of the measurement, in milliseconds (see now())
+ */
+void PressureSeries::append(qint64 time, double measured)
+{
+    const Ring& raw = mTiers[RawTier];
+
+    // Points must be in chronological order; streamed samples are back-dated, so they can arrive slightly late
+    if (raw.size() > 0)
+        time = qMax(time, raw.at(raw.size() - 1).time);
+    if (mFirstTime < 0)
+        mFirstTime = time;
+
+    PressurePoint p { time, float(measured), mSetpoint };
+    mTiers[RawTier].push(p);
+    addToBucket(SecondTier, TierResolution[SecondTier], p);
+    addToBucket(MinuteTier, TierResolution[MinuteTier], p);
+
+    emit updated();
+}
+
+/**
+ * @brief Add a point to the running average of a tier, pushing the average of the previous bucket if it is complete
+ */
+void PressureSeries::addToBucket(Tier tier, qint64 duration, const PressurePoint &p)
+{
+    Bucket& b = mBuckets[tier];
+    qint64 start = p.time - p.time % duration;
+
+    if (b.count > 0 && start != b.start) {
+        mTiers[tier].push(PressurePoint { b.start + duration/2, float(b.measuredSum / b.count), b.setpoint });
+        b.count = 0;
+    }
+
+    if (b.count == 0) {
+        b.start = start;
+        b.measuredSum = 0;
+    }
+    b.measuredSum += p.measured;
+    b.count++;
+    b.setpoint = p.setpoint;
+}
+
+/**
+ * @brief Return the points between two times, from the finest tier that covers that period
+ * @param maxPoints If there are more points than this in the window, they are downsampled to this number
+ */
+std::vector<PressurePoint> PressureSeries::window(qint64 from, qint64 to, int maxPoints) const
+{
+    std::vector<PressurePoint> points;
+    if (mFirstTime < 0)
+        return points;
+
+    qint64 start = qMax(from, mFirstTime);
+
+    int tier = -1;
+    for (int t(0); t < NumTiers; ++t) {
+        if (mTiers[t].size() > 0 && mTiers[t].at(0).time <= start + TierResolution[t]) {
+            tier = t;
+            break;
+        }
+    }
+    if (tier == -1)
+        tier = mTiers[MinuteTier].size() > 0 ? MinuteTier : RawTier;
+
+    const Ring& ring = mTiers[tier];
+    size_t first = ring.lowerBound(from);
+    size_t last = ring.lowerBound(to + 1);
+
+    points.reserve(last - first + 1);
+    for (size_t i(first); i < last; ++i)
+        points.push_back(ring.at(i));
+
+    // The bucket being filled isn't in the ring yet
+    const Bucket& b = mBuckets[tier];
+    if (tier != RawTier && b.count > 0 && b.start <= to && b.start + TierResolution[tier] >= from)
+        points.push_back(PressurePoint { qMin(b.start + TierResolution[tier]/2, to), float(b.measuredSum / b.count), b.setpoint });
+
+    if (maxPoints > 0 && int(points.size()) > maxPoints)
+        return downsample(points, maxPoints);
+    return points;
+}
+
+/**
+ * @brief Reduce a series to the given number of points with the largest-triangle-three-buckets algorithm
+ *
+ * The first and last points are kept; the points in between are split into (threshold - 2) buckets, and the point
+ * kept in each bucket is the one forming the largest triangle with the previously kept point and the average of the
+ * next bucket. This preserves the peaks and overall shape of the measured pressure much better than
+ * averaging or picking every Nth point.
+ */
+std::vector<PressurePoint> PressureSeries::downsample(const std::vector<PressurePoint> &points, int threshold)
+{
+    size_t n = points.size();
+    if (threshold < 3 || size_t(threshold) >= n)
+        return points;
+
+    std::vector<PressurePoint> sampled;
+    sampled.reserve(size_t(threshold));
+    sampled.push_back(points[0]);
+
+    const qint64 t0 = points[0].time;
+    double bucketSize = double(n - 2) / (threshold - 2);
+    size_t a = 0;
+
+    for (int i(0); i < threshold - 2; ++i) {
+        // Average of the next bucket
+        size_t avgStart = size_t(std::floor((i + 1) * bucketSize)) + 1;
+        size_t avgEnd = qMin(size_t(std::floor((i + 2) * bucketSize)) + 1, n);
+        double avgX(0), avgY(0);
+        for (size_t j(avgStart); j < avgEnd; ++j) {
+            avgX += double(points[j].time - t0);
+            avgY += points[j].measured;
+        }
+        if (avgEnd > avgStart) {
+            avgX /= double(avgEnd - avgStart);
+            avgY /= double(avgEnd - avgStart);
+        }
+
+        // Point of the current bucket forming the largest triangle
+        size_t rangeStart = size_t(std::floor(i * bucketSize)) + 1;
+        size_t rangeEnd = size_t(std::floor((i + 1) * bucketSize)) + 1;
+        double ax = double(points[a].time - t0);
+        double ay = points[a].measured;
+
+        double maxArea(-1);
+        size_t next = rangeStart;
+        for (size_t j(rangeStart); j < rangeEnd; ++j) {
+            double area = std::abs((ax - avgX) * (points[j].measured - ay)
+                                   - (ax - double(points[j].time - t0)) * (avgY - ay));
+            if (area > maxArea) {
+                maxArea = area;
+                next = j;
+            }
+        }
+
+        sampled.push_back(points[next]);
+        a = next;
+    }
+
+    sampled.push_back(points[n - 1]);
+    return sampled;
+}
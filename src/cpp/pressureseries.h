@@ -0,0 +1,97 @@
+#ifndef PRESSURESERIES_H
+#define PRESSURESERIES_H
+
+#include <vector>
+
+#include <QtCore>
+
+#include "telemetry.h"
+
+struct PressurePoint {
+    qint64 time;        // Milliseconds, on the same clock as telemetryClock()
+    float measured;     // 0-1
+    float setpoint;     // 0-1
+};
+
+/**
+ * @brief The PressureSeries class keeps the recent history of one pressure controller, for display in a chart.
+ *
+ * Memory use is fixed: points are kept in three rings of increasing time resolution.
+ *  - Raw: every measurement received (including streamed telemetry samples), for the last few minutes
+ *  - Seconds: the average of each second, for the last 24 hours
+ *  - Minutes: the average of each minute, for the last week
+ *
+ * window() returns the points of a time window from the finest ring that covers it, reduced to a given
+ * number of points with the largest-triangle-three-buckets algorithm; charts therefore only ever draw about
+ * as many points as they are wide in pixels, whatever the length of the window.
+ */
+class PressureSeries : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(int controllerNumber READ controllerNumber CONSTANT)
+
+public:
+    enum Tier {
+        RawTier,
+        SecondTier,
+        MinuteTier,
+        NumTiers
+    };
+
+    PressureSeries(int controllerNumber, QObject* parent = nullptr);
+
+    int controllerNumber() const { return mControllerNumber; }
+
+    void append(qint64 time, double measured);
+    qint64 now() const { return telemetryClock() / 1000; }
+
+    std::vector<PressurePoint> window(qint64 from, qint64 to, int maxPoints) const;
+    int tierSize(Tier tier) const { return int(mTiers[tier].size()); }
+
+    static std::vector<PressurePoint> downsample(const std::vector<PressurePoint>& points, int threshold);
+
+public slots:
+    void appendMeasured(double measured);
+    void appendSamples(QVector<TelemetrySample> samples);
+    void setSetpoint(double setpoint);
+
+signals:
+    void updated();
+
+private:
+    /// Ring of points in chronological order; the oldest point is overwritten when it is full
+    class Ring {
+    public:
+        explicit Ring(size_t capacity) : mPoints(capacity), mHead(0), mSize(0) {}
+
+        void push(const PressurePoint& p);
+        size_t size() const { return mSize; }
+        const PressurePoint& at(size_t i) const { return mPoints[(mHead + i) % mPoints.size()]; }
+        size_t lowerBound(qint64 time) const;
+
+    private:
+        std::vector<PressurePoint> mPoints;
+        size_t mHead;
+        size_t mSize;
+    };
+
+    /// Running average of the points of the current second or minute
+    struct Bucket {
+        qint64 start;
+        double measuredSum;
+        int count;
+        float setpoint;
+    };
+
+    void addToBucket(Tier tier, qint64 duration, const PressurePoint& p);
+
+    int mControllerNumber;
+    float mSetpoint;
+    qint64 mFirstTime;
+
+    std::vector<Ring> mTiers;
+    Bucket mBuckets[NumTiers];
+};
+
+#endif // PRESSURESERIES_H
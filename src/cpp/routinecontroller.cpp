@@ -1,5 +1,11 @@
 #include "routinecontroller.h"
 #include "applicationcontroller.h"
+#include "logger.h"
+#include "tracing.h"
+#include "constants.h"
+
+#include <chrono>
+#include <cmath>
 
 RoutineController::RoutineController(ApplicationController *applicationController)
     : mRunStatus(NotReady)
@@ -7,12 +13,28 @@ RoutineController::RoutineController(ApplicationController *applicationControlle
     , mErrorCount(0)
     , mStopRequested(false)
     , mPauseRequested(false)
+    , mWakeRequested(false)
+    , mOutputCongested(false)
     , mNumberOfSteps(-1)
     , mTotalWaitTime(0)
     , mElapsedTime(0)
+    , mTimeScale(1.)
     , appController(applicationController)
 {
+    for (int i(0); i < N_PRS; ++i) {
+        mMeasuredPressure[i] = 0;
+        mHasMeasuredPressure[i] = false;
+    }
 
+    mStepsModel = new QStringListModel(this);
+
+    MetricsRegistry* metrics = MetricsRegistry::registry();
+    mLatenessSumMetric = &metrics->counter("ufcs_routine_step_lateness_microseconds_total", "Total delay of timed routine steps past their deadline");
+    mLatenessCountMetric = &metrics->counter("ufcs_routine_timed_steps_total", "Number of timed routine steps");
+    mLatenessMaxMetric = &metrics->gauge("ufcs_routine_step_lateness_max_microseconds", "Longest delay of a timed routine step past its deadline");
+    mTriggerLatencySumMetric = &metrics->counter("ufcs_routine_trigger_latency_microseconds_total", "Total time from triggers being fired to the routine resuming");
+    mTriggerCountMetric = &metrics->counter("ufcs_routine_triggers_total", "Number of triggers that ended a wait");
+    mTriggerLatencyMaxMetric = &metrics->gauge("ufcs_routine_trigger_latency_max_microseconds", "Longest time from a trigger being fired to the routine resuming");
 }
 
 /**
@@ -51,7 +73,7 @@ bool RoutineController::loadFile(QString fileUrl)
 
     if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
         QString error = "Could not load file " + url.toLocalFile() + " : " + file.errorString();
-        qWarning() << error;
+        qCWarning(lcRoutine) << error;
         return false;
     }
 
@@ -81,6 +103,11 @@ bool RoutineController::loadFile(QString fileUrl)
 int RoutineController::verify()
 {
     run(true);
+
+    // The model shares the list's data rather than copying it
+    mStepsModel->setStringList(mValidSteps);
+    emit stepsListChanged();
+
     return mErrorCount;
 }
 
@@ -89,7 +116,10 @@ int RoutineController::verify()
  */
 void RoutineController::begin()
 {
-    std::thread t([this] { run(false); });
+    std::thread t([this] {
+        Tracer::setThreadName("Routine");
+        run(false);
+    });
     t.detach();
 }
 
@@ -129,6 +159,61 @@ void RoutineController::resume()
 void RoutineController::wake()
 {
     std::lock_guard<std::mutex> lockGuard(mWakeMutex);
+    mWakeRequested = true;
+    mWakeConditionVariable.notify_one();
+}
+
+/**
+ * @brief Fire a trigger, ending the "wait for trigger" step waiting for it, or the next one if there is none yet
+ *
+ * Can be called from any thread; the routine thread is woken up directly. Triggers are ignored while no routine
+ * is running or paused, and once MaxPendingTriggers different ones are waiting for their step.
+ */
+void RoutineController::fireTrigger(const QString &name)
+{
+    RunStatus status = mRunStatus;
+    if (status != Running && status != Paused) {
+        qCDebug(lcRoutine) << "Ignoring trigger" << name << "; no routine is running";
+        return;
+    }
+
+    qint64 now = telemetryClock();
+
+    std::lock_guard<std::mutex> lockGuard(mWakeMutex);
+    if (!mPendingTriggers.contains(name)) {
+        if (mPendingTriggers.size() >= MaxPendingTriggers) {
+            qCWarning(lcRoutine) << "Ignoring trigger" << name << ";" << mPendingTriggers.size()
+                                 << "triggers are already waiting for their step";
+            return;
+        }
+        mPendingTriggers.insert(name, now);
+    }
+    mWakeConditionVariable.notify_one();
+}
+
+/**
+ * @brief Run routines faster (scale > 1) or slower than real time, e.g. for soak tests and simulations
+ *
+ * Waits, ramps and conditional wait timeouts last their duration divided by the scale. Elapsed and total run times
+ * are still given in routine time.
+ */
+void RoutineController::setTimeScale(double scale)
+{
+    if (scale > 0)
+        mTimeScale = scale;
+}
+
+/**
+ * @brief Update the measured pressure of a controller, waking up the routine if it is waiting on it
+ */
+void RoutineController::onPressureChanged(uint controllerNumber, double pressure)
+{
+    if (controllerNumber < 1 || controllerNumber > N_PRS)
+        return;
+
+    std::lock_guard<std::mutex> lockGuard(mWakeMutex);
+    mMeasuredPressure[controllerNumber-1] = pressure;
+    mHasMeasuredPressure[controllerNumber-1] = true;
     mWakeConditionVariable.notify_one();
 }
 
@@ -201,6 +286,10 @@ void RoutineController::run(bool dummyRun)
     if (!dummyRun) {
         mRunStatus = Running;
         emit runStatusChanged(Running);
+
+        // Triggers fired before the run belong to no step of it
+        std::lock_guard<std::mutex> lockGuard(mWakeMutex);
+        mPendingTriggers.clear();
     }
 
     if (dummyRun) {
@@ -211,6 +300,11 @@ void RoutineController::run(bool dummyRun)
     uint nValves = appController->nValves();
     uint nPressureControllers = appController->nPressureControllers();
 
+    // Last pressure set by the routine on each controller (in PSI), for conditional waits; NaN if none yet
+    double targetPressures[N_PRS];
+    for (int j(0); j < N_PRS; ++j)
+        targetPressures[j] = qQNaN();
+
     for (int i(0); i < mLines.size(); ++i) {
 
         QString line = mLines[i];
@@ -220,6 +314,8 @@ void RoutineController::run(bool dummyRun)
         if (line.isEmpty())
             continue;
 
+        TRACE_SPAN("routine", dummyRun ? "verify line" : "step", i+1);
+
         QStringList list = line.split(' ');
         int length = list.size();
 
@@ -255,14 +351,19 @@ void RoutineController::run(bool dummyRun)
                 mValidSteps << line;
             else {
                 setCurrentStep(mCurrentStep+1);
+                waitForOutput();
 
                 if (toggleAll) {
-                    for (uint v(1); v <= nValves; v++)
+                    for (uint v(1); v <= nValves; v++) {
+                        Tracer::flowBegin("routine", "command", Communicator::traceId(VALVE, v));
                         emit setValve(v, (state == "open"));
+                    }
                 }
 
-                else
+                else {
+                    Tracer::flowBegin("routine", "command", Communicator::traceId(VALVE, valveNumber));
                     emit setValve(valveNumber, (state == "open"));
+                }
 
                 // Signals & slots are necessary to avoid calling QSerialPort->write from a different thread
                 // (in which case it throws a QTimer-related error message), which is why "emit setValve" etc.
@@ -295,18 +396,147 @@ void RoutineController::run(bool dummyRun)
                 continue;
             }
 
+            if (controllerNumber <= N_PRS)
+                targetPressures[controllerNumber-1] = pressure;
+
             if (dummyRun)
                 mValidSteps << line;
             else {
-                // TODO: fix this for negative values (vacuum controller).
-                double p = appController->minPressure(controllerNumber)
-                        + (pressure / appController->maxPressure(controllerNumber));
                 setCurrentStep(mCurrentStep+1);
-                emit setPressure(controllerNumber, p);
+                waitForOutput();
+                Tracer::flowBegin("routine", "command", Communicator::traceId(PRESSURE, controllerNumber));
+                emit setPressure(controllerNumber, toSetpoint(controllerNumber, pressure));
             }
 
         }
 
+        else if (list[0] == "wait" && length > 1 && list[1] == "until") {
+            // Expected format: wait until pressure <number> <within / above / below> <value> [timeout <time> [unit]]
+            if ((length != 6 && length != 8 && length != 9) || list[2] != "pressure" || (length > 6 && list[6] != "timeout")) {
+                reportError("Line " + QString::number(i+1) + ": conditional wait should have the form "
+                            + "\"wait until pressure 1 within 0.2 timeout 30 s\"");
+                continue;
+            }
+
+            bool ok;
+            uint controllerNumber = list[3].toUInt(&ok);
+            if (!ok || controllerNumber < 1 || controllerNumber > nPressureControllers || controllerNumber > N_PRS) {
+                reportError("Line " + QString::number(i+1) + ": invalid pressure controller ID: " + list[3]
+                            + ". Must be an integer between 1 and " + QString::number(nPressureControllers));
+                continue;
+            }
+
+            PressureCondition condition;
+            if (list[4] == "within")
+                condition = PressureWithin;
+            else if (list[4] == "above")
+                condition = PressureAbove;
+            else if (list[4] == "below")
+                condition = PressureBelow;
+            else {
+                reportError("Line " + QString::number(i+1) + ": unknown condition: " + list[4]
+                            + ". Must be \"within\", \"above\" or \"below\"");
+                continue;
+            }
+
+            double value = list[5].toDouble(&ok);
+            if (!ok || value < 0) {
+                reportError("Line " + QString::number(i+1) + ": invalid pressure value: " + list[5]);
+                continue;
+            }
+
+            double target = value;
+            if (condition == PressureWithin) {
+                target = targetPressures[controllerNumber-1];
+                if (qIsNaN(target)) {
+                    reportError("Line " + QString::number(i+1) + ": the pressure of controller " + list[3]
+                                + " must be set by the routine before waiting for it");
+                    continue;
+                }
+            }
+
+            // Negative: no timeout
+            double timeout = -1;
+            if (length > 6) {
+                timeout = list[7].toDouble(&ok);
+                double multiplier = 1.0;
+                if (!ok || timeout <= 0 || (length == 9 && !parseTimeUnit(list[8], multiplier))) {
+                    reportError("Line " + QString::number(i+1) + ": invalid timeout: " + list.mid(7).join(' '));
+                    continue;
+                }
+                timeout *= multiplier;
+            }
+
+            if (dummyRun)
+                mValidSteps << line;
+
+            else {
+                setCurrentStep(mCurrentStep+1);
+                double waited;
+                bool met = waitForPressure(controllerNumber, condition, target, value, timeout, waited);
+
+                if (met)
+                    qCInfo(lcRoutine) << "Line" << i+1 << ": pressure" << controllerNumber << "reached the condition after" << waited << "s";
+                else if (!mStopRequested && !mPauseRequested && !mWakeRequested)
+                    reportError("Line " + QString::number(i+1) + ": timed out after " + QString::number(waited)
+                                + " s waiting for pressure " + list[3] + " to be " + list[4] + " " + list[5] + " PSI");
+
+                mElapsedTime += waited;
+                emit elapsedTimeChanged(mElapsedTime);
+            }
+        }
+
+        else if (list[0] == "wait" && length > 1 && list[1] == "for") {
+            // Expected format: wait for trigger <name> [timeout <time> [unit]]
+            if ((length != 4 && length != 6 && length != 7) || list[2] != "trigger" || (length > 4 && list[4] != "timeout")) {
+                reportError("Line " + QString::number(i+1) + ": trigger wait should have the form "
+                            + "\"wait for trigger camera timeout 30 s\"");
+                continue;
+            }
+
+            QString name = list[3];
+            if (!QRegExp("[A-Za-z0-9_-]+").exactMatch(name)) {
+                reportError("Line " + QString::number(i+1) + ": invalid trigger name: " + name
+                            + ". Use letters, digits, \"-\" and \"_\" only");
+                continue;
+            }
+
+            // Negative: no timeout
+            double timeout = -1;
+            if (length > 4) {
+                bool ok;
+                timeout = list[5].toDouble(&ok);
+                double multiplier = 1.0;
+                if (!ok || timeout <= 0 || (length == 7 && !parseTimeUnit(list[6], multiplier))) {
+                    reportError("Line " + QString::number(i+1) + ": invalid timeout: " + list.mid(5).join(' '));
+                    continue;
+                }
+                timeout *= multiplier;
+            }
+
+            if (dummyRun)
+                mValidSteps << line;
+
+            else {
+                setCurrentStep(mCurrentStep+1);
+                double waited;
+                qint64 latency;
+                bool fired = waitForTrigger(name, timeout, waited, latency);
+
+                if (fired) {
+                    qCInfo(lcRoutine) << "Line" << i+1 << ": trigger" << name << "received after" << waited
+                                      << "s; resumed" << latency << "us after it was fired";
+                    emit triggerReceived(name, latency);
+                }
+                else if (!mStopRequested && !mPauseRequested && !mWakeRequested)
+                    reportError("Line " + QString::number(i+1) + ": timed out after " + QString::number(waited)
+                                + " s waiting for trigger " + name);
+
+                mElapsedTime += waited;
+                emit elapsedTimeChanged(mElapsedTime);
+            }
+        }
+
         else if (list[0] == "wait") {
             // Expected format:  wait <time> <unit> . <unit> defaults to seconds. e.g: `wait 10 minutes`, `wait 60`
             if (length != 2 && length != 3) {
@@ -323,14 +553,7 @@ void RoutineController::run(bool dummyRun)
 
             if (length == 3) {
                 double multiplier = 1.0;
-
-                if (list[2] == "ms" || list[2] == "milliseconds" || list[2] == "millisecond" || list[2] == "msec")
-                    multiplier = 0.001;
-                else if (list[2] == "minutes" || list[2] == "minute" || list[2] == "min" || list[2] == "mins" || list[2] == "min")
-                    multiplier = 60;
-                else if (list[2] == "hours" || list[2] == "hour" || list[2] == "hrs" || list[2] == "hr" || list[2] == "h")
-                    multiplier = 3600;
-
+                parseTimeUnit(list[2], multiplier);
                 time *= multiplier;
             }
 
@@ -344,12 +567,88 @@ void RoutineController::run(bool dummyRun)
             else {
                 setCurrentStep(mCurrentStep+1);
                 std::unique_lock<std::mutex> lock(mWakeMutex);
-                mWakeConditionVariable.wait_for(lock, std::chrono::milliseconds(uint64_t(time*1000)));
+                mWakeRequested = false;
+                // The condition variable is also notified by new measurements; only wake(), stop() and pause() end the wait early
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(uint64_t(time*1000 / mTimeScale));
+                if (!mWakeConditionVariable.wait_until(lock, deadline, [this] { return mWakeRequested || mStopRequested || mPauseRequested; }))
+                    recordLateness(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - deadline).count());
                 mElapsedTime += time;
                 emit elapsedTimeChanged(mElapsedTime);
             }
         }
 
+        else if (list[0] == "ramp") {
+            // Expected format: ramp <number> <from> <to> over <duration> [unit] [shape]. e.g: ramp 1 2 10 over 30 s smooth
+            if (length < 6 || length > 8 || list[4] != "over") {
+                reportError("Line " + QString::number(i+1) + ": line starting with \"ramp\" should have the form \"ramp 1 2 10 over 30 seconds\"");
+                continue;
+            }
+
+            bool ok;
+            uint controllerNumber = list[1].toUInt(&ok);
+            if (!ok || controllerNumber < 1 || controllerNumber > nPressureControllers) {
+                reportError("Line " + QString::number(i+1) + ": invalid pressure controller ID: " + list[1]
+                            + ". Must be an integer between 1 and " + QString::number(nPressureControllers));
+                continue;
+            }
+
+            double from = list[2].toDouble(&ok);
+            bool toOk;
+            double to = list[3].toDouble(&toOk);
+            if (!ok || !toOk) {
+                reportError("Line " + QString::number(i+1) + ": could not parse ramp pressures: " + list[2] + ", " + list[3]);
+                continue;
+            }
+            double minPressure = appController->minPressure(controllerNumber);
+            double maxPressure = appController->maxPressure(controllerNumber);
+            if (from < minPressure || from > maxPressure || to < minPressure || to > maxPressure) {
+                reportError("Line " + QString::number(i+1) + ": Pressure value out of bounds for this controller: "
+                            + list[2] + ", " + list[3]);
+                continue;
+            }
+
+            double duration = list[5].toDouble(&ok);
+            if (!ok || duration <= 0) {
+                reportError("Line " + QString::number(i+1) + ": invalid ramp duration: " + list[5]);
+                continue;
+            }
+
+            // The unit and shape are both optional
+            bool smooth = false;
+            bool valid = true;
+            for (int j(6); j < length; ++j) {
+                double multiplier = 1.0;
+                if (list[j] == "smooth" && j == length - 1)
+                    smooth = true;
+                else if (list[j] == "linear" && j == length - 1)
+                    smooth = false;
+                else if (j == 6 && parseTimeUnit(list[j], multiplier))
+                    duration *= multiplier;
+                else {
+                    reportError("Line " + QString::number(i+1) + ": unknown ramp unit or shape: " + list[j]);
+                    valid = false;
+                }
+            }
+            if (!valid)
+                continue;
+
+            if (controllerNumber <= N_PRS)
+                targetPressures[controllerNumber-1] = to;
+
+            if (dummyRun) {
+                mValidSteps << line;
+                mTotalWaitTime += duration;
+                totalRunTimeChanged(mTotalWaitTime);
+            }
+
+            else {
+                setCurrentStep(mCurrentStep+1);
+                runRamp(controllerNumber, from, to, duration / mTimeScale, smooth);
+                mElapsedTime += duration;
+                emit elapsedTimeChanged(mElapsedTime);
+            }
+        }
+
         else if (list[0] == "multiplexer") {
             // Expected format: multiplexer X, where X is 1-8 or "all".
             if (length != 2) {
@@ -388,7 +687,7 @@ void RoutineController::run(bool dummyRun)
             break;
 
         if (mPauseRequested) {
-            qDebug() << "Pause requested. RoutineController::run is pausing";
+            qCDebug(lcRoutine) << "Pause requested. RoutineController::run is pausing";
             mRunStatus = Paused;
             emit paused();
             std::unique_lock<std::mutex> lock(mPauseMutex);
@@ -396,15 +695,12 @@ void RoutineController::run(bool dummyRun)
             if (mStopRequested) {
                 break;
             }
-            qDebug() << "RoutineController::run is resuming";
+            qCDebug(lcRoutine) << "RoutineController::run is resuming";
             mRunStatus = Running;
             emit resumed();
         }
     }
 
-    if (!mValidSteps.empty())
-        emit stepsListChanged();
-
     if (dummyRun)
         mNumberOfSteps = mValidSteps.size();
 
@@ -418,7 +714,11 @@ void RoutineController::run(bool dummyRun)
 
 void RoutineController::reportError(const QString &errorString)
 {
-    mErrors << errorString;
+    // A routine that keeps failing (e.g. a conditional wait timing out at every loop) mustn't grow the list forever
+    if (mErrors.size() < MaxErrors)
+        mErrors << errorString;
+    else if (mErrors.size() == MaxErrors)
+        mErrors << "Further errors are not listed";
     emit error(errorString);
     mErrorCount++;
 
@@ -431,3 +731,276 @@ void RoutineController::setCurrentStep(int stepNumber)
     mCurrentStep = stepNumber;
     emit currentStepChanged(stepNumber);
 }
+
+/**
+ * @brief Tell the routine whether the outgoing command queue is congested
+ */
+void RoutineController::setOutputCongested(bool congested)
+{
+    std::lock_guard<std::mutex> lockGuard(mWakeMutex);
+    mOutputCongested = congested;
+    mWakeConditionVariable.notify_one();
+}
+
+/**
+ * @brief Block while the outgoing command queue is congested, so that the routine doesn't flood it
+ */
+void RoutineController::waitForOutput()
+{
+    std::unique_lock<std::mutex> lock(mWakeMutex);
+    mWakeConditionVariable.wait(lock, [this] { return !mOutputCongested || mStopRequested; });
+}
+
+/**
+ * @brief Convert a pressure in PSI to the normalized (0-1) setpoint of the given controller
+ */
+double RoutineController::toSetpoint(uint controllerNumber, double pressure)
+{
+    // TODO: fix this for negative values (vacuum controller).
+    return appController->minPressure(controllerNumber)
+            + (pressure / appController->maxPressure(controllerNumber));
+}
+
+/**
+ * @brief Convert the normalized (0-1) pressure of the given controller to PSI; inverse of toSetpoint()
+ */
+double RoutineController::toPressure(uint controllerNumber, double setpoint)
+{
+    return (setpoint - appController->minPressure(controllerNumber)) * appController->maxPressure(controllerNumber);
+}
+
+/**
+ * @brief Block until the measured pressure of a controller meets a condition
+ * @param value The target pressure, in PSI (for PressureWithin), or the threshold (for PressureAbove / PressureBelow)
+ * @param tolerance Maximum difference with the target, in PSI (for PressureWithin)
+ * @param timeout Maximum time to wait, in seconds. Negative to wait indefinitely.
+ * @param waitedTime Set to the time waited, in seconds
+ * @return True if the condition was met; false on timeout, or if the routine was stopped, paused or woken up
+ *
+ * The condition is evaluated each time onPressureChanged() receives a new measurement; the routine thread sleeps
+ * in between.
+ */
+bool RoutineController::waitForPressure(uint controllerNumber, PressureCondition condition, double value,
+                                        double tolerance, double timeout, double &waitedTime)
+{
+    using namespace std::chrono;
+
+    const double minPressure = appController->minPressure(controllerNumber);
+    const double maxPressure = appController->maxPressure(controllerNumber);
+    const steady_clock::time_point start = steady_clock::now();
+
+    bool met = false;
+    auto predicate = [&] {
+        if (mHasMeasuredPressure[controllerNumber-1]) {
+            double pressure = (mMeasuredPressure[controllerNumber-1] - minPressure) * maxPressure; // See toPressure()
+            if (condition == PressureWithin)
+                met = std::abs(pressure - value) <= tolerance;
+            else if (condition == PressureAbove)
+                met = pressure > value;
+            else
+                met = pressure < value;
+        }
+        return met || mStopRequested || mPauseRequested || mWakeRequested;
+    };
+
+    {
+        std::unique_lock<std::mutex> lock(mWakeMutex);
+        mWakeRequested = false;
+        if (timeout < 0)
+            mWakeConditionVariable.wait(lock, predicate);
+        else
+            mWakeConditionVariable.wait_for(lock, microseconds(qint64(timeout * 1e6 / mTimeScale)), predicate);
+    }
+
+    waitedTime = duration_cast<milliseconds>(steady_clock::now() - start).count() / 1000. * mTimeScale;
+    return met;
+}
+
+/**
+ * @brief Block until a trigger is fired (see fireTrigger)
+ * @param timeout Maximum time to wait, in seconds. Negative to wait indefinitely.
+ * @param waitedTime Set to the time waited, in seconds
+ * @param latency Set to the time from the trigger being fired (or from the start of the wait, if it was fired
+ * before) to the routine thread running again, in microseconds
+ * @return True if the trigger was fired; false on timeout, or if the routine was stopped, paused or woken up
+ */
+bool RoutineController::waitForTrigger(const QString &name, double timeout, double &waitedTime, qint64 &latency)
+{
+    using namespace std::chrono;
+
+    const steady_clock::time_point start = steady_clock::now();
+    const qint64 waitStart = telemetryClock();
+
+    bool fired = false;
+    qint64 firedAt = 0;
+    auto predicate = [&] {
+        auto it = mPendingTriggers.find(name);
+        if (it != mPendingTriggers.end()) {
+            fired = true;
+            firedAt = it.value();
+            mPendingTriggers.erase(it);
+        }
+        return fired || mStopRequested || mPauseRequested || mWakeRequested;
+    };
+
+    {
+        std::unique_lock<std::mutex> lock(mWakeMutex);
+        mWakeRequested = false;
+        if (timeout < 0)
+            mWakeConditionVariable.wait(lock, predicate);
+        else
+            mWakeConditionVariable.wait_for(lock, microseconds(qint64(timeout * 1e6 / mTimeScale)), predicate);
+    }
+
+    latency = 0;
+    if (fired) {
+        latency = telemetryClock() - qMax(firedAt, waitStart);
+        mTriggerLatencySumMetric->increment(latency);
+        mTriggerCountMetric->increment();
+        mTriggerLatencyMaxMetric->setMax(latency);
+    }
+
+    waitedTime = duration_cast<milliseconds>(steady_clock::now() - start).count() / 1000. * mTimeScale;
+    return fired;
+}
+
+/**
+ * @brief Return the number of ramp setpoints per second
+ *
+ * Unless set with the routine/rampRate setting, this depends on the transport. Over a serial link, each pressure
+ * command takes about 6 bytes on the wire (10 bits each); a ramp uses at most a quarter of the link's capacity, so
+ * that other commands and several simultaneous ramps still get through. The other transports aren't limited by a
+ * baud rate, so ramps use the highest rate; the congestion of the command queue still slows them down if needed.
+ */
+int RoutineController::rampRate()
+{
+    const int MaxRampRate = 100;
+
+    int rate = appController->rampRate();
+    if (rate <= 0) {
+        if (appController->transport() == "serial")
+            rate = int(appController->serialBaudRate() / (10 * 6 * 4));
+        else
+            rate = MaxRampRate;
+    }
+    return qBound(1, rate, MaxRampRate);
+}
+
+/**
+ * @brief Send the setpoints of a ramp, blocking until it is over (or the routine is stopped or paused)
+ *
+ * Setpoints are computed on an absolute schedule (start + k * period), so a late wake-up doesn't shift the rest
+ * of the ramp. A setpoint is only sent when it differs from the previous one by at least one step of the
+ * microcontroller's resolution; slow ramps therefore send fewer commands than the schedule allows.
+ *
+ * The planned trajectory is compared to the setpoints actually sent and to the measured pressure; the result is
+ * logged and emitted with rampCompleted().
+ */
+void RoutineController::runRamp(uint controllerNumber, double from, double to, double duration, bool smooth)
+{
+    using namespace std::chrono;
+
+    const int ticks = qMax(1, int(std::ceil(duration * rampRate())));
+    const steady_clock::time_point start = steady_clock::now();
+
+    int lastValue = -1;
+    int sent = 0;
+    bool interrupted = false;
+    qint64 maxLateness = 0;
+    double measuredErrorSquaredSum = 0, measuredErrorMax = 0;
+    int measuredCount = 0;
+
+    for (int k(0); k <= ticks; ++k) {
+        steady_clock::time_point deadline = start + microseconds(qint64(std::llround(k * duration * 1e6 / ticks)));
+        {
+            std::unique_lock<std::mutex> lock(mWakeMutex);
+            if (mWakeConditionVariable.wait_until(lock, deadline, [this] { return mStopRequested || mPauseRequested; })) {
+                interrupted = true;
+                break;
+            }
+        }
+        qint64 lateness = duration_cast<microseconds>(steady_clock::now() - deadline).count();
+        maxLateness = qMax(maxLateness, lateness);
+        recordLateness(lateness);
+
+        double x = double(k) / ticks;
+        if (smooth)
+            x = (1 - std::cos(M_PI * x)) / 2;
+        double planned = from + (to - from) * x;
+
+        int value = int(std::lround(toSetpoint(controllerNumber, planned) * PR_MAX_VALUE));
+        if (value != lastValue) {
+            waitForOutput();
+            if (mStopRequested) {
+                interrupted = true;
+                break;
+            }
+
+            TRACE_SPAN("routine", "ramp tick", k);
+            Tracer::flowBegin("routine", "command", Communicator::traceId(PRESSURE, controllerNumber));
+            emit setPressure(controllerNumber, double(value) / PR_MAX_VALUE);
+            lastValue = value;
+            sent++;
+        }
+
+        double measured;
+        if (appController->latestMeasurement(controllerNumber, measured)) {
+            double error = std::abs(toPressure(controllerNumber, measured) - planned);
+            measuredErrorSquaredSum += error * error;
+            measuredErrorMax = qMax(measuredErrorMax, error);
+            measuredCount++;
+        }
+    }
+
+    QVariantMap report;
+    report["plannedDuration"] = duration;
+    report["actualDuration"] = duration_cast<milliseconds>(steady_clock::now() - start).count() / 1000.;
+    report["setpointsSent"] = sent;
+    report["maxLateness"] = maxLateness / 1000.;
+    report["interrupted"] = interrupted;
+    if (measuredCount > 0) {
+        report["trackingErrorRms"] = std::sqrt(measuredErrorSquaredSum / measuredCount);
+        report["trackingErrorMax"] = measuredErrorMax;
+    }
+
+    qCInfo(lcRoutine) << "Ramp of controller" << controllerNumber << "from" << from << "to" << to << "PSI:"
+                      << report["actualDuration"].toDouble() << "s instead of" << duration << "s,"
+                      << sent << "setpoints sent, latest by" << report["maxLateness"].toDouble() << "ms;"
+                      << "measured pressure off by" << report.value("trackingErrorRms", "n/a").toString()
+                      << "PSI RMS," << report.value("trackingErrorMax", "n/a").toString() << "PSI max"
+                      << (interrupted ? "(interrupted)" : "");
+
+    emit rampCompleted(mCurrentStep, report);
+}
+
+/**
+ * @brief Parse a time unit (e.g. "ms", "min", "hours")
+ * @param multiplier Set to the number of seconds in one unit, if the unit is recognized
+ * @return False if the unit isn't recognized
+ */
+bool RoutineController::parseTimeUnit(const QString &unit, double &multiplier)
+{
+    if (unit == "ms" || unit == "milliseconds" || unit == "millisecond" || unit == "msec")
+        multiplier = 0.001;
+    else if (unit == "s" || unit == "sec" || unit == "secs" || unit == "seconds" || unit == "second")
+        multiplier = 1;
+    else if (unit == "minutes" || unit == "minute" || unit == "min" || unit == "mins")
+        multiplier = 60;
+    else if (unit == "hours" || unit == "hour" || unit == "hrs" || unit == "hr" || unit == "h")
+        multiplier = 3600;
+    else
+        return false;
+
+    return true;
+}
+
+/**
+ * @brief Add the delay of a timed step past its deadline to the lateness metrics
+ */
+void RoutineController::recordLateness(qint64 microseconds)
+{
+    microseconds = qMax(microseconds, qint64(0));
+    mLatenessSumMetric->increment(microseconds);
+    mLatenessCountMetric->increment();
+    mLatenessMaxMetric->setMax(microseconds);
+}
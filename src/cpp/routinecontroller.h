@@ -7,6 +7,10 @@
 
 #include <QtCore>
 #include <QStringList>
+#include <QStringListModel>
+
+#include "constants.h"
+#include "metrics.h"
 
 class ApplicationController;
 
@@ -45,6 +49,32 @@ class ApplicationController;
  *
  *      Example: wait 2 minutes
  *
+ * wait until pressure X within T [timeout Y [unit]]
+ * wait until pressure X above P [timeout Y [unit]]
+ * wait until pressure X below P [timeout Y [unit]]
+ *      Pause until the pressure measured by regulator X is within T PSI of the last pressure set by the routine
+ *      on that regulator (or above / below P PSI). The condition is checked whenever a new measurement arrives.
+ *      If the timeout (default unit: seconds) expires first, an error is reported and the routine continues.
+ *      Without a timeout, the routine waits until the condition is met or the wait is skipped. The time taken is
+ *      logged, to help tune routines.
+ *
+ *      Example: wait until pressure 1 within 0.2 timeout 30 s
+ *
+ * wait for trigger NAME [timeout Y [unit]]
+ *      Pause until the trigger NAME (letters, digits, "-" and "_") is fired by another program (see fireTrigger).
+ *      A trigger fired while the routine runs but before it gets to this step is kept, and ends the wait at once.
+ *      The timeout works as for conditional waits. The time from the trigger to the next step is logged.
+ *
+ *      Example: wait for trigger camera timeout 2 min
+ *
+ * ramp X A B over T [unit] [shape]
+ *      Change the pressure of regulator X from A to B PSI, over the duration T. The unit is the same as for wait
+ *      (default: seconds). The shape can be "linear" (default) or "smooth", which starts and ends the ramp
+ *      gradually (half a cosine period). Intermediate setpoints are sent on a fixed schedule, as often as the
+ *      link and the setpoint resolution allow. The duration counts towards the total run time.
+ *
+ *      Example: ramp 1 2 10 over 30 seconds smooth
+ *
  *
  * multiplexer X
  *      Open multiplexer to channel X, where X is 1-8 or "all".
@@ -57,7 +87,7 @@ class RoutineController : public QObject
     Q_PROPERTY(int currentStep READ currentStep NOTIFY currentStepChanged)
     Q_PROPERTY(RunStatus runStatus READ status NOTIFY runStatusChanged)
     Q_PROPERTY(QStringList errorList READ errors NOTIFY error)
-    Q_PROPERTY(QStringList stepsList READ steps NOTIFY stepsListChanged)
+    Q_PROPERTY(QStringListModel* stepsModel READ stepsModel CONSTANT)
     Q_PROPERTY(long totalRunTime READ totalRunTime NOTIFY totalRunTimeChanged)
     Q_PROPERTY(long elapsedTime READ elapsedTime NOTIFY elapsedTimeChanged)
 
@@ -70,6 +100,9 @@ public:
         Paused
     }; Q_ENUM(RunStatus)
 
+    /// Distinct triggers kept for later steps; more are ignored
+    static const int MaxPendingTriggers = 64;
+
     RoutineController(ApplicationController* applicationController);
     virtual ~RoutineController() {}
 
@@ -80,6 +113,7 @@ public:
     Q_INVOKABLE void pause();
     Q_INVOKABLE void resume();
     Q_INVOKABLE void wake();
+    Q_INVOKABLE void fireTrigger(const QString& name);
 
     RunStatus status();
 
@@ -88,6 +122,7 @@ public:
     Q_INVOKABLE int numberOfErrors();
 
     Q_INVOKABLE const QStringList &steps();
+    QStringListModel* stepsModel() { return mStepsModel; }
 
     const QStringList &fileContents();
     const QStringList& errors();
@@ -96,8 +131,18 @@ public:
     Q_INVOKABLE long totalRunTime() { return mTotalWaitTime; }
     Q_INVOKABLE long elapsedTime() { return mElapsedTime; }
 
+    void setTimeScale(double scale);
+    double timeScale() const { return mTimeScale; }
+
+    /// Maximum number of error messages kept by errors(); further errors are only counted and emitted
+    static const int MaxErrors = 1000;
+
+public slots:
+    void onPressureChanged(uint controllerNumber, double pressure);
+    void setOutputCongested(bool congested);
+
 signals:
-    /// Emitted when the list of steps is updated
+    /// Emitted when the list of steps is updated, i.e. after verify()
     void stepsListChanged();
 
     /// Emitted whenever an error is encountered
@@ -124,6 +169,12 @@ signals:
     /// Emitted when the elapsed run time has changed
     void elapsedTimeChanged(long time);
 
+    /// Emitted when a "wait for trigger" step ends because the trigger was fired. Latency in microseconds.
+    void triggerReceived(QString name, qint64 latency);
+
+    /// Emitted at the end of a ramp, with a comparison of the planned and achieved trajectories
+    void rampCompleted(int stepNumber, QVariantMap report);
+
     void setValve(uint valveNumber, bool open);
     void setPressure(uint controllerNumber, double value);
     void setMultiplexer(QString label);
@@ -134,6 +185,22 @@ private:
     void run(bool dummyRun);
     void reportError(const QString& errorString);
     void setCurrentStep(int stepNumber);
+    double toSetpoint(uint controllerNumber, double pressure);
+    void runRamp(uint controllerNumber, double from, double to, double duration, bool smooth);
+    int rampRate();
+    static bool parseTimeUnit(const QString& unit, double& multiplier);
+    void waitForOutput();
+    double toPressure(uint controllerNumber, double setpoint);
+    void recordLateness(qint64 microseconds);
+    bool waitForTrigger(const QString& name, double timeout, double& waitedTime, qint64& latency);
+
+    enum PressureCondition {
+        PressureWithin,
+        PressureAbove,
+        PressureBelow
+    };
+    bool waitForPressure(uint controllerNumber, PressureCondition condition, double value, double tolerance,
+                         double timeout, double& waitedTime);
 
     std::atomic<RunStatus> mRunStatus;
     std::atomic<int> mCurrentStep;
@@ -157,12 +224,38 @@ private:
     /// Condition variable used by waking functionality (to wake thread when it is in a wait command)
     std::condition_variable mWakeConditionVariable;
 
+    /// Set by wake(), to skip a conditional wait
+    std::atomic<bool> mWakeRequested;
+
+    /// True while the outgoing command queue is nearly full. Valve and pressure steps wait until it drains.
+    std::atomic<bool> mOutputCongested;
+
+    /// How late timed steps (waits, ramp ticks) start compared to their deadline
+    MetricsRegistry::Metric* mLatenessSumMetric;
+    MetricsRegistry::Metric* mLatenessCountMetric;
+    MetricsRegistry::Metric* mLatenessMaxMetric;
+
+    /// Time from a trigger being fired to the routine resuming (see waitForTrigger)
+    MetricsRegistry::Metric* mTriggerLatencySumMetric;
+    MetricsRegistry::Metric* mTriggerCountMetric;
+    MetricsRegistry::Metric* mTriggerLatencyMaxMetric;
+
+    /// Triggers fired and not yet waited for, with when each was fired (telemetryClock). Guarded by mWakeMutex.
+    QHash<QString, qint64> mPendingTriggers;
+
+    /// Last pressure (0-1) measured by each controller, and whether there is one yet. Guarded by mWakeMutex.
+    double mMeasuredPressure[N_PRS];
+    bool mHasMeasuredPressure[N_PRS];
+
     /// The raw contents of the routine file, including empty lines and comments
     QStringList mLines;
 
     /// The valid steps of the routine. This is initialized only after verify() has run.
     QStringList mValidSteps;
 
+    /// mValidSteps, as shown by QML. Only updated by verify(), so that views aren't rebuilt at every run.
+    QStringListModel* mStepsModel;
+
     /// Number of valid steps in the routine
     int mNumberOfSteps;
 
@@ -178,6 +271,9 @@ private:
     /// Approximate time elapsed (sum of wait times done)
     long mElapsedTime;
 
+    /// Waits, ramps and timeouts last their duration divided by this; 1 in normal use (see setTimeScale)
+    std::atomic<double> mTimeScale;
+
     ApplicationController* appController;
 };
 
@@ -1,5 +1,6 @@
 #include "serialcommunicator.h"
 #include "applicationcontroller.h"
+#include "logger.h"
 
 SerialCommunicator::SerialCommunicator(ApplicationController *applicationController)
     : Communicator(applicationController)
@@ -16,7 +17,8 @@ SerialCommunicator::~SerialCommunicator()
 /**
  * @brief Connect to the microcontroller.
  *
- * The appropriate serial port is automatically selected, based on the device description.
+ * The appropriate serial port is automatically selected, based on the device description, unless a port is
+ * configured (see ApplicationController::serialPort).
  */
 void SerialCommunicator::connect()
 {
@@ -26,10 +28,17 @@ void SerialCommunicator::connect()
 
     setConnectionStatus(Connecting);
 
-    qInfo() << "Connecting to ESP32... ";
+    QString configuredPort = appController->serialPort();
+    if (!configuredPort.isEmpty()) {
+        qCInfo(lcCommunicator) << "Connecting to" << configuredPort << "...";
+        openPort(configuredPort, configuredPort, false);
+        return;
+    }
+
+    qCInfo(lcCommunicator) << "Connecting to ESP32... ";
 
-    qDebug() << "List of all serial devices:";
-    qDebug() << "---------------------------";
+    qCDebug(lcCommunicator) << "List of all serial devices:";
+    qCDebug(lcCommunicator) << "---------------------------";
 
     QSerialPortInfo portToUse;
     foreach (const QSerialPortInfo &info, QSerialPortInfo::availablePorts()) {
@@ -44,7 +53,7 @@ void SerialCommunicator::connect()
                     //"Busy:" + (info.isBusy() ? QObject::tr("Yes") : QObject::tr("No")) + "\n";
                     ;
 
-        qDebug().noquote() << s;
+        qCDebug(lcCommunicator).noquote() << s;
 
         // The following line may need to be customized depending on your specific board.
 
@@ -65,15 +74,27 @@ void SerialCommunicator::connect()
     }
 
     if(portToUse.isNull()) {
-        qWarning() << "Serial port unknown or not valid:" << portToUse.portName();
+        qCWarning(lcCommunicator) << "Serial port unknown or not valid:" << portToUse.portName();
         setConnectionStatus(Disconnected);
         return;
     }
 
+    openPort(portToUse.portName(), portToUse.description(), true);
+}
+
+/**
+ * @brief Open the given serial port at the configured baud rate, and update the connection status
+ * @param portName Name (e.g. COM3, ttyUSB0) or path (e.g. /dev/pts/3) of the port
+ * @param description Shown in the log
+ * @param clearControlLines Whether to clear DTR and RTS once the port is open. Configured ports are left alone, as
+ * they may not support these signals (e.g. virtual serial ports).
+ */
+void SerialCommunicator::openPort(const QString &portName, const QString &description, bool clearControlLines)
+{
     qint32 baudRate = appController->serialBaudRate();
-    qDebug() << "Serial communicator baud rate set to" << baudRate;
+    qCDebug(lcCommunicator) << "Serial communicator baud rate set to" << baudRate;
 
-    mSerialPort->setPortName(portToUse.portName());
+    mSerialPort->setPortName(portName);
     mSerialPort->setBaudRate(baudRate);
     mSerialPort->setDataBits(QSerialPort::Data8);
     mSerialPort->setParity(QSerialPort::NoParity);
@@ -81,19 +102,21 @@ void SerialCommunicator::connect()
     mSerialPort->setFlowControl(QSerialPort::NoFlowControl);
 
     if (mSerialPort->open(QIODevice::ReadWrite)) {
-        qInfo() << "Connected to" << portToUse.description() << "on" << portToUse.portName();
+        qCInfo(lcCommunicator) << "Connected to" << description << "on" << portName;
 
         // The following two lines are necessary with Sparkfun's ESP32 thing (which uses an FTDI chip);
         // not necessary with the Espressif ESP32 DevKitC
-        mSerialPort->setDataTerminalReady(false);
-        mSerialPort->setRequestToSend(false);
+        if (clearControlLines) {
+            mSerialPort->setDataTerminalReady(false);
+            mSerialPort->setRequestToSend(false);
+        }
 
         setConnectionStatus(Connected);
+        return;
     }
-    else {
-        qWarning() << "Could not open serial port: " << mSerialPort->errorString();
-        setConnectionStatus(Disconnected);
-    }
+
+    qCWarning(lcCommunicator) << "Could not open serial port: " << mSerialPort->errorString();
+    setConnectionStatus(Disconnected);
 }
 
 /**
@@ -110,7 +133,7 @@ void SerialCommunicator::handleSerialError(QSerialPort::SerialPortError error)
         return;
 
     if (error != QSerialPort::NoError) {
-        qWarning() << "Serial port error: " << mSerialPort->errorString();
+        qCWarning(lcCommunicator) << "Serial port error: " << mSerialPort->errorString();
         mSerialPort->clearError();
 
         // Currently assuming that any error means that the device disconnected -- there may be a better way of doing this
@@ -146,9 +169,16 @@ void SerialCommunicator::onSerialReady()
 void SerialCommunicator::sendMessage(QByteArray message)
 {
     if (mConnectionStatus == Disconnected)
-        qWarning() << "Can't send message: microcontroller is not connected";
-    else if (mSerialPort)
+        qCWarning(lcCommunicator) << "Can't send message: microcontroller is not connected";
+    else if (mSerialPort) {
+        TRACE_SPAN("communicator", "serial write", message.size());
         mSerialPort->write(message);
+    }
+}
+
+qint64 SerialCommunicator::bytesToWrite() const
+{
+    return mSerialPort ? mSerialPort->bytesToWrite() : 0;
 }
 
 void SerialCommunicator::initSerialPort()
@@ -159,6 +189,7 @@ void SerialCommunicator::initSerialPort()
         QObject::connect(mSerialPort, SIGNAL(error(QSerialPort::SerialPortError)), this,
                 SLOT(handleSerialError(QSerialPort::SerialPortError)));
         QObject::connect(mSerialPort, SIGNAL(readyRead()), this, SLOT(onSerialReady()));
+        QObject::connect(mSerialPort, &QSerialPort::bytesWritten, this, [this] { drainQueue(); });
     }
 }
 
@@ -25,9 +25,11 @@ private slots:
 
 protected:
     void sendMessage(QByteArray message);
+    qint64 bytesToWrite() const;
 
 private:
     void initSerialPort();
+    void openPort(const QString& portName, const QString& description, bool clearControlLines);
 
     QSerialPort * mSerialPort;
 };
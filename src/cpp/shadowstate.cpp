@@ -0,0 +1,105 @@
+#include "shadowstate.h"
+
+ShadowState::ShadowState()
+{
+    const int counts[NumComponents] = { N_VALVES, N_PUMPS, N_PRS };
+    for (int c(0); c < NumComponents; ++c)
+        mEntries[c].assign(size_t(counts[c]), Entry { -1, -1, 0, false });
+}
+
+/**
+ * @brief Return whether a command setting the component to the given value would change nothing
+ *
+ * That is the case if this value is both the last one requested and the last one reported by the microcontroller.
+ */
+bool ShadowState::isRedundant(Component component, uint number, int value) const
+{
+    const Entry* e = entry(component, number);
+    return e && e->desired == value && e->reported == value;
+}
+
+void ShadowState::setDesired(Component component, uint number, int value, qint64 now)
+{
+    Entry* e = mutableEntry(component, number);
+    if (e && e->desired != value) {
+        e->desired = value;
+        e->changedAt = now;
+        e->flagged = false;
+    }
+}
+
+void ShadowState::setReported(Component component, uint number, int value, qint64 now)
+{
+    Entry* e = mutableEntry(component, number);
+    if (e && e->reported != value) {
+        e->reported = value;
+        e->changedAt = now;
+        e->flagged = false;
+    }
+}
+
+/**
+ * @brief Mark all reported states as unknown, e.g. after reconnecting; mismatch timeouts start again from now
+ */
+void ShadowState::forgetReported(qint64 now)
+{
+    for (std::vector<Entry>& entries : mEntries) {
+        for (Entry& e : entries) {
+            e.reported = -1;
+            e.changedAt = now;
+            e.flagged = false;
+        }
+    }
+}
+
+/**
+ * @brief Return the components whose reported state has differed from the requested one for longer than the timeout
+ *
+ * Each mismatch is only returned once, until the requested or reported state changes again.
+ */
+std::vector<std::pair<ShadowState::Component, uint>> ShadowState::newMismatches(qint64 now, qint64 timeout)
+{
+    std::vector<std::pair<Component, uint>> mismatches;
+
+    for (int c(0); c < NumComponents; ++c) {
+        for (size_t i(0); i < mEntries[c].size(); ++i) {
+            Entry& e = mEntries[c][i];
+            if (e.desired >= 0 && e.desired != e.reported && !e.flagged && now - e.changedAt >= timeout) {
+                e.flagged = true;
+                mismatches.push_back(std::make_pair(Component(c), uint(i + 1)));
+            }
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * @brief Return the entry of a component, or nullptr if there is no such component
+ */
+const ShadowState::Entry* ShadowState::entry(Component component, uint number) const
+{
+    if (number < 1 || number > mEntries[component].size())
+        return nullptr;
+    return &mEntries[component][number-1];
+}
+
+ShadowState::Entry* ShadowState::mutableEntry(Component component, uint number)
+{
+    if (number < 1 || number > mEntries[component].size())
+        return nullptr;
+    return &mEntries[component][number-1];
+}
+
+QString ShadowState::componentName(Component component)
+{
+    switch (component) {
+        case Valve:
+            return "valve";
+        case Pump:
+            return "pump";
+        case Pressure:
+            return "pressure controller";
+        default:
+            return QString();
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef SHADOWSTATE_H
+#define SHADOWSTATE_H
+
+#include <vector>
+
+#include <QtCore>
+
+#include "constants.h"
+
+/**
+ * @brief The ShadowState class keeps track of the state requested for each valve, pump and pressure controller,
+ * alongside the state last reported by the microcontroller.
+ *
+ * Values are those exchanged with the microcontroller: 0 or 1 for valves and pumps, raw setpoints
+ * (0-PR_MAX_VALUE) for pressure controllers. -1 means unknown (nothing was requested, or nothing was reported).
+ *
+ * It is used by Communicator to skip commands that wouldn't change anything, to detect components that don't
+ * reach the requested state, and to restore the requested state after reconnecting.
+ */
+class ShadowState
+{
+public:
+    enum Component {
+        Valve,
+        Pump,
+        Pressure,
+        NumComponents
+    };
+
+    struct Entry {
+        int desired;
+        int reported;
+        qint64 changedAt;   // When desired or reported last changed, in milliseconds
+        bool flagged;       // Whether the current mismatch was already reported
+    };
+
+    ShadowState();
+
+    bool isRedundant(Component component, uint number, int value) const;
+    void setDesired(Component component, uint number, int value, qint64 now);
+    void setReported(Component component, uint number, int value, qint64 now);
+    void forgetReported(qint64 now);
+
+    std::vector<std::pair<Component, uint>> newMismatches(qint64 now, qint64 timeout);
+
+    const Entry* entry(Component component, uint number) const;
+    uint count(Component component) const { return uint(mEntries[component].size()); }
+
+    static QString componentName(Component component);
+
+private:
+    Entry* mutableEntry(Component component, uint number);
+
+    /// Entries of each component, indexed by number - 1
+    std::vector<Entry> mEntries[NumComponents];
+};
+
+#endif // SHADOWSTATE_H
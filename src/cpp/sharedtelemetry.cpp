@@ -0,0 +1,256 @@
+#include "sharedtelemetry.h"
+#include "communicator.h"
+#include "logger.h"
+
+#include <cstddef>
+
+#if defined(Q_OS_UNIX) && !defined(Q_OS_ANDROID)
+#define UFCS_SHARED_MEMORY
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(ufcs_shm_record) == 16, "Shared-memory records must be 16 bytes");
+static_assert(sizeof(ufcs_shm_state) == 192, "The shared-memory state must be 192 bytes");
+static_assert(offsetof(ufcs_shm_segment, write_index) == 64, "write_index must start the second cache line");
+static_assert(N_VALVES <= UFCS_SHM_MAX_VALVES && N_PUMPS <= UFCS_SHM_MAX_PUMPS && N_PRS <= UFCS_SHM_MAX_CONTROLLERS,
+              "The shared-memory state has too few entries for this hardware");
+
+SharedTelemetry::SharedTelemetry(Communicator *communicator, QObject *parent)
+    : QObject(parent)
+    , mCommunicator(communicator)
+    , mSegment(nullptr)
+    , mDevice(0)
+    , mInode(0)
+    , mWriteIndex(0)
+{
+    mRecordsMetric = &MetricsRegistry::registry()->counter("ufcs_shared_records_total",
+                                                           "Records written to the shared-memory ring");
+
+    connect(mCommunicator, &Communicator::valveStateChanged, this, [this](uint number, bool open) {
+        record(UFCS_SHM_VALVE, number, open, telemetryClock());
+    });
+    connect(mCommunicator, &Communicator::pumpStateChanged, this, [this](uint number, bool on) {
+        record(UFCS_SHM_PUMP, number, on, telemetryClock());
+    });
+    connect(mCommunicator, &Communicator::pressureSetpointChanged, this, [this](uint number, double pressure) {
+        record(UFCS_SHM_SETPOINT, number, qRound(pressure * PR_MAX_VALUE), telemetryClock());
+    });
+    connect(mCommunicator, &Communicator::pressureChanged, this, [this](uint number, double pressure) {
+        record(UFCS_SHM_PRESSURE, number, qRound(pressure * PR_MAX_VALUE), telemetryClock());
+    });
+    connect(mCommunicator, &Communicator::connectionStatusChanged, this, [this](Communicator::ConnectionStatus status) {
+        record(UFCS_SHM_CONNECTION, 0, status, telemetryClock());
+    });
+}
+
+SharedTelemetry::~SharedTelemetry()
+{
+    close();
+}
+
+#ifdef UFCS_SHARED_MEMORY
+/**
+ * @brief Return true if the existing shared-memory object with the given name was left behind by a process that has
+ * exited, and can therefore be replaced
+ *
+ * Objects that aren't fully initialized, or whose owner is still running (possibly this process), are kept.
+ */
+static bool isAbandoned(const QByteArray &name)
+{
+    int fd = shm_open(name.constData(), O_RDONLY, 0);
+    if (fd < 0)
+        return errno == ENOENT;
+
+    struct stat info;
+    void* address = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size >= off_t(sizeof(ufcs_shm_segment)))
+        address = mmap(nullptr, sizeof(ufcs_shm_segment), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED)
+        return false;
+
+    const ufcs_shm_segment* s = static_cast<const ufcs_shm_segment*>(address);
+    pid_t pid = __atomic_load_n(&s->magic, __ATOMIC_ACQUIRE) == UFCS_SHM_MAGIC ? pid_t(s->pid) : 0;
+    munmap(address, sizeof(ufcs_shm_segment));
+
+    return pid > 0 && kill(pid, 0) != 0 && errno == ESRCH;
+}
+#endif
+
+/**
+ * @brief Create the shared-memory object with the given name, e.g. "/ufcs-telemetry", and initialize it
+ *
+ * An object of that name that is still published by another process (e.g. another instance of the application) is
+ * left alone, and false is returned; one left behind by a process that has exited is replaced. The communicator
+ * starts recording streamed samples into it.
+ */
+bool SharedTelemetry::open(const QString &name)
+{
+    close();
+
+#ifdef UFCS_SHARED_MEMORY
+    QByteArray n = name.toLocal8Bit();
+    if (!n.startsWith('/'))
+        n.prepend('/');
+
+    int fd = shm_open(n.constData(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && errno == EEXIST && isAbandoned(n)) {
+        // Readers of the old object notice the new pid
+        qCInfo(lcGui) << "Replacing the shared-memory object" << n << "of a process that has exited";
+        shm_unlink(n.constData());
+        fd = shm_open(n.constData(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+    if (fd < 0 && errno == EEXIST) {
+        qCWarning(lcGui) << "Could not create the shared-memory object" << n
+                         << ": it is in use by another process (setting: sharedMemory/name)";
+        return false;
+    }
+    if (fd < 0) {
+        qCWarning(lcGui) << "Could not create the shared-memory object" << n << ":" << strerror(errno);
+        return false;
+    }
+
+    void* address = MAP_FAILED;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && ftruncate(fd, sizeof(ufcs_shm_segment)) == 0)
+        address = mmap(nullptr, sizeof(ufcs_shm_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (address == MAP_FAILED) {
+        qCWarning(lcGui) << "Could not map the shared-memory object" << n << ":" << strerror(errno);
+        shm_unlink(n.constData());
+        return false;
+    }
+
+    ufcs_shm_segment* s = static_cast<ufcs_shm_segment*>(address);
+    __atomic_store_n(&s->magic, 0u, __ATOMIC_RELEASE);
+    memset(reinterpret_cast<char*>(s) + sizeof(s->magic), 0, sizeof(ufcs_shm_segment) - sizeof(s->magic));
+
+    s->version = UFCS_SHM_VERSION;
+    s->ring_size = UFCS_SHM_RING_SIZE;
+    s->pr_max_value = PR_MAX_VALUE;
+    s->n_valves = N_VALVES;
+    s->n_pumps = N_PUMPS;
+    s->n_controllers = N_PRS;
+    s->realtime_offset = QDateTime::currentMSecsSinceEpoch() * 1000 - telemetryClock();
+    s->pid = int32_t(getpid());
+
+    s->state.connection = mCommunicator->getConnectionStatus();
+    for (int16_t& v : s->state.valves) v = -1;
+    for (int16_t& v : s->state.pumps) v = -1;
+    for (int16_t& v : s->state.setpoints) v = -1;
+    for (int16_t& v : s->state.pressures) v = -1;
+    s->state.timestamp = telemetryClock();
+
+    __atomic_store_n(&s->magic, UFCS_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    mSegment = s;
+    mName = n;
+    mDevice = quint64(info.st_dev);
+    mInode = quint64(info.st_ino);
+    mWriteIndex = 0;
+    mCommunicator->setSharedTelemetry(this);
+
+    qCInfo(lcGui) << "Publishing telemetry in shared memory:" << n;
+    return true;
+#else
+    qCWarning(lcGui) << "Shared-memory telemetry is not supported on this platform; not publishing to" << name;
+    return false;
+#endif
+}
+
+/**
+ * @brief Stop publishing, and remove the shared-memory object (which open() created). Readers that have it mapped
+ * keep the last data.
+ */
+void SharedTelemetry::close()
+{
+#ifdef UFCS_SHARED_MEMORY
+    if (!mSegment)
+        return;
+
+    mCommunicator->setSharedTelemetry(nullptr);
+    munmap(mSegment, sizeof(ufcs_shm_segment));
+    mSegment = nullptr;
+
+    // Unless the name now refers to an object created by someone else since
+    int fd = shm_open(mName.constData(), O_RDONLY, 0);
+    if (fd >= 0) {
+        struct stat info;
+        if (fstat(fd, &info) == 0 && quint64(info.st_dev) == mDevice && quint64(info.st_ino) == mInode)
+            shm_unlink(mName.constData());
+        ::close(fd);
+    }
+#endif
+}
+
+/**
+ * @brief Append a record to the ring, and update the state accordingly
+ * @param value Raw, as in ufcs_shm.h
+ * @param timestamp telemetryClock() of the event
+ */
+void SharedTelemetry::record(ufcs_shm_kind kind, uint number, int value, qint64 timestamp)
+{
+#ifdef UFCS_SHARED_MEMORY
+    if (!mSegment)
+        return;
+
+    // The state first, so that it is never older than the ring
+    ufcs_shm_state& state = mSegment->state;
+    uint32_t sequence = state.sequence;
+    __atomic_store_n(&state.sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    switch (kind) {
+        case UFCS_SHM_VALVE:
+            if (number >= 1 && number <= UFCS_SHM_MAX_VALVES)
+                state.valves[number - 1] = int16_t(value);
+            break;
+        case UFCS_SHM_PUMP:
+            if (number >= 1 && number <= UFCS_SHM_MAX_PUMPS)
+                state.pumps[number - 1] = int16_t(value);
+            break;
+        case UFCS_SHM_SETPOINT:
+            if (number >= 1 && number <= UFCS_SHM_MAX_CONTROLLERS)
+                state.setpoints[number - 1] = int16_t(value);
+            break;
+        case UFCS_SHM_PRESSURE:
+        case UFCS_SHM_TELEMETRY:
+            if (number >= 1 && number <= UFCS_SHM_MAX_CONTROLLERS)
+                state.pressures[number - 1] = int16_t(value);
+            break;
+        case UFCS_SHM_CONNECTION:
+            state.connection = value;
+            break;
+    }
+    state.timestamp = timestamp;
+    __atomic_store_n(&state.sequence, sequence + 2, __ATOMIC_RELEASE);
+
+    // Then the record, in its slot; the write index is advanced once the record is complete
+    ufcs_shm_record& r = mSegment->ring[mWriteIndex & (UFCS_SHM_RING_SIZE - 1)];
+    __atomic_store_n(&r.sequence, uint32_t(2 * mWriteIndex + 1), __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    r.kind = uint8_t(kind);
+    r.number = uint8_t(number);
+    r.value = int16_t(value);
+    r.timestamp = timestamp;
+
+    mWriteIndex++;
+    __atomic_store_n(&r.sequence, uint32_t(2 * mWriteIndex), __ATOMIC_RELEASE);
+    __atomic_store_n(&mSegment->write_index, mWriteIndex, __ATOMIC_RELEASE);
+
+    mRecordsMetric->increment();
+#else
+    Q_UNUSED(kind)
+    Q_UNUSED(number)
+    Q_UNUSED(value)
+    Q_UNUSED(timestamp)
+#endif
+}
@@ -0,0 +1,51 @@
+#ifndef SHAREDTELEMETRY_H
+#define SHAREDTELEMETRY_H
+
+#include <QtCore>
+
+#include "ufcs_shm.h"
+#include "metrics.h"
+
+class Communicator;
+
+/**
+ * @brief The SharedTelemetry class publishes the state of the hardware, and a ring of its changes, in a POSIX
+ * shared-memory segment that other local programs map read-only (layout and reader functions: ufcs_shm.h).
+ *
+ * Valve, pump, setpoint and pressure reports and connection changes are taken from the communicator's signals;
+ * streamed pressure samples are recorded by the communicator itself as they are decoded (see
+ * Communicator::setSharedTelemetry), so that they are published without waiting for the TelemetryPublisher.
+ *
+ * Writing never waits for readers: each update costs a few stores, on the communicator's thread, which must be the
+ * thread of this object. Only available on Unix (other than Android); elsewhere, open() fails.
+ */
+class SharedTelemetry : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SharedTelemetry(Communicator* communicator, QObject* parent = nullptr);
+    ~SharedTelemetry();
+
+    bool open(const QString& name);
+    void close();
+    bool isOpen() const { return mSegment != nullptr; }
+
+    void record(ufcs_shm_kind kind, uint number, int value, qint64 timestamp);
+
+private:
+    Communicator* mCommunicator;
+    ufcs_shm_segment* mSegment;
+    QByteArray mName;
+
+    /// Identify the object created by open(), so that close() only removes that one
+    quint64 mDevice;
+    quint64 mInode;
+
+    /// Records written, for write_index and the sequence of each record
+    quint64 mWriteIndex;
+
+    MetricsRegistry::Metric* mRecordsMetric;
+};
+
+#endif // SHAREDTELEMETRY_H
@@ -0,0 +1,171 @@
+#include "streamcommunicator.h"
+#include "applicationcontroller.h"
+#include "logger.h"
+
+StreamCommunicator::StreamCommunicator(ApplicationController *applicationController)
+    : Communicator(applicationController)
+    , mDevice(nullptr)
+{
+}
+
+StreamCommunicator::~StreamCommunicator()
+{
+}
+
+/**
+ * @brief Read from and write to the given device, which is opened and closed by the subclass
+ */
+void StreamCommunicator::setDevice(QIODevice *device)
+{
+    mDevice = device;
+    QObject::connect(mDevice, &QIODevice::readyRead, this, &StreamCommunicator::onReadyRead);
+    QObject::connect(mDevice, &QIODevice::bytesWritten, this, [this] { drainQueue(); });
+}
+
+void StreamCommunicator::onReadyRead()
+{
+    mBuffer.append(mDevice->readAll());
+
+    while (mBuffer.size() > 0) {
+        QByteArray b = decodeBuffer();
+        if (b.length() > 0)
+            parseDecodedBuffer(b);
+    }
+}
+
+void StreamCommunicator::sendMessage(QByteArray message)
+{
+    if (mConnectionStatus == Disconnected)
+        qCWarning(lcCommunicator) << "Can't send message: microcontroller is not connected";
+    else if (mDevice && mDevice->isOpen()) {
+        TRACE_SPAN("communicator", "stream write", message.size());
+        mDevice->write(message);
+    }
+}
+
+qint64 StreamCommunicator::bytesToWrite() const
+{
+    return mDevice ? mDevice->bytesToWrite() : 0;
+}
+
+TcpCommunicator::TcpCommunicator(ApplicationController *applicationController)
+    : StreamCommunicator(applicationController)
+    , mSocket(new QTcpSocket(this))
+{
+    setDevice(mSocket);
+
+    QObject::connect(mSocket, &QTcpSocket::connected, this, &TcpCommunicator::onConnected);
+    QObject::connect(mSocket, &QTcpSocket::disconnected, this, &TcpCommunicator::onDisconnected);
+    QObject::connect(mSocket, SIGNAL(error(QAbstractSocket::SocketError)),
+                     this, SLOT(onError(QAbstractSocket::SocketError)));
+}
+
+TcpCommunicator::~TcpCommunicator()
+{
+    mSocket->disconnect(this);
+    mSocket->abort();
+}
+
+/**
+ * @brief Connect to the address in the "transport/address" setting (see ApplicationController::transportAddress)
+ */
+void TcpCommunicator::connect()
+{
+    // Parsed as a URL so that IPv6 addresses can be given in brackets
+    QUrl url("tcp://" + appController->transportAddress());
+    if (!url.isValid() || url.host().isEmpty()) {
+        qCWarning(lcCommunicator) << "Invalid TCP address:" << appController->transportAddress();
+        setConnectionStatus(Disconnected);
+        return;
+    }
+
+    mSocket->abort();
+    setConnectionStatus(Connecting);
+
+    qCInfo(lcCommunicator) << "Connecting to" << url.host() << "on TCP port" << url.port(DefaultPort) << "...";
+    mSocket->connectToHost(url.host(), quint16(url.port(DefaultPort)));
+}
+
+void TcpCommunicator::onConnected()
+{
+    // Commands are already batched (see StreamCommunicator); delaying them further only adds latency
+    mSocket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    mSocket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+
+    qCInfo(lcCommunicator) << "Connected to" << mSocket->peerName() << "on TCP port" << mSocket->peerPort();
+    setConnectionStatus(Connected);
+}
+
+void TcpCommunicator::onDisconnected()
+{
+    qCDebug(lcCommunicator) << "TCP connection closed";
+    setConnectionStatus(Disconnected);
+}
+
+void TcpCommunicator::onError(QAbstractSocket::SocketError error)
+{
+    Q_UNUSED(error);
+    qCWarning(lcCommunicator) << "TCP socket error:" << mSocket->errorString();
+
+    // Errors while connected are followed by disconnected(); those while connecting are not
+    if (mSocket->state() != QAbstractSocket::ConnectedState)
+        setConnectionStatus(Disconnected);
+}
+
+LocalSocketCommunicator::LocalSocketCommunicator(ApplicationController *applicationController)
+    : StreamCommunicator(applicationController)
+    , mSocket(new QLocalSocket(this))
+{
+    setDevice(mSocket);
+
+    QObject::connect(mSocket, &QLocalSocket::connected, this, &LocalSocketCommunicator::onConnected);
+    QObject::connect(mSocket, &QLocalSocket::disconnected, this, &LocalSocketCommunicator::onDisconnected);
+    QObject::connect(mSocket, SIGNAL(error(QLocalSocket::LocalSocketError)),
+                     this, SLOT(onError(QLocalSocket::LocalSocketError)));
+}
+
+LocalSocketCommunicator::~LocalSocketCommunicator()
+{
+    mSocket->disconnect(this);
+    mSocket->abort();
+}
+
+/**
+ * @brief Connect to the local socket named in the "transport/address" setting
+ */
+void LocalSocketCommunicator::connect()
+{
+    QString name = appController->transportAddress();
+    if (name.isEmpty()) {
+        qCWarning(lcCommunicator) << "No local socket configured (setting: transport/address)";
+        setConnectionStatus(Disconnected);
+        return;
+    }
+
+    mSocket->abort();
+    setConnectionStatus(Connecting);
+
+    qCInfo(lcCommunicator) << "Connecting to local socket" << name << "...";
+    mSocket->connectToServer(name);
+}
+
+void LocalSocketCommunicator::onConnected()
+{
+    qCInfo(lcCommunicator) << "Connected to" << mSocket->fullServerName();
+    setConnectionStatus(Connected);
+}
+
+void LocalSocketCommunicator::onDisconnected()
+{
+    qCDebug(lcCommunicator) << "Local socket closed";
+    setConnectionStatus(Disconnected);
+}
+
+void LocalSocketCommunicator::onError(QLocalSocket::LocalSocketError error)
+{
+    Q_UNUSED(error);
+    qCWarning(lcCommunicator) << "Local socket error:" << mSocket->errorString();
+
+    if (mSocket->state() != QLocalSocket::ConnectedState)
+        setConnectionStatus(Disconnected);
+}
@@ -0,0 +1,100 @@
+#ifndef STREAMCOMMUNICATOR_H
+#define STREAMCOMMUNICATOR_H
+
+#include <QtCore>
+#include <QTcpSocket>
+#include <QLocalSocket>
+
+#include "communicator.h"
+
+/**
+ * @brief Base class of the communicators that exchange the usual framed messages over a byte stream (a QIODevice)
+ * other than a serial port, such as a socket to a serial-to-Ethernet bridge.
+ *
+ * Subclasses create the device, give it to setDevice(), open it in connect() and keep the connection status up to
+ * date; this class decodes what is read and writes the commands.
+ *
+ * Unlike a serial port, a socket accepts data much faster than the microcontroller's UART drains it, and sends one
+ * packet per write to the kernel. Commands written during one pass of the event loop are written to the kernel
+ * together, when the socket is next writable, so up to MaxBatchBytes are let into the socket's buffer at once
+ * (instead of Communicator::MaxPendingBytes); the queues take over again beyond that.
+ */
+class StreamCommunicator : public Communicator
+{
+    Q_OBJECT
+
+public:
+    /// Bytes of commands that may wait in the socket's buffer, to be written to the kernel together
+    static const int MaxBatchBytes = 512;
+
+    StreamCommunicator(ApplicationController* applicationController);
+    virtual ~StreamCommunicator();
+
+protected:
+    void setDevice(QIODevice* device);
+    QIODevice* device() const { return mDevice; }
+
+    void sendMessage(QByteArray message);
+    qint64 bytesToWrite() const;
+    qint64 maxPendingBytes() const { return MaxBatchBytes; }
+
+private slots:
+    void onReadyRead();
+
+private:
+    QIODevice* mDevice;
+};
+
+/**
+ * @brief Communicates with the microcontroller over TCP, e.g. through a serial-to-Ethernet bridge in raw TCP mode
+ *
+ * The address is "host:port" (e.g. "192.168.1.50:4001", "[fe80::1]:4001"), from the "transport/address" setting.
+ * Nagle's algorithm is disabled, so that each batch of commands is sent as soon as it is written.
+ */
+class TcpCommunicator : public StreamCommunicator
+{
+    Q_OBJECT
+
+public:
+    static const int DefaultPort = 4001;
+
+    TcpCommunicator(ApplicationController* applicationController);
+    ~TcpCommunicator();
+
+    void connect();
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onError(QAbstractSocket::SocketError error);
+
+private:
+    QTcpSocket* mSocket;
+};
+
+/**
+ * @brief Communicates with the microcontroller over a local socket (a Unix domain socket, or a named pipe on Windows)
+ *
+ * The socket's name or path is the "transport/address" setting. Mostly useful to talk to a simulated device, or to a
+ * program relaying the messages of a device attached elsewhere.
+ */
+class LocalSocketCommunicator : public StreamCommunicator
+{
+    Q_OBJECT
+
+public:
+    LocalSocketCommunicator(ApplicationController* applicationController);
+    ~LocalSocketCommunicator();
+
+    void connect();
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onError(QLocalSocket::LocalSocketError error);
+
+private:
+    QLocalSocket* mSocket;
+};
+
+#endif // STREAMCOMMUNICATOR_H
@@ -0,0 +1,60 @@
+#include "telemetry.h"
+#include "communicator.h"
+
+#include <chrono>
+
+qint64 telemetryClock()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TelemetryPublisher::TelemetryPublisher(Communicator *communicator, QObject *parent)
+    : QObject(parent)
+    , mCommunicator(communicator)
+    , mPublishRate(0)
+{
+    qRegisterMetaType<TelemetrySample>();
+    qRegisterMetaType<QVector<TelemetrySample>>();
+
+    mSamplesMetric = &MetricsRegistry::registry()->counter("ufcs_telemetry_samples_total", "Telemetry samples published");
+    mUpdatesMetric = &MetricsRegistry::registry()->counter("ufcs_gui_pressure_updates_total", "Pressure updates sent to the GUI for telemetry samples");
+
+    connect(&mTimer, &QTimer::timeout, this, &TelemetryPublisher::publish);
+    setPublishRate(20);
+}
+
+/**
+ * @brief Set the number of updates per second sent to the GUI. 0 stops publishing.
+ */
+void TelemetryPublisher::setPublishRate(int hz)
+{
+    mPublishRate = qMax(0, hz);
+    if (mPublishRate == 0)
+        mTimer.stop();
+    else
+        mTimer.start(1000 / mPublishRate);
+}
+
+void TelemetryPublisher::publish()
+{
+    for (uint n(1); n <= N_PRS; ++n) {
+        SpscRing<TelemetrySample>* ring = mCommunicator->telemetryRing(n);
+
+        mScratch.resize(ring->capacity());
+        size_t count = ring->pop(mScratch.data(), mScratch.size());
+        if (count == 0)
+            continue;
+
+        QVector<TelemetrySample> samples;
+        samples.reserve(int(count));
+        for (size_t i(0); i < count; ++i)
+            samples.push_back(mScratch[i]);
+
+        mSamplesMetric->increment(qint64(count));
+        mUpdatesMetric->increment();
+
+        emit samplesReceived(n, samples);
+        emit pressureChanged(n, double(samples.last().value));
+    }
+}
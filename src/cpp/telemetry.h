@@ -0,0 +1,137 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <QtCore>
+
+#include "metrics.h"
+
+class Communicator;
+
+/**
+ * Telemetry
+ * ---------
+ *
+ * In telemetry mode, the microcontroller pushes the measured pressure of a controller at a rate requested by
+ * the host (see Communicator::setTelemetryRate), rather than only when its state changes or when asked to.
+ *
+ * Incoming samples are pushed into one SpscRing per controller by the communicator; a TelemetryPublisher
+ * drains these rings at a much lower, fixed rate, and passes on the latest value of each controller to the
+ * GUI along with the full batch of samples for whoever needs the fine-grained data.
+ */
+
+struct TelemetrySample {
+    qint64 timestamp;   // Microseconds, on the monotonic clock returned by telemetryClock()
+    float value;        // Measured pressure, 0-1
+};
+Q_DECLARE_METATYPE(TelemetrySample)
+
+/// Current time in microseconds on a monotonic clock; used to timestamp telemetry samples
+qint64 telemetryClock();
+
+
+/**
+ * @brief Fixed-capacity, lock-free ring buffer for one producer thread and one consumer thread.
+ *
+ * When the ring is full, new items are dropped (and counted) rather than overwriting items the consumer
+ * may be reading.
+ */
+template <typename T>
+class SpscRing
+{
+public:
+    /// The capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity)
+        : mHead(0)
+        , mTail(0)
+        , mDropped(0)
+    {
+        size_t c = 1;
+        while (c < capacity)
+            c <<= 1;
+        mBuffer.reset(new T[c]);
+        mMask = c - 1;
+    }
+
+    /// Append an item. Must only be called from the producer thread.
+    bool push(const T& item)
+    {
+        size_t head = mHead.load(std::memory_order_relaxed);
+        if (head - mTail.load(std::memory_order_acquire) > mMask) {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        mBuffer[head & mMask] = item;
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Remove up to maxCount items, oldest first. Must only be called from the consumer thread.
+    size_t pop(T* out, size_t maxCount)
+    {
+        size_t tail = mTail.load(std::memory_order_relaxed);
+        size_t n = qMin(mHead.load(std::memory_order_acquire) - tail, maxCount);
+        for (size_t i(0); i < n; ++i)
+            out[i] = mBuffer[(tail + i) & mMask];
+        mTail.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    size_t size() const { return mHead.load(std::memory_order_acquire) - mTail.load(std::memory_order_acquire); }
+    size_t capacity() const { return mMask + 1; }
+    quint64 dropped() const { return mDropped.load(std::memory_order_relaxed); }
+
+private:
+    std::unique_ptr<T[]> mBuffer;
+    size_t mMask;
+
+    // The indices are only ever incremented; they are kept on separate cache lines since each is written
+    // by a different thread
+    std::atomic<size_t> mHead;
+    char mHeadPadding[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> mTail;
+    char mTailPadding[64 - sizeof(std::atomic<size_t>)];
+
+    std::atomic<quint64> mDropped;
+};
+
+
+/**
+ * @brief The TelemetryPublisher class periodically drains the telemetry rings of a communicator.
+ *
+ * At each tick, the samples received since the previous tick are emitted in one batch per controller
+ * (samplesReceived), and the most recent value of each controller is emitted with pressureChanged; the
+ * GUI is therefore updated at the publishing rate, whatever the rate of the telemetry stream.
+ */
+class TelemetryPublisher : public QObject
+{
+    Q_OBJECT
+
+public:
+    TelemetryPublisher(Communicator* communicator, QObject* parent = nullptr);
+
+    int publishRate() const { return mPublishRate; }
+    void setPublishRate(int hz);
+
+signals:
+    void pressureChanged(uint controllerNumber, double pressure);
+    void samplesReceived(uint controllerNumber, QVector<TelemetrySample> samples);
+
+public slots:
+    void publish();
+
+private:
+    Communicator* mCommunicator;
+    QTimer mTimer;
+    int mPublishRate;
+    std::vector<TelemetrySample> mScratch;
+
+    /// Samples drained from the rings, and updates sent to the GUI for them: their ratio is the coalescing factor
+    MetricsRegistry::Metric* mSamplesMetric;
+    MetricsRegistry::Metric* mUpdatesMetric;
+};
+
+#endif // TELEMETRY_H
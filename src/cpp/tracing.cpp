@@ -0,0 +1,280 @@
+#include "tracing.h"
+#include "logger.h"
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+std::atomic<bool> Tracer::sEnabled(false);
+
+struct Tracer::Registry {
+    std::mutex mutex;
+
+    /// Never shrinks, so that threads may keep pointers to their ring without locking
+    std::deque<std::unique_ptr<Ring>> rings;
+};
+
+// Intentionally leaked, so that threads ending during static destruction can still release their ring
+Tracer::Registry* Tracer::registry()
+{
+    static Registry* instance = new Registry;
+    return instance;
+}
+
+namespace {
+
+void appendEventStart(QByteArray& json, bool& first, const char* phase, const char* category, const char* name,
+                      int thread, qint64 timestamp)
+{
+    if (!first)
+        json += ",\n";
+    first = false;
+
+    json += "{\"ph\":\"";
+    json += phase;
+    json += "\",\"cat\":\"";
+    json += category;
+    json += "\",\"name\":\"";
+    json += name;
+    json += "\",\"pid\":1,\"tid\":" + QByteArray::number(thread) + ",\"ts\":" + QByteArray::number(timestamp);
+}
+
+} // namespace
+
+/**
+ * @brief Releases the calling thread's ring when the thread ends, so that a later thread may take it over
+ */
+struct TracerThreadState {
+    TracerThreadState() : ring(nullptr) {}
+
+    ~TracerThreadState()
+    {
+        if (ring)
+            ring->inUse.store(false, std::memory_order_release);
+    }
+
+    Tracer::Ring* ring;
+};
+
+/**
+ * @brief Clear all events, and start recording
+ */
+void Tracer::start()
+{
+    {
+        std::lock_guard<std::mutex> lock(registry()->mutex);
+        for (std::unique_ptr<Ring> const& ring : registry()->rings)
+            ring->head.store(0, std::memory_order_relaxed);
+    }
+
+    sEnabled.store(true, std::memory_order_release);
+    qCInfo(lcGui) << "Tracing started";
+}
+
+void Tracer::stop()
+{
+    sEnabled.store(false, std::memory_order_release);
+    qCInfo(lcGui) << "Tracing stopped";
+}
+
+/**
+ * @brief Name the calling thread in exported traces
+ */
+void Tracer::setThreadName(const char *name)
+{
+    threadRing()->threadName.store(name, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Return the time, in microseconds, on the clock used for trace events
+ */
+qint64 Tracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Record an event marking a single point in time on the calling thread
+ */
+void Tracer::instant(const char *category, const char *name, qint64 arg)
+{
+    if (isEnabled())
+        record('i', category, name, now(), 0, arg, 0);
+}
+
+/**
+ * @brief Start an arrow, from the current point of the calling thread to the matching flowEnd()
+ *
+ * The arrow binds to the spans enclosing the two points. The id identifies the flow among those with the same
+ * category and name.
+ */
+void Tracer::flowBegin(const char *category, const char *name, quint64 id)
+{
+    if (isEnabled())
+        record('s', category, name, now(), 0, 0, id);
+}
+
+void Tracer::flowEnd(const char *category, const char *name, quint64 id)
+{
+    if (isEnabled())
+        record('f', category, name, now(), 0, 0, id);
+}
+
+/**
+ * @brief Start a span that may end on another thread, e.g. while a command waits for an answer
+ *
+ * Asynchronous spans are shown on their own track, and identified by category, name and id.
+ */
+void Tracer::asyncBegin(const char *category, const char *name, quint64 id, qint64 arg)
+{
+    if (isEnabled())
+        record('b', category, name, now(), 0, arg, id);
+}
+
+void Tracer::asyncEnd(const char *category, const char *name, quint64 id)
+{
+    if (isEnabled())
+        record('e', category, name, now(), 0, 0, id);
+}
+
+/**
+ * @brief Record a span of the calling thread, from start (as given by now()) to now
+ */
+void Tracer::complete(const char *category, const char *name, qint64 start, qint64 arg)
+{
+    if (isEnabled())
+        record('X', category, name, start, now() - start, arg, 0);
+}
+
+void Tracer::record(char phase, const char *category, const char *name, qint64 timestamp, qint64 duration,
+                    qint64 arg, quint64 id)
+{
+    Ring* ring = threadRing();
+
+    quint64 head = ring->head.load(std::memory_order_relaxed);
+    Event& e = ring->events[head % RingCapacity];
+    e.category = category;
+    e.name = name;
+    e.timestamp = timestamp;
+    e.duration = duration;
+    e.arg = arg;
+    e.id = id;
+    e.phase = phase;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Return the ring of the calling thread, taking over a released ring or allocating one on first use
+ */
+Tracer::Ring* Tracer::threadRing()
+{
+    static thread_local TracerThreadState state;
+
+    if (state.ring)
+        return state.ring;
+
+    Registry* r = registry();
+    std::lock_guard<std::mutex> lock(r->mutex);
+
+    for (std::unique_ptr<Ring> const& ring : r->rings) {
+        bool expected = false;
+        if (ring->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            ring->threadName.store(nullptr, std::memory_order_relaxed);
+            state.ring = ring.get();
+            return state.ring;
+        }
+    }
+
+    r->rings.emplace_back(new Ring);
+    state.ring = r->rings.back().get();
+    return state.ring;
+}
+
+/**
+ * @brief Format the recorded events as a Chrome trace event JSON document
+ *
+ * Each ring is a thread (tid) of a single process; its events are listed from oldest to newest.
+ */
+QByteArray Tracer::chromeTrace()
+{
+    QByteArray json = "{\"traceEvents\":[\n";
+    bool first = true;
+
+    std::lock_guard<std::mutex> lock(registry()->mutex);
+    std::deque<std::unique_ptr<Ring>> const& rings = registry()->rings;
+
+    for (size_t r(0); r < rings.size(); ++r) {
+        Ring const& ring = *rings[r];
+        int thread = int(r) + 1;
+
+        quint64 head = ring.head.load(std::memory_order_acquire);
+        quint64 oldest = head > RingCapacity ? head - RingCapacity : 0;
+        if (head == 0)
+            continue;
+
+        const char* threadName = ring.threadName.load(std::memory_order_relaxed);
+        appendEventStart(json, first, "M", "__metadata", "thread_name", thread, 0);
+        json += ",\"args\":{\"name\":\"";
+        json += threadName ? QByteArray(threadName) : "Thread " + QByteArray::number(thread);
+        json += "\"}}";
+
+        for (quint64 i(oldest); i < head; ++i) {
+            Event const& e = ring.events[i % RingCapacity];
+            char phase[2] = { e.phase, '\0' };
+            appendEventStart(json, first, phase, e.category, e.name, thread, e.timestamp);
+
+            switch (e.phase) {
+                case 'X':
+                    json += ",\"dur\":" + QByteArray::number(e.duration);
+                    break;
+                case 'i':
+                    json += ",\"s\":\"t\"";
+                    break;
+                case 'f':
+                    json += ",\"bp\":\"e\"";
+                    // fall through
+                case 's':
+                case 'b':
+                case 'e':
+                    json += ",\"id\":\"0x" + QByteArray::number(e.id, 16) + "\"";
+                    break;
+            }
+
+            if (e.arg != 0)
+                json += ",\"args\":{\"value\":" + QByteArray::number(e.arg) + "}";
+            json += "}";
+        }
+    }
+
+    json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return json;
+}
+
+/**
+ * @brief Write the recorded events to a file, as Chrome trace event JSON
+ */
+bool Tracer::exportChromeTrace(const QString &path)
+{
+    if (isEnabled())
+        qCWarning(lcGui) << "Exporting a trace while tracing is on; the last events may be inconsistent";
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(lcGui) << "Could not write trace to" << path;
+        return false;
+    }
+
+    file.write(chromeTrace());
+    qCInfo(lcGui) << "Saved trace to" << path;
+    return true;
+}
+
+/**
+ * @brief Return the directory in which traces are saved
+ */
+QString Tracer::traceDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/traces";
+}
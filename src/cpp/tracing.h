@@ -0,0 +1,115 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <atomic>
+#include <vector>
+
+#include <QtCore>
+
+/**
+ * @brief The Tracer class records timed spans and events into per-thread ring buffers, and exports them in the
+ * Chrome trace event format (which opens in Perfetto, or chrome://tracing).
+ *
+ * Use TraceSpan (or the TRACE_SPAN macro) to time a scope, and the static functions below for instant events,
+ * flows (arrows between threads, e.g. from a routine step to the command it triggers) and asynchronous spans
+ * (e.g. a command waiting in a queue, then for the device's answer).
+ *
+ * While tracing is off, each of these costs one relaxed atomic load. While it is on, recording an event is a
+ * clock read and a few stores into the calling thread's ring; no lock is taken after the first event of a thread.
+ * Each ring keeps the most recent RingCapacity events. The ring of a finished thread (e.g. that of a previous
+ * routine run) is taken over by the next new thread, so that its events are kept until they are overwritten, and
+ * both threads appear on the same track of the trace.
+ *
+ * Names and categories must be string literals (or otherwise outlive the tracer); they are stored as pointers.
+ * start() clears the rings; export after stop(), so that the rings aren't written to while they are read.
+ */
+class Tracer
+{
+public:
+    static const size_t RingCapacity = 16384;
+
+    static bool isEnabled() { return sEnabled.load(std::memory_order_relaxed); }
+    static void start();
+    static void stop();
+
+    static void setThreadName(const char* name);
+
+    static void instant(const char* category, const char* name, qint64 arg = 0);
+    static void flowBegin(const char* category, const char* name, quint64 id);
+    static void flowEnd(const char* category, const char* name, quint64 id);
+    static void asyncBegin(const char* category, const char* name, quint64 id, qint64 arg = 0);
+    static void asyncEnd(const char* category, const char* name, quint64 id);
+
+    static qint64 now();
+    static void complete(const char* category, const char* name, qint64 start, qint64 arg);
+
+    static QByteArray chromeTrace();
+    static bool exportChromeTrace(const QString& path);
+    static QString traceDirectory();
+
+private:
+    struct Event {
+        const char* category;
+        const char* name;
+        qint64 timestamp;   // Microseconds, steady clock
+        qint64 duration;    // Microseconds, for complete events
+        qint64 arg;
+        quint64 id;         // For flow and asynchronous events
+        char phase;         // Chrome trace phase: X, i, s, f, b, e
+    };
+
+    struct Ring {
+        Ring() : events(RingCapacity), head(0), threadName(nullptr), inUse(true) {}
+
+        std::vector<Event> events;
+        std::atomic<quint64> head;              // Number of events ever written; only the owning thread writes
+        std::atomic<const char*> threadName;
+        std::atomic<bool> inUse;
+    };
+
+    struct Registry;
+    static Registry* registry();
+
+    static void record(char phase, const char* category, const char* name, qint64 timestamp, qint64 duration,
+                       qint64 arg, quint64 id);
+    static Ring* threadRing();
+
+    static std::atomic<bool> sEnabled;
+
+    friend struct TracerThreadState;
+};
+
+
+/**
+ * @brief Records the time spent in a scope as a complete event, if tracing is on when the scope is entered
+ */
+class TraceSpan
+{
+public:
+    TraceSpan(const char* category, const char* name, qint64 arg = 0)
+        : mCategory(category)
+        , mName(name)
+        , mArg(arg)
+        , mStart(Tracer::isEnabled() ? Tracer::now() : -1)
+    {}
+
+    ~TraceSpan()
+    {
+        if (mStart >= 0)
+            Tracer::complete(mCategory, mName, mStart, mArg);
+    }
+
+private:
+    const char* mCategory;
+    const char* mName;
+    qint64 mArg;
+    qint64 mStart;
+};
+
+#define TRACE_CONCAT_(a, b) a ## b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+/// Time the rest of the enclosing scope, e.g. TRACE_SPAN("communicator", "decodeBuffer")
+#define TRACE_SPAN(...) TraceSpan TRACE_CONCAT(traceSpan_, __LINE__)(__VA_ARGS__)
+
+#endif // TRACING_H
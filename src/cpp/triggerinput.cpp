@@ -0,0 +1,185 @@
+#include "triggerinput.h"
+#include "routinecontroller.h"
+#include "logger.h"
+
+#if defined(Q_OS_UNIX)
+#define UFCS_TRIGGER_FIFO
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+TriggerInput::TriggerInput(RoutineController *routineController, QObject *parent)
+    : QObject(parent)
+    , mRoutineController(routineController)
+    , mFifo(-1)
+    , mFifoWriter(-1)
+    , mFifoDevice(0)
+    , mFifoInode(0)
+    , mFifoNotifier(nullptr)
+{
+    connect(&mServer, &QLocalServer::newConnection, this, &TriggerInput::onNewConnection);
+}
+
+TriggerInput::~TriggerInput()
+{
+#ifdef UFCS_TRIGGER_FIFO
+    if (mFifo >= 0) {
+        delete mFifoNotifier;
+        ::close(mFifo);
+        ::close(mFifoWriter);
+
+        // Unless the path now refers to a FIFO created by someone else since
+        QByteArray p = QFile::encodeName(mFifoPath);
+        struct stat info;
+        if (stat(p.constData(), &info) == 0 && quint64(info.st_dev) == mFifoDevice && quint64(info.st_ino) == mFifoInode)
+            unlink(p.constData());
+    }
+#endif
+}
+
+/**
+ * @brief Accept triggers on the local socket with the given name (or full path), for the current user only
+ */
+bool TriggerInput::listen(const QString &name)
+{
+    mServer.setSocketOptions(QLocalServer::UserAccessOption);
+
+    // A socket file left behind by a process that didn't exit cleanly is removed; one in use is not
+    if (!mServer.listen(name) && mServer.serverError() == QAbstractSocket::AddressInUseError) {
+        QLocalSocket probe;
+        probe.connectToServer(name);
+        if (!probe.waitForConnected(100)) {
+            QLocalServer::removeServer(name);
+            mServer.listen(name);
+        }
+    }
+
+    if (!mServer.isListening()) {
+        qCWarning(lcRoutine) << "Could not open the trigger socket" << name << ":" << mServer.errorString();
+        return false;
+    }
+
+    qCInfo(lcRoutine) << "Accepting routine triggers on" << mServer.fullServerName();
+    return true;
+}
+
+/**
+ * @brief Accept triggers written to a FIFO at the given path, creating it (Unix only)
+ *
+ * A FIFO left behind by a process that didn't exit cleanly is replaced; one that another process reads from is
+ * not shared with it, since each trigger would only reach one of them.
+ *
+ * The FIFO is kept open for writing too, so that it doesn't reach end-of-file each time a writer closes it.
+ */
+bool TriggerInput::openFifo(const QString &path)
+{
+#ifdef UFCS_TRIGGER_FIFO
+    QByteArray p = QFile::encodeName(path);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    struct stat info;
+    if (stat(p.constData(), &info) == 0) {
+        if (!S_ISFIFO(info.st_mode)) {
+            qCWarning(lcRoutine) << "Could not create the trigger FIFO" << path << ": a file with that name exists";
+            return false;
+        }
+
+        // Opening a FIFO for writing without blocking only fails (with ENXIO) if nobody reads from it
+        int probe = ::open(p.constData(), O_WRONLY | O_NONBLOCK);
+        if (probe >= 0) {
+            ::close(probe);
+            qCWarning(lcRoutine) << "Not opening the trigger FIFO" << path
+                                 << ": it is in use by another process (setting: triggers/fifo)";
+            return false;
+        }
+        unlink(p.constData());
+    }
+
+    if (mkfifo(p.constData(), 0600) != 0) {
+        qCWarning(lcRoutine) << "Could not create the trigger FIFO" << path << ":" << strerror(errno);
+        return false;
+    }
+
+    mFifo = ::open(p.constData(), O_RDONLY | O_NONBLOCK);
+    mFifoWriter = mFifo >= 0 ? ::open(p.constData(), O_WRONLY | O_NONBLOCK) : -1;
+    if (mFifoWriter < 0 || fstat(mFifo, &info) != 0) {
+        qCWarning(lcRoutine) << "Could not open the trigger FIFO" << path << ":" << strerror(errno);
+        if (mFifoWriter >= 0)
+            ::close(mFifoWriter);
+        if (mFifo >= 0)
+            ::close(mFifo);
+        mFifo = -1;
+        mFifoWriter = -1;
+        unlink(p.constData());
+        return false;
+    }
+
+    mFifoPath = path;
+    mFifoDevice = quint64(info.st_dev);
+    mFifoInode = quint64(info.st_ino);
+    mFifoNotifier = new QSocketNotifier(mFifo, QSocketNotifier::Read, this);
+    connect(mFifoNotifier, &QSocketNotifier::activated, this, &TriggerInput::onFifoReadable);
+
+    qCInfo(lcRoutine) << "Accepting routine triggers on" << path;
+    return true;
+#else
+    qCWarning(lcRoutine) << "Trigger FIFOs are not supported on this platform; use the trigger socket instead of" << path;
+    return false;
+#endif
+}
+
+void TriggerInput::onNewConnection()
+{
+    while (QLocalSocket* socket = mServer.nextPendingConnection()) {
+        mBuffers.insert(socket, QByteArray());
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket] {
+            auto buffer = mBuffers.find(socket);
+            if (buffer == mBuffers.end())
+                return;
+            readLines(*buffer, socket->readAll());
+            if (buffer->size() > MaxLineLength)
+                socket->abort();
+        });
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket] {
+            mBuffers.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void TriggerInput::onFifoReadable()
+{
+#ifdef UFCS_TRIGGER_FIFO
+    char data[4096];
+    ssize_t n;
+    while ((n = ::read(mFifo, data, sizeof(data))) > 0)
+        readLines(mFifoBuffer, QByteArray::fromRawData(data, int(n)));
+
+    // A writer that never ends its line mustn't make the buffer grow forever
+    if (mFifoBuffer.size() > MaxLineLength)
+        mFifoBuffer.clear();
+#endif
+}
+
+/**
+ * @brief Append data to a buffer, and fire a trigger for each complete line in it
+ */
+void TriggerInput::readLines(QByteArray &buffer, const QByteArray &data)
+{
+    buffer += data;
+
+    int start = 0;
+    int end;
+    while ((end = buffer.indexOf('\n', start)) >= 0) {
+        QString name = QString::fromUtf8(buffer.constData() + start, end - start).trimmed();
+        if (!name.isEmpty()) {
+            mRoutineController->fireTrigger(name);
+            qCDebug(lcRoutine) << "Trigger" << name << "received";
+        }
+        start = end + 1;
+    }
+    buffer.remove(0, start);
+}
@@ -0,0 +1,65 @@
+#ifndef TRIGGERINPUT_H
+#define TRIGGERINPUT_H
+
+#include <QtCore>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+class RoutineController;
+
+/**
+ * @brief The TriggerInput class receives triggers for routines ("wait for trigger") from other programs, as
+ * plain text: one trigger name per line.
+ *
+ * Triggers can be written to a local socket (a Unix domain socket, or a named pipe on Windows), e.g.
+ *
+ *     echo camera | nc -U /tmp/ufcs-triggers
+ *
+ * or, on Unix, to a FIFO, which needs no client at all:
+ *
+ *     echo camera > ~/.local/share/ufcs/ufcs-pc/triggers.fifo
+ *
+ * Each trigger is passed on to RoutineController::fireTrigger as soon as it is read, from the thread of this object.
+ * Programs using the control socket can fire triggers through it instead (see ControlServer).
+ */
+class TriggerInput : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int MaxLineLength = 256;
+
+    explicit TriggerInput(RoutineController* routineController, QObject* parent = nullptr);
+    ~TriggerInput();
+
+    bool listen(const QString& name);
+    bool openFifo(const QString& path);
+
+    QString fullServerName() const { return mServer.fullServerName(); }
+
+private slots:
+    void onNewConnection();
+    void onFifoReadable();
+
+private:
+    void readLines(QByteArray& buffer, const QByteArray& data);
+
+    RoutineController* mRoutineController;
+    QHash<QLocalSocket*, QByteArray> mBuffers;
+
+    /// Declared after mBuffers, so that the sockets (its children) are disconnected while mBuffers still exists
+    QLocalServer mServer;
+
+    int mFifo;
+    int mFifoWriter;
+    QString mFifoPath;
+
+    /// Identify the FIFO this object created, so that it only removes that one
+    quint64 mFifoDevice;
+    quint64 mFifoInode;
+
+    QByteArray mFifoBuffer;
+    QSocketNotifier* mFifoNotifier;
+};
+
+#endif // TRIGGERINPUT_H
@@ -0,0 +1,146 @@
+#ifndef UFCS_SHM_H
+#define UFCS_SHM_H
+
+/*
+ * Layout of the shared-memory segment in which the application publishes the state of the hardware, and every
+ * change of it, for other programs on the same computer (see SharedTelemetry). This header is plain C, and has no
+ * dependencies: readers include it as is. tools/ufcs_shm_reader.c is an example.
+ *
+ * The segment is a POSIX shared-memory object ("/ufcs-telemetry" by default; setting: sharedMemory/name), created
+ * by the application with read and write access for its user only. Readers open it read-only:
+ *
+ *     int fd = shm_open("/ufcs-telemetry", O_RDONLY, 0);
+ *     const struct ufcs_shm_segment* s = mmap(NULL, sizeof(struct ufcs_shm_segment), PROT_READ, MAP_SHARED, fd, 0);
+ *
+ * then check that magic and version are those below (magic is only set once the segment is initialized).
+ * Reading never blocks the application, and needs no system call: the application writes without waiting for
+ * readers, and readers detect, and retry or skip, what was modified while they were reading it ("seqlock").
+ *
+ * - state: the latest value of each component. Use ufcs_shm_read_state to get a consistent copy.
+ * - ring: every change, in order, as records. write_index is the number of records written since the segment was
+ *   created; record i is in ring[i % UFCS_SHM_RING_SIZE] until it is overwritten, UFCS_SHM_RING_SIZE records later.
+ *   Use ufcs_shm_read_record to read it.
+ *
+ * Values are those exchanged with the microcontroller: 0 or 1 for valves and pumps, 0 to pr_max_value for
+ * pressure setpoints and measurements (a fraction of the controller's range), -1 if unknown. The connection
+ * status is 0 (disconnected), 1 (connecting) or 2 (connected). Components are numbered from 1.
+ *
+ * Timestamps are in microseconds, on the monotonic clock (CLOCK_MONOTONIC on Linux); add realtime_offset to get
+ * microseconds since the Unix epoch. Streamed pressure samples (UFCS_SHM_TELEMETRY) are timestamped by the
+ * microcontroller's sampling interval, so several may share a write but not a timestamp.
+ *
+ * The object is removed when the application exits, and initialized again (with a new pid) when it starts after a
+ * crash: readers that want to follow the application across restarts should reopen the object when pid changes or
+ * when nothing has been written for a while.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define UFCS_SHM_MAGIC              0x53434655u     /* "UFCS" */
+#define UFCS_SHM_VERSION            1
+#define UFCS_SHM_DEFAULT_NAME       "/ufcs-telemetry"
+#define UFCS_SHM_RING_SIZE          8192            /* Records; a power of two */
+#define UFCS_SHM_MAX_VALVES         64
+#define UFCS_SHM_MAX_PUMPS          8
+#define UFCS_SHM_MAX_CONTROLLERS    8
+
+enum ufcs_shm_kind {
+    UFCS_SHM_VALVE,             /* Valve state reported */
+    UFCS_SHM_PUMP,              /* Pump state reported */
+    UFCS_SHM_SETPOINT,          /* Pressure setpoint reported */
+    UFCS_SHM_PRESSURE,          /* Pressure measured, from a status report */
+    UFCS_SHM_CONNECTION,        /* Connection status changed; number is 0 */
+    UFCS_SHM_TELEMETRY          /* Pressure measured, streamed */
+};
+
+/* 16 bytes */
+struct ufcs_shm_record {
+    uint32_t sequence;          /* 2 * (index + 1), truncated, once written; odd while being written */
+    uint8_t kind;               /* enum ufcs_shm_kind */
+    uint8_t number;
+    int16_t value;
+    int64_t timestamp;
+};
+
+/* 192 bytes */
+struct ufcs_shm_state {
+    uint32_t sequence;          /* Even, incremented before and after each update */
+    int32_t connection;
+    int64_t timestamp;          /* Of the last update */
+    int16_t valves[UFCS_SHM_MAX_VALVES];
+    int16_t pumps[UFCS_SHM_MAX_PUMPS];
+    int16_t setpoints[UFCS_SHM_MAX_CONTROLLERS];
+    int16_t pressures[UFCS_SHM_MAX_CONTROLLERS];
+};
+
+struct ufcs_shm_segment {
+    /* Written once, when the segment is created */
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ring_size;
+    uint32_t pr_max_value;
+    uint16_t n_valves;
+    uint16_t n_pumps;
+    uint16_t n_controllers;
+    uint16_t reserved;
+    int64_t realtime_offset;
+    int32_t pid;
+    uint32_t reserved2;
+    char padding[24];
+
+    /* On a cache line of its own, as it is the only field written for every record */
+    uint64_t write_index;
+    char write_index_padding[56];
+
+    struct ufcs_shm_state state;
+    struct ufcs_shm_record ring[UFCS_SHM_RING_SIZE];
+};
+
+/*
+ * Reader functions (GCC and Clang)
+ */
+
+#if defined(__GNUC__)
+
+static inline uint64_t ufcs_shm_write_index(const struct ufcs_shm_segment* s)
+{
+    return __atomic_load_n(&s->write_index, __ATOMIC_ACQUIRE);
+}
+
+/* Copy the state to *out. Returns 1, or 0 if it kept changing while being copied. */
+static inline int ufcs_shm_read_state(const struct ufcs_shm_segment* s, struct ufcs_shm_state* out)
+{
+    int attempt;
+    for (attempt = 0; attempt < 1000; ++attempt) {
+        uint32_t before = __atomic_load_n(&s->state.sequence, __ATOMIC_ACQUIRE);
+        if (before & 1)
+            continue;
+        memcpy(out, &s->state, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->state.sequence, __ATOMIC_RELAXED) == before)
+            return 1;
+    }
+    return 0;
+}
+
+/* Copy record `index` to *out. Returns 1; 0 if it isn't written yet; -1 if it was overwritten (read too late). */
+static inline int ufcs_shm_read_record(const struct ufcs_shm_segment* s, uint64_t index, struct ufcs_shm_record* out)
+{
+    const struct ufcs_shm_record* r = &s->ring[index & (UFCS_SHM_RING_SIZE - 1)];
+    uint32_t expected = (uint32_t)(2 * (index + 1));
+
+    for (;;) {
+        uint32_t before = __atomic_load_n(&r->sequence, __ATOMIC_ACQUIRE);
+        if (before != expected)
+            return index >= ufcs_shm_write_index(s) ? 0 : -1;
+        memcpy(out, r, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&r->sequence, __ATOMIC_RELAXED) == before)
+            return 1;
+    }
+}
+
+#endif /* __GNUC__ */
+
+#endif /* UFCS_SHM_H */
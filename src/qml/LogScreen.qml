@@ -7,6 +7,11 @@ import QtQuick.Controls.Material 2.12
 import org.example.ufcs 1.0 // for the Style singleton
 
 Item {
+    id: logScreen
+
+    // Either the log of the current session, or a log file from a previous session
+    property bool viewingFile: false
+    property var currentModel: viewingFile ? Backend.logFileModel : Backend.logModel
 
     ColumnLayout {
         anchors.fill: parent
@@ -14,12 +19,92 @@ Item {
         anchors.leftMargin: Style.view.margin
         anchors.rightMargin: anchors.leftMargin
 
+        RowLayout {
+            Layout.fillWidth: true
+
+            ComboBox {
+                id: logSourceComboBox
+                Layout.fillWidth: true
+
+                property var files: []
+
+                model: ["Current session"].concat(files.map(function(f) { return f.replace(/^.*[\\/]/, "") }))
+
+                onPressedChanged: if (pressed && currentIndex === 0) files = Backend.pastLogFiles()
+                onActivated: {
+                    if (index === 0) {
+                        logScreen.viewingFile = false
+                        Backend.logFileModel.close()
+                    }
+                    else if (Backend.logFileModel.open(files[index-1]))
+                        logScreen.viewingFile = true
+                }
+                Component.onCompleted: files = Backend.pastLogFiles()
+            }
+
+            BusyIndicator {
+                running: logScreen.viewingFile && Backend.logFileModel.indexing
+                visible: running
+                Layout.preferredHeight: 30
+                Layout.preferredWidth: 30
+            }
+        }
+
+        RowLayout {
+            Layout.fillWidth: true
+
+            CheckBox {
+                text: "Debug"
+                checked: logScreen.currentModel.showDebug
+                onToggled: logScreen.currentModel.showDebug = checked
+            }
+            CheckBox {
+                text: "Info"
+                checked: logScreen.currentModel.showInfo
+                onToggled: logScreen.currentModel.showInfo = checked
+            }
+            CheckBox {
+                text: "Warnings"
+                checked: logScreen.currentModel.showWarnings
+                onToggled: logScreen.currentModel.showWarnings = checked
+            }
+            CheckBox {
+                text: "Errors"
+                checked: logScreen.currentModel.showErrors
+                onToggled: logScreen.currentModel.showErrors = checked
+            }
+
+            TextField {
+                id: searchField
+                visible: !logScreen.viewingFile
+                Layout.fillWidth: true
+                placeholderText: "Search"
+                selectByMouse: true
+                onTextChanged: searchDelay.restart()
+
+                // Don't start a new search on every keystroke
+                Timer {
+                    id: searchDelay
+                    interval: 250
+                    onTriggered: Backend.logModel.searchText = searchField.text
+                }
+            }
+
+            BusyIndicator {
+                running: Backend.logModel.searching
+                visible: running
+                Layout.preferredHeight: 30
+                Layout.preferredWidth: 30
+            }
+        }
+
         ListView {
             id: logMessageList
             visible: true
-            width: parent.width
-            height: parent.height
-            model: Backend.logMessageList
+            Layout.fillWidth: true
+            Layout.fillHeight: true
+            clip: true
+            model: logScreen.currentModel
 
             ScrollBar.vertical: ScrollBar {}
 
@@ -31,14 +116,14 @@ Item {
                 width: parent.width
                 color: "transparent"
 
-                // Logs are stored as a list of strings (represented in a QVariant). The elements are:
-                // 0: timestamp
-                // 1: message type ("debug", "warning", ...)
-                // 2: the actual message text
+                // Each log entry has three roles:
+                // time: timestamp
+                // type: message type ("Debug", "Warning", ...)
+                // message: the actual message text
 
                 function messageTypeColor()
                 {
-                    var text = modelData[1]
+                    var text = model.type
                     switch(text) {
                         case "Debug":
                             return mainWindow.darkMode ? "#B0BEC5" : "#607D8B" // Material.BlueGrey
@@ -58,21 +143,21 @@ Item {
                         id: timestamp
                         font.pointSize: Style.text.fontSize
                         color: mainWindow.darkMode ? "#EEEEEE" : "#9E9E9E" // Material.Grey
-                        text: modelData[0] + " "
+                        text: model.time ? model.time + " " : ""
                     }
 
                     Text {
                         id: messageType
                         font.pointSize: Style.text.fontSize
                         font.bold: true
-                        text: modelData[1] + ": "
+                        text: model.type ? model.type + ": " : "" // empty for continuation lines of log files
                         color: messageTypeColor()
                     }
 
                     Text {
                         id: messageText
                         font.pointSize: Style.text.fontSize
-                        text: modelData[2]
+                        text: model.message
                         wrapMode: Text.Wrap
                         width: parent.width - timestamp.width - messageType.width
                         color: Material.foreground
@@ -81,7 +166,7 @@ Item {
                 }
             }
 
-            onCountChanged: positionViewAtEnd()
+            onCountChanged: if (!logScreen.viewingFile) positionViewAtEnd()
         }
     }
 
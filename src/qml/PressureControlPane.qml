@@ -124,6 +124,22 @@ Item {
 
             }
         }
+
+        PressureHistory {
+            anchors.left: parent.left
+            anchors.right: parent.right
+            visible: !control.collapsed
+            controllerNumber: 1
+            title: qsTr("Control layer history")
+        }
+
+        PressureHistory {
+            anchors.left: parent.left
+            anchors.right: parent.right
+            visible: !control.collapsed
+            controllerNumber: 2
+            title: qsTr("Flow layer history")
+        }
     }
 
 }
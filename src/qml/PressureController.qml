@@ -15,13 +15,17 @@ Item {
     property int sliderHeight: 200
     property bool largeHandle: false
 
-    width: grid1.implicitWidth
-    height: grid1.implicitHeight
+    width: column.implicitWidth
+    height: column.implicitHeight
     enabled: Backend.connectionStatus == "Connected"
 
     property double sp : helper.setPointInPsi
     property double pv : helper.measuredValueInPsi
 
+    ColumnLayout {
+        id: column
+        spacing: 10
+
     GridLayout {
         id: grid1
         flow: GridLayout.TopToBottom
@@ -87,13 +91,29 @@ Item {
         }
     }
 
+    // When checked, the slider sets the pressure to reach rather than the setpoint of the controller
+    CheckBox {
+        id: closedLoopCheckBox
+        text: "Closed loop"
+        Layout.alignment: Qt.AlignHCenter
+        onToggled: {
+            Backend.controlLoop.setEnabled(controllerNumber, checked, helper.setPoint)
+            if (checked)
+                Backend.controlLoop.setTarget(controllerNumber, slider.value)
+        }
+    }
+    }
+
     PCHelper {
         id: helper
         minPressure: control.minPressure
         maxPressure: control.maxPressure
 
         onSetPointChanged: {
-            slider.value = setPoint // this makes it possible for the C++ helper to update the slider position
+            // this makes it possible for the C++ helper to update the slider position. In closed loop, the slider
+            // shows the target pressure, and the setpoint is adjusted by the loop
+            if (!closedLoopCheckBox.checked)
+                slider.value = setPoint
         }
 
         onMeasuredValueChanged: {
@@ -0,0 +1,52 @@
+import QtQuick 2.12
+import QtQuick.Controls 2.12
+import QtQuick.Layouts 1.12
+import QtQuick.Controls.Material 2.12
+
+import org.example.ufcs 1.0
+
+// Chart of the measured pressure and setpoint of one controller over a selectable period
+ColumnLayout {
+    id: control
+    property int controllerNumber
+    property string title
+
+    RowLayout {
+        Layout.fillWidth: true
+
+        Label {
+            text: control.title
+            Layout.fillWidth: true
+        }
+
+        ComboBox {
+            id: windowComboBox
+            textRole: "text"
+            valueRole: "seconds"
+            model: [
+                { text: qsTr("1 minute"), seconds: 60 },
+                { text: qsTr("10 minutes"), seconds: 600 },
+                { text: qsTr("1 hour"), seconds: 3600 },
+                { text: qsTr("24 hours"), seconds: 86400 }
+            ]
+            currentIndex: 1
+        }
+    }
+
+    Rectangle {
+        Layout.fillWidth: true
+        Layout.preferredHeight: 150
+        color: "transparent"
+        border.color: Material.foreground
+        border.width: 1
+
+        PressureChart {
+            anchors.fill: parent
+            anchors.margins: 2
+            series: Backend.pressureSeries(control.controllerNumber)
+            timeWindow: windowComboBox.currentValue
+            measuredColor: Material.accent
+            setpointColor: Material.foreground
+        }
+    }
+}
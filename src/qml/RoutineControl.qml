@@ -101,12 +101,12 @@ Item {
                 visible: false
                 anchors.fill: parent
                 anchors.margins: 20
-                model: RoutineController.stepsList
+                model: RoutineController.stepsModel
                 currentIndex: RoutineController.currentStep
 
                 delegate: Text {
                     id: delegateText
-                    text: modelData
+                    text: display
 
                     font.pointSize: Style.text.fontSize
                     font.bold: RoutineController.currentStep == index
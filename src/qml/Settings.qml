@@ -105,7 +105,7 @@ Item {
             }
 
             RowLayout {
-                visible: !Backend.bluetoothEnabled
+                visible: Backend.transport === "serial"
 
                 SettingsLabel {
                     Layout.fillWidth: true
@@ -120,6 +120,109 @@ Item {
                 }
             }
 
+            Repeater {
+                model: Backend.logCategories()
+
+                RowLayout {
+                    SettingsLabel {
+                        Layout.fillWidth: true
+                        primaryText: "Logging level: " + modelData
+                        secondaryText: "Debug messages are only written to the log file"
+                    }
+
+                    ComboBox {
+                        model: ["Debug", "Info", "Warnings and errors"]
+                        onActivated: Backend.setLogLevel(modelData, index)
+                        Component.onCompleted: currentIndex = Backend.logLevel(modelData)
+                    }
+                }
+            }
+
+            Repeater {
+                model: Backend.telemetryControllers()
+
+                RowLayout {
+                    property int controllerNumber: modelData
+
+                    SettingsLabel {
+                        Layout.fillWidth: true
+                        primaryText: "Pressure streaming rate: controller " + controllerNumber
+                        secondaryText: "Samples per second sent by the microcontroller"
+                    }
+
+                    ComboBox {
+                        model: [0, 1, 10, 50, 100]
+                        displayText: currentValue === 0 ? "Off" : currentValue + " Hz"
+                        onActivated: Backend.setTelemetryRate(controllerNumber, currentValue)
+                        Component.onCompleted: currentIndex = Math.max(0, indexOfValue(Backend.telemetryRate(controllerNumber)))
+                    }
+                }
+            }
+
+            Repeater {
+                model: ["heartbeat", "valve", "pump", "pressure"]
+
+                RowLayout {
+                    property var stats: Backend.linkMonitor.statistics[modelData]
+
+                    SettingsLabel {
+                        Layout.fillWidth: true
+                        primaryText: "Round-trip time: " + modelData + " commands"
+                        secondaryText: stats && stats.confirmed > 0
+                                       ? "Median " + stats.p50.toFixed(1) + " ms, 99th percentile " + stats.p99.toFixed(1)
+                                         + " ms, max " + stats.max.toFixed(1) + " ms"
+                                       : "No confirmed commands in the last interval"
+                    }
+
+                    Label {
+                        visible: stats !== undefined && stats.lost > 0
+                        text: stats ? stats.lost + " lost" : ""
+                        color: Material.color(Material.Red)
+                    }
+                }
+            }
+
+            RowLayout {
+                SettingsLabel {
+                    id: metricsLabel
+                    Layout.fillWidth: true
+                    primaryText: "Metrics"
+                    secondaryText: "Counters for monitoring, also served on localhost in Prometheus format"
+                }
+
+                Button {
+                    text: "Save to file"
+                    onClicked: {
+                        var path = Backend.dumpMetrics()
+                        metricsLabel.secondaryText = path ? "Saved to " + path : "Could not save metrics"
+                    }
+                }
+            }
+
+            RowLayout {
+                SettingsLabel {
+                    id: tracingLabel
+                    Layout.fillWidth: true
+                    primaryText: "Tracing"
+                    secondaryText: "Record the timing of commands and routine steps; the trace is saved when switched off, and opens in Perfetto"
+                }
+
+                Switch {
+                    Layout.alignment: Qt.AlignRight | Qt.AlignVCenter
+                    Component.onCompleted: checked = Backend.isTracing()
+                    onClicked: {
+                        if (checked) {
+                            Backend.startTracing()
+                            tracingLabel.secondaryText = "Recording..."
+                        }
+                        else {
+                            var path = Backend.stopTracing()
+                            tracingLabel.secondaryText = path ? "Saved to " + path : "Could not save trace"
+                        }
+                    }
+                }
+            }
+
 
         }
 
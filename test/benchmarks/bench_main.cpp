@@ -0,0 +1,76 @@
+#include "benchlogging.h"
+#include "benchcommandsink.h"
+#include "benchprotocol.h"
+#include "benchroutines.h"
+
+/**
+ * @brief Run the benchmarks of one class, also writing its results to <resultDirectory>/<class name>.xml if a
+ * result directory was given
+ *
+ * Each class is a separate QTest run, so a single "-o file,format" option would be overwritten by every class.
+ */
+static int run(QObject* benchmarks, const QStringList& arguments, const QString& resultDirectory)
+{
+   QStringList args = arguments;
+   if (!resultDirectory.isEmpty()) {
+      QString path = resultDirectory + "/" + benchmarks->metaObject()->className() + ".xml";
+      args << "-o" << path + ",xml" << "-o" << "-,txt";
+   }
+   return QTest::qExec(benchmarks, args);
+}
+
+int main(int argc, char** argv)
+{
+   QCoreApplication app(argc, argv);
+   QCoreApplication::setApplicationName("ufcs-pc-benchmarks");
+   QCoreApplication::setOrganizationName("ufcs");
+
+   // Keep log files and settings written by the benchmarks away from the user's
+   QStandardPaths::setTestModeEnabled(true);
+
+   // Test mode doesn't cover QSettings, which ApplicationController reads
+   QTemporaryDir settingsDirectory;
+   QSettings::setDefaultFormat(QSettings::IniFormat);
+   QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, settingsDirectory.path());
+
+   // Neither clash with a running application, nor measure with its services attached
+   QSettings settings;
+   settings.setValue("metrics/port", 0);
+   settings.setValue("controlSocket/enabled", false);
+   settings.setValue("sharedMemory/enabled", false);
+   settings.setValue("triggers/enabled", false);
+   settings.setValue("journal/enabled", false);
+   settings.setValue("recorder/enabled", false);
+   settings.sync();
+
+   // -resultdir <directory>: save machine-readable results (see tools/compare_benchmarks.py); other arguments
+   // are passed on to QTest
+   QStringList arguments = app.arguments();
+   QString resultDirectory;
+   int i = arguments.indexOf("-resultdir");
+   if (i > 0 && i + 1 < arguments.size()) {
+       resultDirectory = arguments[i + 1];
+       arguments.erase(arguments.begin() + i, arguments.begin() + i + 2);
+       QDir().mkpath(resultDirectory);
+   }
+
+   int status = 0;
+   {
+      BenchLogging bl;
+      status |= run(&bl, arguments, resultDirectory);
+   }
+   {
+      BenchCommandSink bcs;
+      status |= run(&bcs, arguments, resultDirectory);
+   }
+   {
+      BenchProtocol bp;
+      status |= run(&bp, arguments, resultDirectory);
+   }
+   {
+      BenchRoutines br;
+      status |= run(&br, arguments, resultDirectory);
+   }
+
+   return status;
+}
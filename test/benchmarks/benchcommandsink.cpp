@@ -0,0 +1,46 @@
+#include "benchcommandsink.h"
+
+#include <thread>
+
+void BenchCommandSink::initTestCase()
+{
+    mCommunicator = new NullCommunicator();
+}
+
+void BenchCommandSink::cleanupTestCase()
+{
+    delete mCommunicator;
+}
+
+void BenchCommandSink::submit()
+{
+    // Cost paid by the submitting thread; the commands are handed to the communicator when the event loop next runs
+    CommandSink& sink = mCommunicator->commandSink();
+    uint i(0);
+
+    QBENCHMARK {
+        sink.setValve(1 + i % N_VALVES, i % 2);
+        ++i;
+    }
+
+    QCoreApplication::processEvents();
+}
+
+void BenchCommandSink::submitFromThreads()
+{
+    // Four threads submitting at once, to include contention on the queue
+    CommandSink& sink = mCommunicator->commandSink();
+
+    QBENCHMARK {
+        std::vector<std::thread> threads;
+        for (uint t(0); t < 4; ++t) {
+            threads.emplace_back([&sink, t] {
+                for (uint i(0); i < 1000; ++i)
+                    sink.setValve(1 + (t * 8 + i) % N_VALVES, i % 2);
+            });
+        }
+        for (std::thread& t : threads)
+            t.join();
+        QCoreApplication::processEvents();
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef BENCHCOMMANDSINK_H
+#define BENCHCOMMANDSINK_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "communicator.h"
+
+/**
+ * @brief A connected Communicator that discards what it writes
+ */
+class NullCommunicator : public Communicator
+{
+public:
+    NullCommunicator() : Communicator(nullptr) { mConnectionStatus = Connected; }
+    void connect() {}
+
+protected:
+    void sendMessage(QByteArray) {}
+};
+
+/**
+ * @brief Measures the cost of submitting commands through Communicator::commandSink()
+ */
+class BenchCommandSink : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void submit();
+    void submitFromThreads();
+
+private:
+    NullCommunicator* mCommunicator;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "benchlogging.h"
+#include "logger.h"
+
+void BenchLogging::initTestCase()
+{
+    Logger::logger();
+    qInstallMessageHandler(Logger::messageHandler);
+
+    mController = new ApplicationController();
+    mCommunicator = new BenchmarkCommunicator(mController);
+}
+
+void BenchLogging::cleanupTestCase()
+{
+    qInstallMessageHandler(nullptr);
+    Logger::setCategoryLevel("communicator", Logger::DebugLevel);
+
+    delete mCommunicator;
+    delete mController;
+}
+
+void BenchLogging::pressureFrame_data()
+{
+    QTest::addColumn<int>("level");
+
+    QTest::newRow("debug logging on") << int(Logger::DebugLevel);
+    QTest::newRow("debug logging off") << int(Logger::InfoLevel);
+}
+
+void BenchLogging::pressureFrame()
+{
+    // A PRESSURE frame for controller 1, which is logged at debug level, through the whole decoding path
+    QFETCH(int, level);
+    Logger::setCategoryLevel("communicator", Logger::Level(level));
+
+    QByteArray message;
+    message.push_back(PRESSURE);
+    message.push_back(1);
+    message.push_back(1);
+    message.push_back(1);
+    message.push_back(120);
+    message.push_back(1);
+    message.push_back(118);
+    QByteArray frame = mCommunicator->frameMessage(message);
+
+    QBENCHMARK {
+        mCommunicator->mBuffer.append(frame);
+        QByteArray b = mCommunicator->decodeBuffer();
+        mCommunicator->parseDecodedBuffer(b);
+    }
+}
+
+void BenchLogging::messageHandler_data()
+{
+    QTest::addColumn<int>("type");
+
+    QTest::newRow("debug") << int(QtDebugMsg);
+    QTest::newRow("info") << int(QtInfoMsg);
+    QTest::newRow("warning") << int(QtWarningMsg);
+    QTest::newRow("critical") << int(QtCriticalMsg);
+}
+
+void BenchLogging::messageHandler()
+{
+    // Cost of formatting and writing one message, once it has passed the category check
+    QFETCH(int, type);
+    QMessageLogContext context;
+    QString message("Flow layer pressure setpoint vs measured 0.470588 \t 0.462745");
+
+    QBENCHMARK {
+        Logger::messageHandler(QtMsgType(type), context, message);
+    }
+}
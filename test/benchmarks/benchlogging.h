@@ -0,0 +1,47 @@
+#ifndef BENCHLOGGING_H
+#define BENCHLOGGING_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "serialcommunicator.h"
+#include "applicationcontroller.h"
+
+/**
+ * @brief Exposes the protected frame handling functions of Communicator to the benchmarks
+ */
+class BenchmarkCommunicator : public SerialCommunicator
+{
+public:
+    BenchmarkCommunicator(ApplicationController* controller) : SerialCommunicator(controller) {}
+
+    using Communicator::frameMessage;
+    using Communicator::decodeBuffer;
+    using Communicator::parseDecodedBuffer;
+    using Communicator::handleCommand;
+    using Communicator::mBuffer;
+};
+
+/**
+ * @brief Measures the cost of logging on the hot paths, with debug logging on and off
+ */
+class BenchLogging : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void pressureFrame_data();
+    void pressureFrame();
+
+    void messageHandler_data();
+    void messageHandler();
+
+private:
+    ApplicationController* mController;
+    BenchmarkCommunicator* mCommunicator;
+};
+
+#endif
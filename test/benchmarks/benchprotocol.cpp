@@ -0,0 +1,187 @@
+#include "benchprotocol.h"
+#include "logger.h"
+
+void BenchProtocol::initTestCase()
+{
+    // Decoding is measured, not the logging of the flow layer pressure (see BenchLogging for that)
+    Logger::setCategoryLevel("communicator", Logger::InfoLevel);
+
+    mCommunicator = new ProtocolCommunicator();
+}
+
+void BenchProtocol::cleanupTestCase()
+{
+    Logger::setCategoryLevel("communicator", Logger::DebugLevel);
+
+    delete mCommunicator;
+}
+
+QByteArray BenchProtocol::pressureMessage(uint8_t number, uint8_t setpoint, uint8_t measured)
+{
+    QByteArray message;
+    message.push_back(PRESSURE);
+    message.push_back(1);
+    message.push_back(number);
+    message.push_back(1);
+    message.push_back(setpoint);
+    message.push_back(1);
+    message.push_back(measured);
+    return message;
+}
+
+QByteArray BenchProtocol::valveMessage(uint8_t number, bool open)
+{
+    QByteArray message;
+    message.push_back(VALVE);
+    message.push_back(1);
+    message.push_back(number);
+    message.push_back(1);
+    message.push_back(open);
+    return message;
+}
+
+QByteArray BenchProtocol::telemetryMessage(uint8_t number, int samples)
+{
+    // Controller number, sample interval (10 ms, big-endian), then the samples
+    QByteArray message;
+    message.push_back(TELEMETRY);
+    message.push_back(1);
+    message.push_back(number);
+    message.push_back(4);
+    message.append(QByteArray::fromHex("00002710"));
+    message.push_back(char(samples));
+    for (int i(0); i < samples; ++i)
+        message.push_back(char(100 + i % 50));
+    return message;
+}
+
+/**
+ * @brief Return a stream of 100 frames, as received from the microcontroller
+ * @param escaped If true, every pressure frame contains bytes that must be escaped
+ * @param junk If true, frames are separated by bytes outside of any frame, and one in ten has an unknown command
+ */
+QByteArray BenchProtocol::stream(bool escaped, bool junk)
+{
+    QByteArray s;
+    for (int i(0); i < 100; ++i) {
+        QByteArray message;
+        switch (i % 4) {
+            case 0:
+                message = valveMessage(1 + i % N_VALVES, i % 8 < 4);
+                break;
+            case 1:
+                message = telemetryMessage(1 + i % N_PRS, 10);
+                break;
+            default:
+                message = escaped ? pressureMessage(1 + i % N_PRS, STOP_BYTE, ESCAPE_BYTE)
+                                  : pressureMessage(1 + i % N_PRS, 120, 118);
+                break;
+        }
+
+        if (junk) {
+            s.append(QByteArray::fromHex("0102037f80"));
+            if (i % 10 == 0)
+                message[0] = char(NUM_COMMANDS + 10);
+        }
+        s.append(mCommunicator->frameMessage(message));
+    }
+    return s;
+}
+
+void BenchProtocol::frameMessage_data()
+{
+    QTest::addColumn<QByteArray>("message");
+
+    QTest::newRow("valve") << valveMessage(12, true);
+    QTest::newRow("pressure") << pressureMessage(1, 120, 118);
+    QTest::newRow("pressure, escaped") << pressureMessage(1, STOP_BYTE, ESCAPE_BYTE);
+    QTest::newRow("telemetry, 50 samples") << telemetryMessage(1, 50);
+}
+
+void BenchProtocol::frameMessage()
+{
+    QFETCH(QByteArray, message);
+
+    QBENCHMARK {
+        QByteArray frame = mCommunicator->frameMessage(message);
+        Q_UNUSED(frame);
+    }
+}
+
+void BenchProtocol::decodeStream_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<int>("chunkSize");
+
+    QTest::newRow("clean") << stream(false, false) << 0;
+    QTest::newRow("escaped") << stream(true, false) << 0;
+    QTest::newRow("fragmented, 7-byte reads") << stream(false, false) << 7;
+    QTest::newRow("fragmented, 1-byte reads") << stream(false, false) << 1;
+    QTest::newRow("junk") << stream(false, true) << 0;
+}
+
+void BenchProtocol::decodeStream()
+{
+    // 100 frames per iteration, delivered at once or in chunks (as successive readyRead signals would), decoded
+    // the way the communicators do, but not parsed
+    QFETCH(QByteArray, data);
+    QFETCH(int, chunkSize);
+
+    if (chunkSize <= 0)
+        chunkSize = data.size();
+
+    int decoded(0);
+    QBENCHMARK {
+        for (int offset(0); offset < data.size(); offset += chunkSize) {
+            mCommunicator->mBuffer.append(data.constData() + offset, qMin(chunkSize, data.size() - offset));
+            while (mCommunicator->mBuffer.size() > 0) {
+                if (!mCommunicator->decodeBuffer().isEmpty())
+                    decoded++;
+            }
+        }
+    }
+    QVERIFY(decoded > 0);
+}
+
+void BenchProtocol::parseDecodedBuffer_data()
+{
+    QTest::addColumn<QByteArray>("message");
+
+    QTest::newRow("valve") << valveMessage(12, true);
+    QTest::newRow("pressure") << pressureMessage(2, 120, 118);
+    QTest::newRow("telemetry, 10 samples") << telemetryMessage(2, 10);
+}
+
+void BenchProtocol::parseDecodedBuffer()
+{
+    // Splitting into parameters, then handling the command
+    QFETCH(QByteArray, message);
+
+    QBENCHMARK {
+        mCommunicator->parseDecodedBuffer(message);
+    }
+}
+
+void BenchProtocol::handleCommand_data()
+{
+    QTest::addColumn<QByteArray>("message");
+
+    QTest::newRow("valve") << valveMessage(12, true);
+    QTest::newRow("pressure") << pressureMessage(2, 120, 118);
+    QTest::newRow("telemetry, 10 samples") << telemetryMessage(2, 10);
+}
+
+void BenchProtocol::handleCommand()
+{
+    // Updating the shadow state, checking the safety rules and emitting the signals, from parameters split already
+    QFETCH(QByteArray, message);
+
+    QList<QByteArray> parameters;
+    for (int i(1); i < message.size(); i += 1 + uint8_t(message[i]))
+        parameters << message.mid(i + 1, uint8_t(message[i]));
+    uint8_t command = message[0];
+
+    QBENCHMARK {
+        mCommunicator->handleCommand(command, parameters);
+    }
+}
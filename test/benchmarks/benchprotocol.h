@@ -0,0 +1,62 @@
+#ifndef BENCHPROTOCOL_H
+#define BENCHPROTOCOL_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "communicator.h"
+
+/**
+ * @brief A connected Communicator that discards what it writes, and exposes its frame handling functions
+ */
+class ProtocolCommunicator : public Communicator
+{
+public:
+    ProtocolCommunicator() : Communicator(nullptr) { mConnectionStatus = Connected; }
+    void connect() {}
+
+    using Communicator::frameMessage;
+    using Communicator::decodeBuffer;
+    using Communicator::parseDecodedBuffer;
+    using Communicator::handleCommand;
+    using Communicator::mBuffer;
+
+protected:
+    void sendMessage(QByteArray) {}
+};
+
+/**
+ * @brief Measures the encoding and decoding of messages exchanged with the microcontroller
+ *
+ * Streams are made of the messages the microcontroller sends most: PRESSURE, VALVE and TELEMETRY reports.
+ */
+class BenchProtocol : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void frameMessage_data();
+    void frameMessage();
+
+    void decodeStream_data();
+    void decodeStream();
+
+    void parseDecodedBuffer_data();
+    void parseDecodedBuffer();
+
+    void handleCommand_data();
+    void handleCommand();
+
+private:
+    static QByteArray pressureMessage(uint8_t number, uint8_t setpoint, uint8_t measured);
+    static QByteArray valveMessage(uint8_t number, bool open);
+    static QByteArray telemetryMessage(uint8_t number, int samples);
+    QByteArray stream(bool escaped, bool junk);
+
+    ProtocolCommunicator* mCommunicator;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "benchroutines.h"
+
+void BenchRoutines::initTestCase()
+{
+    // The hardware is defined by the helpers registered from QML: 32 valves and 2 pressure controllers (0-30 PSI)
+    mController = new ApplicationController();
+
+    for (int v(1); v <= 32; ++v) {
+        ValveSwitchHelper* helper = new ValveSwitchHelper();
+        mController->registerValveSwitchHelper(v, helper);
+        mHelpers << helper;
+    }
+    for (int p(1); p <= 2; ++p) {
+        PCHelper* helper = new PCHelper();
+        helper->setProperty("minPressure", 0.);
+        helper->setProperty("maxPressure", 30.);
+        mController->registerPCHelper(p, helper);
+        mHelpers << helper;
+    }
+
+    mRoutineController = new RoutineController(mController);
+}
+
+void BenchRoutines::cleanupTestCase()
+{
+    delete mRoutineController;
+    delete mController;
+    qDeleteAll(mHelpers);
+}
+
+/**
+ * @brief Write a routine with the given number of lines to a file, and return its URL
+ *
+ * The routine cycles through the commands seen in typical protocols, with comments and blank lines.
+ */
+QString BenchRoutines::generateRoutine(int lines)
+{
+    static const char* const commands[] = {
+        "# Fill the chamber",
+        "valve %1 open",
+        "pressure 1 %2",
+        "wait 2 s",
+        "valve %1 close",
+        "wait until pressure 1 within 0.5 timeout 10 s",
+        "",
+        "ramp 2 %2 12.5 over 30 s smooth",
+        "valve all close",
+        "pressure 2 %2   # flow layer",
+    };
+    const int nCommands = sizeof(commands) / sizeof(commands[0]);
+
+    QString path = mDirectory.filePath(QString("routine-%1.txt").arg(lines));
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return QString();
+
+    QTextStream stream(&file);
+    for (int i(0); i < lines; ++i)
+        stream << QString(commands[i % nCommands]).replace("%1", QString::number(1 + i % 32))
+                                                  .replace("%2", QString::number(0.5 * (i % 40))) << '\n';
+
+    return QUrl::fromLocalFile(path).toString();
+}
+
+void BenchRoutines::verify_data()
+{
+    QTest::addColumn<int>("lines");
+
+    QTest::newRow("1k lines") << 1000;
+    QTest::newRow("10k lines") << 10000;
+    QTest::newRow("100k lines") << 100000;
+    QTest::newRow("1M lines") << 1000000;
+}
+
+void BenchRoutines::verify()
+{
+    QFETCH(int, lines);
+
+    QString url = generateRoutine(lines);
+    QVERIFY(!url.isEmpty());
+    QVERIFY(mRoutineController->loadFile(url));
+
+    int errors(0);
+    QBENCHMARK {
+        errors = mRoutineController->verify();
+    }
+    QCOMPARE(errors, 0);
+
+    QFile::remove(QUrl(url).toLocalFile());
+}
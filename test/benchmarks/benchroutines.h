@@ -0,0 +1,34 @@
+#ifndef BENCHROUTINES_H
+#define BENCHROUTINES_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "routinecontroller.h"
+#include "applicationcontroller.h"
+#include "guihelper.h"
+
+/**
+ * @brief Measures the verification of routines, from a thousand to a million lines long
+ */
+class BenchRoutines : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void verify_data();
+    void verify();
+
+private:
+    QString generateRoutine(int lines);
+
+    ApplicationController* mController;
+    RoutineController* mRoutineController;
+    QList<QObject*> mHelpers;
+    QTemporaryDir mDirectory;
+};
+
+#endif
@@ -0,0 +1,32 @@
+#include "testseriallink.h"
+
+int main(int argc, char** argv)
+{
+   QCoreApplication app(argc, argv);
+   QCoreApplication::setApplicationName("ufcs-pc-integration");
+   QCoreApplication::setOrganizationName("ufcs");
+
+   // Keep log files and settings written by the tests away from the user's
+   QStandardPaths::setTestModeEnabled(true);
+
+   // QTest prints every message; one per valve report would bury the results
+   QLoggingCategory::setFilterRules("ufcs.*.debug=false\nufcs.*.info=false");
+
+   // -csv <file>: save the measurements; other arguments are passed on to QTest
+   QStringList arguments = app.arguments();
+   QString resultFile;
+   int i = arguments.indexOf("-csv");
+   if (i > 0 && i + 1 < arguments.size()) {
+      resultFile = arguments[i + 1];
+      arguments.erase(arguments.begin() + i, arguments.begin() + i + 2);
+   }
+
+   int status = 0;
+   {
+      TestSerialLink tsl;
+      tsl.setResultFile(resultFile);
+      status |= QTest::qExec(&tsl, arguments);
+   }
+
+   return status;
+}
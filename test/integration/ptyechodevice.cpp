@@ -0,0 +1,319 @@
+#include "ptyechodevice.h"
+#include "constants.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+PtyEchoDevice::PtyEchoDevice()
+    : mMaster(-1)
+    , mListener(-1)
+    , mSocketType(TcpSocket)
+    , mByteTime(0)
+    , mStopRequested(false)
+    , mCommandsReceived(0)
+    , mReceiveFree(0)
+    , mTransmitFree(0)
+    , mStart(0)
+    , mRecording(false)
+    , mEscaped(false)
+{
+}
+
+PtyEchoDevice::~PtyEchoDevice()
+{
+    close();
+}
+
+/**
+ * @brief Create the pty pair and start answering commands
+ * @param baudRate Speed of the modelled serial line, in bits per second
+ */
+bool PtyEchoDevice::open(int baudRate)
+{
+    mMaster = posix_openpt(O_RDWR | O_NOCTTY);
+    if (mMaster < 0 || grantpt(mMaster) != 0 || unlockpt(mMaster) != 0) {
+        qWarning() << "Could not create a pseudo-terminal:" << strerror(errno);
+        close();
+        return false;
+    }
+
+    // No echo or line editing on the device side either
+    termios attributes;
+    tcgetattr(mMaster, &attributes);
+    cfmakeraw(&attributes);
+    tcsetattr(mMaster, TCSANOW, &attributes);
+    fcntl(mMaster, F_SETFL, fcntl(mMaster, F_GETFL) | O_NONBLOCK);
+
+    mPortName = QString::fromLocal8Bit(ptsname(mMaster));
+    start(10 * 1000000LL / qMax(1, baudRate));
+    return true;
+}
+
+/**
+ * @brief Listen on a socket of the given type, and answer the commands of the client that connects to it
+ */
+bool PtyEchoDevice::listen(SocketType type)
+{
+    mSocketType = type;
+
+    if (type == TcpSocket) {
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+
+        mListener = socket(AF_INET, SOCK_STREAM, 0);
+        if (mListener < 0 || bind(mListener, reinterpret_cast<sockaddr*>(&address), length) != 0
+                || ::listen(mListener, 1) != 0
+                || getsockname(mListener, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            qWarning() << "Could not listen on a TCP port:" << strerror(errno);
+            close();
+            return false;
+        }
+        mPortName = "127.0.0.1:" + QString::number(ntohs(address.sin_port));
+    }
+    else {
+        mPortName = QDir::temp().filePath("ufcs-echo-" + QString::number(QCoreApplication::applicationPid()));
+        QByteArray path = QFile::encodeName(mPortName);
+        unlink(path.constData());
+
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path.constData(), sizeof(address.sun_path) - 1);
+
+        mListener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (mListener < 0 || bind(mListener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+                || ::listen(mListener, 1) != 0) {
+            qWarning() << "Could not listen on" << mPortName << ":" << strerror(errno);
+            close();
+            return false;
+        }
+    }
+
+    start(0);
+    return true;
+}
+
+void PtyEchoDevice::start(qint64 byteTime)
+{
+    mByteTime = byteTime;
+    mStart = now();
+    mReceiveFree = mTransmitFree = mStart;
+    mCommandsReceived = 0;
+    mStopRequested = false;
+
+    mThread = std::thread([this] { run(); });
+}
+
+void PtyEchoDevice::close()
+{
+    mStopRequested = true;
+    if (mThread.joinable())
+        mThread.join();
+
+    if (mMaster >= 0)
+        ::close(mMaster);
+    mMaster = -1;
+
+    if (mListener >= 0) {
+        ::close(mListener);
+        if (mSocketType == UnixSocket)
+            unlink(QFile::encodeName(mPortName).constData());
+    }
+    mListener = -1;
+
+    mIncoming.clear();
+    mOutgoing.clear();
+    mFrame.clear();
+    mRecording = mEscaped = false;
+}
+
+qint64 PtyEchoDevice::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PtyEchoDevice::run()
+{
+    char buffer[4096];
+
+    while (!mStopRequested) {
+        if (mMaster < 0) {
+            accept();
+            continue;
+        }
+
+        qint64 t = now();
+
+        // Release the replies that have been "transmitted" by now
+        while (!mOutgoing.empty() && mOutgoing.front().due <= t) {
+            QByteArray& data = mOutgoing.front().data;
+            // A client that went away mustn't kill the test with SIGPIPE
+            ssize_t written = mListener >= 0 ? send(mMaster, data.constData(), size_t(data.size()), MSG_NOSIGNAL)
+                                             : ::write(mMaster, data.constData(), size_t(data.size()));
+            if (written < 0)
+                break;  // The host isn't reading; try again later
+            data.remove(0, int(written));
+            if (!data.isEmpty())
+                break;
+            mOutgoing.pop_front();
+        }
+
+        // Handle the bytes that have been "received" by now
+        while (!mIncoming.empty() && mIncoming.front().due <= t) {
+            receive(mIncoming.front().data, t);
+            mIncoming.pop_front();
+        }
+
+        // Only read more once the line has caught up, so that the kernel buffer fills up when the host is too fast
+        qint64 next = t + 10000;
+        if (!mIncoming.empty())
+            next = qMin(next, mIncoming.front().due);
+        if (!mOutgoing.empty())
+            next = qMin(next, mOutgoing.front().due);
+
+        pollfd p { mMaster, short(mIncoming.empty() ? POLLIN : 0), 0 };
+        int timeout = int(qMax(qint64(0), (next - t + 999) / 1000));
+        if (poll(&p, 1, timeout) > 0) {
+            if (p.revents & POLLIN) {
+                ssize_t n = ::read(mMaster, buffer, sizeof(buffer));
+                if (n > 0) {
+                    mReceiveFree = qMax(mReceiveFree, now()) + n * mByteTime;
+                    mIncoming.push_back(Chunk { QByteArray(buffer, int(n)), mReceiveFree });
+                }
+                else if (n == 0 && mListener >= 0) {
+                    // The client disconnected; wait for the next one
+                    ::close(mMaster);
+                    mMaster = -1;
+                    mIncoming.clear();
+                    mOutgoing.clear();
+                    mRecording = mEscaped = false;
+                }
+            }
+            else if (p.revents & POLLHUP) {
+                // The host hasn't opened the port yet, or has closed it
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+    }
+}
+
+/**
+ * @brief Wait a little for a client to connect to the listening socket, and accept it
+ */
+void PtyEchoDevice::accept()
+{
+    if (mListener < 0)
+        return;
+
+    pollfd p { mListener, POLLIN, 0 };
+    if (poll(&p, 1, 10) <= 0)
+        return;
+
+    int client = ::accept(mListener, nullptr, nullptr);
+    if (client < 0)
+        return;
+
+    fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+    if (mSocketType == TcpSocket) {
+        int on = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    mReceiveFree = mTransmitFree = now();
+    mMaster = client;
+}
+
+void PtyEchoDevice::receive(const QByteArray &data, qint64 now)
+{
+    for (uint8_t c : data) {
+        if (!mRecording) {
+            if (c == START_BYTE) {
+                mRecording = true;
+                mFrame.clear();
+            }
+        }
+        else if (mEscaped) {
+            mFrame.append(char(c));
+            mEscaped = false;
+        }
+        else if (c == ESCAPE_BYTE)
+            mEscaped = true;
+        else if (c == STOP_BYTE) {
+            mRecording = false;
+            handleFrame(mFrame, now);
+        }
+        else
+            mFrame.append(char(c));
+    }
+}
+
+void PtyEchoDevice::handleFrame(const QByteArray &message, qint64 now)
+{
+    if (message.isEmpty())
+        return;
+
+    mCommandsReceived.fetch_add(1, std::memory_order_relaxed);
+    uint8_t command = message[0];
+
+    switch (command) {
+        case VALVE:
+        case PUMP:
+            // number, state: reported back as is
+            if (message.size() == 5)
+                reply(message, now);
+            break;
+
+        case PRESSURE:
+            // number, setpoint: reported with the measured value equal to the setpoint
+            if (message.size() == 5)
+                reply(message + QByteArray(1, char(1)) + message.right(1), now);
+            break;
+
+        case UPTIME: {
+            quint32 seconds = quint32((now - mStart) / 1000000);
+            QByteArray r;
+            r.append(char(UPTIME));
+            r.append(char(4));
+            r.append(char(seconds >> 24));
+            r.append(char(seconds >> 16));
+            r.append(char(seconds >> 8));
+            r.append(char(seconds));
+            reply(r, now);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+void PtyEchoDevice::reply(const QByteArray &message, qint64 now)
+{
+    QByteArray frame;
+    frame.append(char(START_BYTE));
+    for (uint8_t c : message) {
+        if (c == STOP_BYTE || c == ESCAPE_BYTE)
+            frame.append(char(ESCAPE_BYTE));
+        frame.append(char(c));
+    }
+    frame.append(char(STOP_BYTE));
+
+    mTransmitFree = qMax(mTransmitFree, now) + frame.size() * mByteTime;
+    mOutgoing.push_back(Chunk { frame, mTransmitFree });
+}
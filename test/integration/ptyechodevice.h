@@ -0,0 +1,83 @@
+#ifndef PTYECHODEVICE_H
+#define PTYECHODEVICE_H
+
+#include <atomic>
+#include <deque>
+#include <thread>
+
+#include <QtCore>
+
+/**
+ * @brief A simulated microcontroller at the far end of a pseudo-terminal pair
+ *
+ * The device opens a pty master, and SerialCommunicator connects to the slave (portName()) as to any serial port.
+ * A thread decodes the frames written by the host and answers as the firmware does: VALVE, PUMP and PRESSURE
+ * commands are confirmed by a report of the new state (a pressure is reported as reached immediately), and
+ * UPTIME is answered with the time since start. Other commands are ignored.
+ *
+ * A pty transfers data as fast as the kernel copies it, so the serial line is modelled here: bytes are only
+ * taken into account once they would have been received at the configured baud rate (10 bits per byte), and
+ * replies are released at the same rate. The kernel buffer between the two fills up when the host writes faster
+ * than that, as the FIFO of a USB-serial adapter would.
+ *
+ * With listen(), the device is at the far end of a socket instead (TCP on the loopback interface, or a Unix domain
+ * socket), for TcpCommunicator and LocalSocketCommunicator; no line is modelled then, so only the protocol, the
+ * sockets and the application's own overhead are measured. One connection is served at a time.
+ */
+class PtyEchoDevice
+{
+public:
+    enum SocketType {
+        TcpSocket,
+        UnixSocket
+    };
+
+    PtyEchoDevice();
+    ~PtyEchoDevice();
+
+    bool open(int baudRate);
+    bool listen(SocketType type);
+    void close();
+
+    /// Path of the pty's slave, or address to connect to ("127.0.0.1:port", or the socket's path)
+    QString portName() const { return mPortName; }
+
+    quint64 commandsReceived() const { return mCommandsReceived.load(std::memory_order_relaxed); }
+
+private:
+    struct Chunk {
+        QByteArray data;
+        qint64 due;     // Microseconds on the steady clock
+    };
+
+    void start(qint64 byteTime);
+    void run();
+    void accept();
+    void receive(const QByteArray& data, qint64 now);
+    void handleFrame(const QByteArray& message, qint64 now);
+    void reply(const QByteArray& message, qint64 now);
+
+    static qint64 now();
+
+    int mMaster;                // The pty's master, or the connected socket (-1 until a client connects)
+    int mListener;              // Listening socket, or -1 for a pty
+    SocketType mSocketType;
+    QString mPortName;
+    qint64 mByteTime;           // Microseconds per byte on the modelled line
+
+    std::thread mThread;
+    std::atomic<bool> mStopRequested;
+    std::atomic<quint64> mCommandsReceived;
+
+    std::deque<Chunk> mIncoming;
+    std::deque<Chunk> mOutgoing;
+    qint64 mReceiveFree;        // When the modelled line will have received everything read so far
+    qint64 mTransmitFree;       // When the modelled line will have sent every reply queued so far
+    qint64 mStart;
+
+    QByteArray mFrame;
+    bool mRecording;
+    bool mEscaped;
+};
+
+#endif // PTYECHODEVICE_H
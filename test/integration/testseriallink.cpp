@@ -0,0 +1,220 @@
+#include "testseriallink.h"
+#include "ptyechodevice.h"
+#include "telemetry.h"
+
+void TestSerialLink::initTestCase()
+{
+#ifndef Q_OS_LINUX
+    QSKIP("Pseudo-terminal pairs are only set up on Linux");
+#endif
+
+    // Milliseconds per command rate; shorter steps give quicker but noisier results
+    mStepDuration = qEnvironmentVariableIsSet("UFCS_LINK_STEP_MS") ? qEnvironmentVariableIntValue("UFCS_LINK_STEP_MS") : 2000;
+
+    // Only what is on the command path; these settings belong to the test application, not the user's
+    QSettings settings;
+    settings.setValue("metrics/port", 0);
+    settings.setValue("controlSocket/enabled", false);
+    settings.setValue("sharedMemory/enabled", false);
+    settings.setValue("triggers/enabled", false);
+    settings.setValue("journal/enabled", false);
+    settings.setValue("recorder/enabled", false);
+}
+
+void TestSerialLink::cleanupTestCase()
+{
+    QSettings().remove("transport");
+
+    QTextStream out(stdout);
+    out << "\nSaturation point (commands per second):\n";
+    for (QPair<QString, int> const& s : mSaturation) {
+        out << "  " << s.first << ": "
+            << (s.second > 0 ? QString::number(s.second) : QString("not reached")) << "\n";
+    }
+
+    if (mResultFile.isEmpty())
+        return;
+
+    QFile file(mResultFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qWarning() << "Could not write results to" << mResultFile;
+        return;
+    }
+
+    QTextStream csv(&file);
+    csv << "link,baud_rate,offered_per_s,achieved_per_s,sent,confirmed,lost,p50_ms,p99_ms,max_ms\n";
+    for (Step const& s : mSteps) {
+        csv << s.link << "," << s.baudRate << "," << s.offered << "," << s.achieved << "," << s.sent << ","
+            << s.confirmed << "," << s.lost << "," << s.p50 << "," << s.p99 << "," << s.max << "\n";
+    }
+}
+
+void TestSerialLink::commandRates_data()
+{
+    QTest::addColumn<QString>("transport");
+    QTest::addColumn<int>("baudRate");
+
+    QTest::newRow("9600 baud") << QString("serial") << 9600;
+    QTest::newRow("115200 baud") << QString("serial") << 115200;
+    QTest::newRow("921600 baud") << QString("serial") << 921600;
+    QTest::newRow("tcp") << QString("tcp") << 0;
+    QTest::newRow("local") << QString("local") << 0;
+}
+
+void TestSerialLink::commandRates()
+{
+    QFETCH(QString, transport);
+    QFETCH(int, baudRate);
+    QString link = QTest::currentDataTag();
+
+    PtyEchoDevice device;
+    if (transport == "tcp")
+        QVERIFY(device.listen(PtyEchoDevice::TcpSocket));
+    else if (transport == "local")
+        QVERIFY(device.listen(PtyEchoDevice::UnixSocket));
+    else
+        QVERIFY(device.open(baudRate));
+
+    QSettings settings;
+    settings.setValue("transport/type", transport);
+    settings.setValue("transport/address", device.portName());
+    settings.setValue("serialPort", device.portName());
+    settings.setValue("baudRate", baudRate);
+
+    ApplicationController controller;
+    Communicator* communicator = controller.communicator();
+
+    // Connected after ApplicationController's own handlers, so that their cost is included
+    connect(communicator, &Communicator::valveStateChanged, this, [this](uint valveNumber, bool open) {
+        if (valveNumber > N_VALVES)
+            return;
+
+        qint64 now = telemetryClock();
+        std::deque<QPair<bool, qint64>>& pending = mPending[valveNumber];
+        while (!pending.empty()) {
+            QPair<bool, qint64> p = pending.front();
+            pending.pop_front();
+            if (p.first == open) {
+                mLatencies.record(now - p.second);
+                mConfirmed++;
+                mLastConfirmation = now;
+                break;
+            }
+            // Never confirmed: refused by a full queue, or dropped as redundant after that
+            mLost++;
+        }
+    });
+
+    controller.connect();
+    QTRY_COMPARE_WITH_TIMEOUT(communicator->getConnectionStatus(), Communicator::Connected, 5000);
+
+    for (bool& r : mRequested)
+        r = false;
+
+    QTextStream out(stdout);
+    out << "\n" << link << ":\n"
+        << "  offered/s  achieved/s      sent confirmed    lost   p50 ms   p99 ms   max ms\n";
+
+    static const int rates[] = { 25, 50, 100, 200, 400, 800, 1600, 3200, 6400, 12800, 25600, 51200 };
+    int saturation = 0;
+
+    for (int rate : rates) {
+        Step s = runStep(&controller, link, baudRate, rate);
+        mSteps << s;
+
+        out << QString("  %1 %2 %3 %4 %5 %6 %7 %8\n")
+               .arg(s.offered, 9).arg(s.achieved, 11, 'f', 1).arg(s.sent, 9).arg(s.confirmed, 9).arg(s.lost, 7)
+               .arg(s.p50, 8, 'f', 2).arg(s.p99, 8, 'f', 2).arg(s.max, 8, 'f', 2);
+        out.flush();
+
+        // At the lowest rate, every command must make the round trip
+        if (rate == rates[0]) {
+            QCOMPARE(s.lost, quint64(0));
+            QCOMPARE(s.confirmed, s.sent);
+        }
+
+        bool saturated = s.achieved < 0.9 * s.offered || s.lost > s.sent / 100;
+        if (saturated && saturation == 0)
+            saturation = rate;
+        else if (saturation > 0)
+            break;  // One step past saturation is enough to see the trend
+    }
+
+    mSaturation << qMakePair(link, saturation);
+    QVERIFY(device.commandsReceived() > 0);
+}
+
+/**
+ * @brief Send valve commands at the given rate for the step duration, then wait for the outstanding confirmations
+ */
+TestSerialLink::Step TestSerialLink::runStep(ApplicationController *controller, const QString &link, int baudRate, int rate)
+{
+    for (std::deque<QPair<bool, qint64>>& p : mPending)
+        p.clear();
+    mLatencies.reset();
+    mConfirmed = 0;
+    mLost = 0;
+
+    quint64 sent = 0;
+    uint nextValve = 1;
+    double credit = 0;
+    qint64 start = telemetryClock();
+    qint64 lastTick = start;
+    mLastConfirmation = start;
+
+    // Timers can't fire faster than every millisecond, so commands are sent in small bursts
+    QTimer ticker;
+    ticker.setTimerType(Qt::PreciseTimer);
+    ticker.setInterval(5);
+    connect(&ticker, &QTimer::timeout, this, [&] {
+        qint64 now = telemetryClock();
+        credit += rate * (now - lastTick) / 1e6;
+        lastTick = now;
+
+        while (credit >= 1) {
+            uint v = nextValve;
+            nextValve = nextValve % N_VALVES + 1;
+            mRequested[v] = !mRequested[v];
+
+            mPending[v].push_back(qMakePair(mRequested[v], telemetryClock()));
+            controller->setValve(v, mRequested[v]);
+            sent++;
+            credit -= 1;
+        }
+    });
+
+    ticker.start();
+    QTest::qWait(mStepDuration);
+    ticker.stop();
+
+    // Wait for the answers still on their way
+    QElapsedTimer drain;
+    drain.start();
+    auto outstanding = [this] {
+        for (std::deque<QPair<bool, qint64>> const& p : mPending) {
+            if (!p.empty())
+                return true;
+        }
+        return false;
+    };
+    while (outstanding() && drain.elapsed() < 3000)
+        QTest::qWait(10);
+
+    for (std::deque<QPair<bool, qint64>>& p : mPending) {
+        mLost += p.size();
+        p.clear();
+    }
+
+    Step s;
+    s.link = link;
+    s.baudRate = baudRate;
+    s.offered = rate;
+    s.sent = sent;
+    s.confirmed = mConfirmed;
+    s.lost = mLost;
+    s.achieved = mConfirmed / qMax(1e-3, (mLastConfirmation - start) / 1e6);
+    s.p50 = mLatencies.percentile(50) / 1000.;
+    s.p99 = mLatencies.percentile(99) / 1000.;
+    s.max = mLatencies.max() / 1000.;
+    return s;
+}
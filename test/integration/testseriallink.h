@@ -0,0 +1,71 @@
+#ifndef TESTSERIALLINK_H
+#define TESTSERIALLINK_H
+
+#include <deque>
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "applicationcontroller.h"
+#include "linkmonitor.h"
+
+/**
+ * @brief Measures the latency and throughput of the whole serial path, against a simulated device on a pty
+ *
+ * For each baud rate, an ApplicationController connects its SerialCommunicator to a PtyEchoDevice, then valve
+ * commands are sent through ApplicationController::setValve at increasing rates. The same is done over TCP and a
+ * Unix domain socket (TcpCommunicator and LocalSocketCommunicator), with no serial line in the way. Each command is matched with
+ * the valve report it causes, as received by the application (after ApplicationController has handled it), so
+ * the time measured covers queueing, framing, QSerialPort, the modelled serial line, decoding and the signal
+ * fan-out.
+ *
+ * For each rate, the commands confirmed per second, the round-trip time percentiles and the proportion of lost
+ * commands are printed (and saved to a CSV file, see setResultFile). The saturation point is the first rate
+ * at which fewer than 90% of the commands offered are confirmed in time.
+ */
+class TestSerialLink : public QObject
+{
+    Q_OBJECT
+
+public:
+    void setResultFile(const QString& path) { mResultFile = path; }
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void commandRates_data();
+    void commandRates();
+
+private:
+    struct Step {
+        QString link;
+        int baudRate;           // 0 for sockets
+        int offered;            // Commands per second
+        double achieved;        // Confirmed commands per second
+        quint64 sent;
+        quint64 confirmed;
+        quint64 lost;
+        double p50;             // Milliseconds
+        double p99;
+        double max;
+    };
+
+    Step runStep(ApplicationController* controller, const QString& link, int baudRate, int rate);
+
+    QString mResultFile;
+    QList<Step> mSteps;
+    QList<QPair<QString, int>> mSaturation;   // Link, saturation rate (0 if none)
+    int mStepDuration;                    // Milliseconds
+
+    /// Commands sent to each valve and not yet confirmed: requested state, send time (telemetryClock)
+    std::deque<QPair<bool, qint64>> mPending[N_VALVES + 1];
+    /// Last state requested for each valve; every command toggles it, so that none is redundant
+    bool mRequested[N_VALVES + 1];
+    LatencyHistogram mLatencies;
+    quint64 mConfirmed;
+    quint64 mLost;
+    qint64 mLastConfirmation;
+};
+
+#endif // TESTSERIALLINK_H
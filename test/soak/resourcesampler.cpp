@@ -0,0 +1,97 @@
+#include "resourcesampler.h"
+
+#include <unistd.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+ResourceSampler::ResourceSampler(QObject *parent)
+    : QObject(parent)
+    , mExpected(0)
+{
+    mProbe.setTimerType(Qt::PreciseTimer);
+    mProbe.setInterval(ProbeInterval);
+    connect(&mProbe, &QTimer::timeout, this, &ResourceSampler::onProbe);
+}
+
+void ResourceSampler::start()
+{
+    mLatencies.reset();
+    mClock.start();
+    mExpected = ProbeInterval * 1000;
+    mProbe.start();
+}
+
+void ResourceSampler::onProbe()
+{
+    qint64 now = mClock.nsecsElapsed() / 1000;
+    mLatencies.record(qMax(qint64(0), now - mExpected));
+    mExpected = now + ProbeInterval * 1000;
+}
+
+/**
+ * @brief Return the current resource use. Routine counters and the simulated time are left to the caller.
+ */
+ResourceSample ResourceSampler::sample()
+{
+    ResourceSample s;
+    s.hours = 0;
+    s.routineRuns = 0;
+    s.routineSteps = 0;
+    s.residentKiB = residentKiB();
+    s.heapKiB = heapKiB();
+    s.fileDescriptors = openFileDescriptors();
+    s.loopLatencyP99 = mLatencies.percentile(99) / 1000.;
+    s.loopLatencyMax = mLatencies.max() / 1000.;
+
+    mLatencies.reset();
+    return s;
+}
+
+/**
+ * @brief Return the resident set size of the process, in KiB, or -1 if it is unknown
+ */
+qint64 ResourceSampler::residentKiB()
+{
+    // /proc/self/statm: total size and resident size, in pages, followed by other fields
+    QFile file("/proc/self/statm");
+    if (!file.open(QIODevice::ReadOnly))
+        return -1;
+
+    QList<QByteArray> fields = file.readAll().split(' ');
+    if (fields.size() < 2)
+        return -1;
+
+    return fields[1].toLongLong() * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+/**
+ * @brief Return the memory allocated on the heap and not freed yet, in KiB, or -1 if it is unknown
+ */
+qint64 ResourceSampler::heapKiB()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return qint64(info.uordblks + info.hblkhd) / 1024;
+#elif defined(__GLIBC__)
+    // The older interface's fields are ints, which wrap around above 2 GiB
+    struct mallinfo info = mallinfo();
+    return (qint64(uint(info.uordblks)) + qint64(uint(info.hblkhd))) / 1024;
+#else
+    return -1;
+#endif
+}
+
+/**
+ * @brief Return the number of file descriptors open in the process, or -1 if it is unknown
+ */
+int ResourceSampler::openFileDescriptors()
+{
+    QDir fds("/proc/self/fd");
+    if (!fds.exists())
+        return -1;
+
+    // Includes the descriptor used to list the directory, which is constant
+    return fds.entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot).size();
+}
@@ -0,0 +1,59 @@
+#ifndef RESOURCESAMPLER_H
+#define RESOURCESAMPLER_H
+
+#include <QtCore>
+
+#include "linkmonitor.h"
+
+/**
+ * @brief Resource use of the process at one point of a soak run
+ */
+struct ResourceSample {
+    double hours;               // Simulated time since the start of the run
+    quint64 routineRuns;
+    quint64 routineSteps;
+    qint64 residentKiB;         // Resident set size
+    qint64 heapKiB;             // Bytes allocated with malloc and not freed; -1 if unknown
+    int fileDescriptors;        // -1 if unknown
+    double loopLatencyP99;      // Milliseconds, since the previous sample
+    double loopLatencyMax;
+};
+
+
+/**
+ * @brief Measures the memory, file descriptors and event loop latency of the current process
+ *
+ * Memory and file descriptors are read from /proc and from the C library's allocator statistics, so they are
+ * only available on Linux (with glibc for the heap).
+ *
+ * The event loop latency is measured by a timer firing every 10 ms in the thread the sampler lives in: each time,
+ * the delay past its expected time is recorded. sample() returns the 99th percentile and maximum since the
+ * previous sample.
+ */
+class ResourceSampler : public QObject
+{
+    Q_OBJECT
+
+public:
+    ResourceSampler(QObject* parent = nullptr);
+
+    void start();
+    ResourceSample sample();
+
+    static qint64 residentKiB();
+    static qint64 heapKiB();
+    static int openFileDescriptors();
+
+private slots:
+    void onProbe();
+
+private:
+    static const int ProbeInterval = 10;    // Milliseconds
+
+    QTimer mProbe;
+    QElapsedTimer mClock;
+    qint64 mExpected;                       // Microseconds, on mClock
+    LatencyHistogram mLatencies;
+};
+
+#endif // RESOURCESAMPLER_H
@@ -0,0 +1,74 @@
+QT += qml quick core concurrent serialport bluetooth network
+
+HEADERS += \
+    resourcesampler.h \
+    soakrunner.h \
+    ../integration/ptyechodevice.h \
+    ../../src/cpp/bluetoothcommunicator.h \
+    ../../src/cpp/serialcommunicator.h \
+    ../../src/cpp/streamcommunicator.h \
+    ../../src/cpp/communicator.h \
+    ../../src/cpp/constants.h \
+    ../../src/cpp/applicationcontroller.h \
+    ../../src/cpp/guihelper.h \
+    ../../src/cpp/routinecontroller.h \
+    ../../src/cpp/logger.h \
+    ../../src/cpp/logmodel.h \
+    ../../src/cpp/logfilemodel.h \
+    ../../src/cpp/eventjournal.h \
+    ../../src/cpp/experimentrecorder.h \
+    ../../src/cpp/telemetry.h \
+    ../../src/cpp/interlocks.h \
+    ../../src/cpp/shadowstate.h \
+    ../../src/cpp/commandsink.h \
+    ../../src/cpp/linkmonitor.h \
+    ../../src/cpp/metrics.h \
+    ../../src/cpp/controlserver.h \
+    ../../src/cpp/sharedtelemetry.h \
+    ../../src/cpp/triggerinput.h \
+    ../../src/cpp/ufcs_shm.h \
+    ../../src/cpp/tracing.h \
+    ../../src/cpp/pressureseries.h \
+    ../../src/cpp/pressurecontrolloop.h
+
+SOURCES += \
+    soak_main.cpp \
+    resourcesampler.cpp \
+    soakrunner.cpp \
+    ../integration/ptyechodevice.cpp \
+    ../../src/cpp/bluetoothcommunicator.cpp \
+    ../../src/cpp/serialcommunicator.cpp \
+    ../../src/cpp/streamcommunicator.cpp \
+    ../../src/cpp/communicator.cpp \
+    ../../src/cpp/applicationcontroller.cpp \
+    ../../src/cpp/guihelper.cpp \
+    ../../src/cpp/routinecontroller.cpp \
+    ../../src/cpp/logger.cpp \
+    ../../src/cpp/logmodel.cpp \
+    ../../src/cpp/logfilemodel.cpp \
+    ../../src/cpp/eventjournal.cpp \
+    ../../src/cpp/experimentrecorder.cpp \
+    ../../src/cpp/telemetry.cpp \
+    ../../src/cpp/interlocks.cpp \
+    ../../src/cpp/shadowstate.cpp \
+    ../../src/cpp/commandsink.cpp \
+    ../../src/cpp/linkmonitor.cpp \
+    ../../src/cpp/metrics.cpp \
+    ../../src/cpp/controlserver.cpp \
+    ../../src/cpp/sharedtelemetry.cpp \
+    ../../src/cpp/triggerinput.cpp \
+    ../../src/cpp/tracing.cpp \
+    ../../src/cpp/pressureseries.cpp \
+    ../../src/cpp/pressurecontrolloop.cpp
+
+INCLUDEPATH += ../../src/cpp/ ../integration/
+
+DEFINES += GIT_VERSION=0
+
+CONFIG += c++14
+
+# The simulated device sits behind a pseudo-terminal, and resource use is read from /proc
+!linux: error("The soak test needs Linux")
+
+# shm_open (see SharedTelemetry) is in librt with glibc older than 2.34
+linux:!android: LIBS += -lrt
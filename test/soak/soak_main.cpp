@@ -0,0 +1,67 @@
+#include "soakrunner.h"
+#include "ptyechodevice.h"
+#include "guihelper.h"
+#include "logger.h"
+
+int main(int argc, char** argv)
+{
+   QCoreApplication app(argc, argv);
+   QCoreApplication::setApplicationName("ufcs-pc-soak");
+   QCoreApplication::setOrganizationName("ufcs");
+
+   // Keep log files, journals and recordings written during the run away from the user's
+   QStandardPaths::setTestModeEnabled(true);
+
+   // -csv <file>: save the samples; the other options are read from the environment (see SoakOptions)
+   SoakOptions options = SoakOptions::fromEnvironment();
+   QStringList arguments = app.arguments();
+   int i = arguments.indexOf("-csv");
+   if (i > 0 && i + 1 < arguments.size())
+      options.resultFile = arguments[i + 1];
+
+   PtyEchoDevice device;
+   if (!device.open(115200))
+      return 2;
+
+   QSettings settings;
+   settings.setValue("serialPort", device.portName());
+   settings.setValue("baudRate", 115200);
+   settings.setValue("metrics/port", 0);
+   settings.setValue("controlSocket/enabled", false);
+   settings.setValue("sharedMemory/enabled", false);
+   settings.setValue("triggers/enabled", false);
+
+   // Small enough for the log screen's ring to fill up during the warm-up, so that a full ring is what is measured
+   settings.setValue("log/capacity", 5000);
+
+   // Set up as in the application, with the hardware the routine screen would declare
+   Logger* logger = Logger::logger();
+   qInstallMessageHandler(Logger::messageHandler);
+
+   ApplicationController controller;
+   QObject::connect(logger, &Logger::newLogForGUI, &controller, &ApplicationController::addToLog);
+
+   QList<QObject*> helpers;
+   for (int v(1); v <= 32; ++v) {
+      ValveSwitchHelper* helper = new ValveSwitchHelper();
+      controller.registerValveSwitchHelper(v, helper);
+      helpers << helper;
+   }
+   for (int p(1); p <= 2; ++p) {
+      PCHelper* helper = new PCHelper();
+      helper->setProperty("minPressure", 0.);
+      helper->setProperty("maxPressure", 30.);
+      controller.registerPCHelper(p, helper);
+      helpers << helper;
+   }
+
+   SoakRunner runner(&controller, options);
+   QObject::connect(&runner, &SoakRunner::finished, &app, &QCoreApplication::exit, Qt::QueuedConnection);
+   QTimer::singleShot(0, &runner, &SoakRunner::start);
+
+   int status = app.exec();
+
+   qInstallMessageHandler(nullptr);
+   qDeleteAll(helpers);
+   return status;
+}
@@ -0,0 +1,222 @@
+#include "soakrunner.h"
+
+static double environmentValue(const char* name, double defaultValue)
+{
+    bool ok;
+    double value = qEnvironmentVariable(name).toDouble(&ok);
+    return ok ? value : defaultValue;
+}
+
+/**
+ * @brief Read the options from UFCS_SOAK_* environment variables, with defaults simulating a day in 10 minutes
+ */
+SoakOptions SoakOptions::fromEnvironment()
+{
+    SoakOptions o;
+    o.minutes = int(environmentValue("UFCS_SOAK_MINUTES", 10));
+    o.timeScale = environmentValue("UFCS_SOAK_TIME_SCALE", 144);
+    o.sampleInterval = qMax(1, int(environmentValue("UFCS_SOAK_SAMPLE_INTERVAL", 10)));
+    o.warmUp = qBound(0., environmentValue("UFCS_SOAK_WARM_UP", 0.2), 0.9);
+
+    o.maxResidentSlope = environmentValue("UFCS_SOAK_MAX_RSS_SLOPE", 256);
+    o.maxHeapSlope = environmentValue("UFCS_SOAK_MAX_HEAP_SLOPE", 256);
+    o.maxFileDescriptorSlope = environmentValue("UFCS_SOAK_MAX_FD_SLOPE", 0.5);
+    o.maxLoopLatencySlope = environmentValue("UFCS_SOAK_MAX_LATENCY_SLOPE", 0.5);
+    return o;
+}
+
+
+SoakRunner::SoakRunner(ApplicationController *controller, const SoakOptions &options, QObject *parent)
+    : QObject(parent)
+    , mController(controller)
+    , mRoutineController(controller->routineController())
+    , mOptions(options)
+    , mRuns(0)
+    , mSteps(0)
+    , mStopping(false)
+{
+    mSampleTimer.setInterval(mOptions.sampleInterval * 1000);
+    connect(&mSampleTimer, &QTimer::timeout, this, &SoakRunner::takeSample);
+}
+
+void SoakRunner::start()
+{
+    QTextStream out(stdout);
+
+    mController->connect();
+    if (mController->communicator()->getConnectionStatus() != Communicator::Connected) {
+        out << "Could not connect to the simulated device\n";
+        emit finished(2);
+        return;
+    }
+
+    QString url = writeRoutine();
+    if (url.isEmpty() || !mRoutineController->loadFile(url) || mRoutineController->verify() != 0) {
+        out << "Could not load the soak routine:\n  " << mRoutineController->errors().join("\n  ") << "\n";
+        emit finished(2);
+        return;
+    }
+
+    mRoutineController->setTimeScale(mOptions.timeScale);
+
+    // The routine signals come from its thread, so these are queued, as for the user interface
+    connect(mRoutineController, &RoutineController::finished, this, &SoakRunner::onRoutineFinished);
+    connect(mRoutineController, &RoutineController::currentStepChanged, this, [this](int step) {
+        QStringListModel* model = mRoutineController->stepsModel();
+        model->data(model->index(step), Qt::DisplayRole);
+        mSteps++;
+    });
+
+    out << "Soak run: " << mOptions.minutes << " min at " << mOptions.timeScale << "x ("
+        << mOptions.minutes * mOptions.timeScale / 60. << " simulated hours), routine of "
+        << mRoutineController->numberOfSteps() << " steps\n"
+        << "     hours    runs     steps   RSS KiB  heap KiB   fds  loop p99 ms  loop max ms\n";
+    out.flush();
+
+    mSampler.start();
+    mClock.start();
+    takeSample();
+    mSampleTimer.start();
+    QTimer::singleShot(mOptions.minutes * 60000, this, &SoakRunner::stop);
+
+    mRoutineController->begin();
+}
+
+void SoakRunner::onRoutineFinished()
+{
+    mRuns++;
+
+    if (mStopping)
+        finish();
+    else
+        mRoutineController->begin();
+}
+
+void SoakRunner::stop()
+{
+    // The routine stops after its current step, then finished() ends the run
+    mStopping = true;
+    mRoutineController->stop();
+}
+
+void SoakRunner::takeSample()
+{
+    ResourceSample s = mSampler.sample();
+    s.hours = mClock.elapsed() / 3.6e6 * mOptions.timeScale;
+    s.routineRuns = mRuns;
+    s.routineSteps = mSteps;
+    mSamples << s;
+
+    QTextStream(stdout) << QString("%1 %2 %3 %4 %5 %6 %7 %8\n")
+                           .arg(s.hours, 10, 'f', 2).arg(s.routineRuns, 7).arg(s.routineSteps, 9)
+                           .arg(s.residentKiB, 9).arg(s.heapKiB, 9).arg(s.fileDescriptors, 5)
+                           .arg(s.loopLatencyP99, 12, 'f', 2).arg(s.loopLatencyMax, 12, 'f', 2);
+}
+
+void SoakRunner::finish()
+{
+    mSampleTimer.stop();
+    takeSample();
+
+    QTextStream out(stdout);
+
+    if (!mOptions.resultFile.isEmpty()) {
+        QFile file(mOptions.resultFile);
+        if (file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+            QTextStream csv(&file);
+            csv << "hours,routine_runs,routine_steps,rss_kib,heap_kib,fds,loop_p99_ms,loop_max_ms\n";
+            for (ResourceSample const& s : mSamples) {
+                csv << s.hours << "," << s.routineRuns << "," << s.routineSteps << "," << s.residentKiB << ","
+                    << s.heapKiB << "," << s.fileDescriptors << "," << s.loopLatencyP99 << "," << s.loopLatencyMax << "\n";
+            }
+        }
+        else
+            out << "Could not write the samples to " << mOptions.resultFile << "\n";
+    }
+
+    out << "\nGrowth per simulated hour, after the first " << int(mOptions.warmUp * 100) << "% of the run:\n";
+
+    bool ok = true;
+    ok &= checkSlope("RSS", "KiB", mOptions.maxResidentSlope, [](const ResourceSample& s) { return double(s.residentKiB); });
+    ok &= checkSlope("Heap", "KiB", mOptions.maxHeapSlope, [](const ResourceSample& s) { return double(s.heapKiB); });
+    ok &= checkSlope("File descriptors", "", mOptions.maxFileDescriptorSlope, [](const ResourceSample& s) { return double(s.fileDescriptors); });
+    ok &= checkSlope("Event loop p99", "ms", mOptions.maxLoopLatencySlope, [](const ResourceSample& s) { return s.loopLatencyP99; });
+
+    out << (ok ? "PASSED" : "FAILED") << " (" << mRuns << " routine runs, " << mSteps << " steps)\n";
+    out.flush();
+
+    emit finished(ok ? 0 : 1);
+}
+
+/**
+ * @brief Fit a line to the samples taken after the warm-up, print its slope and compare it with the limit
+ * @return False if the slope exceeds the limit. Unknown values (negative) and too short runs are not checked.
+ */
+bool SoakRunner::checkSlope(const QString &name, const QString &unit, double limit,
+                            std::function<double (const ResourceSample &)> value)
+{
+    QTextStream out(stdout);
+    out << "  " << qSetFieldWidth(18) << left << name << qSetFieldWidth(0);
+
+    int first = int(mSamples.size() * mOptions.warmUp);
+    int n = mSamples.size() - first;
+    if (n < 3 || value(mSamples.last()) < 0) {
+        out << "not measured\n";
+        return true;
+    }
+
+    double meanX = 0, meanY = 0;
+    for (int i(first); i < mSamples.size(); ++i) {
+        meanX += mSamples[i].hours;
+        meanY += value(mSamples[i]);
+    }
+    meanX /= n;
+    meanY /= n;
+
+    double covariance = 0, variance = 0;
+    for (int i(first); i < mSamples.size(); ++i) {
+        double dx = mSamples[i].hours - meanX;
+        covariance += dx * (value(mSamples[i]) - meanY);
+        variance += dx * dx;
+    }
+    double slope = variance > 0 ? covariance / variance : 0;
+
+    bool ok = slope <= limit;
+    out << QString("%1 %2/h (limit %3)  %4\n").arg(slope, 10, 'f', 3).arg(unit).arg(limit).arg(ok ? "OK" : "TOO HIGH");
+    return ok;
+}
+
+/**
+ * @brief Write the soak routine to a temporary file, and return its URL
+ *
+ * One run is about 7 minutes of routine time: each valve is opened and closed in turn, with the pressures set,
+ * ramped up and down, and waited for.
+ */
+QString SoakRunner::writeRoutine()
+{
+    QString path = mDirectory.filePath("soak.txt");
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return QString();
+
+    QTextStream stream(&file);
+    stream << "# Soak routine\n"
+           << "pressure 1 5\n"
+           << "pressure 2 10\n"
+           << "wait until pressure 1 within 0.5 timeout 30 s\n";
+
+    for (int v(1); v <= 32; ++v) {
+        stream << "valve " << v << " open\n"
+               << "wait 3 s\n"
+               << "valve " << v << " close\n"
+               << "wait 2 s\n";
+    }
+
+    stream << "ramp 1 5 15 over 60 s smooth\n"
+           << "wait until pressure 1 above 14 timeout 30 s\n"
+           << "ramp 1 15 5 over 60 s\n"
+           << "valve all close\n"
+           << "wait 1 min\n";
+
+    return QUrl::fromLocalFile(path).toString();
+}
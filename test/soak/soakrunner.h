@@ -0,0 +1,84 @@
+#ifndef SOAKRUNNER_H
+#define SOAKRUNNER_H
+
+#include <functional>
+
+#include <QtCore>
+
+#include "applicationcontroller.h"
+#include "routinecontroller.h"
+#include "resourcesampler.h"
+
+/**
+ * @brief Duration, speed and pass criteria of a soak run
+ *
+ * Slopes are fitted (least squares) to the samples taken after the warm-up, against simulated time.
+ */
+struct SoakOptions {
+    int minutes;                        // Wall-clock duration of the run
+    double timeScale;                   // Simulated time per wall-clock time (see RoutineController::setTimeScale)
+    int sampleInterval;                 // Wall-clock seconds between samples
+    double warmUp;                      // Fraction of the run during which caches, pools and rings fill up
+
+    double maxResidentSlope;            // KiB per simulated hour
+    double maxHeapSlope;                // KiB per simulated hour
+    double maxFileDescriptorSlope;      // Descriptors per simulated hour
+    double maxLoopLatencySlope;         // Milliseconds (99th percentile) per simulated hour
+
+    QString resultFile;                 // CSV file the samples are written to, if not empty
+
+    static SoakOptions fromEnvironment();
+};
+
+
+/**
+ * @brief Loops a routine through an ApplicationController for a long time, and checks that resource use is flat
+ *
+ * The routine is a typical protocol (valve sequences, setpoints, ramps, conditional waits), run again as soon as it
+ * finishes, as with "Run continuously" in the user interface. Its waits are shortened by the time scale, so that
+ * a run of a few minutes covers days of use. The step list is read at every step, as the routine screen does.
+ *
+ * Resource use is sampled at a fixed interval (see ResourceSampler). At the end, the growth of each resource per
+ * simulated hour is compared with its limit; finished() is emitted with 0 if all are within their limits, 1
+ * otherwise.
+ */
+class SoakRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    SoakRunner(ApplicationController* controller, const SoakOptions& options, QObject* parent = nullptr);
+
+public slots:
+    void start();
+
+signals:
+    void finished(int status);
+
+private slots:
+    void onRoutineFinished();
+    void takeSample();
+    void stop();
+
+private:
+    QString writeRoutine();
+    void finish();
+    bool checkSlope(const QString& name, const QString& unit, double limit,
+                    std::function<double(const ResourceSample&)> value);
+
+    ApplicationController* mController;
+    RoutineController* mRoutineController;
+    SoakOptions mOptions;
+
+    ResourceSampler mSampler;
+    QTimer mSampleTimer;
+    QElapsedTimer mClock;
+    QTemporaryDir mDirectory;
+
+    QVector<ResourceSample> mSamples;
+    quint64 mRuns;
+    quint64 mSteps;
+    bool mStopping;
+};
+
+#endif // SOAKRUNNER_H
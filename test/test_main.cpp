@@ -1,8 +1,40 @@
 #include "testroutines.h"
 #include "testcommunicator.h"
+#include "testlogmodel.h"
+#include "testlogfilemodel.h"
+#include "testeventjournal.h"
+#include "testexperimentrecorder.h"
+#include "testpressureseries.h"
+#include "testpressurecontrolloop.h"
+#include "testinterlocks.h"
+#include "testlinkmonitor.h"
+#include "testmetrics.h"
+#include "testtracing.h"
+#include "testcontrolserver.h"
+#include "testsharedtelemetry.h"
+#include "teststreamcommunicator.h"
 
 int main(int argc, char** argv)
 {
+   // Needed for queued signals, e.g. those of QFutureWatcher
+   QCoreApplication app(argc, argv);
+
+   // Journals and experiment files created by ApplicationController go to a test location
+   QStandardPaths::setTestModeEnabled(true);
+
+   // So do the settings it reads, which some tests change; test mode doesn't cover QSettings
+   QTemporaryDir settingsDirectory;
+   QSettings::setDefaultFormat(QSettings::IniFormat);
+   QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, settingsDirectory.path());
+
+   // ApplicationController mustn't open the services of a running application, which tests set up on their own
+   QSettings settings;
+   settings.setValue("metrics/port", 0);
+   settings.setValue("controlSocket/enabled", false);
+   settings.setValue("sharedMemory/enabled", false);
+   settings.setValue("triggers/enabled", false);
+   settings.sync();
+
    int status = 0;
    {
       TestCommunicator tc;
@@ -14,5 +46,70 @@ int main(int argc, char** argv)
       status |= QTest::qExec(&tc, argc, argv);
    }
 
+   {
+      TestLogModel tc;
+      status |= QTest::qExec(&tc, argc, argv);
+   }
+
+   {
+      TestLogFileModel tc;
+      status |= QTest::qExec(&tc, argc, argv);
+   }
+
+   {
+      TestEventJournal tc;
+      status |= QTest::qExec(&tc, argc, argv);
+   }
+
+   {
+      TestExperimentRecorder tc;
+      status |= QTest::qExec(&tc, argc, argv);
+   }
+
+   {
+      TestPressureSeries tc;
+      status |= QTest::qExec(&tc, argc, argv);
+   }
+
+   {
+      TestPressureControlLoop tc;
+      status |= QTest::qExec(&tc, argc, argv);
+   }
+
+   {
+      TestInterlocks tc;
+      status |= QTest::qExec(&tc, argc, argv);
+   }
+
+   {
+      TestLinkMonitor tc;
+      status |= QTest::qExec(&tc, argc, argv);
+   }
+
+   {
+      TestMetrics tc;
+      status |= QTest::qExec(&tc, argc, argv);
+   }
+
+   {
+      TestTracing tc;
+      status |= QTest::qExec(&tc, argc, argv);
+   }
+
+   {
+      TestControlServer tc;
+      status |= QTest::qExec(&tc, argc, argv);
+   }
+
+   {
+      TestSharedTelemetry tc;
+      status |= QTest::qExec(&tc, argc, argv);
+   }
+
+   {
+      TestStreamCommunicator tc;
+      status |= QTest::qExec(&tc, argc, argv);
+   }
+
    return status;
 }
@@ -1,5 +1,7 @@
 #include "testcommunicator.h"
 
+#include <thread>
+
 
 void noMessageOutput(QtMsgType, const QMessageLogContext&, const QString&)
 {}
@@ -279,6 +281,225 @@ void TestCommunicator::pressureChange()
     }
 }
 
+void TestCommunicator::commandQueue()
+{
+    QueueMockCommunicator m;
+    m.pendingBytes = Communicator::MaxPendingBytes;
+
+    // Nothing is written while the backend is busy; setpoints and status requests replace queued ones
+    m.setValve(1, true);
+    m.setPressure(1, 0.2);
+    m.setPressure(1, 0.4);
+    m.requestStatus();
+    m.requestStatus();
+    QCOMPARE(m.written.size(), 0);
+
+    QVariantMap normal = m.queueStatistics()["normal"].toMap();
+    QCOMPARE(normal["depth"].toInt(), 2);
+    QCOMPARE(normal["superseded"].toInt(), 1);
+
+    // Normal lane first, in order, then the low-priority lane
+    m.flush();
+    QCOMPARE(m.written.size(), 3);
+    QCOMPARE(uint8_t(m.written[0][1]), uint8_t(VALVE));
+    QCOMPARE(uint8_t(m.written[1][1]), uint8_t(PRESSURE));
+    QCOMPARE(uint8_t(m.written[1][5]), uint8_t(0.4 * PR_MAX_VALUE));
+    QCOMPARE(uint8_t(m.written[2][1]), uint8_t(STATUS));
+
+    // Valve commands are never merged; the lane is bounded, and senders are told when it fills up
+    QSignalSpy congestionSpy(&m, SIGNAL(congestionChanged(bool)));
+    m.written.clear();
+    m.pendingBytes = Communicator::MaxPendingBytes;
+    for (int i(0); i < Communicator::MaxQueueDepth + 2; ++i)
+        m.setValve(1 + i % 2, i % 4 < 2);
+    QCOMPARE(congestionSpy.count(), 1);
+    QCOMPARE(congestionSpy[0][0].toBool(), true);
+
+    normal = m.queueStatistics()["normal"].toMap();
+    QCOMPARE(normal["depth"].toInt(), Communicator::MaxQueueDepth);
+    QCOMPARE(normal["rejected"].toInt(), 2);
+
+    // The emergency lane doesn't wait for the backend, and discards what is queued in the other lanes, except
+    // commands closing a valve
+    m.emergencyStop();
+    QCOMPARE(m.written.size(), N_PRS + N_PUMPS);
+    QCOMPARE(m.queueStatistics()["normal"].toMap()["depth"].toInt(), Communicator::MaxQueueDepth / 2);
+
+    m.flush();
+    QVERIFY(m.written.size() > N_PRS + N_PUMPS);
+    for (int i(N_PRS + N_PUMPS); i < m.written.size(); ++i) {
+        QCOMPARE(uint8_t(m.written[i][1]), uint8_t(VALVE));
+        QCOMPARE(uint8_t(m.written[i][5]), uint8_t(0));
+    }
+}
+
+void TestCommunicator::shadowState()
+{
+    QueueMockCommunicator m;
+    Communicator& base = m;
+
+    // A command is only dropped once the device has reported the requested state
+    m.setValve(3, true);
+    m.setValve(3, true);
+    QCOMPARE(m.written.size(), 2);
+
+    base.handleCommand(VALVE, QList<QByteArray> { QByteArray(1, 3), QByteArray(1, 1) });
+    m.setValve(3, true);
+    QCOMPARE(m.written.size(), 2);
+    m.setValve(3, false);
+    QCOMPARE(m.written.size(), 3);
+    base.handleCommand(VALVE, QList<QByteArray> { QByteArray(1, 3), QByteArray(1, 0) });
+
+    uint8_t sp = 0.4 * PR_MAX_VALUE;
+    m.setPressure(1, 0.4);
+    base.handleCommand(PRESSURE, QList<QByteArray> { QByteArray(1, 1), QByteArray(1, char(sp)), QByteArray(1, 90) });
+    m.setPressure(1, 0.4);
+    QCOMPARE(m.written.size(), 4);
+
+    // Components that don't reach the requested state are reported once
+    m.setPump(1, true);
+    QSignalSpy mismatchSpy(&m, SIGNAL(stateMismatch(QString, uint)));
+    m.setMismatchTimeout(0);
+    base.checkShadowState();
+    base.checkShadowState();
+    QCOMPARE(mismatchSpy.count(), 1);
+    QCOMPARE(mismatchSpy[0][0].toString(), QString("pump"));
+    QCOMPARE(mismatchSpy[0][1].toUInt(), 1u);
+
+    // After reconnecting, the requested state is written back in a single write
+    m.written.clear();
+    m.resynchronize();
+    QCOMPARE(m.written.size(), 1);
+    QCOMPARE(m.written[0].count(char(START_BYTE)), 3);
+    QCOMPARE(m.written[0], c->frameMessage(Communicator::valveMessage(3, false))
+                           + c->frameMessage(Communicator::pumpMessage(1, true))
+                           + c->frameMessage(Communicator::pressureMessage(1, sp)));
+
+    // A safety command that couldn't be sent isn't recorded as requested
+    QList<QPair<double, double>> ranges;
+    ranges << qMakePair(0., 14.) << qMakePair(0., 14.) << qMakePair(0., 14.);
+    QVERIFY(m.interlocks().compile("if pressure 2 > 7 then close valves 6", ranges));
+    base.mConnectionStatus = Communicator::Disconnected;
+    base.handleCommand(PRESSURE, QList<QByteArray> { QByteArray(1, 2), QByteArray(1, 0), QByteArray(1, char(255)) });
+    QCOMPARE(base.mShadow.entry(ShadowState::Valve, 6)->desired, -1);
+}
+
+void TestCommunicator::commandSink()
+{
+    QueueMockCommunicator m;
+    Communicator& base = m;
+
+    // Commands submitted from another thread are sent in order, after a single wake-up
+    std::future<bool> valve, pump, pressure;
+    std::thread t([&] {
+        valve = m.commandSink().setValve(4, true);
+        pump = m.commandSink().setPump(2, true);
+        pressure = m.commandSink().setPressure(2, 1.5);
+    });
+    t.join();
+
+    QCOMPARE(m.written.size(), 0);
+    QCOMPARE(int(m.commandSink().submitted()), 3);
+    QCOMPARE(int(m.commandSink().wakeups()), 1);
+
+    QCoreApplication::processEvents();
+    QCOMPARE(m.written.size(), 2);
+    QCOMPARE(uint8_t(m.written[0][1]), uint8_t(VALVE));
+    QCOMPARE(uint8_t(m.written[1][1]), uint8_t(PUMP));
+
+    // Invalid commands are refused right away; the others resolve once the device reports the requested state
+    QVERIFY(pressure.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+    QVERIFY(!pressure.get());
+
+    // Valve 257 would be valve 1 once truncated to 8 bits
+    std::future<bool> missing = m.commandSink().setValve(257, true);
+    QVERIFY(missing.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+    QVERIFY(!missing.get());
+    QCOMPARE(int(m.commandSink().submitted()), 3);
+
+    QVERIFY(valve.wait_for(std::chrono::seconds(0)) == std::future_status::timeout);
+
+    base.handleCommand(VALVE, QList<QByteArray> { QByteArray(1, 4), QByteArray(1, 1) });
+    QVERIFY(valve.get());
+
+    // A later command for the same component means the earlier one will never be confirmed
+    m.setPump(2, false);
+    QVERIFY(!pump.get());
+
+    // A command that changes nothing is confirmed without being sent
+    std::future<bool> again = m.commandSink().setValve(4, true);
+    QCoreApplication::processEvents();
+    QCOMPARE(m.written.size(), 3);
+    QVERIFY(again.get());
+
+    // Commands discarded by an emergency stop are never confirmed, nor restored after reconnecting
+    m.pendingBytes = Communicator::MaxPendingBytes;
+    std::future<bool> dropped = m.commandSink().setValve(5, true);
+    std::future<bool> closing = m.commandSink().setValve(4, false);
+    QCoreApplication::processEvents();
+    QCOMPARE(m.written.size(), 3);
+    QVERIFY(dropped.wait_for(std::chrono::seconds(0)) == std::future_status::timeout);
+
+    m.emergencyStop();
+    QVERIFY(dropped.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+    QVERIFY(!dropped.get());
+    QCOMPARE(base.mShadow.entry(ShadowState::Valve, 5)->desired, -1);
+
+    // Closing a valve is still done
+    QVERIFY(closing.wait_for(std::chrono::seconds(0)) == std::future_status::timeout);
+    QCOMPARE(base.mShadow.entry(ShadowState::Valve, 4)->desired, 0);
+
+    m.written.clear();
+    m.pendingBytes = 0;
+    m.resynchronize();
+    QCOMPARE(m.written.size(), 1);
+    QVERIFY(!m.written[0].contains(c->frameMessage(Communicator::valveMessage(5, true))));
+    QVERIFY(m.written[0].contains(c->frameMessage(Communicator::valveMessage(4, false))));
+}
+
+void TestCommunicator::telemetry()
+{
+    // TELEMETRY commands contain the controller number, the sample interval in microseconds (4 bytes)
+    // and the samples. They are pushed to the controller's ring rather than emitted one by one.
+
+    QByteArray p1, p2, p3;
+    p1.push_back(2);
+    p2.append(QByteArrayLiteral("\x00\x00\x27\x10")); // 10 ms
+    p3.push_back(char(0));
+    p3.push_back(char(51));
+    p3.push_back(char(255));
+
+    QSignalSpy pvSpy(c, SIGNAL(pressureChanged(uint, double)));
+    c->handleCommand(TELEMETRY, QList<QByteArray> { p1, p2, p3 });
+    QCOMPARE(pvSpy.count(), 0);
+
+    SpscRing<TelemetrySample>* ring = c->telemetryRing(2);
+    QVERIFY(ring);
+    QCOMPARE(int(ring->size()), 3);
+
+    TelemetrySample samples[4];
+    QCOMPARE(int(ring->pop(samples, 4)), 3);
+    QCOMPARE(samples[0].value, 0.f);
+    QCOMPARE(samples[1].value, 0.2f);
+    QCOMPARE(samples[2].value, 1.f);
+    QCOMPARE(samples[1].timestamp - samples[0].timestamp, qint64(10000));
+    QCOMPARE(samples[2].timestamp - samples[1].timestamp, qint64(10000));
+
+    QCOMPARE(int(c->telemetryRing(1)->size()), 0);
+    QVERIFY(!c->telemetryRing(N_PRS + 1));
+
+    // The ring drops new samples rather than overwriting old ones when it is full
+    SpscRing<int> small(3);
+    QCOMPARE(int(small.capacity()), 4);
+    for (int i(0); i < 6; ++i)
+        small.push(i);
+    QCOMPARE(small.dropped(), quint64(2));
+    int out[4];
+    QCOMPARE(int(small.pop(out, 4)), 4);
+    QCOMPARE(out[0], 0);
+    QCOMPARE(out[3], 3);
+}
+
 void TestCommunicator::frameMessage()
 {
     // Messages need to be framed by a start and end byte, and any special characters
@@ -36,6 +36,12 @@ private slots:
 
     void uptime();
 
+    void telemetry();
+
+    void commandQueue();
+    void shadowState();
+    void commandSink();
+
     void parseDecodedBuffer();
     // To do:
     // void error();
@@ -52,4 +58,23 @@ public:
     CommunicatorMockApplicationController() {}
 };
 
+/// Records the messages written, and simulates a backend whose write buffer only empties on demand
+class QueueMockCommunicator : public Communicator
+{
+public:
+    QueueMockCommunicator() : Communicator(nullptr), pendingBytes(0) { mConnectionStatus = Connected; }
+    void connect() {}
+
+    void flush() { pendingBytes = 0; drainQueue(); }
+    using Communicator::setConnectionStatus;
+    using Communicator::storeLatestMeasurement;
+
+    QList<QByteArray> written;
+    qint64 pendingBytes;
+
+protected:
+    void sendMessage(QByteArray message) { written << message; pendingBytes += message.size(); }
+    qint64 bytesToWrite() const { return pendingBytes; }
+};
+
 #endif
@@ -0,0 +1,167 @@
+#include "testcontrolserver.h"
+#include "testcommunicator.h"
+
+static QString serverName()
+{
+    return "ufcs-test-control-" + QString::number(QCoreApplication::applicationPid());
+}
+
+/**
+ * @brief Send a request and wait for the message answering it
+ * @return The whole message, header included, or an empty array if none came
+ */
+QByteArray TestControlServer::request(QLocalSocket &socket, quint8 type, quint32 id, const QByteArray &payload)
+{
+    socket.write(ControlServer::message(type, id, payload));
+
+    QByteArray received;
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < 1000) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+        received += socket.readAll();
+
+        // Skip events, which may come before the reply
+        while (received.size() >= 4) {
+            int length = int(qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(received.constData())));
+            if (received.size() < 4 + length)
+                break;
+            QByteArray message = received.left(4 + length);
+            received.remove(0, 4 + length);
+            if (quint8(message[4]) != ControlServer::Event)
+                return message;
+        }
+    }
+    return QByteArray();
+}
+
+void TestControlServer::ping()
+{
+    QueueMockCommunicator m;
+    ControlServer server(&m);
+    QVERIFY(server.listen(serverName()));
+
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
+    QVERIFY(socket.waitForConnected(1000));
+
+    qint64 before = telemetryClock();
+    QByteArray reply = request(socket, ControlServer::Ping, 42);
+    QCOMPARE(reply.size(), ControlServer::HeaderSize + 8);
+    QCOMPARE(quint8(reply[4]), quint8(ControlServer::Ping | ControlServer::ReplyFlag));
+    QCOMPARE(qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(reply.constData() + 5)), quint32(42));
+
+    qint64 clock = qFromLittleEndian<qint64>(reinterpret_cast<const uchar*>(reply.constData() + ControlServer::HeaderSize));
+    QVERIFY(clock >= before && clock <= telemetryClock());
+    QCOMPARE(server.clientCount(), 1);
+}
+
+void TestControlServer::commands()
+{
+    QueueMockCommunicator m;
+    ControlServer server(&m);
+    QVERIFY(server.listen(serverName()));
+
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
+    QVERIFY(socket.waitForConnected(1000));
+
+    // Open valve 3, set controller 2 to 128, then an unknown valve, a valve value out of range, an unknown component
+    QByteArray payload = QByteArrayLiteral("\x05\x00" "\x00\x03\x01" "\x02\x02\x80" "\x00\x63\x01" "\x00\x01\x02" "\x07\x01\x01");
+    QByteArray reply = request(socket, ControlServer::Commands, 1, payload);
+    QCOMPARE(reply.mid(4, 1), QByteArray(1, char(ControlServer::Commands | ControlServer::ReplyFlag)));
+    QCOMPARE(reply.mid(ControlServer::HeaderSize), QByteArrayLiteral("\x05\x00\x00\x00\x03\x03\x03"));
+
+    // Sent in order (the messages are framed)
+    m.flush();
+    QCOMPARE(m.written.size(), 2);
+    QCOMPARE(m.written[0].mid(1, 5), QByteArrayLiteral("\x00\x01\x03\x01\x01"));
+    QCOMPARE(m.written[1].mid(1, 5), QByteArrayLiteral("\x01\x01\x02\x01\x80"));
+
+    // Refused while disconnected
+    m.setConnectionStatus(Communicator::Disconnected);
+    reply = request(socket, ControlServer::Commands, 2, QByteArrayLiteral("\x01\x00\x01\x01\x01"));
+    QCOMPARE(reply.mid(ControlServer::HeaderSize), QByteArrayLiteral("\x01\x00\x02"));
+}
+
+void TestControlServer::state()
+{
+    QueueMockCommunicator m;
+    ControlServer server(&m);
+    QVERIFY(server.listen(serverName()));
+
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
+    QVERIFY(socket.waitForConnected(1000));
+
+    m.requestState(ShadowState::Valve, 2, 1);
+
+    QByteArray reply = request(socket, ControlServer::GetState, 7);
+    QByteArray s = reply.mid(ControlServer::HeaderSize);
+    QCOMPARE(s.size(), 1 + 3 + 4 * (N_VALVES + N_PUMPS + N_PRS));
+    QCOMPARE(quint8(s[0]), quint8(Communicator::Connected));
+    QCOMPARE(quint8(s[1]), quint8(N_VALVES));
+
+    // Valve 2: requested open, not reported yet
+    const uchar* valve2 = reinterpret_cast<const uchar*>(s.constData()) + 2 + 4;
+    QCOMPARE(qFromLittleEndian<qint16>(valve2), qint16(1));
+    QCOMPARE(qFromLittleEndian<qint16>(valve2 + 2), qint16(-1));
+}
+
+void TestControlServer::events()
+{
+    QueueMockCommunicator m;
+    ControlServer server(&m);
+    QVERIFY(server.listen(serverName()));
+
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
+    QVERIFY(socket.waitForConnected(1000));
+
+    // Valves and measured pressures only
+    QByteArray mask(4, 0);
+    qToLittleEndian<quint32>(1 << ControlServer::ValveEvent | 1 << ControlServer::PressureEvent, reinterpret_cast<uchar*>(mask.data()));
+    QCOMPARE(request(socket, ControlServer::Subscribe, 3, mask).size(), ControlServer::HeaderSize);
+
+    emit m.valveStateChanged(5, true);
+    emit m.pumpStateChanged(1, true);
+    emit m.pressureChanged(2, 0.5);
+
+    QByteArray received;
+    QTRY_VERIFY((received += socket.readAll()).size() >= 2 * (ControlServer::HeaderSize + 12));
+    QCOMPARE(received.size(), 2 * (ControlServer::HeaderSize + 12));
+
+    QByteArray valve = received.mid(ControlServer::HeaderSize, 4);
+    QCOMPARE(quint8(received[4]), quint8(ControlServer::Event));
+    QCOMPARE(valve, QByteArrayLiteral("\x00\x05\x01\x00"));
+
+    QByteArray pressure = received.mid(2 * ControlServer::HeaderSize + 12, 4);
+    QCOMPARE(pressure, QByteArrayLiteral("\x03\x02\x80\x00"));
+}
+
+void TestControlServer::invalidMessages()
+{
+    QueueMockCommunicator m;
+    ControlServer server(&m);
+    QVERIFY(server.listen(serverName()));
+
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
+    QVERIFY(socket.waitForConnected(1000));
+
+    // Unknown type, and a command list whose count doesn't match its size
+    QCOMPARE(quint8(request(socket, 0x33, 1)[4]), quint8(ControlServer::ErrorReply));
+    QCOMPARE(quint8(request(socket, ControlServer::Commands, 2, QByteArrayLiteral("\x02\x00\x00\x01\x01"))[4]),
+             quint8(ControlServer::ErrorReply));
+    QVERIFY(m.written.isEmpty());
+
+    // Triggers need a routine controller
+    QCOMPARE(quint8(request(socket, ControlServer::Trigger, 3, "camera")[4]), quint8(ControlServer::ErrorReply));
+
+    // A message larger than allowed ends the connection
+    QByteArray header(4, 0);
+    qToLittleEndian<quint32>(ControlServer::MaxMessageSize + 1, reinterpret_cast<uchar*>(header.data()));
+    socket.write(header);
+    QTRY_COMPARE(socket.state(), QLocalSocket::UnconnectedState);
+    QTRY_COMPARE(server.clientCount(), 0);
+}
@@ -0,0 +1,25 @@
+#ifndef TESTCONTROLSERVER_H
+#define TESTCONTROLSERVER_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+#include <QLocalSocket>
+
+#include "controlserver.h"
+
+class TestControlServer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void ping();
+    void commands();
+    void state();
+    void events();
+    void invalidMessages();
+
+private:
+    QByteArray request(QLocalSocket& socket, quint8 type, quint32 id, const QByteArray& payload = QByteArray());
+};
+
+#endif
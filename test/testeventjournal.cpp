@@ -0,0 +1,66 @@
+#include "testeventjournal.h"
+
+void TestEventJournal::writeAndRead()
+{
+    QTemporaryDir dir;
+    QString path = dir.filePath("journal.ufj");
+
+    EventJournal journal;
+    QVERIFY(journal.open(path));
+    journal.recordValveState(3, true);
+    journal.recordPumpState(1, true);
+    journal.recordPressureMeasured(2, 0.5);
+    journal.recordPressureMeasured(2, 0.5); // unchanged, so not recorded
+    journal.recordPressureSetpoint(2, 0.25);
+    journal.recordCommandSent(QByteArray("\x01\x01\x03", 3));
+    journal.close();
+
+    JournalReader reader;
+    QVERIFY(reader.open(path));
+    QCOMPARE(reader.snapshotCount(), 1);
+
+    int n(0);
+    quint32 sequence(0);
+    reader.forEachRecord(0, reader.endTimestamp(), [&](const JournalReader::Record& r) {
+        QCOMPARE(r.sequence, sequence++);
+        n++;
+    });
+    // Initial snapshot, valve, pump, pressure, setpoint and command
+    QCOMPARE(n, 6);
+
+    JournalState state = reader.stateAt(reader.endTimestamp());
+    QCOMPARE(state.valves[2], quint8(1));
+    QCOMPARE(state.valves[0], JournalState::Unknown);
+    QCOMPARE(state.pumps[0], quint8(1));
+    QCOMPARE(state.measured[1], 0.5f);
+    QCOMPARE(state.setpoints[1], 0.25f);
+}
+
+void TestEventJournal::stateAtSnapshots()
+{
+    QTemporaryDir dir;
+    QString path = dir.filePath("journal.ufj");
+
+    // A snapshot before every record
+    EventJournal journal;
+    journal.setSnapshotInterval(0);
+    QVERIFY(journal.open(path));
+    for (int i(0); i < 10; ++i)
+        journal.recordValveState(1, i % 2);
+    journal.close();
+
+    JournalReader reader;
+    QVERIFY(reader.open(path));
+    QCOMPARE(reader.snapshotCount(), 11);
+
+    // The state just after each valve record must match what was recorded
+    std::vector<std::pair<quint64, quint8>> changes;
+    reader.forEachRecord(0, reader.endTimestamp(), [&](const JournalReader::Record& r) {
+        if (r.type == JournalValveState)
+            changes.push_back(std::make_pair(r.timestamp, r.payload[1]));
+    });
+    QCOMPARE(int(changes.size()), 10);
+
+    for (auto const& c : changes)
+        QCOMPARE(reader.stateAt(c.first).valves[0], c.second);
+}
@@ -0,0 +1,18 @@
+#ifndef TESTEVENTJOURNAL_H
+#define TESTEVENTJOURNAL_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "eventjournal.h"
+
+class TestEventJournal : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void writeAndRead();
+    void stateAtSnapshots();
+};
+
+#endif
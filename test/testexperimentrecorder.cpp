@@ -0,0 +1,53 @@
+#include "testexperimentrecorder.h"
+
+void TestExperimentRecorder::roundTrip()
+{
+    QTemporaryDir dir;
+    QString path = dir.filePath("run.ufx");
+
+    ExperimentRecorder recorder;
+    QVERIFY(recorder.start(path, QStringList() << "valve 1 open" << "wait 1"));
+
+    // More samples than fit in a chunk, so that the series spans several chunks
+    int n = ExperimentRecorder::ChunkSamples * 2 + 10;
+    for (int i(0); i < n; ++i)
+        recorder.recordPressure(2, double(i % 256) / PR_MAX_VALUE);
+    recorder.recordValveState(1, true);
+    recorder.recordValveState(1, false);
+    recorder.recordStep(0);
+    recorder.recordStep(1);
+    recorder.stop();
+    QCOMPARE(recorder.droppedSamples(), quint64(0));
+
+    ExperimentReader reader;
+    QVERIFY(reader.open(path));
+    QCOMPARE(reader.steps(), QStringList() << "valve 1 open" << "wait 1");
+    QCOMPARE(int(reader.channels().size()), 3);
+
+    ExperimentReader::Series pressure = reader.series(ExperimentPressure, 2);
+    QCOMPARE(int(pressure.values.size()), n);
+    for (int i(0); i < n; ++i)
+        QCOMPARE(pressure.values[i], qint64(i % 256));
+    for (int i(1); i < n; ++i)
+        QVERIFY(pressure.timestamps[i] >= pressure.timestamps[i-1]);
+
+    ExperimentReader::Series valve = reader.series(ExperimentValve, 1);
+    QCOMPARE(int(valve.values.size()), 2);
+    QCOMPARE(valve.values[0], qint64(1));
+    QCOMPARE(valve.values[1], qint64(0));
+
+    ExperimentReader::Series steps = reader.series(ExperimentStep, 0);
+    QCOMPARE(int(steps.values.size()), 2);
+    QCOMPARE(steps.values[1], qint64(1));
+
+    QVERIFY(reader.series(ExperimentSetpoint, 1).values.empty());
+}
+
+void TestExperimentRecorder::notRecording()
+{
+    // Samples received outside of a run are ignored
+    ExperimentRecorder recorder;
+    recorder.recordPressure(1, 0.5);
+    QVERIFY(!recorder.isRecording());
+    QCOMPARE(recorder.droppedSamples(), quint64(0));
+}
@@ -0,0 +1,18 @@
+#ifndef TESTEXPERIMENTRECORDER_H
+#define TESTEXPERIMENTRECORDER_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "experimentrecorder.h"
+
+class TestExperimentRecorder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip();
+    void notRecording();
+};
+
+#endif
@@ -0,0 +1,87 @@
+#include "testinterlocks.h"
+
+void TestInterlocks::initTestCase()
+{
+    mRanges << qMakePair(0., 14.) << qMakePair(0., 4.8) << qMakePair(0., 14.);
+}
+
+void TestInterlocks::compile()
+{
+    InterlockEngine e;
+    bool ok = e.compile("if pressure 2 > 4 then close valves 1-3 and stop\n"
+                        "valve 5 requires pressure 1 >= 7 # control layer\n"
+                        "\n"
+                        "if pressure 4 > 1 then stop\n"
+                        "valve 5 needs pressure 1 > 2\n"
+                        "if pressure 1 > 2 then close valves 40\n", mRanges);
+
+    QVERIFY(!ok);
+    QCOMPARE(e.ruleCount(), 2);
+    QCOMPARE(e.errors().size(), 3);
+    QVERIFY(e.errors()[0].startsWith("Line 4"));
+}
+
+void TestInterlocks::trigger()
+{
+    InterlockEngine e;
+    QVERIFY(e.compile("if pressure 2 > 4 then close valves 1-3 and set pressure 2 0 and stop", mRanges));
+
+    // 4 PSI out of 4.8 is 212.5 in raw units
+    std::vector<InterlockEngine::Action> actions;
+    e.onPressure(2, 212, actions);
+    QVERIFY(actions.empty());
+
+    e.onPressure(2, 213, actions);
+    QCOMPARE(int(actions.size()), 5);
+    QCOMPARE(actions[0].type, InterlockEngine::Action::CloseValve);
+    QCOMPARE(int(actions[2].number), 3);
+    QCOMPARE(actions[3].type, InterlockEngine::Action::SetPressure);
+    QCOMPARE(int(actions[3].value), 0);
+    QCOMPARE(actions[4].type, InterlockEngine::Action::StopRoutine);
+
+    // Fires once per violation
+    actions.clear();
+    e.onPressure(2, 220, actions);
+    QVERIFY(actions.empty());
+    e.onPressure(2, 200, actions);
+    e.onPressure(2, 230, actions);
+    QCOMPARE(int(actions.size()), 5);
+
+    // Other controllers don't evaluate this rule
+    actions.clear();
+    e.onPressure(1, 255, actions);
+    QVERIFY(actions.empty());
+
+    QCOMPARE(e.metrics().evaluations, quint64(6));
+    QCOMPARE(e.metrics().triggers, quint64(2));
+}
+
+void TestInterlocks::requirement()
+{
+    InterlockEngine e;
+    QVERIFY(e.compile("valve 5 requires pressure 1 >= 7", mRanges));
+
+    // 7 PSI out of 14 is 127.5 in raw units. Until the pressure is known, the valve can't be opened.
+    QVERIFY(!e.allowsValve(5, true));
+    QVERIFY(e.allowsValve(5, false));
+    QVERIFY(e.allowsValve(6, true));
+
+    std::vector<InterlockEngine::Action> actions;
+    e.onPressure(1, 128, actions);
+    QVERIFY(actions.empty());
+    QVERIFY(e.allowsValve(5, true));
+
+    // The valve is closed when the pressure drops, once
+    e.setValveState(5, true);
+    e.onPressure(1, 127, actions);
+    QCOMPARE(int(actions.size()), 1);
+    QCOMPARE(actions[0].type, InterlockEngine::Action::CloseValve);
+    QCOMPARE(int(actions[0].number), 5);
+    e.onPressure(1, 120, actions);
+    QCOMPARE(int(actions.size()), 1);
+
+    // And again if it is reported open anyway
+    e.onValveState(5, true, actions);
+    QCOMPARE(int(actions.size()), 2);
+    QVERIFY(!e.allowsValve(5, true));
+}
@@ -0,0 +1,23 @@
+#ifndef TESTINTERLOCKS_H
+#define TESTINTERLOCKS_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "interlocks.h"
+
+class TestInterlocks : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void compile();
+    void trigger();
+    void requirement();
+
+private:
+    QList<QPair<double, double>> mRanges;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include "testlinkmonitor.h"
+#include "testcommunicator.h"
+
+void TestLinkMonitor::histogram()
+{
+    LatencyHistogram h;
+    QCOMPARE(h.percentile(50), qint64(0));
+
+    for (qint64 v(1); v <= 1000; ++v)
+        h.record(v);
+
+    QCOMPARE(int(h.count()), 1000);
+    QCOMPARE(h.max(), qint64(1000));
+    QCOMPARE(h.percentile(100), qint64(1000));
+
+    // Within one sub-bucket (1/16) of the exact value, never below it
+    QVERIFY(h.percentile(50) >= 500 && h.percentile(50) <= 500 * 17 / 16);
+    QVERIFY(h.percentile(99) >= 990 && h.percentile(99) <= 1000);
+
+    // Small values are exact; very large ones are counted, not dropped
+    h.reset();
+    h.record(7);
+    h.record(qint64(1) << 40);
+    QCOMPARE(h.percentile(50), qint64(7));
+    QCOMPARE(h.percentile(100), qint64(1) << 40);
+}
+
+void TestLinkMonitor::roundTrip()
+{
+    QueueMockCommunicator m;
+    Communicator& base = m;
+    LinkMonitor monitor(&m);
+
+    // Each command is matched with the first report of the requested state for the same component
+    m.setValve(5, true);
+    m.setPressure(2, 0.5);
+    QCOMPARE(int(monitor.mPending.size()), 2);
+
+    base.handleCommand(VALVE, QList<QByteArray> { QByteArray(1, 5), QByteArray(1, 0) });
+    QCOMPARE(int(monitor.mPending.size()), 2);
+    base.handleCommand(VALVE, QList<QByteArray> { QByteArray(1, 5), QByteArray(1, 1) });
+    uint8_t sp = 0.5 * PR_MAX_VALUE;
+    base.handleCommand(PRESSURE, QList<QByteArray> { QByteArray(1, 2), QByteArray(1, char(sp)), QByteArray(1, 0) });
+    QCOMPARE(int(monitor.mPending.size()), 0);
+
+    m.requestUptime();
+    base.handleCommand(UPTIME, QList<QByteArray> { QByteArray(4, 0) });
+
+    QSignalSpy statisticsSpy(&monitor, SIGNAL(statisticsChanged()));
+    monitor.report();
+    QCOMPARE(statisticsSpy.count(), 1);
+    QVERIFY(monitor.isHealthy());
+
+    QVariantMap valve = monitor.statistics()["valve"].toMap();
+    QCOMPARE(valve["sent"].toInt(), 1);
+    QCOMPARE(valve["confirmed"].toInt(), 1);
+    QCOMPARE(valve["lost"].toInt(), 0);
+    QVERIFY(valve["max"].toDouble() >= valve["p50"].toDouble());
+    QCOMPARE(monitor.statistics()["pressure"].toMap()["confirmed"].toInt(), 1);
+    QCOMPARE(monitor.statistics()["heartbeat"].toMap()["confirmed"].toInt(), 1);
+
+    // Statistics are per interval
+    monitor.report();
+    QCOMPARE(monitor.statistics()["valve"].toMap()["sent"].toInt(), 0);
+}
+
+void TestLinkMonitor::loss()
+{
+    QueueMockCommunicator m;
+    LinkMonitor monitor(&m);
+    monitor.setConfirmationTimeout(0);
+
+    QSignalSpy warningSpy(&monitor, SIGNAL(linkWarning(QString)));
+    QSignalSpy healthSpy(&monitor, SIGNAL(healthChanged(bool)));
+
+    // An unanswered heartbeat is reported straight away
+    m.requestUptime();
+    monitor.expirePending();
+    QCOMPARE(warningSpy.count(), 1);
+    QCOMPARE(healthSpy.count(), 1);
+    QVERIFY(!monitor.isHealthy());
+
+    // Unconfirmed commands count as lost at the end of the interval
+    m.setPump(1, true);
+    monitor.report();
+    QCOMPARE(monitor.statistics()["pump"].toMap()["lost"].toInt(), 1);
+    QCOMPARE(monitor.statistics()["heartbeat"].toMap()["lost"].toInt(), 1);
+    QVERIFY(!monitor.isHealthy());
+    QCOMPARE(warningSpy.count(), 3);
+
+    // And the link is healthy again after a clean interval
+    monitor.report();
+    QVERIFY(monitor.isHealthy());
+    QCOMPARE(healthSpy.count(), 2);
+}
@@ -0,0 +1,19 @@
+#ifndef TESTLINKMONITOR_H
+#define TESTLINKMONITOR_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "linkmonitor.h"
+
+class TestLinkMonitor : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void histogram();
+    void roundTrip();
+    void loss();
+};
+
+#endif
@@ -0,0 +1,172 @@
+#include "testlogfilemodel.h"
+#include "logmodel.h"
+
+namespace {
+
+const QByteArray Log =
+        "2024-05-02 10:00:00.000 Info: Starting\n"
+        "2024-05-02 10:00:00.100 Debug: Connecting\n"
+        "2024-05-02 10:00:01.000 Warning: Multi-line\n"
+        "second line\n"
+        "2024-05-02 10:00:02.000 Critical error: Disconnected\n"
+        "2024-05-02 10:00:03.000 Info: Done\n";
+
+void writeFile(const QString& path, const QByteArray& contents)
+{
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(contents);
+}
+
+QString message(const LogFileModel& m, int row)
+{
+    return m.data(m.index(row), LogModel::MessageRole).toString();
+}
+
+}
+
+void TestLogFileModel::buildAndReloadIndex()
+{
+    QTemporaryDir dir;
+    QString path = dir.filePath("ufcs.log");
+    writeFile(path, Log);
+
+    // The first time, the index is built in the background, then saved next to the log file
+    LogFileModel m;
+    QVERIFY(m.open(path));
+    QVERIFY(m.isIndexing());
+    QTRY_VERIFY(!m.isIndexing());
+    QVERIFY(QFile::exists(path + ".idx"));
+
+    QCOMPARE(m.rowCount(), 6);
+    QCOMPARE(m.fileName(), QString("ufcs.log"));
+    QCOMPARE(m.data(m.index(0), LogModel::TimeRole).toString(), QString("2024-05-02 10:00:00.000"));
+    QCOMPARE(m.data(m.index(0), LogModel::TypeRole).toString(), QString("Info"));
+    QCOMPARE(message(m, 0), QString("Starting"));
+    QCOMPARE(m.data(m.index(4), LogModel::TypeRole).toString(), QString("Critical error"));
+    QCOMPARE(m.data(m.index(4), LogModel::LevelRole).toInt(), int(LogModel::ErrorLevel));
+
+    // The second time, the saved index is used right away
+    m.close();
+    QCOMPARE(m.rowCount(), 0);
+    QVERIFY(m.open(path));
+    QVERIFY(!m.isIndexing());
+    QCOMPARE(m.rowCount(), 6);
+    QCOMPARE(message(m, 5), QString("Done"));
+}
+
+void TestLogFileModel::continuationLines()
+{
+    QTemporaryDir dir;
+    QString path = dir.filePath("ufcs.log");
+    writeFile(path, Log);
+
+    LogFileModel m;
+    QVERIFY(m.open(path));
+    QTRY_VERIFY(!m.isIndexing());
+
+    // Lines that don't start with a timestamp take the level of the message they belong to
+    QCOMPARE(message(m, 3), QString("second line"));
+    QCOMPARE(m.data(m.index(3), LogModel::LevelRole).toInt(), int(LogModel::WarningLevel));
+    QCOMPARE(m.data(m.index(3), LogModel::TimeRole).toString(), QString());
+    QCOMPARE(m.data(m.index(3), LogModel::TypeRole).toString(), QString());
+}
+
+void TestLogFileModel::levelFilter()
+{
+    QTemporaryDir dir;
+    QString path = dir.filePath("ufcs.log");
+    writeFile(path, Log);
+
+    LogFileModel m;
+    QVERIFY(m.open(path));
+    QTRY_VERIFY(!m.isIndexing());
+
+    QSignalSpy countSpy(&m, SIGNAL(countChanged(int)));
+    m.setShowDebug(false);
+    m.setShowInfo(false);
+    QCOMPARE(m.rowCount(), 3);
+    QCOMPARE(countSpy.count(), 2);
+    QCOMPARE(message(m, 0), QString("Multi-line"));
+    QCOMPARE(message(m, 1), QString("second line"));
+    QCOMPARE(message(m, 2), QString("Disconnected"));
+
+    // The filter is kept when the file is opened again
+    m.close();
+    QVERIFY(m.open(path));
+    QVERIFY(!m.isIndexing());
+    QCOMPARE(m.rowCount(), 3);
+
+    m.setShowInfo(true);
+    QCOMPARE(m.rowCount(), 5);
+    QCOMPARE(message(m, 0), QString("Starting"));
+}
+
+void TestLogFileModel::staleIndex()
+{
+    QTemporaryDir dir;
+    QString path = dir.filePath("ufcs.log");
+    writeFile(path, Log);
+
+    LogFileModel m;
+    QVERIFY(m.open(path));
+    QTRY_VERIFY(!m.isIndexing());
+    m.close();
+
+    // A log file that was truncated or rotated since it was indexed is indexed again
+    writeFile(path, Log.left(Log.indexOf("second line")));
+    QVERIFY(m.open(path));
+    QVERIFY(m.isIndexing());
+    QTRY_VERIFY(!m.isIndexing());
+    QCOMPARE(m.rowCount(), 3);
+    m.close();
+
+    // So is one whose index points past its end, even though the index header matches it
+    QFile index(path + ".idx");
+    QVERIFY(index.open(QIODevice::ReadWrite));
+    quint64 lineCount;
+    QVERIFY(index.seek(24));
+    QCOMPARE(index.read(reinterpret_cast<char*>(&lineCount), sizeof(lineCount)), qint64(sizeof(lineCount)));
+    QCOMPARE(lineCount, quint64(3));
+    quint64 offset = Log.size();
+    QVERIFY(index.seek(32 + sizeof(quint64)));
+    index.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+    index.close();
+
+    QVERIFY(m.open(path));
+    QVERIFY(m.isIndexing());
+    QTRY_VERIFY(!m.isIndexing());
+    QCOMPARE(m.rowCount(), 3);
+    QCOMPARE(message(m, 1), QString("Connecting"));
+}
+
+void TestLogFileModel::reopenWhileIndexing()
+{
+    QTemporaryDir dir;
+    QString first = dir.filePath("first.log");
+    QString second = dir.filePath("second.log");
+    writeFile(first, Log);
+    writeFile(second, "2024-05-03 09:00:00.000 Info: Other session\n");
+
+    LogFileModel m;
+    QVERIFY(m.open(second));
+    QTRY_VERIFY(!m.isIndexing());
+    QFile secondIndex(second + ".idx");
+    QVERIFY(secondIndex.open(QIODevice::ReadOnly));
+    QByteArray savedIndex = secondIndex.readAll();
+    secondIndex.close();
+
+    // The first file's index is still being built (or its result not delivered yet) when the second one is opened
+    QVERIFY(m.open(first));
+    QVERIFY(m.isIndexing());
+    QVERIFY(m.open(second));
+    QVERIFY(!m.isIndexing());
+
+    // Its result must not be applied to the second file, nor saved as its index
+    QTest::qWait(50);
+    QCoreApplication::processEvents();
+    QCOMPARE(m.rowCount(), 1);
+    QCOMPARE(message(m, 0), QString("Other session"));
+    QVERIFY(secondIndex.open(QIODevice::ReadOnly));
+    QCOMPARE(secondIndex.readAll(), savedIndex);
+}
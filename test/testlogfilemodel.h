@@ -0,0 +1,21 @@
+#ifndef TESTLOGFILEMODEL_H
+#define TESTLOGFILEMODEL_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "logfilemodel.h"
+
+class TestLogFileModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void buildAndReloadIndex();
+    void continuationLines();
+    void levelFilter();
+    void staleIndex();
+    void reopenWhileIndexing();
+};
+
+#endif
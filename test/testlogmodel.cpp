@@ -0,0 +1,98 @@
+#include "testlogmodel.h"
+
+void TestLogModel::ringEviction()
+{
+    // Once the capacity is reached, the oldest messages are dropped
+    LogModel m(3);
+
+    for (int i(0); i < 5; ++i)
+        m.append(QStringList() << "00:00:00.000" << "Info" << QString::number(i));
+
+    QCOMPARE(m.rowCount(), 3);
+    QCOMPARE(m.firstSequence(), quint64(2));
+    QCOMPARE(m.endSequence(), quint64(5));
+    QCOMPARE(m.data(m.index(0), LogModel::MessageRole).toString(), QString("2"));
+    QCOMPARE(m.data(m.index(2), LogModel::MessageRole).toString(), QString("4"));
+}
+
+void TestLogModel::levelFilter()
+{
+    LogModel m(100);
+    LogFilterModel f(&m);
+
+    m.append(QStringList() << "t" << "Info" << "a");
+    m.append(QStringList() << "t" << "Warning" << "b");
+    m.append(QStringList() << "t" << "Debug" << "c");
+    m.append(QStringList() << "t" << "Critical error" << "d");
+    m.append(QStringList() << "t" << "Info" << "e");
+
+    QCOMPARE(f.rowCount(), 5);
+
+    // Warnings and errors only
+    f.setShowDebug(false);
+    f.setShowInfo(false);
+    QCOMPARE(f.rowCount(), 2);
+    QCOMPARE(f.data(f.index(0), LogModel::MessageRole).toString(), QString("b"));
+    QCOMPARE(f.data(f.index(1), LogModel::MessageRole).toString(), QString("d"));
+
+    // Messages appended afterwards are filtered as they arrive
+    m.append(QStringList() << "t" << "Info" << "f");
+    m.append(QStringList() << "t" << "Warning" << "g");
+    QCOMPARE(f.rowCount(), 3);
+    QCOMPARE(f.data(f.index(2), LogModel::MessageRole).toString(), QString("g"));
+
+    // Re-enabling a level restores the original order
+    f.setShowInfo(true);
+    QCOMPARE(f.rowCount(), 6);
+    QCOMPARE(f.data(f.index(0), LogModel::MessageRole).toString(), QString("a"));
+    QCOMPARE(f.data(f.index(4), LogModel::MessageRole).toString(), QString("f"));
+}
+
+void TestLogModel::levelFilterWithEviction()
+{
+    LogModel m(4);
+    LogFilterModel f(&m);
+    f.setShowInfo(false);
+
+    m.append(QStringList() << "t" << "Warning" << "a");
+    m.append(QStringList() << "t" << "Info" << "b");
+    m.append(QStringList() << "t" << "Info" << "c");
+    m.append(QStringList() << "t" << "Warning" << "d");
+    QCOMPARE(f.rowCount(), 2);
+
+    // Evicts "a"
+    m.append(QStringList() << "t" << "Info" << "e");
+    QCOMPARE(f.rowCount(), 1);
+    QCOMPARE(f.data(f.index(0), LogModel::MessageRole).toString(), QString("d"));
+
+    f.setShowInfo(true);
+    QCOMPARE(f.rowCount(), 4);
+    QCOMPARE(f.data(f.index(0), LogModel::MessageRole).toString(), QString("b"));
+}
+
+void TestLogModel::textFilter()
+{
+    LogModel m(100);
+    LogFilterModel f(&m);
+
+    m.append(QStringList() << "t" << "Info" << "Valve 3 opened");
+    m.append(QStringList() << "t" << "Info" << "Pump 1 switched on");
+    m.append(QStringList() << "t" << "Warning" << "Valve 4 closed");
+
+    // The search runs in a separate thread; the result is applied once the event loop runs
+    f.setSearchText("valve");
+    QTRY_COMPARE(f.rowCount(), 2);
+    QVERIFY(!f.isSearching());
+
+    m.append(QStringList() << "t" << "Info" << "VALVE 5 opened");
+    m.append(QStringList() << "t" << "Info" << "Uptime");
+    QCOMPARE(f.rowCount(), 3);
+
+    f.setShowInfo(false);
+    QCOMPARE(f.rowCount(), 1);
+    QCOMPARE(f.data(f.index(0), LogModel::MessageRole).toString(), QString("Valve 4 closed"));
+
+    f.setShowInfo(true);
+    f.setSearchText(QString());
+    QCOMPARE(f.rowCount(), 5);
+}
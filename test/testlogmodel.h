@@ -0,0 +1,20 @@
+#ifndef TESTLOGMODEL_H
+#define TESTLOGMODEL_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "logmodel.h"
+
+class TestLogModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void ringEviction();
+    void levelFilter();
+    void levelFilterWithEviction();
+    void textFilter();
+};
+
+#endif
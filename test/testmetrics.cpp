@@ -0,0 +1,97 @@
+#include "testmetrics.h"
+#include "testcommunicator.h"
+
+void TestMetrics::registry()
+{
+    MetricsRegistry* r = MetricsRegistry::registry();
+
+    MetricsRegistry::Metric& a = r->counter("test_requests_total", "Requests", "kind=\"a\"");
+    MetricsRegistry::Metric& b = r->counter("test_requests_total", "Requests", "kind=\"b\"");
+    QCOMPARE(&r->counter("test_requests_total", "Requests", "kind=\"a\""), &a);
+
+    a.increment();
+    a.increment(2);
+    b.increment();
+
+    MetricsRegistry::Metric& g = r->gauge("test_depth", "Depth");
+    g.set(5);
+    g.setMax(3);
+    QCOMPARE(g.value(), qint64(5));
+    g.setMax(8);
+    QCOMPARE(g.value(), qint64(8));
+
+    // One HELP and TYPE line per name, then one line per set of labels
+    QByteArray text = r->prometheusText();
+    QCOMPARE(text.count("# TYPE test_requests_total counter\n"), 1);
+    QVERIFY(text.contains("test_requests_total{kind=\"a\"} 3\n"));
+    QVERIFY(text.contains("test_requests_total{kind=\"b\"} 1\n"));
+    QVERIFY(text.contains("# TYPE test_depth gauge\ntest_depth 8\n"));
+
+    QTemporaryDir dir;
+    QString path = dir.path() + "/metrics.prom";
+    QVERIFY(r->dump(path));
+    QFile f(path);
+    QVERIFY(f.open(QIODevice::ReadOnly));
+    QVERIFY(f.readAll().contains("test_depth 8"));
+}
+
+void TestMetrics::communicatorCounters()
+{
+    MetricsRegistry* r = MetricsRegistry::registry();
+    QueueMockCommunicator m;
+    Communicator& base = m;
+
+    qint64 decoded = r->counter("ufcs_frames_decoded_total", "").value();
+    qint64 unknown = r->counter("ufcs_frames_rejected_total", "", "reason=\"unknown_command\"").value();
+    qint64 incomplete = r->counter("ufcs_frames_rejected_total", "", "reason=\"incomplete_parameter\"").value();
+    qint64 received = r->counter("ufcs_bytes_received_total", "").value();
+    qint64 sent = r->counter("ufcs_bytes_sent_total", "").value();
+
+    // A valid frame, a frame with an unknown command, and one whose parameter is cut short
+    QByteArray valid = QByteArrayLiteral("\xFA\x00\x01\x03\x01\x01\xFB");
+    base.mBuffer = valid + QByteArrayLiteral("\xFA\xF0\x01\xFB");
+    base.parseDecodedBuffer(base.decodeBuffer());
+    base.decodeBuffer();
+    base.parseDecodedBuffer(QByteArrayLiteral("\x00\x01\x03\x05"));
+
+    QCOMPARE(r->counter("ufcs_frames_decoded_total", "").value() - decoded, qint64(1));
+    QCOMPARE(r->counter("ufcs_frames_rejected_total", "", "reason=\"unknown_command\"").value() - unknown, qint64(1));
+    QCOMPARE(r->counter("ufcs_frames_rejected_total", "", "reason=\"incomplete_parameter\"").value() - incomplete, qint64(1));
+    QVERIFY(r->counter("ufcs_bytes_received_total", "").value() - received >= valid.size());
+
+    // Bytes written include framing; queued commands show in the queue depth
+    m.setValve(1, true);
+    QCOMPARE(r->counter("ufcs_bytes_sent_total", "").value() - sent, qint64(m.written[0].size()));
+
+    m.pendingBytes = Communicator::MaxPendingBytes;
+    m.setValve(2, true);
+    QCOMPARE(r->gauge("ufcs_command_queue_depth", "", "lane=\"normal\"").value(), qint64(1));
+    m.flush();
+    QCOMPARE(r->gauge("ufcs_command_queue_depth", "", "lane=\"normal\"").value(), qint64(0));
+}
+
+void TestMetrics::server()
+{
+    MetricsRegistry::registry()->counter("test_served_total", "Served").increment();
+
+    MetricsServer server;
+    QVERIFY(server.listen(0));
+
+    QTcpSocket socket;
+    QByteArray response;
+    connect(&socket, &QTcpSocket::readyRead, [&] { response += socket.readAll(); });
+    socket.connectToHost(QHostAddress::LocalHost, server.serverPort());
+    QVERIFY(socket.waitForConnected(1000));
+    socket.write("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+
+    QTRY_VERIFY(response.contains("test_served_total 1"));
+    QVERIFY(response.startsWith("HTTP/1.0 200 OK"));
+
+    QTcpSocket other;
+    QByteArray notFound;
+    connect(&other, &QTcpSocket::readyRead, [&] { notFound += other.readAll(); });
+    other.connectToHost(QHostAddress::LocalHost, server.serverPort());
+    QVERIFY(other.waitForConnected(1000));
+    other.write("GET /other HTTP/1.1\r\n\r\n");
+    QTRY_VERIFY(notFound.startsWith("HTTP/1.0 404"));
+}
@@ -0,0 +1,19 @@
+#ifndef TESTMETRICS_H
+#define TESTMETRICS_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "metrics.h"
+
+class TestMetrics : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void registry();
+    void communicatorCounters();
+    void server();
+};
+
+#endif
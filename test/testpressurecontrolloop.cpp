@@ -0,0 +1,100 @@
+#include "testpressurecontrolloop.h"
+#include "testcommunicator.h"
+
+namespace {
+
+/// Regulator that only reaches 80% of its setpoint, with a first-order lag of 0.1 s
+struct LossyRegulator {
+    double pressure = 0;
+
+    double step(double setpoint, double dt)
+    {
+        pressure += (0.8 * setpoint - pressure) * dt / 0.1;
+        return pressure;
+    }
+};
+
+}
+
+void TestPressureControlLoop::converges()
+{
+    PiController pi;
+    pi.slewRate = 0;
+    LossyRegulator plant;
+
+    const double dt = 0.02;
+    double measured = 0;
+    for (int i(0); i < 1000; ++i)
+        measured = plant.step(pi.update(0.4, measured, dt), dt);
+
+    // Open-loop, the pressure would settle at 0.32
+    QVERIFY(qAbs(measured - 0.4) < 1e-3);
+    QVERIFY(qAbs(pi.output - 0.5) < 1e-3);
+}
+
+void TestPressureControlLoop::antiWindup()
+{
+    PiController pi;
+    pi.slewRate = 0;
+
+    // Unreachable target: the output saturates, and the integral must not keep growing
+    for (int i(0); i < 1000; ++i)
+        pi.update(1, 0, 0.02);
+    QCOMPARE(pi.output, 1.);
+    QVERIFY(pi.integral <= 1.);
+
+    // As soon as the target is reachable again, the output comes down
+    pi.update(0.2, 0.5, 0.02);
+    QVERIFY(pi.output < 1.);
+}
+
+void TestPressureControlLoop::slewRate()
+{
+    PiController pi;
+    pi.slewRate = 0.5;
+    pi.reset(0.2);
+
+    // Bumpless: no error, no change
+    QCOMPARE(pi.update(0.3, 0.3, 0.02), 0.2);
+
+    // 0.5 per second, so at most 0.01 per 20 ms
+    double previous = pi.output;
+    for (int i(0); i < 50; ++i) {
+        double output = pi.update(1, 0, 0.02);
+        QVERIFY(output - previous <= 0.01 + 1e-12);
+        previous = output;
+    }
+    QVERIFY(qAbs(previous - 0.7) < 1e-9);
+}
+
+void TestPressureControlLoop::newSamplesOnly()
+{
+    QueueMockCommunicator m;
+    PressureControlLoop loop(&m, 100);
+    loop.setSlewRate(1, 0);
+
+    // Queued to this thread, as the loop emits from its own
+    QList<double> setpoints;
+    connect(&loop, &PressureControlLoop::setPressure, this, [&](uint, double pressure) { setpoints << pressure; });
+
+    m.storeLatestMeasurement(1, 0);
+    loop.setEnabled(1, true, 0.2);
+    loop.setTarget(1, 0.6);
+
+    // One measurement, however many iterations: the error is integrated once
+    QTRY_COMPARE(setpoints.size(), 1);
+    QTest::qWait(200);
+    QCOMPARE(setpoints.size(), 1);
+
+    m.storeLatestMeasurement(1, 10);
+    QTRY_COMPARE(setpoints.size(), 2);
+    QTest::qWait(100);
+    QCOMPARE(setpoints.size(), 2);
+
+    // With no controller enabled, the thread doesn't iterate
+    loop.setEnabled(1, false);
+    QTest::qWait(50);
+    loop.statistics();
+    QTest::qWait(200);
+    QVERIFY(loop.statistics()["iterations"].toULongLong() <= 1);
+}
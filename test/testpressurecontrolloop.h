@@ -0,0 +1,20 @@
+#ifndef TESTPRESSURECONTROLLOOP_H
+#define TESTPRESSURECONTROLLOOP_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "pressurecontrolloop.h"
+
+class TestPressureControlLoop : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void converges();
+    void antiWindup();
+    void slewRate();
+    void newSamplesOnly();
+};
+
+#endif
@@ -0,0 +1,58 @@
+#include "testpressureseries.h"
+
+void TestPressureSeries::tiers()
+{
+    // 10 points per second for 2 minutes and a bit
+    PressureSeries s(1);
+    for (int i(0); i < 1210; ++i)
+        s.append(i * 100, (i / 10) % 2);
+
+    QCOMPARE(s.tierSize(PressureSeries::RawTier), 1210);
+
+    // Complete seconds only; the 121st is still being averaged
+    QCOMPARE(s.tierSize(PressureSeries::SecondTier), 120);
+    QCOMPARE(s.tierSize(PressureSeries::MinuteTier), 2);
+
+    std::vector<PressurePoint> seconds = s.window(0, 5000, 0);
+    QVERIFY(!seconds.empty());
+}
+
+void TestPressureSeries::windowTier()
+{
+    PressureSeries s(1);
+    for (int i(0); i < 40000; ++i)
+        s.append(i * 100, 0.5);
+
+    // The raw tier only holds the last 30000 points (3000 s), so older windows come from the seconds tier
+    std::vector<PressurePoint> recent = s.window(3900000, 4000000, 0);
+    QCOMPARE(int(recent.size()), 1000);
+
+    std::vector<PressurePoint> old = s.window(0, 100000, 0);
+    QCOMPARE(int(old.size()), 100);
+    QCOMPARE(old[0].time, qint64(500));
+    QCOMPARE(old[0].measured, 0.5f);
+
+    // Downsampled to the requested number of points
+    QCOMPARE(int(s.window(0, 4000000, 500).size()), 500);
+}
+
+void TestPressureSeries::downsample()
+{
+    std::vector<PressurePoint> points;
+    for (int i(0); i < 10000; ++i)
+        points.push_back(PressurePoint { i, i == 5000 ? 1.f : 0.f, 0.f });
+
+    std::vector<PressurePoint> reduced = PressureSeries::downsample(points, 100);
+    QCOMPARE(int(reduced.size()), 100);
+    QCOMPARE(reduced.front().time, qint64(0));
+    QCOMPARE(reduced.back().time, qint64(9999));
+
+    // The single peak must survive
+    bool foundPeak = false;
+    for (auto const& p : reduced)
+        foundPeak |= (p.measured == 1.f);
+    QVERIFY(foundPeak);
+
+    // Nothing to do if there are fewer points than the threshold
+    QCOMPARE(int(PressureSeries::downsample(points, 20000).size()), 10000);
+}
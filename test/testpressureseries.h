@@ -0,0 +1,19 @@
+#ifndef TESTPRESSURESERIES_H
+#define TESTPRESSURESERIES_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "pressureseries.h"
+
+class TestPressureSeries : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void tiers();
+    void windowTier();
+    void downsample();
+};
+
+#endif
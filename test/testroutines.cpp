@@ -1,5 +1,9 @@
 #include "testroutines.h"
 
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
 void TestRoutines::initTestCase()
 {
     mTempFileLocation = "file:./dummyroutine.txt";
@@ -55,6 +59,238 @@ void TestRoutines::testRunning()
     QCOMPARE(pressureSpy[1][1].toDouble(), 3.1/30);
 }
 
+void TestRoutines::testRamp()
+{
+    QString url = "file:./dummyramp.txt";
+    QFile file(QUrl(url).toLocalFile());
+    file.open(QIODevice::WriteOnly);
+    file.write("ramp 1 0 30 over 1000 ms\n"
+               "ramp 2 10 5 over 1 seconds smooth\n"
+               "ramp 1 0 30 over 1 fortnight\n"
+               "ramp 1 0 45 over 1\n"
+               "ramp 1 0 10 in 1\n");
+    file.close();
+
+    QSignalSpy errorSpy(r, SIGNAL(error(QString)));
+    r->loadFile(url);
+    r->verify();
+
+    QCOMPARE(r->numberOfSteps(), 2);
+    QCOMPARE(errorSpy.count(), 3);
+    QCOMPARE(r->totalRunTime(), 2L);
+
+    QSignalSpy pressureSpy(r, SIGNAL(setPressure(uint, double)));
+    QSignalSpy rampSpy(r, SIGNAL(rampCompleted(int, QVariantMap)));
+    r->begin();
+
+    while(r->status() != RoutineController::Finished)
+        QTest::qSleep(100);
+
+    QCOMPARE(rampSpy.count(), 2);
+
+    // Setpoints are only sent when they change, and each ramp ends exactly on its target
+    QVERIFY(pressureSpy.count() > 2);
+    for (int i(1); i < pressureSpy.count(); ++i)
+        QVERIFY(pressureSpy[i][1].toDouble() != pressureSpy[i-1][1].toDouble() || pressureSpy[i][0] != pressureSpy[i-1][0]);
+    QCOMPARE(pressureSpy.last()[1].toDouble(), qRound(5./30 * PR_MAX_VALUE) / double(PR_MAX_VALUE));
+}
+void TestRoutines::testConditionalWait()
+{
+    QString url = "file:./dummyconditionalwait.txt";
+    QFile file(QUrl(url).toLocalFile());
+    file.open(QIODevice::WriteOnly);
+    file.write("wait until pressure 2 within 0.5\n" // no pressure set yet
+               "pressure 1 15\n"
+               "wait until pressure 1 within 0.5 timeout 5\n"
+               "wait until pressure 1 above 20 timeout 200 ms\n"
+               "wait until pressure 1 around 20\n");
+    file.close();
+
+    QSignalSpy errorSpy(r, SIGNAL(error(QString)));
+    r->loadFile(url);
+    r->verify();
+
+    QCOMPARE(r->numberOfSteps(), 3);
+    QCOMPARE(errorSpy.count(), 2);
+
+    errorSpy.clear();
+    QElapsedTimer timer;
+    timer.start();
+    r->begin();
+
+    while (r->currentStep() < 1)
+        QTest::qSleep(10);
+
+    // 15 PSI out of 30; the first wait ends as soon as this is received
+    r->onPressureChanged(1, 0.5);
+
+    while(r->status() != RoutineController::Finished)
+        QTest::qSleep(50);
+
+    // The invalid lines are reported again, and the second wait times out
+    QVERIFY(timer.elapsed() < 2000);
+    QCOMPARE(errorSpy.count(), 3);
+}
+
+void TestRoutines::testTimeScale()
+{
+    QString url = "file:./dummytimescale.txt";
+    QFile file(QUrl(url).toLocalFile());
+    file.open(QIODevice::WriteOnly);
+    file.write("valve 1 open\n"
+               "wait 10 s\n"
+               "wait until pressure 1 above 20 timeout 10 s\n"
+               "valve 1 close\n");
+    file.close();
+
+    QSignalSpy stepsSpy(r, SIGNAL(stepsListChanged()));
+    QSignalSpy errorSpy(r, SIGNAL(error(QString)));
+    r->loadFile(url);
+    r->verify();
+
+    // The model shown by QML is updated by verify() only
+    QCOMPARE(stepsSpy.count(), 1);
+    QCOMPARE(r->stepsModel()->rowCount(), 4);
+    QCOMPARE(r->stepsModel()->data(r->stepsModel()->index(1)).toString(), QString("wait 10 s"));
+
+    r->setTimeScale(100);
+    QElapsedTimer timer;
+    timer.start();
+    r->begin();
+
+    while(r->status() != RoutineController::Finished)
+        QTest::qSleep(20);
+
+    // 20 s of waits in 0.2 s; times are still given in routine time
+    QVERIFY(timer.elapsed() < 2000);
+    QCOMPARE(errorSpy.count(), 1);
+    QVERIFY(r->elapsedTime() >= 19);
+    QCOMPARE(stepsSpy.count(), 1);
+
+    r->setTimeScale(1);
+}
+
+void TestRoutines::testTriggers()
+{
+    QString url = "file:./dummytriggers.txt";
+    QFile file(QUrl(url).toLocalFile());
+    file.open(QIODevice::WriteOnly);
+    file.write("wait for trigger\n"
+               "wait for trigger camera/1\n"
+               "wait for trigger camera timeout soon\n"
+               "wait for trigger camera timeout 10 s\n"
+               "wait for trigger early timeout 10 s\n"
+               "wait for trigger never timeout 100 ms\n");
+    file.close();
+
+    r->loadFile(url);
+    QCOMPARE(r->verify(), 3);
+    QCOMPARE(r->numberOfSteps(), 3);
+
+    QString socketName = "ufcs-test-triggers-" + QString::number(QCoreApplication::applicationPid());
+    TriggerInput input(r);
+    QVERIFY(input.listen(socketName));
+
+    QSignalSpy triggerSpy(r, SIGNAL(triggerReceived(QString, qint64)));
+    QSignalSpy errorSpy(r, SIGNAL(error(QString)));
+    QElapsedTimer timer;
+    timer.start();
+    r->begin();
+    QTRY_COMPARE(r->currentStep(), 0);
+
+    // "early" is fired before its step, and ends it at once; "never" times out
+    QLocalSocket socket;
+    socket.connectToServer(socketName);
+    QVERIFY(socket.waitForConnected(1000));
+    socket.write("camera\nearly\n");
+
+    QTRY_COMPARE(r->status(), RoutineController::Finished);
+    QVERIFY(timer.elapsed() < 5000);
+    QCOMPARE(triggerSpy.count(), 2);
+    QCOMPARE(triggerSpy[0][0].toString(), QString("camera"));
+    QVERIFY(triggerSpy[0][1].toLongLong() >= 0);
+    QCOMPARE(triggerSpy[1][0].toString(), QString("early"));
+    QCOMPARE(errorSpy.count(), 1);
+}
+
+void TestRoutines::testTriggerFifo()
+{
+#ifdef Q_OS_UNIX
+    QTemporaryDir dir;
+    QString path = dir.filePath("triggers.fifo");
+
+    // A FIFO that another process reads from is left to it, and not removed
+    TriggerInput* input = new TriggerInput(r);
+    QVERIFY(input->openFifo(path));
+    {
+        TriggerInput other(r);
+        QVERIFY(!other.openFifo(path));
+    }
+    QVERIFY(QFileInfo::exists(path));
+
+    // One nobody reads from anymore is taken over
+    delete input;
+    QVERIFY(!QFileInfo::exists(path));
+    QVERIFY(mkfifo(QFile::encodeName(path).constData(), 0600) == 0);
+    TriggerInput successor(r);
+    QVERIFY(successor.openFifo(path));
+#else
+    QSKIP("Trigger FIFOs are only supported on Unix");
+#endif
+}
+
+void TestRoutines::testHardwareConfiguration()
+{
+    QString path = "./dummyhardware.ini";
+    QFile file(path);
+    file.open(QIODevice::WriteOnly);
+    file.write("[valves]\n"
+               "count=8\n"
+               "[pumps]\n"
+               "count=1\n"
+               "[pressureControllers]\n"
+               "count=2\n"
+               "1\\minPressure=0\n"
+               "1\\maxPressure=29.5\n"
+               "2\\minPressure=0\n"
+               "2\\maxPressure=4.8\n");
+    file.close();
+
+    ApplicationController controller;
+    QVERIFY(!controller.loadHardwareConfiguration("./missing.ini"));
+    QCOMPARE(controller.nValves(), 0);
+
+    QVERIFY(controller.loadHardwareConfiguration(path));
+    QCOMPARE(controller.nValves(), 8);
+    QCOMPARE(controller.nPumps(), 1);
+    QCOMPARE(controller.nPressureControllers(), 2);
+    QCOMPARE(controller.maxPressure(2), 4.8);
+
+    // Routines are checked against the configured hardware
+    QString url = "file:./dummyhardwareroutine.txt";
+    QFile routine(QUrl(url).toLocalFile());
+    routine.open(QIODevice::WriteOnly);
+    routine.write("valve 8 open\n"
+                  "valve 9 open\n"
+                  "pressure 2 4\n"
+                  "pressure 3 4\n");
+    routine.close();
+
+    RoutineController* rc = controller.routineController();
+    rc->loadFile(url);
+    QCOMPARE(rc->verify(), 2);
+    QCOMPARE(rc->numberOfSteps(), 2);
+
+    // A file with a missing pressure range is refused as a whole
+    file.open(QIODevice::WriteOnly);
+    file.write("[valves]\n"
+               "count=4\n"
+               "[pressureControllers]\n"
+               "count=1\n");
+    file.close();
+    QVERIFY(!controller.loadHardwareConfiguration(path));
+    QCOMPARE(controller.nValves(), 8);
+}
 
 void TestRoutines::createDummyRoutineFile(QString url)
 {
@@ -7,6 +7,7 @@
 #include "communicator.h"
 #include "routinecontroller.h"
 #include "applicationcontroller.h"
+#include "triggerinput.h"
 
 class TestRoutines : public QObject
 {
@@ -17,6 +18,12 @@ private slots:
     void cleanupTestCase();
     void testParsing();
     void testRunning();
+    void testRamp();
+    void testConditionalWait();
+    void testTimeScale();
+    void testTriggers();
+    void testTriggerFifo();
+    void testHardwareConfiguration();
 private:
     void createDummyRoutineFile(QString url);
 
@@ -0,0 +1,153 @@
+#include "testsharedtelemetry.h"
+#include "testcommunicator.h"
+
+#if defined(Q_OS_UNIX) && !defined(Q_OS_ANDROID)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static QByteArray segmentName()
+{
+    return "/ufcs-test-" + QByteArray::number(QCoreApplication::applicationPid());
+}
+
+/// Map the segment read-only, as another program would
+static const ufcs_shm_segment* mapSegment()
+{
+    int fd = shm_open(segmentName().constData(), O_RDONLY, 0);
+    if (fd < 0)
+        return nullptr;
+    void* address = mmap(nullptr, sizeof(ufcs_shm_segment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return address == MAP_FAILED ? nullptr : static_cast<const ufcs_shm_segment*>(address);
+}
+#endif
+
+void TestSharedTelemetry::stateAndRecords()
+{
+#if defined(Q_OS_UNIX) && !defined(Q_OS_ANDROID)
+    QueueMockCommunicator m;
+    SharedTelemetry shared(&m);
+    QVERIFY(shared.open(segmentName()));
+
+    const ufcs_shm_segment* s = mapSegment();
+    QVERIFY(s);
+    QCOMPARE(s->magic, UFCS_SHM_MAGIC);
+    QCOMPARE(s->version, uint32_t(UFCS_SHM_VERSION));
+    QCOMPARE(s->n_valves, uint16_t(N_VALVES));
+    QCOMPARE(s->pid, int32_t(getpid()));
+    QCOMPARE(ufcs_shm_write_index(s), uint64_t(0));
+
+    emit m.valveStateChanged(4, true);
+    emit m.pressureSetpointChanged(2, 0.5);
+    shared.record(UFCS_SHM_TELEMETRY, 2, 100, 12345);
+
+    ufcs_shm_state state;
+    QVERIFY(ufcs_shm_read_state(s, &state));
+    QCOMPARE(state.connection, int32_t(Communicator::Connected));
+    QCOMPARE(state.valves[3], int16_t(1));
+    QCOMPARE(state.valves[2], int16_t(-1));
+    QCOMPARE(state.setpoints[1], int16_t(128));
+    QCOMPARE(state.pressures[1], int16_t(100));
+    QCOMPARE(state.timestamp, qint64(12345));
+
+    QCOMPARE(ufcs_shm_write_index(s), uint64_t(3));
+    ufcs_shm_record r;
+    QCOMPARE(ufcs_shm_read_record(s, 0, &r), 1);
+    QCOMPARE(r.kind, uint8_t(UFCS_SHM_VALVE));
+    QCOMPARE(r.number, uint8_t(4));
+    QCOMPARE(r.value, int16_t(1));
+    QCOMPARE(ufcs_shm_read_record(s, 2, &r), 1);
+    QCOMPARE(r.kind, uint8_t(UFCS_SHM_TELEMETRY));
+    QCOMPARE(r.timestamp, qint64(12345));
+    QCOMPARE(ufcs_shm_read_record(s, 3, &r), 0);
+
+    munmap(const_cast<ufcs_shm_segment*>(s), sizeof(ufcs_shm_segment));
+
+    // The object is removed when publishing stops
+    shared.close();
+    QVERIFY(!mapSegment());
+#else
+    QSKIP("Shared-memory telemetry is only available on Unix");
+#endif
+}
+
+void TestSharedTelemetry::ringOverwrite()
+{
+#if defined(Q_OS_UNIX) && !defined(Q_OS_ANDROID)
+    QueueMockCommunicator m;
+    SharedTelemetry shared(&m);
+    QVERIFY(shared.open(segmentName()));
+
+    const ufcs_shm_segment* s = mapSegment();
+    QVERIFY(s);
+
+    for (int i(0); i < UFCS_SHM_RING_SIZE + 10; ++i)
+        shared.record(UFCS_SHM_TELEMETRY, 1, i % 256, i);
+
+    // The first 10 records were overwritten; a reader that far behind is told so
+    ufcs_shm_record r;
+    QCOMPARE(ufcs_shm_read_record(s, 9, &r), -1);
+    QCOMPARE(ufcs_shm_read_record(s, 10, &r), 1);
+    QCOMPARE(r.timestamp, qint64(10));
+    QCOMPARE(ufcs_shm_read_record(s, UFCS_SHM_RING_SIZE + 9, &r), 1);
+    QCOMPARE(r.timestamp, qint64(UFCS_SHM_RING_SIZE + 9));
+    QCOMPARE(ufcs_shm_read_record(s, UFCS_SHM_RING_SIZE + 10, &r), 0);
+
+    munmap(const_cast<ufcs_shm_segment*>(s), sizeof(ufcs_shm_segment));
+#else
+    QSKIP("Shared-memory telemetry is only available on Unix");
+#endif
+}
+
+void TestSharedTelemetry::ownership()
+{
+#if defined(Q_OS_UNIX) && !defined(Q_OS_ANDROID)
+    QueueMockCommunicator m;
+    SharedTelemetry shared(&m);
+    QVERIFY(shared.open(segmentName()));
+    shared.record(UFCS_SHM_VALVE, 1, 1, 1);
+
+    // A second publisher can't take over, or remove, an object that is in use
+    {
+        SharedTelemetry other(&m);
+        QVERIFY(!other.open(segmentName()));
+    }
+    const ufcs_shm_segment* s = mapSegment();
+    QVERIFY(s);
+    QCOMPARE(s->pid, int32_t(getpid()));
+    QCOMPARE(ufcs_shm_write_index(s), uint64_t(1));
+    munmap(const_cast<ufcs_shm_segment*>(s), sizeof(ufcs_shm_segment));
+
+    // One left behind by a process that has exited is replaced
+    pid_t child = fork();
+    if (child == 0)
+        _exit(0);
+    waitpid(child, nullptr, 0);
+
+    int fd = shm_open(segmentName().constData(), O_RDWR, 0);
+    QVERIFY(fd >= 0);
+    void* address = mmap(nullptr, sizeof(ufcs_shm_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    QVERIFY(address != MAP_FAILED);
+    static_cast<ufcs_shm_segment*>(address)->pid = int32_t(child);
+    munmap(address, sizeof(ufcs_shm_segment));
+
+    SharedTelemetry successor(&m);
+    QVERIFY(successor.open(segmentName()));
+    s = mapSegment();
+    QVERIFY(s);
+    QCOMPARE(s->pid, int32_t(getpid()));
+    QCOMPARE(ufcs_shm_write_index(s), uint64_t(0));
+    munmap(const_cast<ufcs_shm_segment*>(s), sizeof(ufcs_shm_segment));
+
+    // The first publisher no longer owns the object, and mustn't remove the successor's
+    shared.close();
+    s = mapSegment();
+    QVERIFY(s);
+    munmap(const_cast<ufcs_shm_segment*>(s), sizeof(ufcs_shm_segment));
+#else
+    QSKIP("Shared-memory telemetry is only available on Unix");
+#endif
+}
@@ -0,0 +1,19 @@
+#ifndef TESTSHAREDTELEMETRY_H
+#define TESTSHAREDTELEMETRY_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "sharedtelemetry.h"
+
+class TestSharedTelemetry : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void stateAndRecords();
+    void ringOverwrite();
+    void ownership();
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include "teststreamcommunicator.h"
+
+/**
+ * @brief Remove the complete frames at the start of a buffer, and return the messages they contain
+ */
+static QList<QByteArray> takeMessages(QByteArray& buffer)
+{
+    QList<QByteArray> messages;
+    int end;
+    while ((end = buffer.indexOf(char(STOP_BYTE))) >= 0) {
+        QByteArray message;
+        bool escaped = false;
+        for (int i(1); i < end; ++i) {
+            if (!escaped && uint8_t(buffer[i]) == ESCAPE_BYTE)
+                escaped = true;
+            else {
+                message.append(buffer[i]);
+                escaped = false;
+            }
+        }
+        messages << message;
+        buffer.remove(0, end + 1);
+    }
+    return messages;
+}
+
+void TestStreamCommunicator::cleanup()
+{
+    // ApplicationControllers created by other tests must use the default transport
+    QSettings().remove("transport");
+}
+
+/**
+ * @brief Check that commands reach the device, that its reports are decoded, and that a lost connection is noticed
+ * @param device The device's end of the connection, already open
+ */
+void TestStreamCommunicator::exchange(ApplicationController &controller, QIODevice *device)
+{
+    Communicator* communicator = controller.communicator();
+    QSignalSpy sent(communicator, &Communicator::commandSent);
+    QSignalSpy reported(communicator, &Communicator::valveStateChanged);
+
+    // Commands written in one go are let into the socket's buffer together, rather than a few bytes at a time
+    for (uint v(1); v <= 20; ++v)
+        communicator->setValve(v, true);
+
+    int valveCommands = 0;
+    for (QList<QVariant> const& arguments : sent) {
+        if (uint8_t(arguments[0].toByteArray()[0]) == VALVE)
+            valveCommands++;
+    }
+    QCOMPARE(valveCommands, 20);
+
+    QByteArray received;
+    QList<QByteArray> valveMessages;
+    QElapsedTimer timer;
+    timer.start();
+    while (valveMessages.size() < 20 && timer.elapsed() < 2000) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+        received += device->readAll();
+        for (QByteArray const& m : takeMessages(received)) {
+            if (!m.isEmpty() && uint8_t(m[0]) == VALVE)
+                valveMessages << m;
+        }
+    }
+    QCOMPARE(valveMessages.size(), 20);
+
+    QByteArray expected;
+    expected.append(char(VALVE)).append(char(1)).append(char(3)).append(char(1)).append(char(1));
+    QCOMPARE(valveMessages[2], expected);
+
+    // The device confirms the commands by reporting the new state, as the firmware does
+    QByteArray reports;
+    for (QByteArray const& m : valveMessages)
+        reports += char(START_BYTE) + m + char(STOP_BYTE);
+    device->write(reports);
+    QTRY_COMPARE(reported.size(), 20);
+    QCOMPARE(reported[2][0].toUInt(), 3u);
+    QCOMPARE(reported[2][1].toBool(), true);
+
+    device->close();
+    QTRY_COMPARE(communicator->getConnectionStatus(), Communicator::Disconnected);
+}
+
+void TestStreamCommunicator::tcp()
+{
+    // A stand-in for a serial-to-Ethernet bridge
+    QTcpServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+
+    QSettings settings;
+    settings.setValue("transport/type", "tcp");
+    settings.setValue("transport/address", "127.0.0.1:" + QString::number(server.serverPort()));
+
+    ApplicationController controller;
+    QCOMPARE(controller.transport(), QString("tcp"));
+    QVERIFY(qobject_cast<TcpCommunicator*>(controller.communicator()));
+
+    controller.connect();
+    QTRY_COMPARE(controller.communicator()->getConnectionStatus(), Communicator::Connected);
+    QTRY_VERIFY(server.hasPendingConnections());
+    QTcpSocket* device = server.nextPendingConnection();
+
+    exchange(controller, device);
+
+    // Nobody listening: the connection fails, and the status says so
+    server.close();
+    controller.connect();
+    QTRY_COMPARE(controller.communicator()->getConnectionStatus(), Communicator::Disconnected);
+}
+
+void TestStreamCommunicator::localSocket()
+{
+    QString name = "ufcs-test-device-" + QString::number(QCoreApplication::applicationPid());
+    QLocalServer server;
+    QVERIFY(server.listen(name));
+
+    QSettings settings;
+    settings.setValue("transport/type", "local");
+    settings.setValue("transport/address", name);
+
+    ApplicationController controller;
+    QVERIFY(qobject_cast<LocalSocketCommunicator*>(controller.communicator()));
+
+    controller.connect();
+    QTRY_COMPARE(controller.communicator()->getConnectionStatus(), Communicator::Connected);
+    QTRY_VERIFY(server.hasPendingConnections());
+    QLocalSocket* device = server.nextPendingConnection();
+
+    exchange(controller, device);
+}
+
+void TestStreamCommunicator::transportSettings()
+{
+    QSettings settings;
+
+    // An unknown transport falls back to the serial port
+    settings.setValue("transport/type", "carrier pigeon");
+    {
+        ApplicationController controller;
+        QCOMPARE(controller.transport(), QString("serial"));
+        QVERIFY(qobject_cast<SerialCommunicator*>(controller.communicator()));
+    }
+
+    // A TCP transport without an address can't connect
+    settings.setValue("transport/type", "tcp");
+    settings.remove("transport/address");
+    {
+        ApplicationController controller;
+        controller.connect();
+        QCOMPARE(controller.communicator()->getConnectionStatus(), Communicator::Disconnected);
+    }
+}
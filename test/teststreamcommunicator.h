@@ -0,0 +1,26 @@
+#ifndef TESTSTREAMCOMMUNICATOR_H
+#define TESTSTREAMCOMMUNICATOR_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+#include <QTcpServer>
+#include <QLocalServer>
+
+#include "applicationcontroller.h"
+
+class TestStreamCommunicator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanup();
+
+    void tcp();
+    void localSocket();
+    void transportSettings();
+
+private:
+    void exchange(ApplicationController& controller, QIODevice* device);
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include "testtracing.h"
+#include "testcommunicator.h"
+
+#include <thread>
+
+QJsonArray TestTracing::events()
+{
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(Tracer::chromeTrace(), &error);
+    if (error.error != QJsonParseError::NoError)
+        qWarning() << "Invalid trace:" << error.errorString();
+    return document.object().value("traceEvents").toArray();
+}
+
+static QList<QJsonObject> named(const QJsonArray& events, const QString& name)
+{
+    QList<QJsonObject> result;
+    for (QJsonValue const& e : events) {
+        if (e.toObject().value("name").toString() == name)
+            result << e.toObject();
+    }
+    return result;
+}
+
+void TestTracing::spans()
+{
+    Tracer::stop();
+    Tracer::start();
+    Tracer::stop();
+
+    // Nothing is recorded while tracing is off
+    {
+        TRACE_SPAN("test", "off");
+    }
+    Tracer::instant("test", "off");
+    QVERIFY(named(events(), "off").isEmpty());
+
+    Tracer::start();
+    {
+        TRACE_SPAN("test", "outer", 42);
+        QThread::msleep(2);
+        Tracer::instant("test", "point");
+    }
+    Tracer::stop();
+
+    QJsonArray e = events();
+    QList<QJsonObject> outer = named(e, "outer");
+    QCOMPARE(outer.size(), 1);
+    QCOMPARE(outer[0].value("ph").toString(), QString("X"));
+    QCOMPARE(outer[0].value("cat").toString(), QString("test"));
+    QVERIFY(outer[0].value("dur").toDouble() >= 2000);
+    QCOMPARE(outer[0].value("args").toObject().value("value").toInt(), 42);
+
+    QList<QJsonObject> point = named(e, "point");
+    QCOMPARE(point.size(), 1);
+    QCOMPARE(point[0].value("ph").toString(), QString("i"));
+    QVERIFY(point[0].value("ts").toDouble() >= outer[0].value("ts").toDouble());
+
+    // Each ring only keeps the latest events
+    Tracer::start();
+    for (size_t i(0); i < Tracer::RingCapacity + 10; ++i)
+        Tracer::instant("test", "many", qint64(i) + 1);
+    Tracer::stop();
+
+    QList<QJsonObject> many = named(events(), "many");
+    QCOMPARE(size_t(many.size()), Tracer::RingCapacity);
+    QCOMPARE(many.first().value("args").toObject().value("value").toInt(), 11);
+
+    // Starting again clears the previous trace
+    Tracer::start();
+    Tracer::stop();
+    QVERIFY(named(events(), "many").isEmpty());
+}
+
+void TestTracing::threads()
+{
+    Tracer::start();
+    Tracer::setThreadName("Test main");
+
+    for (int run(0); run < 3; ++run) {
+        std::thread t([run] {
+            Tracer::setThreadName("Test worker");
+            TRACE_SPAN("test", "work", run + 1);
+            Tracer::asyncBegin("test", "handover", 7);
+        });
+        t.join();
+    }
+    Tracer::asyncEnd("test", "handover", 7);
+    Tracer::stop();
+
+    QJsonArray e = events();
+
+    // Threads that ended left their ring to the next one, so all runs are on the same track
+    QList<QJsonObject> work = named(e, "work");
+    QCOMPARE(work.size(), 3);
+    QCOMPARE(work[0].value("tid"), work[2].value("tid"));
+
+    QList<QJsonObject> handover = named(e, "handover");
+    QCOMPARE(handover.size(), 4);
+    QCOMPARE(handover.last().value("ph").toString(), QString("e"));
+    QCOMPARE(handover.last().value("id"), handover.first().value("id"));
+    QVERIFY(handover.last().value("tid") != handover.first().value("tid"));
+
+    QStringList threadNames;
+    for (QJsonObject const& m : named(e, "thread_name"))
+        threadNames << m.value("args").toObject().value("name").toString();
+    QVERIFY(threadNames.contains("Test main"));
+    QVERIFY(threadNames.contains("Test worker"));
+}
+
+void TestTracing::commandLifecycle()
+{
+    QueueMockCommunicator m;
+    Communicator& base = m;
+
+    Tracer::start();
+    m.setValve(5, true);
+    base.mBuffer = QByteArrayLiteral("\xFA\x00\x01\x05\x01\x01\xFB");
+    while (base.mBuffer.size() > 0) {
+        QByteArray b = base.decodeBuffer();
+        if (b.length() > 0)
+            base.parseDecodedBuffer(b);
+    }
+    Tracer::stop();
+
+    QJsonArray e = events();
+    QString id = "0x" + QString::number(Communicator::traceId(VALVE, 5), 16);
+
+    QList<QJsonObject> queued = named(e, "queued");
+    QCOMPARE(queued.size(), 2);
+    QCOMPARE(queued[0].value("ph").toString(), QString("b"));
+    QCOMPARE(queued[1].value("ph").toString(), QString("e"));
+    QCOMPARE(queued[0].value("id").toString(), id);
+
+    QList<QJsonObject> awaiting = named(e, "awaiting report");
+    QCOMPARE(awaiting.size(), 2);
+    QCOMPARE(awaiting[1].value("ph").toString(), QString("e"));
+    QCOMPARE(awaiting[1].value("id").toString(), id);
+
+    for (const char* span : { "requestState", "frameMessage", "decodeBuffer", "parseDecodedBuffer", "handleCommand" })
+        QVERIFY2(!named(e, span).isEmpty(), span);
+}
@@ -0,0 +1,22 @@
+#ifndef TESTTRACING_H
+#define TESTTRACING_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QDebug>
+
+#include "tracing.h"
+
+class TestTracing : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void spans();
+    void threads();
+    void commandLifecycle();
+
+private:
+    static QJsonArray events();
+};
+
+#endif
@@ -0,0 +1,67 @@
+"""Compare two sets of benchmark results, and report regressions.
+
+Results are the XML files written by the benchmark target when run with `-resultdir <directory>`
+(see test/benchmarks/bench_main.cpp). For example, before and after pulling a new version:
+
+    ./benchmarks -resultdir results/before
+    ./benchmarks -resultdir results/after
+    python3 compare_benchmarks.py results/before results/after --threshold 10
+
+The exit status is 1 if any benchmark got slower by more than the threshold (in percent), so this can be used
+in a script or continuous integration job.
+"""
+
+import argparse
+import glob
+import os
+import sys
+import xml.etree.ElementTree as ElementTree
+
+
+def load_results(directory):
+    """Return {(class, function, tag): (value, metric)} for all result files in a directory."""
+    results = {}
+    for path in sorted(glob.glob(os.path.join(directory, "*.xml"))):
+        root = ElementTree.parse(path).getroot()
+        test_case = root.get("name", os.path.splitext(os.path.basename(path))[0])
+        for function in root.iter("TestFunction"):
+            for result in function.iter("BenchmarkResult"):
+                key = (test_case, function.get("name"), result.get("tag", ""))
+                results[key] = (float(result.get("value")), result.get("metric"))
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline", help="directory of the reference results")
+    parser.add_argument("current", help="directory of the results to check")
+    parser.add_argument("--threshold", type=float, default=10,
+                        help="slowdown, in percent, above which a benchmark is reported as a regression")
+    args = parser.parse_args()
+
+    baseline = load_results(args.baseline)
+    current = load_results(args.current)
+    if not baseline or not current:
+        sys.exit("No results found; run the benchmarks with -resultdir <directory>")
+
+    regressions = 0
+    for key in sorted(set(baseline) & set(current)):
+        before, metric = baseline[key]
+        after, _ = current[key]
+        change = (after - before) / before * 100 if before > 0 else 0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        name = "::".join(key[:2]) + ("(" + key[2] + ")" if key[2] else "")
+        print(f"{name:70} {before:12.6g} -> {after:12.6g} {metric:24} {change:+7.1f}%{flag}")
+
+    for key in sorted(set(baseline) - set(current)):
+        print("Missing from current results:", "::".join(key))
+
+    print(f"\n{regressions} regression(s) above {args.threshold}%")
+    sys.exit(1 if regressions else 0)
+
+
+if __name__ == "__main__":
+    main()
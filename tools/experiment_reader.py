@@ -0,0 +1,87 @@
+"""Load experiment files recorded by ExperimentRecorder (see src/cpp/experimentrecorder.h for the format).
+
+Example:
+
+    from experiment_reader import load_experiment
+    exp = load_experiment("run_2024-01-01_12-00-00.ufx")
+    t, p = exp.series("pressure", 2)   # seconds since the start of the run, pressure (0-1)
+"""
+
+import datetime
+import struct
+
+import numpy as np
+
+FILE_HEADER = struct.Struct("<4sIqII")
+CHUNK_HEADER = struct.Struct("<BBHIIqq")
+KINDS = {"pressure": 0, "setpoint": 1, "valve": 2, "step": 3, "telemetry": 4}
+
+
+def _decode_varints(data):
+    """Decode a buffer of unsigned LEB128 varints into a uint64 array, without a Python-level loop."""
+    if len(data) == 0:
+        return np.zeros(0, dtype=np.uint64)
+    b = np.frombuffer(data, dtype=np.uint8)
+    ends = np.flatnonzero(b < 0x80)
+    starts = np.concatenate(([0], ends[:-1] + 1))
+    position = np.arange(len(b)) - np.repeat(starts, ends - starts + 1)
+    parts = (b & 0x7F).astype(np.uint64) << (7 * position).astype(np.uint64)
+    return np.add.reduceat(parts, starts)
+
+
+def _unzigzag(values):
+    return (values >> np.uint64(1)).astype(np.int64) ^ -(values & np.uint64(1)).astype(np.int64)
+
+
+class Experiment:
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self._data = f.read()
+
+        magic, version, start_ms, self.pressure_scale, steps_size = FILE_HEADER.unpack_from(self._data, 0)
+        if magic != b"UFXR" or version != 1:
+            raise ValueError("not an experiment file: " + path)
+
+        self.start_time = datetime.datetime.fromtimestamp(start_ms / 1000, datetime.timezone.utc)
+        offset = FILE_HEADER.size
+        steps = self._data[offset:offset + steps_size].decode("utf-8")
+        self.steps = steps.split("\n") if steps else []
+        offset += steps_size
+
+        self._chunks = {}
+        while offset + CHUNK_HEADER.size <= len(self._data):
+            header = CHUNK_HEADER.unpack_from(self._data, offset)
+            size = header[4]
+            if offset + CHUNK_HEADER.size + size > len(self._data) or header[3] == 0:
+                break
+            self._chunks.setdefault((header[0], header[1]), []).append(offset)
+            offset += CHUNK_HEADER.size + size
+
+    def channels(self):
+        names = {v: k for k, v in KINDS.items()}
+        return sorted((names[kind], number) for kind, number in self._chunks)
+
+    def raw_series(self, kind, number=0):
+        """Return (timestamps in microseconds, integer values) of a channel."""
+        key = (KINDS[kind], number)
+        timestamps, values = [], []
+        for offset in self._chunks.get(key, []):
+            _, _, _, count, size, t0, v0 = CHUNK_HEADER.unpack_from(self._data, offset)
+            start = offset + CHUNK_HEADER.size
+            varints = _decode_varints(self._data[start:start + size])
+            timestamps.append(np.cumsum(np.concatenate(([t0], varints[:count - 1].astype(np.int64)))))
+            values.append(np.cumsum(np.concatenate(([v0], _unzigzag(varints[count - 1:])))))
+        if not timestamps:
+            return np.zeros(0, dtype=np.int64), np.zeros(0, dtype=np.int64)
+        return np.concatenate(timestamps), np.concatenate(values)
+
+    def series(self, kind, number=0):
+        """Return (seconds since the start of the run, values) of a channel. Pressures are scaled to 0-1."""
+        t, v = self.raw_series(kind, number)
+        if kind in ("pressure", "setpoint", "telemetry"):
+            v = v / self.pressure_scale
+        return t / 1e6, v
+
+
+def load_experiment(path):
+    return Experiment(path)
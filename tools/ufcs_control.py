@@ -0,0 +1,148 @@
+"""Drive the microcontroller through the application's control socket (see src/cpp/controlserver.h for the protocol).
+
+The application (or "ufcs-cli daemon") must be running, with the control socket enabled. Unix only.
+
+Example:
+
+    from ufcs_control import ControlClient, VALVE, PRESSURE
+    with ControlClient() as c:
+        c.commands([(VALVE, 3, 1), (PRESSURE, 1, 128)])   # open valve 3, set controller 1 to half its range
+        print(c.state()["valves"][2])                       # (requested, reported), -1 if unknown
+
+Run as a script to measure round-trip times:
+
+    python3 tools/ufcs_control.py [--socket NAME] [--count 1000]
+"""
+
+import argparse
+import os
+import socket
+import struct
+import tempfile
+import time
+
+VALVE, PUMP, PRESSURE = 0, 1, 2
+PING, COMMANDS, GET_STATE, SUBSCRIBE, TRIGGER, EVENT, REPLY, ERROR = 1, 2, 3, 4, 5, 0x40, 0x80, 0xFF
+EVENT_KINDS = ["valve", "pump", "setpoint", "pressure", "connection"]
+RESULTS = ["sent", "redundant", "refused", "invalid"]
+
+HEADER = struct.Struct("<IBI")
+EVENT_PAYLOAD = struct.Struct("<BBhq")
+
+
+class ControlClient:
+    def __init__(self, name="ufcs-control"):
+        # Relative names are in the temporary directory, as for QLocalServer
+        path = name if os.path.isabs(name) else os.path.join(tempfile.gettempdir(), name)
+        self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._socket.connect(path)
+        self._buffer = b""
+        self._next_id = 1
+        self.events = []
+
+    def close(self):
+        self._socket.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def ping(self):
+        """Return the server's clock, in microseconds."""
+        return struct.unpack("<q", self._request(PING))[0]
+
+    def commands(self, commands):
+        """Send (component, number, value) commands in one request; return the result of each, as in RESULTS."""
+        payload = struct.pack("<H", len(commands)) + b"".join(struct.pack("<BBB", *c) for c in commands)
+        reply = self._request(COMMANDS, payload)
+        return [RESULTS[r] for r in reply[2:]]
+
+    def state(self):
+        reply = self._request(GET_STATE)
+        state = {"connection": reply[0]}
+        offset = 1
+        for name in ("valves", "pumps", "pressures"):
+            count = reply[offset]
+            values = struct.unpack_from("<%dh" % (2 * count), reply, offset + 1)
+            state[name] = list(zip(values[0::2], values[1::2]))
+            offset += 1 + 4 * count
+        return state
+
+    def subscribe(self, kinds):
+        """Receive events of the given kinds (names from EVENT_KINDS); they are appended to self.events."""
+        mask = sum(1 << EVENT_KINDS.index(k) for k in kinds)
+        self._request(SUBSCRIBE, struct.pack("<I", mask))
+
+    def trigger(self, name):
+        """Fire a routine trigger (see "wait for trigger" in the routine reference)."""
+        self._request(TRIGGER, name.encode("utf-8"))
+
+    def wait_events(self, timeout):
+        """Read events for the given time, in seconds; return those received."""
+        self._socket.settimeout(timeout)
+        try:
+            while True:
+                self._read_message()
+        except socket.timeout:
+            pass
+        finally:
+            self._socket.settimeout(None)
+        events, self.events = self.events, []
+        return events
+
+    def _request(self, message_type, payload=b""):
+        request_id = self._next_id
+        self._next_id += 1
+        self._socket.sendall(HEADER.pack(HEADER.size - 4 + len(payload), message_type, request_id) + payload)
+
+        while True:
+            reply_type, reply_id, reply = self._read_message()
+            if reply_id != request_id:
+                continue
+            if reply_type == ERROR:
+                raise ValueError("request refused by the server")
+            return reply
+
+    def _read_message(self):
+        while True:
+            if len(self._buffer) >= HEADER.size:
+                length, message_type, message_id = HEADER.unpack_from(self._buffer)
+                if len(self._buffer) >= 4 + length:
+                    payload = self._buffer[HEADER.size:4 + length]
+                    self._buffer = self._buffer[4 + length:]
+                    if message_type == EVENT:
+                        kind, number, value, timestamp = EVENT_PAYLOAD.unpack(payload)
+                        self.events.append((EVENT_KINDS[kind], number, value, timestamp))
+                    return message_type, message_id, payload
+            data = self._socket.recv(65536)
+            if not data:
+                raise ConnectionError("control socket closed")
+            self._buffer += data
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure round-trip times to the application's control socket.")
+    parser.add_argument("--socket", default="ufcs-control", help="socket name or path")
+    parser.add_argument("--count", type=int, default=1000, help="number of pings")
+    args = parser.parse_args()
+
+    with ControlClient(args.socket) as client:
+        times = []
+        for _ in range(args.count):
+            start = time.perf_counter()
+            client.ping()
+            times.append((time.perf_counter() - start) * 1e6)
+
+        times.sort()
+        print("%d pings: median %.1f us, p99 %.1f us, max %.1f us"
+              % (len(times), times[len(times) // 2], times[int(len(times) * 0.99)], times[-1]))
+
+        state = client.state()
+        print("Connection status: %d, valves open: %s"
+              % (state["connection"], [n + 1 for n, (_, reported) in enumerate(state["valves"]) if reported == 1]))
+
+
+if __name__ == "__main__":
+    main()
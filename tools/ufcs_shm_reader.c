@@ -0,0 +1,104 @@
+/*
+ * Print the hardware state and every change published by the application in shared memory (see src/cpp/ufcs_shm.h).
+ *
+ * Build and run (Linux; add -lrt with glibc older than 2.34):
+ *
+ *     cc -O2 -I src/cpp tools/ufcs_shm_reader.c -o ufcs_shm_reader
+ *     ./ufcs_shm_reader [name] [--spin]
+ *
+ * By default, the ring is polled every millisecond; with --spin, it is polled continuously, which takes a core but
+ * sees each record within a microsecond or so of it being written. Stop with Ctrl+C.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ufcs_shm.h"
+
+static const char* kind_names[] = { "valve", "pump", "setpoint", "pressure", "connection", "telemetry" };
+
+static int64_t monotonic_us(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+int main(int argc, char** argv)
+{
+    const char* name = UFCS_SHM_DEFAULT_NAME;
+    int spin = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--spin") == 0)
+            spin = 1;
+        else
+            name = argv[i];
+    }
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        perror("shm_open (is the application running?)");
+        return 1;
+    }
+    const struct ufcs_shm_segment* s = mmap(NULL, sizeof(struct ufcs_shm_segment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (s == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    if (__atomic_load_n(&s->magic, __ATOMIC_ACQUIRE) != UFCS_SHM_MAGIC || s->version != UFCS_SHM_VERSION) {
+        fprintf(stderr, "%s is not initialized, or has an unsupported version\n", name);
+        return 1;
+    }
+    int32_t pid = s->pid;
+
+    struct ufcs_shm_state state;
+    if (ufcs_shm_read_state(s, &state)) {
+        printf("Connection status %d. Open valves:", state.connection);
+        for (int v = 0; v < s->n_valves; ++v) {
+            if (state.valves[v] == 1)
+                printf(" %d", v + 1);
+        }
+        printf("\n");
+        for (int c = 0; c < s->n_controllers; ++c)
+            printf("Pressure controller %d: setpoint %d, measured %d (of %u)\n",
+                   c + 1, state.setpoints[c], state.pressures[c], s->pr_max_value);
+    }
+
+    /* Follow the ring from the next record on */
+    uint64_t next = ufcs_shm_write_index(s);
+    uint64_t missed = 0;
+    struct timespec pause = { 0, 1000000 };
+
+    for (;;) {
+        struct ufcs_shm_record r;
+        int result = ufcs_shm_read_record(s, next, &r);
+
+        if (result == 1) {
+            printf("%.6f  %-10s %2u  %4d   (%lld us ago)\n", (r.timestamp + s->realtime_offset) / 1e6,
+                   r.kind < 6 ? kind_names[r.kind] : "?", r.number, r.value, (long long)(monotonic_us() - r.timestamp));
+            next++;
+        }
+        else if (result < 0) {
+            /* Too slow: skip to the oldest record still in the ring */
+            uint64_t oldest = ufcs_shm_write_index(s) - UFCS_SHM_RING_SIZE + 1;
+            missed += oldest - next;
+            fprintf(stderr, "Missed %llu records in total\n", (unsigned long long)missed);
+            next = oldest;
+        }
+        else {
+            if (s->pid != pid) {
+                fprintf(stderr, "The application restarted\n");
+                return 2;
+            }
+            fflush(stdout);
+            if (!spin)
+                nanosleep(&pause, NULL);
+        }
+    }
+}
@@ -0,0 +1,95 @@
+# Command-line runner: the backend without QML or a display (see src/cli/main.cpp)
+QT = core \
+     qml \
+     concurrent \
+     serialport \
+     bluetooth \
+     network
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = ufcs-cli
+
+INCLUDEPATH += src/cpp
+
+HEADERS += \
+    src/cli/clirunner.h \
+    src/cpp/communicator.h \
+    src/cpp/constants.h \
+    src/cpp/applicationcontroller.h \
+    src/cpp/logger.h \
+    src/cpp/routinecontroller.h \
+    src/cpp/guihelper.h \
+    src/cpp/bluetoothcommunicator.h \
+    src/cpp/serialcommunicator.h \
+    src/cpp/streamcommunicator.h \
+    src/cpp/logmodel.h \
+    src/cpp/logfilemodel.h \
+    src/cpp/eventjournal.h \
+    src/cpp/experimentrecorder.h \
+    src/cpp/telemetry.h \
+    src/cpp/interlocks.h \
+    src/cpp/shadowstate.h \
+    src/cpp/commandsink.h \
+    src/cpp/linkmonitor.h \
+    src/cpp/metrics.h \
+    src/cpp/controlserver.h \
+    src/cpp/sharedtelemetry.h \
+    src/cpp/triggerinput.h \
+    src/cpp/ufcs_shm.h \
+    src/cpp/tracing.h \
+    src/cpp/pressureseries.h \
+    src/cpp/pressurecontrolloop.h
+
+SOURCES += \
+    src/cli/main.cpp \
+    src/cli/clirunner.cpp \
+    src/cpp/logger.cpp \
+    src/cpp/communicator.cpp \
+    src/cpp/applicationcontroller.cpp \
+    src/cpp/routinecontroller.cpp \
+    src/cpp/guihelper.cpp \
+    src/cpp/bluetoothcommunicator.cpp \
+    src/cpp/serialcommunicator.cpp \
+    src/cpp/streamcommunicator.cpp \
+    src/cpp/logmodel.cpp \
+    src/cpp/logfilemodel.cpp \
+    src/cpp/eventjournal.cpp \
+    src/cpp/experimentrecorder.cpp \
+    src/cpp/telemetry.cpp \
+    src/cpp/interlocks.cpp \
+    src/cpp/shadowstate.cpp \
+    src/cpp/commandsink.cpp \
+    src/cpp/linkmonitor.cpp \
+    src/cpp/metrics.cpp \
+    src/cpp/controlserver.cpp \
+    src/cpp/sharedtelemetry.cpp \
+    src/cpp/triggerinput.cpp \
+    src/cpp/tracing.cpp \
+    src/cpp/pressureseries.cpp \
+    src/cpp/pressurecontrolloop.cpp
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
+
+# Same version number as the application
+win32 {
+    GIT_BIN = $$system(where git)
+}
+unix|mac {
+    GIT_BIN = $$system(which git)
+}
+isEmpty(GIT_BIN) {
+    DEFINES += GIT_VERSION=\\\"UNKNOWN\\\"
+} else {
+   GIT_VERSION = $$system(git --git-dir $$PWD/.git --work-tree $$PWD describe --always --tags)
+   GIT_VERSION ~= s/g/"" # Remove the "g" which is prepended to the hash
+   DEFINES += GIT_VERSION=\\\"$$GIT_VERSION\\\"
+}
+
+# shm_open (see SharedTelemetry) is in librt with glibc older than 2.34
+linux:!android: LIBS += -lrt